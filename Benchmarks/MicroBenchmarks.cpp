@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <cstring>
+#include <sched.h>
+#include "../Networking/Http/HttpRequest.hpp"
+#include "../Networking/Http/HttpResponse.hpp"
+#include "../Networking/Http/Router.hpp"
+#include "../Networking/IO/ChainBuffer.hpp"
+#include "../Networking/IO/PipePool.hpp"
+#include "../Networking/Events/EventLoop.hpp"
+#include "../Networking/Metrics/MetricsRegistry.hpp"
+#include "../Networking/Metrics/CycleClock.hpp"
+#include "../Networking/Metrics/PerfCounters.hpp"
+#include "../Networking/Cache/MicroCache.hpp"
+#include "../Networking/IO/MemoryTransport.hpp"
+#include "../Networking/Servers/TestServer.hpp"
+
+//Fixed-workload microbenchmarks of the request path, each case runs in batches sized to min_ms and reports the
+//median of repetitions so runs on different commits compare. Usage: MicroBenchmarks [--filter text]
+//[--min-ms n] [--repetitions n] [--cpu n] [--out file] [--compare file]
+
+#ifndef HDE_BENCH_COMMIT
+#define HDE_BENCH_COMMIT "unknown"
+#endif
+
+//Keeps a value alive without letting the compiler reason about it
+template <typename T>
+static inline void keep(const T &value){
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static inline void clobber(){
+    asm volatile("" : : : "memory");
+}
+
+struct Benchmark{
+    std::string name;
+    std::function<void(uint64_t iterations)> run;
+};
+
+struct Result{
+    std::string name;
+    uint64_t iterations;
+    double median_ns;
+    double min_ns;
+    double max_ns;
+    double perf[HDE::PERF_EVENT_COUNT];
+};
+
+static const char browser_request[] =
+    "GET /api/v1/items?page=2&sort=desc HTTP/1.1\r\n"
+    "Host: localhost:3000\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: session=4f1c2a9e8b7d6c5f; theme=dark\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "If-None-Match: \"5d8c72a5edda8d6a\"\r\n"
+    "\r\n";
+
+//One TestServer on a MemoryTransport for every pipeline case, the server's per-thread metric, trace and access log
+//slots are per instance so it is built once. Its access log rotates at 8MB so long runs stay small on disk
+struct PipelineServer{
+    HDE::MemoryTransport transport;
+    HDE::TestServer server;
+    PipelineServer() : server(&transport, HDE::TestServerConfig{HDE::AccessLogConfig{std::string(P_tmpdir) + "/hdelibc-bench-access.log", 16384, 64 * 1024, 8 << 20, 1, 20}, "", false}){}
+};
+
+static PipelineServer & pipeline_server(){
+    static PipelineServer pipeline;
+    return pipeline;
+}
+
+//Accepts, parses, routes, handles and writes one scripted request per iteration, advance_ns moves the virtual
+//clock before each so the microcache can be made to expire
+static void run_pipeline(uint64_t iterations, int64_t advance_ns, size_t write_limit){
+    PipelineServer &pipeline = pipeline_server();
+    pipeline.transport.set_write_limit(write_limit);
+    const std::string input(browser_request, sizeof(browser_request) - 1);
+    uint64_t failures = 0;
+    for (uint64_t i = 0; i < iterations; i++){
+        pipeline.transport.advance(advance_ns);
+        int fd = pipeline.transport.connect(input);
+        pipeline.server.dispatch(0);
+        const std::string &output = pipeline.transport.get_output(fd);
+        failures += output.compare(0, 15, "HTTP/1.1 200 OK") != 0 || !pipeline.transport.is_closed(fd);
+        pipeline.transport.release(fd);
+    }
+    pipeline.transport.set_write_limit(0);
+    if (failures > 0){
+        std::cerr << "Pipeline produced " << failures << " bad responses" << std::endl;
+        exit(1);
+    }
+}
+
+static std::vector<Benchmark> benchmarks(){
+    std::vector<Benchmark> list;
+    list.push_back({"http_parse_request", [](uint64_t iterations){
+        HDE::HttpRequest request;
+        for (uint64_t i = 0; i < iterations; i++){
+            keep(request.parse(browser_request, sizeof(browser_request) - 1));
+        }
+    }});
+    list.push_back({"http_header_lookup", [](uint64_t iterations){
+        HDE::HttpRequest request;
+        request.parse(browser_request, sizeof(browser_request) - 1);
+        const std::string names[4] = {"host", "If-None-Match", "connection", "X-Missing"};
+        for (uint64_t i = 0; i < iterations; i++){
+            keep(request.get_header(names[i & 3]));
+        }
+    }});
+    list.push_back({"router_match_16", [](uint64_t iterations){
+        HDE::Router<int> router(0);
+        for (int r = 0; r < 16; r++){
+            router.add("/api/v" + std::to_string(r % 4) + "/" + std::to_string(r), r);
+        }
+        const std::string paths[4] = {"/api/v1/13/items", "/api/v3/3", "/static/app.js", "/api/v2/10?x=1"};
+        for (uint64_t i = 0; i < iterations; i++){
+            keep(router.match(paths[i & 3]));
+        }
+    }});
+    list.push_back({"http_serialize_response", [](uint64_t iterations){
+        HDE::HttpResponse response(200, "OK");
+        response.set_header("Content-Type", "text/plain");
+        response.set_header("Cache-Control", "max-age=60");
+        response.set_header("ETag", "\"5d8c72a5edda8d6a\"");
+        response.set_body("Hello from Server!\r\n");
+        for (uint64_t i = 0; i < iterations; i++){
+            keep(response.to_string());
+        }
+    }});
+    list.push_back({"chain_buffer_append_consume", [](uint64_t iterations){
+        HDE::ChainBuffer buffer(16384);
+        char chunk[1500];
+        memset(chunk, 'x', sizeof(chunk));
+        // Blocks cycle through the spare list after the first pass
+        for (uint64_t i = 0; i < iterations; i++){
+            buffer.append(chunk, sizeof(chunk));
+            if (buffer.size() > 64 * 1024){
+                buffer.consume(buffer.size());
+            }
+        }
+        keep(buffer.size());
+    }});
+    list.push_back({"pipe_pool_acquire_release", [](uint64_t iterations){
+        HDE::PipePool pool(8, 0);
+        HDE::Pipe pipe;
+        for (uint64_t i = 0; i < iterations; i++){
+            pool.acquire(pipe);
+            keep(pipe.read_fd);
+            pool.release(pipe, true);
+        }
+    }});
+    list.push_back({"timer_add_cancel", [](uint64_t iterations){
+        HDE::EventLoop loop;
+        std::vector<uint64_t> ids(64, 0);
+        // A steady population of 64 timers, each step cancels the oldest and arms a new one
+        for (uint64_t i = 0; i < iterations; i++){
+            uint64_t &slot = ids[i & 63];
+            loop.cancel_timer(slot);
+            slot = loop.run_after(1000 + (int)(i & 1023), [](){});
+        }
+    }});
+    list.push_back({"timer_fire", [](uint64_t iterations){
+        HDE::EventLoop loop;
+        uint64_t fired = 0;
+        for (uint64_t i = 0; i < iterations; i += 256){
+            for (uint64_t j = 0; j < 256; j++){
+                loop.run_after(0, [&fired](){ fired++; });
+            }
+            loop.run_once(0);
+        }
+        keep(fired);
+    }});
+    list.push_back({"metrics_counter_increment", [](uint64_t iterations){
+        static HDE::MetricsRegistry registry(1024);
+        static int id = registry.add_counter("bench_total", "Benchmark counter");
+        for (uint64_t i = 0; i < iterations; i++){
+            registry.increment(id);
+            clobber();
+        }
+    }});
+    list.push_back({"metrics_latency_record", [](uint64_t iterations){
+        static HDE::MetricsRegistry registry(4096);
+        static int id = registry.add_latency("bench_seconds", "Benchmark latency");
+        for (uint64_t i = 0; i < iterations; i++){
+            registry.record_ns(id, 800 + (i & 4095) * 37);
+        }
+    }});
+    list.push_back({"cycle_clock_now", [](uint64_t iterations){
+        for (uint64_t i = 0; i < iterations; i++){
+            keep(HDE::CycleClock::now());
+        }
+    }});
+    list.push_back({"microcache_hit", [](uint64_t iterations){
+        HDE::MicroCache cache(1 << 20);
+        cache.add_route("/", 60000, std::vector<std::string>());
+        HDE::HttpRequest request;
+        request.parse(browser_request, sizeof(browser_request) - 1);
+        int64_t now = HDE::EventLoop::now_ms();
+        cache.store(request, "HTTP/1.1 200 OK\r\nContent-Length: 20\r\n\r\nHello from Server!\r\n", now);
+        for (uint64_t i = 0; i < iterations; i++){
+            keep(cache.lookup(request, now));
+        }
+    }});
+    list.push_back({"memory_transport_roundtrip", [](uint64_t iterations){
+        // The transport's own share of each pipeline iteration
+        HDE::MemoryTransport transport;
+        const std::string input(browser_request, sizeof(browser_request) - 1);
+        const std::string response = "HTTP/1.1 200 OK\r\nContent-Length: 20\r\n\r\nHello from Server!\r\n";
+        char buffer[1024];
+        for (uint64_t i = 0; i < iterations; i++){
+            int fd = transport.connect(input);
+            keep(transport.accept(-1, NULL));
+            transport.set_receive_timeout(fd, 5);
+            keep(transport.recv(fd, buffer, sizeof(buffer)));
+            keep(transport.send(fd, response.data(), response.size(), 0));
+            transport.shutdown(fd);
+            transport.close(fd);
+            transport.release(fd);
+        }
+    }});
+    list.push_back({"server_pipeline_cached", [](uint64_t iterations){
+        run_pipeline(iterations, 0, 0);
+    }});
+    list.push_back({"server_pipeline_uncached", [](uint64_t iterations){
+        // Past the microcache's one second TTL, every request runs the handler and stores again
+        run_pipeline(iterations, 1001000000LL, 0);
+    }});
+    list.push_back({"server_pipeline_partial_writes", [](uint64_t iterations){
+        run_pipeline(iterations, 1001000000LL, 16);
+    }});
+    return list;
+}
+
+static double elapsed_ns(uint64_t start_tick){
+    return (double)HDE::CycleClock::to_ns(HDE::CycleClock::now() - start_tick);
+}
+
+//Doubles the batch until one takes min_ms, then times repetitions batches of that size
+static Result measure(const Benchmark &benchmark, HDE::PerfCounters &perf, int min_ms, int repetitions){
+    uint64_t iterations = 1;
+    while (true){
+        uint64_t start = HDE::CycleClock::now();
+        benchmark.run(iterations);
+        if (elapsed_ns(start) >= min_ms * 1e6 || iterations >= (1ULL << 34)){
+            break;
+        }
+        iterations *= 2;
+    }
+    std::vector<double> samples;
+    HDE::PerfSample begin, end;
+    perf.read(begin);
+    for (int r = 0; r < repetitions; r++){
+        uint64_t start = HDE::CycleClock::now();
+        benchmark.run(iterations);
+        samples.push_back(elapsed_ns(start) / iterations);
+    }
+    perf.read(end);
+    std::sort(samples.begin(), samples.end());
+    Result result;
+    result.name = benchmark.name;
+    result.iterations = iterations;
+    result.median_ns = samples[samples.size() / 2];
+    result.min_ns = samples.front();
+    result.max_ns = samples.back();
+    HDE::PerfSample delta = HDE::PerfCounters::difference(end, begin);
+    for (int event = 0; event < HDE::PERF_EVENT_COUNT; event++){
+        result.perf[event] = (double)delta.values[event] / (iterations * repetitions);
+    }
+    return result;
+}
+
+static std::map<std::string, double> load_baseline(const std::string &path){
+    std::map<std::string, double> baseline;
+    std::ifstream file(path.c_str());
+    std::string line;
+    while (std::getline(file, line)){
+        if (line.empty() || line[0] == '#'){
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string name;
+        double median = 0;
+        if (fields >> name >> median){
+            baseline[name] = median;
+        }
+    }
+    return baseline;
+}
+
+static std::string cpu_model(){
+    std::ifstream file("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(file, line)){
+        if (line.compare(0, 10, "model name") == 0){
+            return line.substr(line.find(':') + 2);
+        }
+    }
+    return "unknown";
+}
+
+int main(int argc, char **argv){
+    std::string filter;
+    std::string out_path;
+    std::string compare_path;
+    int min_ms = 50;
+    int repetitions = 5;
+    int cpu = -1;
+    for (int i = 1; i + 1 < argc; i += 2){
+        std::string flag = argv[i];
+        if (flag == "--filter"){
+            filter = argv[i + 1];
+        } else if (flag == "--min-ms"){
+            min_ms = atoi(argv[i + 1]);
+        } else if (flag == "--repetitions"){
+            repetitions = atoi(argv[i + 1]);
+        } else if (flag == "--cpu"){
+            cpu = atoi(argv[i + 1]);
+        } else if (flag == "--out"){
+            out_path = argv[i + 1];
+        } else if (flag == "--compare"){
+            compare_path = argv[i + 1];
+        } else {
+            std::cerr << "Unknown option " << flag << std::endl;
+            return 1;
+        }
+    }
+    if (cpu >= 0){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) < 0){
+            std::cerr << "Failed to pin to cpu " << cpu << ": " << strerror(errno) << std::endl;
+        }
+    }
+    repetitions = repetitions < 1 ? 1 : repetitions;
+    HDE::CycleClock::calibrate();
+    HDE::PerfCounters perf;
+    std::map<std::string, double> baseline = compare_path.empty() ? std::map<std::string, double>() : load_baseline(compare_path);
+
+    std::ostringstream report;
+    report << "# commit=" << HDE_BENCH_COMMIT << " compiler=\"" << __VERSION__ << "\" cpu=\"" << cpu_model() << "\" tsc="
+           << (HDE::CycleClock::is_tsc() ? "yes" : "no") << " perf=" << (perf.is_available() ? "yes" : "no") << "\n";
+    report << "# name median_ns min_ns max_ns iterations instructions cycles cache_misses branch_misses\n";
+    std::cout << report.str();
+    std::vector<Benchmark> list = benchmarks();
+    for (size_t i = 0; i < list.size(); i++){
+        if (!filter.empty() && list[i].name.find(filter) == std::string::npos){
+            continue;
+        }
+        Result result = measure(list[i], perf, min_ms, repetitions);
+        char line[256];
+        snprintf(line, sizeof(line), "%-30s %10.2f %10.2f %10.2f %12llu %10.1f %10.1f %8.3f %8.3f", result.name.c_str(), result.median_ns,
+                 result.min_ns, result.max_ns, (unsigned long long)result.iterations, result.perf[HDE::PERF_INSTRUCTIONS],
+                 result.perf[HDE::PERF_CYCLES], result.perf[HDE::PERF_CACHE_MISSES], result.perf[HDE::PERF_BRANCH_MISSES]);
+        report << line << "\n";
+        std::cout << line;
+        std::map<std::string, double>::iterator before = baseline.find(result.name);
+        if (before != baseline.end() && before->second > 0){
+            printf("   %+6.1f%% vs %.2f", (result.median_ns / before->second - 1) * 100, before->second);
+        }
+        std::cout << std::endl;
+    }
+    if (!out_path.empty()){
+        std::ofstream file(out_path.c_str());
+        file << report.str();
+        if (!file){
+            std::cerr << "Failed to write " << out_path << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,520 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../Networking/Events/EventLoop.hpp"
+#include "../Networking/Http/HttpResponse.hpp"
+#include "../Networking/Cache/HttpCache.hpp"
+#include "../Networking/Proxy/UpstreamPool.hpp"
+#include "../Networking/Proxy/Balancer.hpp"
+#include "../Networking/Proxy/BalancingPolicy.hpp"
+#include "../Networking/Proxy/HedgePolicy.hpp"
+#include "../Networking/Proxy/RetryBudget.hpp"
+#include "../Networking/Proxy/ReverseProxy.hpp"
+
+//End-to-end ReverseProxy scenarios over loopback. Each one starts its own upstream on separate threads, runs the
+//proxy on the main thread's EventLoop and drives it from client threads, so nothing outside the process is needed.
+//Usage: ProxyBenchmarks scenario [--seconds n] [--size bytes] [--clients n] [--delay us] [--fraction f]
+//  throughput keep-alive requests per second, latency percentiles and proxy CPU per request, nothing cached
+//  slowbackend tail latency per balancing policy when one of four backends answers slowly
+//  hedging    p99/p999 with and without hedged requests when a fraction of upstream answers is delayed
+//  stampede   backend QPS and peak concurrency while every client misses one expiring key, with and without coalescing
+//  zerocopy   proxy CPU per GB of large cache hits, copied and sent with MSG_ZEROCOPY
+
+struct Options{
+    double seconds;
+    size_t size;
+    int clients;
+    int64_t delay_us;
+    double fraction;
+};
+
+static int64_t thread_cpu_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//Sorted latencies in microseconds, p is a fraction
+static int64_t percentile(const std::vector<int64_t> &sorted, double p){
+    if (sorted.empty()){
+        return 0;
+    }
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+static int loopback_listener(int &port){
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 128) < 0 ||
+        getsockname(listener, (struct sockaddr *)&address, &length) < 0){
+        std::cerr << "Failed to open a loopback listener: " << strerror(errno) << std::endl;
+        exit(1);
+    }
+    port = ntohs(address.sin_port);
+    return listener;
+}
+
+static bool send_all(int sock, const char *data, size_t len){
+    while (len > 0){
+        ssize_t n = send(sock, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n <= 0){
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+//A blocking upstream with a thread per connection, every request head is answered with reply. A fraction of the
+//requests, all of them by default, wait delay_us first
+class Upstream{
+    private:
+        int listener;
+        int port;
+        std::string reply;
+        int64_t delay_us;
+        double delay_fraction;
+        std::atomic<uint64_t> requests;
+        std::atomic<int> active;
+        std::atomic<int> peak;
+        std::thread acceptor;
+        std::mutex lock;
+        std::vector<int> open;
+        std::vector<std::thread> workers;
+
+        void serve(int sock){
+            std::string in;
+            char buffer[16384];
+            ssize_t n;
+            while ((n = recv(sock, buffer, sizeof(buffer), 0)) > 0){
+                in.append(buffer, n);
+                size_t end;
+                while ((end = in.find("\r\n\r\n")) != std::string::npos){
+                    in.erase(0, end + 4);
+                    requests++;
+                    int now = ++active;
+                    int seen = peak.load();
+                    while (now > seen && !peak.compare_exchange_weak(seen, now)){
+                    }
+                    if (delay_us > 0 && (delay_fraction >= 1 || HDE::random_u64() % 1000000 < delay_fraction * 1000000)){
+                        usleep(delay_us);
+                    }
+                    active--;
+                    if (!send_all(sock, reply.data(), reply.size())){
+                        return;
+                    }
+                }
+            }
+        }
+    public:
+        Upstream(const std::string &reply, int64_t delay_us = 0, double delay_fraction = 1){
+            this->reply = reply;
+            this->delay_us = delay_us;
+            this->delay_fraction = delay_fraction;
+            requests.store(0);
+            active.store(0);
+            peak.store(0);
+            listener = loopback_listener(port);
+            acceptor = std::thread([this](){
+                int sock;
+                while ((sock = accept(listener, NULL, NULL)) >= 0){
+                    std::lock_guard<std::mutex> guard(lock);
+                    open.push_back(sock);
+                    workers.push_back(std::thread([this, sock](){ serve(sock); }));
+                }
+            });
+        }
+
+        //Shutting the sockets down wakes every blocked accept and recv
+        ~Upstream(){
+            shutdown(listener, SHUT_RDWR);
+            acceptor.join();
+            std::lock_guard<std::mutex> guard(lock);
+            for (size_t i = 0; i < open.size(); i++){
+                shutdown(open[i], SHUT_RDWR);
+            }
+            for (size_t i = 0; i < workers.size(); i++){
+                workers[i].join();
+                close(open[i]);
+            }
+            close(listener);
+        }
+
+        int get_port(){
+            return port;
+        }
+
+        uint64_t get_requests(){
+            return requests.load();
+        }
+
+        //Most requests being answered at once
+        int get_peak(){
+            return peak.load();
+        }
+};
+
+static HDE::Backend upstream_backend(Upstream &upstream, size_t index){
+    return HDE::Backend{"upstream" + std::to_string(index), upstream.get_port(), INADDR_LOOPBACK, 1};
+}
+
+//The proxy under test, accepting on its own loopback port. With a policy the upstreams sit behind a Balancer
+struct Frontend{
+    HDE::EventLoop loop;
+    std::vector<HDE::UpstreamPool *> pools;
+    std::unique_ptr<HDE::Balancer> balancer;
+    std::unique_ptr<HDE::ReverseProxy> proxy;
+    int listener;
+    int port;
+
+    Frontend(Upstream &upstream){
+        pools.push_back(new HDE::UpstreamPool(&loop, upstream_backend(upstream, 0), pool_config()));
+        proxy.reset(new HDE::ReverseProxy(&loop, pools[0], proxy_config()));
+        listen_loopback();
+    }
+
+    Frontend(std::vector<Upstream *> upstreams, HDE::BalancingPolicy *policy){
+        std::vector<HDE::Backend> backends;
+        for (size_t i = 0; i < upstreams.size(); i++){
+            backends.push_back(upstream_backend(*upstreams[i], i));
+            pools.push_back(new HDE::UpstreamPool(&loop, backends[i], pool_config()));
+        }
+        balancer.reset(new HDE::Balancer(backends, policy));
+        proxy.reset(new HDE::ReverseProxy(&loop, balancer.get(), pools, proxy_config()));
+        listen_loopback();
+    }
+
+    ~Frontend(){
+        loop.remove(listener);
+        close(listener);
+        proxy.reset();
+        for (size_t i = 0; i < pools.size(); i++){
+            delete pools[i];
+        }
+    }
+
+    static HDE::UpstreamPoolConfig pool_config(){
+        return HDE::UpstreamPoolConfig{64, 256, 1024, 60000, 5000, 1000, 1000};
+    }
+
+    static HDE::ReverseProxyConfig proxy_config(){
+        return HDE::ReverseProxyConfig{256 * 1024, 64 * 1024, 5000, "bench"};
+    }
+
+    void listen_loopback(){
+        listener = loopback_listener(port);
+        fcntl(listener, F_SETFL, O_NONBLOCK);
+        loop.add(listener, EPOLLIN, [this](uint32_t){
+            int client;
+            while ((client = accept(listener, NULL, NULL)) >= 0){
+                proxy->handle(client);
+            }
+        });
+    }
+
+    //Runs the proxy until every client thread has returned
+    void run(std::vector<std::thread> &clients, std::atomic<int> &running){
+        while (running.load() > 0){
+            loop.run_once(10);
+        }
+        for (size_t i = 0; i < clients.size(); i++){
+            clients[i].join();
+        }
+    }
+};
+
+static int connect_to(int port){
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (connect(sock, (struct sockaddr *)&address, sizeof(address)) < 0){
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+//Sends one keep-alive request and reads its Content-Length response, returns the response's size or 0 on failure.
+//Only the head is kept, requests aren't pipelined so nothing past the body arrives
+static size_t fetch(int sock, const std::string &request){
+    if (!send_all(sock, request.data(), request.size())){
+        return 0;
+    }
+    static thread_local char buffer[262144];
+    std::string head;
+    size_t end;
+    while ((end = head.find("\r\n\r\n")) == std::string::npos){
+        ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+        if (n <= 0){
+            return 0;
+        }
+        head.append(buffer, n);
+    }
+    HDE::HttpResponse response;
+    response.parse(head.data(), end + 4);
+    size_t total = end + 4 + strtoull(response.get_header("Content-Length").c_str(), NULL, 10);
+    size_t have = head.size();
+    while (have < total){
+        ssize_t n = recv(sock, buffer, total - have < sizeof(buffer) ? total - have : sizeof(buffer), 0);
+        if (n <= 0){
+            return 0;
+        }
+        have += n;
+    }
+    return total;
+}
+
+//Runs options.clients keep-alive clients sending request back to back for options.seconds and returns their
+//latencies in microseconds, sorted. cpu_ns is the proxy's CPU time
+static std::vector<int64_t> drive(Frontend &frontend, const Options &options, const std::string &request, int64_t &cpu_ns){
+    std::atomic<int> running(options.clients);
+    std::mutex lock;
+    std::vector<int64_t> latencies;
+    std::vector<std::thread> clients;
+    for (int c = 0; c < options.clients; c++){
+        clients.push_back(std::thread([&](){
+            std::vector<int64_t> mine;
+            int sock = connect_to(frontend.port);
+            int64_t deadline = HDE::EventLoop::now_ms() + (int64_t)(options.seconds * 1000);
+            while (sock >= 0 && HDE::EventLoop::now_ms() < deadline){
+                int64_t start = HDE::EventLoop::now_us();
+                if (fetch(sock, request) == 0){
+                    break;
+                }
+                mine.push_back(HDE::EventLoop::now_us() - start);
+            }
+            close(sock);
+            std::lock_guard<std::mutex> guard(lock);
+            latencies.insert(latencies.end(), mine.begin(), mine.end());
+            running--;
+        }));
+    }
+    cpu_ns = thread_cpu_ns();
+    frontend.run(clients, running);
+    cpu_ns = thread_cpu_ns() - cpu_ns;
+    std::sort(latencies.begin(), latencies.end());
+    return latencies;
+}
+
+static std::string plain_reply(size_t size){
+    return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(size) + "\r\n\r\n" + std::string(size, 'x');
+}
+
+//Every client sends keep-alive requests back to back, responses aren't cacheable so each one reaches the upstream
+static void throughput(const Options &options){
+    Upstream upstream(plain_reply(options.size));
+    Frontend frontend(upstream);
+    int64_t cpu;
+    std::vector<int64_t> latencies = drive(frontend, options, "GET /item HTTP/1.1\r\nHost: bench\r\n\r\n", cpu);
+    size_t requests = latencies.size();
+    printf("# throughput clients=%d body=%zu seconds=%.1f\n", options.clients, options.size, options.seconds);
+    printf("# requests rps p50_us p99_us p999_us proxy_cpu_us_per_request upstream_requests upstream_errors\n");
+    printf("%10zu %10.0f %8lld %8lld %8lld %10.2f %10llu %6llu\n", requests, requests / options.seconds,
+           (long long)percentile(latencies, 0.5), (long long)percentile(latencies, 0.99), (long long)percentile(latencies, 0.999),
+           requests > 0 ? cpu / 1e3 / requests : 0.0, (unsigned long long)upstream.get_requests(),
+           (unsigned long long)frontend.proxy->get_upstream_errors());
+}
+
+//Four backends where the last answers every request after options.delay_us. Round-robin keeps sending it a quarter
+//of the traffic, load-aware policies should shift requests away and pull the tail in
+static void slowbackend(const Options &options){
+    const char *names[3] = {"round_robin", "power_of_two", "ewma"};
+    printf("# slowbackend clients=%d body=%zu seconds=%.1f delay_us=%lld\n", options.clients, options.size, options.seconds,
+           (long long)options.delay_us);
+    printf("# policy requests p50_us p99_us p999_us slow_share\n");
+    for (int mode = 0; mode < 3; mode++){
+        std::vector<std::unique_ptr<Upstream> > owned;
+        std::vector<Upstream *> upstreams;
+        for (int i = 0; i < 4; i++){
+            owned.push_back(std::unique_ptr<Upstream>(new Upstream(plain_reply(options.size), i == 3 ? options.delay_us : 0)));
+            upstreams.push_back(owned.back().get());
+        }
+        HDE::BalancingPolicy *policy;
+        if (mode == 0){
+            policy = new HDE::RoundRobinPolicy();
+        } else if (mode == 1){
+            policy = new HDE::PowerOfTwoPolicy();
+        } else {
+            policy = new HDE::EwmaPolicy();
+        }
+        Frontend frontend(upstreams, policy);
+        int64_t cpu;
+        std::vector<int64_t> latencies = drive(frontend, options, "GET /item HTTP/1.1\r\nHost: bench\r\n\r\n", cpu);
+        uint64_t total = 0;
+        for (int i = 0; i < 4; i++){
+            total += upstreams[i]->get_requests();
+        }
+        printf("%-12s %8zu %8lld %8lld %8lld %8.3f\n", names[mode], latencies.size(), (long long)percentile(latencies, 0.5),
+               (long long)percentile(latencies, 0.99), (long long)percentile(latencies, 0.999),
+               total > 0 ? (double)upstreams[3]->get_requests() / total : 0.0);
+    }
+}
+
+//Two backends that each delay options.fraction of their answers by options.delay_us. Hedging sends a second copy
+//of a request still waiting after the p95 delay, cutting the tail for a few percent of extra upstream requests
+static void hedging(const Options &options){
+    printf("# hedging clients=%d body=%zu seconds=%.1f delay_us=%lld fraction=%.3f\n", options.clients, options.size,
+           options.seconds, (long long)options.delay_us, options.fraction);
+    printf("# mode requests p50_us p99_us p999_us hedges hedge_wins upstream_per_request\n");
+    for (int mode = 0; mode < 2; mode++){
+        Upstream first(plain_reply(options.size), options.delay_us, options.fraction);
+        Upstream second(plain_reply(options.size), options.delay_us, options.fraction);
+        std::vector<Upstream *> upstreams;
+        upstreams.push_back(&first);
+        upstreams.push_back(&second);
+        Frontend frontend(upstreams, new HDE::RoundRobinPolicy());
+        HDE::HedgePolicy hedge(0.95, 1000, options.delay_us);
+        HDE::RetryBudget budget(0.1, 10, 100);
+        if (mode == 1){
+            frontend.proxy->set_hedging(&hedge, &budget);
+        }
+        int64_t cpu;
+        std::vector<int64_t> latencies = drive(frontend, options, "GET /item HTTP/1.1\r\nHost: bench\r\n\r\n", cpu);
+        uint64_t upstream_requests = first.get_requests() + second.get_requests();
+        printf("%-8s %8zu %8lld %8lld %8lld %8llu %8llu %8.3f\n", mode == 0 ? "plain" : "hedged", latencies.size(),
+               (long long)percentile(latencies, 0.5), (long long)percentile(latencies, 0.99), (long long)percentile(latencies, 0.999),
+               (unsigned long long)frontend.proxy->get_hedges(), (unsigned long long)frontend.proxy->get_hedge_wins(),
+               latencies.empty() ? 0.0 : (double)upstream_requests / latencies.size());
+    }
+}
+
+//Every client asks for one key that stays fresh for a second, and the upstream takes options.delay_us to answer.
+//Without coalescing each expiry sends every client's miss upstream at once, with it one fetch refills the entry
+static void stampede(const Options &options){
+    std::string reply = "HTTP/1.1 200 OK\r\nCache-Control: max-age=1\r\nContent-Length: " + std::to_string(options.size) +
+                        "\r\n\r\n" + std::string(options.size, 'x');
+    printf("# stampede clients=%d body=%zu seconds=%.1f delay_us=%lld\n", options.clients, options.size, options.seconds,
+           (long long)options.delay_us);
+    printf("# mode requests p99_us upstream_requests upstream_qps peak_upstream_concurrency coalesced\n");
+    for (int mode = 0; mode < 2; mode++){
+        HDE::HttpCache cache(HDE::HttpCacheConfig{64 << 20, 16 << 20, 1});
+        Upstream upstream(reply, options.delay_us);
+        Frontend frontend(upstream);
+        frontend.proxy->set_cache(&cache);
+        if (mode == 1){
+            frontend.proxy->set_coalescing(1000);
+        }
+        int64_t cpu;
+        std::vector<int64_t> latencies = drive(frontend, options, "GET /hot HTTP/1.1\r\nHost: bench\r\n\r\n", cpu);
+        printf("%-10s %8zu %8lld %8llu %8.1f %6d %8llu\n", mode == 0 ? "plain" : "coalesced", latencies.size(),
+               (long long)percentile(latencies, 0.99), (unsigned long long)upstream.get_requests(),
+               upstream.get_requests() / options.seconds, upstream.get_peak(),
+               (unsigned long long)frontend.proxy->get_flights().get_coalesced());
+    }
+}
+
+//Large cacheable responses are served from the cache after the first request, threshold 0 copies them and 64KB
+//sends them with MSG_ZEROCOPY. On loopback the kernel copies zerocopy pages anyway, so only a NIC shows the saving
+static void zerocopy(const Options &options){
+    std::string body(options.size, 'x');
+    std::string reply = "HTTP/1.1 200 OK\r\nCache-Control: max-age=600\r\nContent-Length: " + std::to_string(body.size()) +
+                        "\r\n\r\n" + body;
+    size_t thresholds[2] = {0, 64 * 1024};
+    printf("# zerocopy body=%zu seconds=%.1f\n# mode requests gigabytes proxy_cpu_ms_per_gb zerocopy_bytes\n", options.size, options.seconds);
+    for (int mode = 0; mode < 2; mode++){
+        HDE::HttpCache cache(HDE::HttpCacheConfig{options.size * 4 + (16 << 20), options.size * 2, 1});
+        Upstream upstream(reply);
+        Frontend frontend(upstream);
+        frontend.proxy->set_cache(&cache);
+        frontend.proxy->set_zerocopy(thresholds[mode]);
+        std::atomic<int> running(1);
+        std::atomic<uint64_t> bytes(0);
+        std::atomic<uint64_t> requests(0);
+        std::vector<std::thread> clients;
+        clients.push_back(std::thread([&](){
+            int sock = connect_to(frontend.port);
+            const std::string request = "GET /large HTTP/1.1\r\nHost: bench\r\n\r\n";
+            int64_t deadline = HDE::EventLoop::now_ms() + (int64_t)(options.seconds * 1000);
+            while (sock >= 0 && HDE::EventLoop::now_ms() < deadline){
+                size_t n = fetch(sock, request);
+                if (n == 0){
+                    break;
+                }
+                bytes += n;
+                requests++;
+            }
+            close(sock);
+            running--;
+        }));
+        int64_t cpu = thread_cpu_ns();
+        frontend.run(clients, running);
+        cpu = thread_cpu_ns() - cpu;
+        double gigabytes = bytes.load() / 1e9;
+        printf("%-8s %8llu %10.2f %12.1f %14llu\n", mode == 0 ? "copy" : "zerocopy", (unsigned long long)requests.load(), gigabytes,
+               gigabytes > 0 ? cpu / 1e6 / gigabytes : 0.0, (unsigned long long)frontend.proxy->get_zerocopy_bytes());
+    }
+}
+
+int main(int argc, char **argv){
+    if (argc < 2){
+        std::cerr << "Usage: " << argv[0] << " throughput|slowbackend|hedging|stampede|zerocopy [--seconds n] [--size bytes] [--clients n] [--delay us]" << std::endl;
+        return 2;
+    }
+    std::string scenario = argv[1];
+    Options options{5, 0, 8, 20000, 0.01};
+    for (int i = 2; i + 1 < argc; i += 2){
+        std::string flag = argv[i];
+        if (flag == "--seconds"){
+            options.seconds = atof(argv[i + 1]);
+        } else if (flag == "--size"){
+            options.size = strtoull(argv[i + 1], NULL, 10);
+        } else if (flag == "--delay"){
+            options.delay_us = strtoll(argv[i + 1], NULL, 10);
+        } else if (flag == "--fraction"){
+            options.fraction = atof(argv[i + 1]);
+        } else if (flag == "--clients"){
+            options.clients = atoi(argv[i + 1]) > 0 ? atoi(argv[i + 1]) : 1;
+        } else {
+            std::cerr << "Unknown option " << flag << std::endl;
+            return 2;
+        }
+    }
+    if (scenario == "throughput"){
+        options.size = options.size > 0 ? options.size : 1024;
+        throughput(options);
+    } else if (scenario == "slowbackend"){
+        options.size = options.size > 0 ? options.size : 1024;
+        slowbackend(options);
+    } else if (scenario == "hedging"){
+        options.size = options.size > 0 ? options.size : 1024;
+        hedging(options);
+    } else if (scenario == "stampede"){
+        options.size = options.size > 0 ? options.size : 1024;
+        stampede(options);
+    } else if (scenario == "zerocopy"){
+        options.size = options.size > 0 ? options.size : 8 << 20;
+        zerocopy(options);
+    } else {
+        std::cerr << "Unknown scenario " << scenario << std::endl;
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,485 @@
+#include "HttpCache.hpp"
+#include "../Http/CacheControl.hpp"
+#include <mutex>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_ENTRY_OVERHEAD 256
+#define CACHE_MAX_VARIANTS 4
+
+//Constructor
+HDE::CacheEntry::CacheEntry(){
+    status_line = 0;
+    status = 0;
+    stored_ms = 0;
+    age_ms = 0;
+    fresh_ms = 0;
+    stale_while_revalidate_ms = 0;
+    must_revalidate = false;
+    referenced.store(false);
+    refreshing.store(false);
+}
+
+int64_t HDE::CacheEntry::get_age_ms(int64_t now_ms) const{
+    return age_ms + (now_ms - stored_ms);
+}
+
+size_t HDE::CacheEntry::get_bytes() const{
+    return head.size() + (body ? body->size() : 0) + CACHE_ENTRY_OVERHEAD;
+}
+
+//Explicit freshness lifetime in milliseconds from s-maxage, max-age or Expires, false when none is given
+static bool freshness_lifetime(HDE::HttpResponse &response, HDE::CacheControl &cc, int64_t &fresh_ms){
+    if (cc.s_maxage >= 0){
+        fresh_ms = cc.s_maxage * 1000;
+        return true;
+    }
+    if (cc.max_age >= 0){
+        fresh_ms = cc.max_age * 1000;
+        return true;
+    }
+    if (!response.has_header("Expires")){
+        return false;
+    }
+    int64_t expires = 0;
+    int64_t date = time(NULL);
+    fresh_ms = 0;
+    if (HDE::parse_http_date(response.get_header("Expires"), expires)){
+        HDE::parse_http_date(response.get_header("Date"), date);
+        fresh_ms = expires > date ? (expires - date) * 1000 : 0;
+    }
+    return true;
+}
+
+static int64_t clock_ms(clockid_t clock){
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void put_bytes(std::string &out, const void *data, size_t len){
+    out.append((const char *)data, len);
+}
+
+static void put_string(std::string &out, const std::string &value){
+    uint32_t len = value.size();
+    put_bytes(out, &len, sizeof(len));
+    out += value;
+}
+
+static bool get_bytes(const char *&data, const char *end, void *out, size_t len){
+    if ((size_t)(end - data) < len){
+        return false;
+    }
+    memcpy(out, data, len);
+    data += len;
+    return true;
+}
+
+static bool get_string(const char *&data, const char *end, std::string &value){
+    uint32_t len = 0;
+    if (!get_bytes(data, end, &len, sizeof(len)) || (size_t)(end - data) < len){
+        return false;
+    }
+    value.assign(data, len);
+    data += len;
+    return true;
+}
+
+//Persisted form of an entry, the age is taken against the wall clock since monotonic time restarts with the host
+static std::string serialize_entry(const HDE::CacheEntry &entry){
+    std::string out;
+    int64_t fields[5] = {entry.get_age_ms(clock_ms(CLOCK_MONOTONIC)), clock_ms(CLOCK_REALTIME), entry.fresh_ms,
+                         entry.stale_while_revalidate_ms, entry.must_revalidate ? 1 : 0};
+    uint32_t numbers[3] = {(uint32_t)entry.status, (uint32_t)entry.status_line, (uint32_t)entry.vary.size()};
+    put_bytes(out, fields, sizeof(fields));
+    put_bytes(out, numbers, sizeof(numbers));
+    put_string(out, entry.head);
+    put_string(out, entry.etag);
+    put_string(out, entry.last_modified);
+    for (size_t i = 0; i < entry.vary.size(); i++){
+        put_string(out, entry.vary[i].first);
+        put_string(out, entry.vary[i].second);
+    }
+    out += entry.body ? *entry.body : std::string();
+    return out;
+}
+
+static std::shared_ptr<HDE::CacheEntry> deserialize_entry(const char *data, size_t len, int64_t now_ms){
+    std::shared_ptr<HDE::CacheEntry> entry = std::make_shared<HDE::CacheEntry>();
+    const char *end = data + len;
+    int64_t fields[5];
+    uint32_t numbers[3];
+    if (!get_bytes(data, end, fields, sizeof(fields)) || !get_bytes(data, end, numbers, sizeof(numbers)) ||
+        !get_string(data, end, entry->head) || !get_string(data, end, entry->etag) || !get_string(data, end, entry->last_modified)){
+        return std::shared_ptr<HDE::CacheEntry>();
+    }
+    for (uint32_t i = 0; i < numbers[2]; i++){
+        std::pair<std::string, std::string> field;
+        if (!get_string(data, end, field.first) || !get_string(data, end, field.second)){
+            return std::shared_ptr<HDE::CacheEntry>();
+        }
+        entry->vary.push_back(field);
+    }
+    int64_t offline = clock_ms(CLOCK_REALTIME) - fields[1];
+    entry->body = std::make_shared<const std::string>(data, end - data);
+    entry->age_ms = fields[0] + (offline > 0 ? offline : 0);
+    entry->stored_ms = now_ms;
+    entry->fresh_ms = fields[2];
+    entry->stale_while_revalidate_ms = fields[3];
+    entry->must_revalidate = fields[4] != 0;
+    entry->status = numbers[0];
+    entry->status_line = numbers[1];
+    return entry;
+}
+
+static bool cacheable_status(int status){
+    return status == 200 || status == 203 || status == 204 || status == 300 || status == 301 ||
+           status == 308 || status == 404 || status == 410;
+}
+
+//Constructor
+HDE::HttpCache::HttpCache(HttpCacheConfig config){
+    this->config = config;
+    if (this->config.shards < 1){
+        this->config.shards = 1;
+    }
+    for (int i = 0; i < this->config.shards; i++){
+        Shard *shard = new Shard();
+        shard->bytes = 0;
+        shards.push_back(shard);
+    }
+    shard_budget = this->config.max_bytes / this->config.shards;
+    lookups.store(0);
+    hits.store(0);
+    stale_hits.store(0);
+    revalidations.store(0);
+    stores.store(0);
+    evictions.store(0);
+    persistent = NULL;
+}
+
+HDE::HttpCache::~HttpCache(){
+    for (size_t i = 0; i < shards.size(); i++){
+        delete shards[i];
+    }
+}
+
+HDE::HttpCache::Shard & HDE::HttpCache::shard_for(const std::string &key){
+    return *shards[std::hash<std::string>()(key) % shards.size()];
+}
+
+std::string HDE::HttpCache::key_for(HttpRequest &request){
+    return request.get_header("Host") + request.get_path();
+}
+
+bool HDE::HttpCache::vary_matches(const CacheEntry &entry, HttpRequest &request){
+    for (size_t i = 0; i < entry.vary.size(); i++){
+        if (request.get_header(entry.vary[i].first) != entry.vary[i].second){
+            return false;
+        }
+    }
+    return true;
+}
+
+//Finds the variant matching the request's Vary headers and says how it may be used, only the shard map is locked
+HDE::CacheStatus HDE::HttpCache::lookup(const std::string &key, HttpRequest &request, int64_t now_ms, std::shared_ptr<const CacheEntry> &entry){
+    lookups.fetch_add(1, std::memory_order_relaxed);
+    entry.reset();
+    CacheControl cc = parse_cache_control(request.get_header("Cache-Control"));
+    if (cc.no_store || request.has_header("Authorization")){
+        return CACHE_BYPASS;
+    }
+    Shard &shard = shard_for(key);
+    {
+        std::shared_lock<std::shared_mutex> guard(shard.lock);
+        std::unordered_map<std::string, Slot>::iterator it = shard.slots.find(key);
+        if (it != shard.slots.end()){
+            for (size_t i = 0; i < it->second.variants.size(); i++){
+                if (vary_matches(*it->second.variants[i], request)){
+                    entry = it->second.variants[i];
+                    break;
+                }
+            }
+        }
+    }
+    if (!entry){
+        return CACHE_MISS;
+    }
+    entry->referenced.store(true, std::memory_order_relaxed);
+    int64_t age = entry->get_age_ms(now_ms);
+    bool revalidate = cc.no_cache || cc.max_age == 0;
+    if (!revalidate && age < entry->fresh_ms){
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return CACHE_FRESH;
+    }
+    if (!revalidate && !entry->must_revalidate && age < entry->fresh_ms + entry->stale_while_revalidate_ms){
+        stale_hits.fetch_add(1, std::memory_order_relaxed);
+        return CACHE_STALE_WHILE_REVALIDATE;
+    }
+    if (entry->etag.empty() && entry->last_modified.empty()){
+        entry.reset();
+        return CACHE_MISS;
+    }
+    return CACHE_STALE;
+}
+
+//Builds an entry for a response the shared cache may store, or NULL, the caller fills in head and body
+std::shared_ptr<HDE::CacheEntry> HDE::HttpCache::prepare(HttpRequest &request, HttpResponse &response, int64_t now_ms){
+    std::shared_ptr<CacheEntry> entry;
+    if (request.get_method() != "GET" || !cacheable_status(response.get_status()) || response.has_header("Set-Cookie")){
+        return entry;
+    }
+    CacheControl cc = parse_cache_control(response.get_header("Cache-Control"));
+    if (cc.no_store || cc.is_private || parse_cache_control(request.get_header("Cache-Control")).no_store){
+        return entry;
+    }
+    int64_t fresh_ms = 0;
+    if (!freshness_lifetime(response, cc, fresh_ms) && !cc.no_cache){
+        return entry;
+    }
+    std::string etag = response.get_header("ETag");
+    std::string last_modified = response.get_header("Last-Modified");
+    if (cc.no_cache){
+        fresh_ms = 0;
+    }
+    if (fresh_ms == 0 && etag.empty() && last_modified.empty()){
+        return entry;
+    }
+    std::string length = response.get_header("Content-Length");
+    if (!length.empty() && strtoull(length.c_str(), NULL, 10) > config.max_object){
+        return entry;
+    }
+    entry = std::make_shared<CacheEntry>();
+    std::string vary = response.get_header("Vary");
+    size_t start = 0;
+    while (start < vary.size()){
+        size_t end = vary.find(',', start);
+        if (end == std::string::npos){
+            end = vary.size();
+        }
+        while (start < end && (vary[start] == ' ' || vary[start] == '\t')){
+            start++;
+        }
+        size_t stop = end;
+        while (stop > start && (vary[stop - 1] == ' ' || vary[stop - 1] == '\t')){
+            stop--;
+        }
+        std::string name = vary.substr(start, stop - start);
+        if (name == "*"){
+            entry.reset();
+            return entry;
+        }
+        if (!name.empty()){
+            entry->vary.push_back(std::make_pair(name, request.get_header(name)));
+        }
+        start = end + 1;
+    }
+    entry->etag = etag;
+    entry->last_modified = last_modified;
+    entry->status = response.get_status();
+    entry->stored_ms = now_ms;
+    entry->age_ms = strtoll(response.get_header("Age").c_str(), NULL, 10) * 1000;
+    entry->fresh_ms = fresh_ms;
+    entry->stale_while_revalidate_ms = cc.stale_while_revalidate > 0 ? cc.stale_while_revalidate * 1000 : 0;
+    entry->must_revalidate = cc.must_revalidate || cc.no_cache;
+    return entry;
+}
+
+//A copy of entry renewed by a 304, the body is shared rather than copied
+std::shared_ptr<HDE::CacheEntry> HDE::HttpCache::refreshed(const CacheEntry &entry, HttpResponse &not_modified, int64_t now_ms){
+    std::shared_ptr<CacheEntry> fresh = std::make_shared<CacheEntry>();
+    fresh->head = entry.head;
+    fresh->status_line = entry.status_line;
+    fresh->body = entry.body;
+    fresh->vary = entry.vary;
+    fresh->etag = entry.etag;
+    fresh->last_modified = entry.last_modified;
+    fresh->status = entry.status;
+    fresh->stored_ms = now_ms;
+    fresh->age_ms = strtoll(not_modified.get_header("Age").c_str(), NULL, 10) * 1000;
+    fresh->fresh_ms = entry.fresh_ms;
+    fresh->stale_while_revalidate_ms = entry.stale_while_revalidate_ms;
+    fresh->must_revalidate = entry.must_revalidate;
+    CacheControl cc = parse_cache_control(not_modified.get_header("Cache-Control"));
+    int64_t fresh_ms = 0;
+    if (freshness_lifetime(not_modified, cc, fresh_ms)){
+        fresh->fresh_ms = cc.no_cache ? 0 : fresh_ms;
+        fresh->stale_while_revalidate_ms = cc.stale_while_revalidate > 0 ? cc.stale_while_revalidate * 1000 : 0;
+    }
+    revalidations.fetch_add(1, std::memory_order_relaxed);
+    return fresh;
+}
+
+//Stores in memory and, with a persistent store attached, writes the entry through to the mapped file
+void HDE::HttpCache::store(const std::string &key, std::shared_ptr<const CacheEntry> entry){
+    insert(key, entry);
+    if (persistent != NULL){
+        std::string value = serialize_entry(*entry);
+        persistent->put(persistent_key(key, *entry), value.data(), value.size());
+    }
+}
+
+//Replaces the variant with the same Vary values, then evicts until the shard fits its share of max_bytes
+void HDE::HttpCache::insert(const std::string &key, std::shared_ptr<const CacheEntry> entry){
+    size_t bytes = entry->get_bytes() + key.size();
+    if (bytes > shard_budget){
+        return;
+    }
+    Shard &shard = shard_for(key);
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    std::unordered_map<std::string, Slot>::iterator it = shard.slots.find(key);
+    if (it == shard.slots.end()){
+        it = shard.slots.insert(std::make_pair(key, Slot())).first;
+        it->second.bytes = 0;
+        it->second.hand = shard.clock.insert(shard.clock.end(), key);
+    }
+    Slot &slot = it->second;
+    size_t i = 0;
+    while (i < slot.variants.size() && slot.variants[i]->vary != entry->vary){
+        i++;
+    }
+    if (i == slot.variants.size() && i == CACHE_MAX_VARIANTS){
+        i = 0;
+    }
+    if (i < slot.variants.size()){
+        size_t old = slot.variants[i]->get_bytes() + key.size();
+        slot.bytes -= old;
+        shard.bytes -= old;
+        slot.variants[i] = entry;
+    } else {
+        slot.variants.push_back(entry);
+    }
+    slot.bytes += bytes;
+    shard.bytes += bytes;
+    stores.fetch_add(1, std::memory_order_relaxed);
+    while (shard.bytes > shard_budget && !shard.clock.empty()){
+        evict(shard);
+    }
+}
+
+//Second-chance sweep, a key whose entries were read since the last pass is skipped once
+void HDE::HttpCache::evict(Shard &shard){
+    size_t passes = shard.clock.size() * 2 + 1;
+    while (passes-- > 0 && !shard.clock.empty()){
+        std::unordered_map<std::string, Slot>::iterator it = shard.slots.find(shard.clock.front());
+        bool referenced = false;
+        for (size_t i = 0; i < it->second.variants.size(); i++){
+            referenced = it->second.variants[i]->referenced.exchange(false, std::memory_order_relaxed) || referenced;
+        }
+        if (referenced && passes > 0){
+            // Splicing keeps the slot's hand valid
+            shard.clock.splice(shard.clock.end(), shard.clock, shard.clock.begin());
+            continue;
+        }
+        shard.bytes -= it->second.bytes;
+        evictions.fetch_add(it->second.variants.size(), std::memory_order_relaxed);
+        shard.clock.pop_front();
+        shard.slots.erase(it);
+        return;
+    }
+}
+
+//Drops every variant, the persistent records are removed after the shard is unlocked so the two locks never nest
+void HDE::HttpCache::remove(const std::string &key){
+    Shard &shard = shard_for(key);
+    std::vector<std::string> records;
+    {
+        std::unique_lock<std::shared_mutex> guard(shard.lock);
+        std::unordered_map<std::string, Slot>::iterator it = shard.slots.find(key);
+        if (it == shard.slots.end()){
+            return;
+        }
+        for (size_t i = 0; persistent != NULL && i < it->second.variants.size(); i++){
+            records.push_back(persistent_key(key, *it->second.variants[i]));
+        }
+        shard.bytes -= it->second.bytes;
+        shard.clock.erase(it->second.hand);
+        shard.slots.erase(it);
+    }
+    for (size_t i = 0; i < records.size(); i++){
+        persistent->remove(records[i]);
+    }
+}
+
+//One record per variant, the cache key comes first and ends at the NUL
+std::string HDE::HttpCache::persistent_key(const std::string &key, const CacheEntry &entry){
+    std::string out = key;
+    out += '\0';
+    for (size_t i = 0; i < entry.vary.size(); i++){
+        out += entry.vary[i].first + ":" + entry.vary[i].second + "\n";
+    }
+    return out;
+}
+
+void HDE::HttpCache::set_store(PersistentStore *persistent){
+    this->persistent = persistent;
+}
+
+//Refills memory from the persistent store after a restart, entries that can be neither served nor revalidated are skipped
+size_t HDE::HttpCache::load(int64_t now_ms){
+    if (persistent == NULL){
+        return 0;
+    }
+    // The visitor runs under the store lock and insert() takes a shard lock, so entries are inserted once it returns
+    std::vector<std::pair<std::string, std::shared_ptr<CacheEntry> > > records;
+    persistent->for_each([&](const std::string &key, const char *value, size_t len){
+        std::shared_ptr<CacheEntry> entry = deserialize_entry(value, len, now_ms);
+        if (!entry || (entry->get_age_ms(now_ms) >= entry->fresh_ms + entry->stale_while_revalidate_ms &&
+                       entry->etag.empty() && entry->last_modified.empty())){
+            return;
+        }
+        records.push_back(std::make_pair(key.substr(0, key.find('\0')), entry));
+    });
+    for (size_t i = 0; i < records.size(); i++){
+        insert(records[i].first, records[i].second);
+    }
+    return records.size();
+}
+
+size_t HDE::HttpCache::get_max_object(){
+    return config.max_object;
+}
+
+uint64_t HDE::HttpCache::get_lookups(){
+    return lookups.load(std::memory_order_relaxed);
+}
+
+uint64_t HDE::HttpCache::get_hits(){
+    return hits.load(std::memory_order_relaxed);
+}
+
+uint64_t HDE::HttpCache::get_stale_hits(){
+    return stale_hits.load(std::memory_order_relaxed);
+}
+
+uint64_t HDE::HttpCache::get_revalidations(){
+    return revalidations.load(std::memory_order_relaxed);
+}
+
+uint64_t HDE::HttpCache::get_stores(){
+    return stores.load(std::memory_order_relaxed);
+}
+
+uint64_t HDE::HttpCache::get_evictions(){
+    return evictions.load(std::memory_order_relaxed);
+}
+
+size_t HDE::HttpCache::get_bytes(){
+    size_t total = 0;
+    for (size_t i = 0; i < shards.size(); i++){
+        std::shared_lock<std::shared_mutex> guard(shards[i]->lock);
+        total += shards[i]->bytes;
+    }
+    return total;
+}
+
+//Share of lookups answered without a full upstream response, 304 revalidations included
+double HDE::HttpCache::get_hit_ratio(){
+    uint64_t total = get_lookups();
+    if (total == 0){
+        return 0;
+    }
+    return (double)(get_hits() + get_stale_hits() + get_revalidations()) / total;
+}
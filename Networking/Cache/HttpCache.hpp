@@ -0,0 +1,109 @@
+#ifndef HttpCache_hpp
+#define HttpCache_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+#include "../Http/HttpRequest.hpp"
+#include "../Http/HttpResponse.hpp"
+#include "PersistentStore.hpp"
+
+namespace HDE{
+    struct HttpCacheConfig{
+        size_t max_bytes;
+        size_t max_object;
+        int shards;
+    };
+
+    enum CacheStatus{
+        CACHE_BYPASS,
+        CACHE_MISS,
+        CACHE_FRESH,
+        CACHE_STALE_WHILE_REVALIDATE,
+        CACHE_STALE
+    };
+
+    //A stored response, immutable once stored so readers share it without locks,
+    //head holds the status line and headers without Age or Connection, body is the framed body as received
+    struct CacheEntry{
+        std::string head;
+        size_t status_line;
+        std::shared_ptr<const std::string> body;
+        HttpRequest::Headers vary;
+        std::string etag;
+        std::string last_modified;
+        int status;
+        int64_t stored_ms;
+        int64_t age_ms;
+        int64_t fresh_ms;
+        int64_t stale_while_revalidate_ms;
+        bool must_revalidate;
+        mutable std::atomic<bool> referenced;
+        mutable std::atomic<bool> refreshing;
+        CacheEntry();
+        int64_t get_age_ms(int64_t now_ms) const;
+        size_t get_bytes() const;
+    };
+
+    //Shared RFC 9111 response cache, sharded with reader-writer locks and bounded in bytes by CLOCK eviction
+    class HttpCache{
+        private:
+            //hand is the slot's place in its shard's clock, so removing the key also takes it off the clock
+            struct Slot{
+                std::vector<std::shared_ptr<const CacheEntry> > variants;
+                size_t bytes;
+                std::list<std::string>::iterator hand;
+            };
+            struct Shard{
+                std::shared_mutex lock;
+                std::unordered_map<std::string, Slot> slots;
+                std::list<std::string> clock;
+                size_t bytes;
+            };
+            HttpCacheConfig config;
+            std::vector<Shard *> shards;
+            size_t shard_budget;
+            std::atomic<uint64_t> lookups;
+            std::atomic<uint64_t> hits;
+            std::atomic<uint64_t> stale_hits;
+            std::atomic<uint64_t> revalidations;
+            std::atomic<uint64_t> stores;
+            std::atomic<uint64_t> evictions;
+            PersistentStore *persistent;
+            Shard & shard_for(const std::string &key);
+            void evict(Shard &shard);
+            void insert(const std::string &key, std::shared_ptr<const CacheEntry> entry);
+            static std::string persistent_key(const std::string &key, const CacheEntry &entry);
+            static bool vary_matches(const CacheEntry &entry, HttpRequest &request);
+            HttpCache(const HttpCache &);
+            HttpCache & operator=(const HttpCache &);
+        public:
+            HttpCache(HttpCacheConfig config);
+            ~HttpCache();
+            CacheStatus lookup(const std::string &key, HttpRequest &request, int64_t now_ms, std::shared_ptr<const CacheEntry> &entry);
+            std::shared_ptr<CacheEntry> prepare(HttpRequest &request, HttpResponse &response, int64_t now_ms);
+            std::shared_ptr<CacheEntry> refreshed(const CacheEntry &entry, HttpResponse &not_modified, int64_t now_ms);
+            void store(const std::string &key, std::shared_ptr<const CacheEntry> entry);
+            void remove(const std::string &key);
+            void set_store(PersistentStore *persistent);
+            size_t load(int64_t now_ms);
+            size_t get_max_object();
+            uint64_t get_lookups();
+            uint64_t get_hits();
+            uint64_t get_stale_hits();
+            uint64_t get_revalidations();
+            uint64_t get_stores();
+            uint64_t get_evictions();
+            size_t get_bytes();
+            double get_hit_ratio();
+            static std::string key_for(HttpRequest &request);
+    };
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include "MicroCache.hpp"
+
+#define MICRO_ENTRY_OVERHEAD 128
+
+static uint64_t fnv_mix(uint64_t hash, const std::string &value){
+    for (size_t i = 0; i < value.size(); i++){
+        hash ^= (unsigned char)value[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= 0xff;
+    return hash * 1099511628211ULL;
+}
+
+//Finds a header without copying its value, NULL when absent
+static const std::string * find_header(HDE::HttpRequest &request, const std::string &name){
+    HDE::HttpRequest::Headers &headers = request.get_headers();
+    for (size_t i = 0; i < headers.size(); i++){
+        if (HDE::header_name_equals(headers[i].first, name)){
+            return &headers[i].second;
+        }
+    }
+    return NULL;
+}
+
+//Constructor
+HDE::MicroCache::MicroCache(size_t max_bytes) : routes(-1){
+    this->max_bytes = max_bytes;
+    bytes = 0;
+    hits = 0;
+    misses = 0;
+    stores = 0;
+    evictions = 0;
+}
+
+//Opts every path under prefix in, vary lists the request headers that select different responses
+void HDE::MicroCache::add_route(const std::string &prefix, int ttl_ms, const std::vector<std::string> &vary){
+    Rule rule;
+    rule.ttl_ms = ttl_ms;
+    rule.vary = vary;
+    rules.push_back(rule);
+    routes.add(prefix, rules.size() - 1);
+}
+
+int HDE::MicroCache::rule_for(HttpRequest &request){
+    const std::string &method = request.get_method();
+    if (method != "GET" && method != "HEAD"){
+        return -1;
+    }
+    return routes.match(request.get_path());
+}
+
+bool HDE::MicroCache::is_cacheable(HttpRequest &request){
+    return rule_for(request) >= 0;
+}
+
+uint64_t HDE::MicroCache::key_for(HttpRequest &request, const Rule &rule){
+    uint64_t hash = 14695981039346656037ULL;
+    hash = fnv_mix(hash, request.get_method());
+    hash = fnv_mix(hash, request.get_path());
+    static const std::string none;
+    for (size_t i = 0; i < rule.vary.size(); i++){
+        const std::string *value = find_header(request, rule.vary[i]);
+        hash = fnv_mix(hash, value ? *value : none);
+    }
+    return hash;
+}
+
+bool HDE::MicroCache::matches(const Entry &entry, HttpRequest &request, const Rule &rule){
+    if (entry.method != request.get_method() || entry.path != request.get_path()){
+        return false;
+    }
+    for (size_t i = 0; i < rule.vary.size(); i++){
+        const std::string *value = find_header(request, rule.vary[i]);
+        if (value ? *value != entry.vary_values[i] : !entry.vary_values[i].empty()){
+            return false;
+        }
+    }
+    return true;
+}
+
+//Returns the stored response bytes while they are within the route's TTL, a hit neither copies nor allocates
+const std::string * HDE::MicroCache::lookup(HttpRequest &request, int64_t now_ms){
+    int index = rule_for(request);
+    if (index < 0){
+        return NULL;
+    }
+    const Rule &rule = rules[index];
+    std::unordered_map<uint64_t, Entry>::iterator it = entries.find(key_for(request, rule));
+    if (it == entries.end() || it->second.expires_ms <= now_ms || !matches(it->second, request, rule)){
+        misses++;
+        return NULL;
+    }
+    hits++;
+    return &it->second.bytes;
+}
+
+void HDE::MicroCache::store(HttpRequest &request, const std::string &response, int64_t now_ms){
+    int index = rule_for(request);
+    if (index < 0){
+        return;
+    }
+    const Rule &rule = rules[index];
+    size_t size = response.size() + request.get_path().size() + MICRO_ENTRY_OVERHEAD;
+    if (size > max_bytes){
+        return;
+    }
+    uint64_t key = key_for(request, rule);
+    std::unordered_map<uint64_t, Entry>::iterator it = entries.find(key);
+    if (it != entries.end()){
+        erase(it);
+    }
+    make_room(size, now_ms);
+    Entry &entry = entries[key];
+    entry.method = request.get_method();
+    entry.path = request.get_path();
+    for (size_t i = 0; i < rule.vary.size(); i++){
+        const std::string *value = find_header(request, rule.vary[i]);
+        entry.vary_values.push_back(value ? *value : std::string());
+    }
+    entry.bytes = response;
+    entry.expires_ms = now_ms + rule.ttl_ms;
+    bytes += size;
+    stores++;
+}
+
+void HDE::MicroCache::erase(std::unordered_map<uint64_t, Entry>::iterator it){
+    bytes -= it->second.bytes.size() + it->second.path.size() + MICRO_ENTRY_OVERHEAD;
+    entries.erase(it);
+}
+
+//Expired entries go first, then arbitrary ones, TTLs are short so the first pass usually suffices
+void HDE::MicroCache::make_room(size_t needed, int64_t now_ms){
+    if (bytes + needed <= max_bytes){
+        return;
+    }
+    for (std::unordered_map<uint64_t, Entry>::iterator it = entries.begin(); it != entries.end();){
+        std::unordered_map<uint64_t, Entry>::iterator next = it;
+        ++next;
+        if (it->second.expires_ms <= now_ms){
+            erase(it);
+            evictions++;
+        }
+        it = next;
+    }
+    while (bytes + needed > max_bytes && !entries.empty()){
+        erase(entries.begin());
+        evictions++;
+    }
+}
+
+size_t HDE::MicroCache::get_bytes(){
+    return bytes;
+}
+
+uint64_t HDE::MicroCache::get_hits(){
+    return hits;
+}
+
+uint64_t HDE::MicroCache::get_misses(){
+    return misses;
+}
+
+uint64_t HDE::MicroCache::get_stores(){
+    return stores;
+}
+
+uint64_t HDE::MicroCache::get_evictions(){
+    return evictions;
+}
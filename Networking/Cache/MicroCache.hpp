@@ -0,0 +1,56 @@
+#ifndef MicroCache_hpp
+#define MicroCache_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "../Http/HttpRequest.hpp"
+#include "../Http/Router.hpp"
+
+namespace HDE{
+    //Keeps fully serialized handler responses for a few milliseconds on opted-in routes,
+    //keyed by method, path and the route's vary headers, owned by one event loop
+    class MicroCache{
+        private:
+            struct Rule{
+                int ttl_ms;
+                std::vector<std::string> vary;
+            };
+            struct Entry{
+                std::string method;
+                std::string path;
+                std::vector<std::string> vary_values;
+                std::string bytes;
+                int64_t expires_ms;
+            };
+            std::vector<Rule> rules;
+            Router<int> routes;
+            std::unordered_map<uint64_t, Entry> entries;
+            size_t max_bytes;
+            size_t bytes;
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t stores;
+            uint64_t evictions;
+            int rule_for(HttpRequest &request);
+            uint64_t key_for(HttpRequest &request, const Rule &rule);
+            bool matches(const Entry &entry, HttpRequest &request, const Rule &rule);
+            void erase(std::unordered_map<uint64_t, Entry>::iterator it);
+            void make_room(size_t needed, int64_t now_ms);
+        public:
+            MicroCache(size_t max_bytes);
+            void add_route(const std::string &prefix, int ttl_ms, const std::vector<std::string> &vary);
+            bool is_cacheable(HttpRequest &request);
+            const std::string * lookup(HttpRequest &request, int64_t now_ms);
+            void store(HttpRequest &request, const std::string &response, int64_t now_ms);
+            size_t get_bytes();
+            uint64_t get_hits();
+            uint64_t get_misses();
+            uint64_t get_stores();
+            uint64_t get_evictions();
+    };
+}
+
+#endif
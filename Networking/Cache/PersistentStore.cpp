@@ -0,0 +1,326 @@
+#include "PersistentStore.hpp"
+#include <iostream>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mutex>
+
+#define STORE_MAGIC 0x4844454341434845ULL
+#define STORE_VERSION 1
+#define STORE_HEADER_SIZE 4096
+#define RECORD_MAGIC 0x52454331U
+#define STORE_WAYS 4
+
+//Geometry is fixed when the file is formatted, write_offset only grows and wraps modulo capacity
+struct HDE::PersistentStore::Header{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_crc;
+    uint64_t capacity;
+    uint64_t slot_count;
+    uint64_t write_offset;
+};
+
+struct HDE::PersistentStore::Slot{
+    uint64_t hash;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t crc;
+};
+
+struct RecordHead{
+    uint32_t magic;
+    uint32_t key_len;
+    uint32_t value_len;
+    uint32_t crc;
+};
+
+static uint64_t hash_bytes(const std::string &key){
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < key.size(); i++){
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+//Slicing-by-8 CRC-32, eight table lookups per eight bytes keeps recovery scans close to memory bandwidth
+uint32_t HDE::PersistentStore::crc32(uint32_t crc, const char *data, size_t len){
+    static uint32_t table[8][256];
+    static std::once_flag ready;
+    std::call_once(ready, [](){
+        for (uint32_t i = 0; i < 256; i++){
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++){
+                c = c & 1 ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+            }
+            table[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++){
+            for (int t = 1; t < 8; t++){
+                table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xff];
+            }
+        }
+    });
+    const unsigned char *bytes = (const unsigned char *)data;
+    crc = ~crc;
+    while (len >= 8){
+        uint32_t low = 0;
+        uint32_t high = 0;
+        memcpy(&low, bytes, 4);
+        memcpy(&high, bytes + 4, 4);
+        low ^= crc;
+        crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^ table[5][(low >> 16) & 0xff] ^ table[4][low >> 24] ^
+              table[3][high & 0xff] ^ table[2][(high >> 8) & 0xff] ^ table[1][(high >> 16) & 0xff] ^ table[0][high >> 24];
+        bytes += 8;
+        len -= 8;
+    }
+    while (len-- > 0){
+        crc = table[0][(crc ^ *bytes++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+//Constructor, an existing file is reused only if its header, version and geometry check out
+HDE::PersistentStore::PersistentStore(const std::string &path, size_t capacity, size_t slot_count){
+    this->path = path;
+    fd = -1;
+    map = NULL;
+    map_size = 0;
+    header = NULL;
+    slots = NULL;
+    data = NULL;
+    recovered = false;
+    puts = 0;
+    discarded = 0;
+    if (!open_file(capacity, slot_count)){
+        std::cerr << "Failed to open cache file " << path << ": " << strerror(errno) << std::endl;
+    }
+}
+
+HDE::PersistentStore::~PersistentStore(){
+    if (map != NULL){
+        munmap(map, map_size);
+    }
+    if (fd >= 0){
+        close(fd);
+    }
+}
+
+bool HDE::PersistentStore::open_file(size_t capacity, size_t slot_count){
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0){
+        return false;
+    }
+    map_size = STORE_HEADER_SIZE + slot_count * sizeof(Slot) + capacity;
+    struct stat st;
+    bool existing = fstat(fd, &st) == 0 && (size_t)st.st_size == map_size;
+    if (!existing && ftruncate(fd, map_size) < 0){
+        return false;
+    }
+    void *addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED){
+        return false;
+    }
+    map = (char *)addr;
+    header = (Header *)map;
+    slots = (Slot *)(map + STORE_HEADER_SIZE);
+    data = map + STORE_HEADER_SIZE + slot_count * sizeof(Slot);
+    recovered = existing && valid_header(capacity, slot_count);
+    if (!recovered){
+        format(capacity, slot_count);
+    }
+    return true;
+}
+
+bool HDE::PersistentStore::valid_header(size_t capacity, size_t slot_count){
+    Header copy = *header;
+    copy.header_crc = 0;
+    copy.write_offset = 0;
+    return header->magic == STORE_MAGIC && header->version == STORE_VERSION && header->capacity == capacity &&
+           header->slot_count == slot_count && header->header_crc == crc32(0, (const char *)&copy, sizeof(copy));
+}
+
+//Discards everything, the header is written last so a crash while formatting leaves an invalid file
+void HDE::PersistentStore::format(size_t capacity, size_t slot_count){
+    header->magic = 0;
+    memset(slots, 0, slot_count * sizeof(Slot));
+    Header fresh;
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.magic = STORE_MAGIC;
+    fresh.version = STORE_VERSION;
+    fresh.capacity = capacity;
+    fresh.slot_count = slot_count;
+    fresh.header_crc = crc32(0, (const char *)&fresh, sizeof(fresh));
+    fresh.write_offset = 0;
+    *header = fresh;
+    msync(map, map_size, MS_ASYNC);
+}
+
+bool HDE::PersistentStore::is_open(){
+    return map != NULL;
+}
+
+//True when an intact file from a previous run was mapped
+bool HDE::PersistentStore::was_recovered(){
+    return recovered;
+}
+
+//Appends the record to the ring then points the key's slot at it, a crash between the two loses only this record
+bool HDE::PersistentStore::put(const std::string &key, const char *value, size_t len){
+    if (map == NULL){
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t capacity = header->capacity;
+    size_t length = sizeof(RecordHead) + key.size() + len;
+    if (length > capacity / 4){
+        return false;
+    }
+    uint64_t offset = header->write_offset;
+    if (offset % capacity + length > capacity){
+        offset += capacity - offset % capacity;
+    }
+    RecordHead head;
+    head.magic = RECORD_MAGIC;
+    head.key_len = key.size();
+    head.value_len = len;
+    head.crc = 0;
+    char *record = data + offset % capacity;
+    memcpy(record + sizeof(RecordHead), key.data(), key.size());
+    memcpy(record + sizeof(RecordHead) + key.size(), value, len);
+    head.crc = crc32(crc32(0, (const char *)&head, sizeof(head)), record + sizeof(RecordHead), key.size() + len);
+    memcpy(record, &head, sizeof(head));
+    header->write_offset = offset + length;
+    Slot &slot = slot_for(hash_bytes(key), offset);
+    slot.hash = 0;
+    slot.offset = offset;
+    slot.length = length;
+    slot.crc = head.crc;
+    slot.hash = hash_bytes(key);
+    puts++;
+    return true;
+}
+
+//Each key may sit in any of STORE_WAYS consecutive slots, a slot holding the same key wins,
+//then an empty or overwritten one, then the one with the oldest record
+HDE::PersistentStore::Slot & HDE::PersistentStore::slot_for(uint64_t hash, uint64_t offset){
+    Slot *oldest = NULL;
+    for (int i = 0; i < STORE_WAYS; i++){
+        Slot &slot = slots[(hash + i) % header->slot_count];
+        if (slot.hash == hash){
+            return slot;
+        }
+        if (oldest == NULL || slot.offset < oldest->offset){
+            oldest = &slot;
+        }
+    }
+    for (int i = 0; i < STORE_WAYS; i++){
+        Slot &slot = slots[(hash + i) % header->slot_count];
+        if (slot.hash == 0 || offset - slot.offset > header->capacity){
+            return slot;
+        }
+    }
+    return *oldest;
+}
+
+//Checks that the slot's record is still inside the live part of the ring and intact
+bool HDE::PersistentStore::read_slot(const Slot &slot, std::string &key, const char *&value, size_t &len){
+    uint64_t capacity = header->capacity;
+    uint64_t end = header->write_offset;
+    if (slot.hash == 0 || slot.offset + slot.length > end || end - slot.offset > capacity ||
+        slot.length < sizeof(RecordHead) || slot.offset % capacity + slot.length > capacity){
+        return false;
+    }
+    const char *record = data + slot.offset % capacity;
+    RecordHead head;
+    memcpy(&head, record, sizeof(head));
+    if (head.magic != RECORD_MAGIC || head.crc != slot.crc || sizeof(RecordHead) + (uint64_t)head.key_len + head.value_len != slot.length){
+        return false;
+    }
+    uint32_t crc = head.crc;
+    head.crc = 0;
+    if (crc32(crc32(0, (const char *)&head, sizeof(head)), record + sizeof(RecordHead), head.key_len + head.value_len) != crc){
+        return false;
+    }
+    key.assign(record + sizeof(RecordHead), head.key_len);
+    value = record + sizeof(RecordHead) + head.key_len;
+    len = head.value_len;
+    return true;
+}
+
+bool HDE::PersistentStore::get(const std::string &key, std::string &value){
+    if (map == NULL){
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t hash = hash_bytes(key);
+    std::string stored;
+    const char *bytes = NULL;
+    size_t len = 0;
+    for (int i = 0; i < STORE_WAYS; i++){
+        Slot &slot = slots[(hash + i) % header->slot_count];
+        if (slot.hash == hash && read_slot(slot, stored, bytes, len) && stored == key){
+            value.assign(bytes, len);
+            return true;
+        }
+    }
+    return false;
+}
+
+void HDE::PersistentStore::remove(const std::string &key){
+    if (map == NULL){
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t hash = hash_bytes(key);
+    for (int i = 0; i < STORE_WAYS; i++){
+        Slot &slot = slots[(hash + i) % header->slot_count];
+        if (slot.hash == hash){
+            slot.hash = 0;
+        }
+    }
+}
+
+//Visits every intact record, damaged slots are cleared and counted in get_discarded()
+size_t HDE::PersistentStore::for_each(Visitor visit){
+    if (map == NULL){
+        return 0;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    size_t count = 0;
+    std::string key;
+    for (uint64_t i = 0; i < header->slot_count; i++){
+        const char *value = NULL;
+        size_t len = 0;
+        if (slots[i].hash == 0){
+            continue;
+        }
+        if (!read_slot(slots[i], key, value, len) || hash_bytes(key) != slots[i].hash){
+            slots[i].hash = 0;
+            discarded++;
+            continue;
+        }
+        visit(key, value, len);
+        count++;
+    }
+    return count;
+}
+
+//Starts write-back of dirty pages, the page cache already keeps them across a process crash
+void HDE::PersistentStore::sync(){
+    if (map != NULL){
+        msync(map, map_size, MS_ASYNC);
+    }
+}
+
+uint64_t HDE::PersistentStore::get_puts(){
+    return puts;
+}
+
+uint64_t HDE::PersistentStore::get_discarded(){
+    return discarded;
+}
@@ -0,0 +1,54 @@
+#ifndef PersistentStore_hpp
+#define PersistentStore_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <functional>
+#include <mutex>
+
+namespace HDE{
+    //Key-value records in a memory-mapped file that outlives the process, laid out as a header,
+    //a 4-way set-associative slot index and a data ring, every record carries a CRC so torn or stale ones are skipped,
+    //the visitor runs with the store locked and must not call back into it or take a lock held around store calls
+    class PersistentStore{
+        public:
+            typedef std::function<void(const std::string &key, const char *value, size_t len)> Visitor;
+        private:
+            struct Header;
+            struct Slot;
+            std::mutex lock;
+            std::string path;
+            int fd;
+            char *map;
+            size_t map_size;
+            Header *header;
+            Slot *slots;
+            char *data;
+            bool recovered;
+            uint64_t puts;
+            uint64_t discarded;
+            bool open_file(size_t capacity, size_t slot_count);
+            void format(size_t capacity, size_t slot_count);
+            bool valid_header(size_t capacity, size_t slot_count);
+            Slot & slot_for(uint64_t hash, uint64_t offset);
+            bool read_slot(const Slot &slot, std::string &key, const char *&value, size_t &len);
+            PersistentStore(const PersistentStore &);
+            PersistentStore & operator=(const PersistentStore &);
+        public:
+            PersistentStore(const std::string &path, size_t capacity, size_t slot_count);
+            ~PersistentStore();
+            bool is_open();
+            bool was_recovered();
+            bool put(const std::string &key, const char *value, size_t len);
+            bool get(const std::string &key, std::string &value);
+            void remove(const std::string &key);
+            size_t for_each(Visitor visit);
+            void sync();
+            uint64_t get_puts();
+            uint64_t get_discarded();
+            static uint32_t crc32(uint32_t crc, const char *data, size_t len);
+    };
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include "SingleFlight.hpp"
+
+//Constructor
+HDE::SingleFlight::SingleFlight(){
+    next_id = 0;
+    leaders = 0;
+    coalesced = 0;
+    abandoned = 0;
+}
+
+//Starts a flight, false when one is already running for key
+bool HDE::SingleFlight::begin(const std::string &key){
+    if (!flights.insert(std::make_pair(key, std::vector<Waiter>())).second){
+        return false;
+    }
+    leaders++;
+    return true;
+}
+
+//Waits on a running flight, returns a waiter id or 0 when there is no flight to join
+uint64_t HDE::SingleFlight::join(const std::string &key, Callback done){
+    std::unordered_map<std::string, std::vector<Waiter> >::iterator it = flights.find(key);
+    if (it == flights.end()){
+        return 0;
+    }
+    Waiter waiter;
+    waiter.id = ++next_id;
+    waiter.done = done;
+    it->second.push_back(waiter);
+    coalesced++;
+    return waiter.id;
+}
+
+//Stops waiting, used when a waiter times out or goes away
+void HDE::SingleFlight::leave(const std::string &key, uint64_t id){
+    std::unordered_map<std::string, std::vector<Waiter> >::iterator it = flights.find(key);
+    if (it == flights.end()){
+        return;
+    }
+    std::vector<Waiter> &waiters = it->second;
+    for (size_t i = 0; i < waiters.size(); i++){
+        if (waiters[i].id == id){
+            waiters.erase(waiters.begin() + i);
+            abandoned++;
+            return;
+        }
+    }
+}
+
+//Ends the flight then wakes its waiters, which may start new flights for the same key
+void HDE::SingleFlight::finish(const std::string &key){
+    std::unordered_map<std::string, std::vector<Waiter> >::iterator it = flights.find(key);
+    if (it == flights.end()){
+        return;
+    }
+    std::vector<Waiter> waiters;
+    waiters.swap(it->second);
+    flights.erase(it);
+    for (size_t i = 0; i < waiters.size(); i++){
+        waiters[i].done();
+    }
+}
+
+size_t HDE::SingleFlight::get_in_flight(){
+    return flights.size();
+}
+
+uint64_t HDE::SingleFlight::get_leaders(){
+    return leaders;
+}
+
+uint64_t HDE::SingleFlight::get_coalesced(){
+    return coalesced;
+}
+
+uint64_t HDE::SingleFlight::get_abandoned(){
+    return abandoned;
+}
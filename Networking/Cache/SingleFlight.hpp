@@ -0,0 +1,40 @@
+#ifndef SingleFlight_hpp
+#define SingleFlight_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+namespace HDE{
+    //Tracks one in-progress fetch per key so concurrent misses wait for it instead of repeating it,
+    //owned by one event loop and not thread safe
+    class SingleFlight{
+        public:
+            typedef std::function<void()> Callback;
+        private:
+            struct Waiter{
+                uint64_t id;
+                Callback done;
+            };
+            std::unordered_map<std::string, std::vector<Waiter> > flights;
+            uint64_t next_id;
+            uint64_t leaders;
+            uint64_t coalesced;
+            uint64_t abandoned;
+        public:
+            SingleFlight();
+            bool begin(const std::string &key);
+            uint64_t join(const std::string &key, Callback done);
+            void leave(const std::string &key, uint64_t id);
+            void finish(const std::string &key);
+            size_t get_in_flight();
+            uint64_t get_leaders();
+            uint64_t get_coalesced();
+            uint64_t get_abandoned();
+    };
+}
+
+#endif
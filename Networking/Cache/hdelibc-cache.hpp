@@ -0,0 +1,11 @@
+#ifndef hdelibc_cache_hpp
+#define hdelibc_cache_hpp
+
+#include <stdio.h>
+#include "HttpCache.hpp"
+#include "SingleFlight.hpp"
+#include "MicroCache.hpp"
+#include "PersistentStore.hpp"
+
+
+#endif
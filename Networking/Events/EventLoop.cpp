@@ -0,0 +1,206 @@
+#include "EventLoop.hpp"
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <iostream>
+#include <time.h>
+
+//Constructor
+HDE::EventLoop::EventLoop(){
+    running = false;
+    next_timer = 1;
+    busy_since.store(0);
+    current_fd.store(-1);
+    timer_lag = -1;
+    label_since = 0;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0){
+        perror("Failed to create event loop!");
+        exit(EXIT_FAILURE);
+    }
+}
+
+HDE::EventLoop::~EventLoop(){
+    close(epoll_fd);
+}
+
+int HDE::EventLoop::add(int fd, uint32_t events, Callback callback){
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0){
+        return -1;
+    }
+    callbacks[fd] = callback;
+    return 0;
+}
+
+int HDE::EventLoop::modify(int fd, uint32_t events){
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+int HDE::EventLoop::remove(int fd){
+    callbacks.erase(fd);
+    return epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int64_t HDE::EventLoop::now_ms(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int64_t HDE::EventLoop::now_us(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t HDE::EventLoop::now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//Wall-clock microseconds since the epoch, for timestamps that leave the process
+int64_t HDE::EventLoop::wall_us(){
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//Schedules a one-shot callback on the loop thread, returns an id for cancel_timer
+uint64_t HDE::EventLoop::run_after(int delay_ms, TimerCallback callback){
+    uint64_t id = next_timer++;
+    int64_t deadline = now_ms() + (delay_ms > 0 ? delay_ms : 0);
+    timers[std::make_pair(deadline, id)] = callback;
+    timer_deadlines[id] = deadline;
+    return id;
+}
+
+bool HDE::EventLoop::cancel_timer(uint64_t id){
+    std::unordered_map<uint64_t, int64_t>::iterator it = timer_deadlines.find(id);
+    if (it == timer_deadlines.end()){
+        return false;
+    }
+    timers.erase(std::make_pair(it->second, id));
+    timer_deadlines.erase(it);
+    return true;
+}
+
+size_t HDE::EventLoop::get_timer_count(){
+    return timers.size();
+}
+
+//Shortens the wait so the earliest timer fires on time
+int HDE::EventLoop::next_timeout(int timeout_ms){
+    if (timers.empty()){
+        return timeout_ms;
+    }
+    int64_t wait = timers.begin()->first.first - now_ms();
+    if (wait < 0){
+        wait = 0;
+    }
+    if (timeout_ms < 0 || wait < timeout_ms){
+        return (int)wait;
+    }
+    return timeout_ms;
+}
+
+void HDE::EventLoop::run_timers(){
+    int64_t now = now_ms();
+    while (!timers.empty() && timers.begin()->first.first <= now){
+        std::map<std::pair<int64_t, uint64_t>, TimerCallback>::iterator it = timers.begin();
+        if (observer){
+            int64_t lag = now_ns() - it->first.first * 1000000;
+            timer_lag = lag > timer_lag ? lag : timer_lag;
+        }
+        TimerCallback callback = it->second;
+        timer_deadlines.erase(it->first.second);
+        timers.erase(it);
+        callback();
+    }
+}
+
+//Waits once, dispatches ready descriptors and due timers, returns the number of descriptors dispatched
+int HDE::EventLoop::run_once(int timeout_ms){
+    struct epoll_event events[64];
+    int ready = epoll_wait(epoll_fd, events, 64, next_timeout(timeout_ms));
+    if (ready < 0){
+        if (errno != EINTR){
+            std::cerr << "Event loop wait failed: " << strerror(errno) << std::endl;
+        }
+        ready = 0;
+    }
+    int64_t woke = 0;
+    if (observer){
+        woke = now_ns();
+        busy_since.store(woke, std::memory_order_release);
+        timer_lag = -1;
+    }
+    for (int i = 0; i < ready; i++){
+        // A callback may remove any descriptor, including ones later in this batch
+        std::unordered_map<int, Callback>::iterator it = callbacks.find(events[i].data.fd);
+        if (it == callbacks.end()){
+            continue;
+        }
+        Callback callback = it->second;
+        current_fd.store(events[i].data.fd, std::memory_order_relaxed);
+        callback(events[i].events);
+    }
+    current_fd.store(-1, std::memory_order_relaxed);
+    run_timers();
+    if (observer){
+        busy_since.store(0, std::memory_order_release);
+        observer(now_ns() - woke, timer_lag);
+    }
+    return ready;
+}
+
+void HDE::EventLoop::run(){
+    running = true;
+    while (running){
+        run_once(-1);
+    }
+}
+
+void HDE::EventLoop::stop(){
+    running = false;
+}
+
+int HDE::EventLoop::get_epoll_fd(){
+    return epoll_fd;
+}
+
+//Enables the monitoring state, an empty observer turns it off again
+void HDE::EventLoop::set_observer(IterationObserver observer){
+    this->observer = observer;
+    busy_since.store(0);
+}
+
+int64_t HDE::EventLoop::get_busy_since(){
+    return busy_since.load(std::memory_order_acquire);
+}
+
+//Descriptor whose callback is running, -1 between callbacks and while timers run
+int HDE::EventLoop::get_current_fd(){
+    return current_fd.load(std::memory_order_relaxed);
+}
+
+//Names the work in progress for stall reports, the label belongs to the iteration that set it
+void HDE::EventLoop::set_label(const std::string &label){
+    std::lock_guard<std::mutex> guard(label_lock);
+    this->label = label;
+    label_since = busy_since.load(std::memory_order_relaxed);
+}
+
+//The label set during the iteration that started at since, empty if that iteration set none
+std::string HDE::EventLoop::get_label(int64_t since){
+    std::lock_guard<std::mutex> guard(label_lock);
+    return label_since == since ? label : std::string();
+}
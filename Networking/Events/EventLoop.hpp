@@ -0,0 +1,64 @@
+#ifndef EventLoop_hpp
+#define EventLoop_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <functional>
+#include <unordered_map>
+#include <map>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <sys/epoll.h>
+
+namespace HDE{
+    class EventLoop{
+        public:
+            typedef std::function<void(uint32_t events)> Callback;
+            typedef std::function<void()> TimerCallback;
+            //Called at the end of every iteration with the time spent dispatching and the lateness of the
+            //latest due timer, lag_ns is -1 when no timer ran
+            typedef std::function<void(int64_t busy_ns, int64_t lag_ns)> IterationObserver;
+        private:
+            int epoll_fd;
+            bool running;
+            uint64_t next_timer;
+            std::unordered_map<int, Callback> callbacks;
+            std::map<std::pair<int64_t, uint64_t>, TimerCallback> timers;
+            std::unordered_map<uint64_t, int64_t> timer_deadlines;
+            IterationObserver observer;
+            std::atomic<int64_t> busy_since;
+            std::atomic<int> current_fd;
+            int64_t timer_lag;
+            std::mutex label_lock;
+            std::string label;
+            int64_t label_since;
+            int next_timeout(int timeout_ms);
+            void run_timers();
+        public:
+            EventLoop();
+            ~EventLoop();
+            int add(int fd, uint32_t events, Callback callback);
+            int modify(int fd, uint32_t events);
+            int remove(int fd);
+            uint64_t run_after(int delay_ms, TimerCallback callback);
+            bool cancel_timer(uint64_t id);
+            size_t get_timer_count();
+            int run_once(int timeout_ms);
+            void run();
+            void stop();
+            int get_epoll_fd();
+            void set_observer(IterationObserver observer);
+            //Monitoring state other threads may read while the loop runs, busy_since is 0 while waiting
+            int64_t get_busy_since();
+            int get_current_fd();
+            void set_label(const std::string &label);
+            std::string get_label(int64_t since);
+            static int64_t now_ms();
+            static int64_t now_us();
+            static int64_t now_ns();
+            static int64_t wall_us();
+    };
+}
+
+#endif
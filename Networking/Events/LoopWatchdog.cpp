@@ -0,0 +1,141 @@
+#include "LoopWatchdog.hpp"
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <errno.h>
+#include <execinfo.h>
+
+//Runs on the stalled thread, backtrace_symbols_fd doesn't allocate
+static void dump_stack(int){
+    static const char header[] = "--- Stalled event loop stack ---\n";
+    // The interrupted code may be about to read errno
+    int saved_errno = errno;
+    void *frames[64];
+    ssize_t ignored = write(STDERR_FILENO, header, sizeof(header) - 1);
+    (void)ignored;
+    int count = backtrace(frames, 64);
+    backtrace_symbols_fd(frames, count, STDERR_FILENO);
+    errno = saved_errno;
+}
+
+//Constructor, metrics may be NULL to only report stalls
+HDE::LoopWatchdog::LoopWatchdog(LoopWatchdogConfig config, MetricsRegistry *metrics){
+    this->config = config;
+    this->metrics = metrics;
+    stalls.store(0);
+    if (config.stack_traces){
+        // The first backtrace() loads libgcc, which must not happen inside the signal handler
+        void *frame;
+        backtrace(&frame, 1);
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = dump_stack;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(WATCHDOG_STACK_SIGNAL, &action, NULL);
+    }
+    running.store(true);
+    monitor = std::thread(&LoopWatchdog::run, this);
+}
+
+HDE::LoopWatchdog::~LoopWatchdog(){
+    stop();
+    for (size_t i = 0; i < loops.size(); i++){
+        loops[i]->loop->cancel_timer(loops[i]->probe_timer);
+        loops[i]->loop->set_observer(EventLoop::IterationObserver());
+        delete loops[i];
+    }
+}
+
+void HDE::LoopWatchdog::stop(){
+    if (!running.exchange(false)){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        wake.notify_one();
+    }
+    monitor.join();
+}
+
+void HDE::LoopWatchdog::watch(EventLoop *loop, const std::string &name){
+    Watched *watched = new Watched();
+    watched->loop = loop;
+    watched->name = name;
+    watched->thread = pthread_self();
+    watched->iteration_metric = -1;
+    watched->lag_metric = -1;
+    watched->stall_metric = -1;
+    watched->reported = 0;
+    if (metrics != NULL){
+        watched->iteration_metric = metrics->add_latency("hdelibc_loop_iteration_seconds{loop=\"" + name + "\"}", "Time each event loop iteration spent dispatching");
+        watched->lag_metric = metrics->add_latency("hdelibc_loop_lag_seconds{loop=\"" + name + "\"}", "How late due timers ran");
+        watched->stall_metric = metrics->add_counter("hdelibc_loop_stalls_total{loop=\"" + name + "\"}", "Iterations that ran past the watchdog threshold");
+    }
+    MetricsRegistry *metrics = this->metrics;
+    loop->set_observer([metrics, watched](int64_t busy_ns, int64_t lag_ns){
+        if (metrics != NULL){
+            metrics->record_ns(watched->iteration_metric, busy_ns);
+            if (lag_ns >= 0){
+                metrics->record_ns(watched->lag_metric, lag_ns);
+            }
+        }
+    });
+    watched->probe_timer = loop->run_after(config.probe_ms, [this, watched](){ probe(watched); });
+    std::lock_guard<std::mutex> guard(lock);
+    loops.push_back(watched);
+}
+
+//Does nothing but re-arm, the loop measures how late it ran
+void HDE::LoopWatchdog::probe(Watched *watched){
+    watched->probe_timer = watched->loop->run_after(config.probe_ms, [this, watched](){ probe(watched); });
+}
+
+void HDE::LoopWatchdog::run(){
+    std::unique_lock<std::mutex> guard(lock);
+    while (running.load()){
+        int64_t now = EventLoop::now_ns();
+        for (size_t i = 0; i < loops.size(); i++){
+            check(loops[i], now);
+        }
+        wake.wait_for(guard, std::chrono::milliseconds(config.poll_ms));
+    }
+}
+
+//A stall is reported once, when it first crosses the threshold
+void HDE::LoopWatchdog::check(Watched *watched, int64_t now){
+    int64_t since = watched->loop->get_busy_since();
+    if (since == 0 || since == watched->reported || now - since < (int64_t)config.threshold_ms * 1000000){
+        return;
+    }
+    watched->reported = since;
+    stalls.fetch_add(1);
+    if (metrics != NULL){
+        metrics->increment(watched->stall_metric);
+    }
+    int fd = watched->loop->get_current_fd();
+    std::string label = watched->loop->get_label(since);
+    // Runs under lock, which also guards last_report
+    last_report = "Event loop " + watched->name + " stalled for " + std::to_string((now - since) / 1000000) + "ms";
+    if (fd >= 0){
+        last_report += " in descriptor " + std::to_string(fd);
+    } else {
+        last_report += " in a timer";
+    }
+    if (!label.empty()){
+        last_report += " serving " + label;
+    }
+    std::cerr << last_report << std::endl;
+    if (config.stack_traces){
+        pthread_kill(watched->thread, WATCHDOG_STACK_SIGNAL);
+    }
+}
+
+uint64_t HDE::LoopWatchdog::get_stalls(){
+    return stalls.load();
+}
+
+std::string HDE::LoopWatchdog::get_last_report(){
+    std::lock_guard<std::mutex> guard(lock);
+    return last_report;
+}
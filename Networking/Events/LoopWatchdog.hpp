@@ -0,0 +1,71 @@
+#ifndef LoopWatchdog_hpp
+#define LoopWatchdog_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <pthread.h>
+#include <signal.h>
+#include "EventLoop.hpp"
+#include "../Metrics/MetricsRegistry.hpp"
+
+//Sent to a stalled loop's thread to print its stack
+#define WATCHDOG_STACK_SIGNAL SIGUSR2
+
+namespace HDE{
+    struct LoopWatchdogConfig{
+        int threshold_ms;
+        int poll_ms;
+        int probe_ms;
+        bool stack_traces;
+    };
+
+    //Records each watched loop's iteration time and timer lag as latency histograms, and a background thread
+    //that polls every poll_ms and reports any iteration running past threshold_ms once, naming the descriptor
+    //and label being served. With stack_traces the stalled thread prints its own backtrace to stderr.
+    //A probe timer every probe_ms keeps lag measured while the loop is otherwise idle
+    class LoopWatchdog{
+        private:
+            struct Watched{
+                EventLoop *loop;
+                std::string name;
+                pthread_t thread;
+                int iteration_metric;
+                int lag_metric;
+                int stall_metric;
+                uint64_t probe_timer;
+                int64_t reported;
+            };
+            LoopWatchdogConfig config;
+            MetricsRegistry *metrics;
+            std::vector<Watched *> loops;
+            std::atomic<bool> running;
+            std::mutex lock;
+            std::condition_variable wake;
+            std::thread monitor;
+            std::atomic<uint64_t> stalls;
+            std::string last_report;
+            void run();
+            void check(Watched *watched, int64_t now);
+            void probe(Watched *watched);
+            LoopWatchdog(const LoopWatchdog &);
+            LoopWatchdog & operator=(const LoopWatchdog &);
+        public:
+            LoopWatchdog(LoopWatchdogConfig config, MetricsRegistry *metrics);
+            ~LoopWatchdog();
+            //Call on the loop's own thread before it runs, the watchdog must be destroyed on that thread
+            //or after the loop has stopped
+            void watch(EventLoop *loop, const std::string &name);
+            void stop();
+            uint64_t get_stalls();
+            //The most recent stall line printed to stderr, empty before the first stall
+            std::string get_last_report();
+    };
+}
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef hdelibc_events_hpp
+#define hdelibc_events_hpp
+
+#include <stdio.h>
+#include "EventLoop.hpp"
+#include "LoopWatchdog.hpp"
+
+
+#endif
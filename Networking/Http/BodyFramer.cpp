@@ -0,0 +1,130 @@
+#include "BodyFramer.hpp"
+
+//Constructor
+HDE::BodyFramer::BodyFramer(){
+    reset(NO_BODY, 0);
+}
+
+void HDE::BodyFramer::reset(Mode mode, uint64_t length){
+    this->mode = mode;
+    state = CHUNK_SIZE;
+    remaining = length;
+    error = false;
+    done = mode == NO_BODY || (mode == LENGTH && length == 0);
+}
+
+//Returns how many of the bytes belong to the body, anything after that starts the next message
+size_t HDE::BodyFramer::feed(const char *data, size_t len){
+    if (done || error){
+        return 0;
+    }
+    if (mode == UNTIL_CLOSE){
+        return len;
+    }
+    if (mode == LENGTH){
+        size_t n = remaining < len ? (size_t)remaining : len;
+        remaining -= n;
+        done = remaining == 0;
+        return n;
+    }
+    size_t i = 0;
+    while (i < len && !done && !error){
+        char c = data[i];
+        switch (state){
+            case CHUNK_SIZE:
+                if (c >= '0' && c <= '9'){
+                    remaining = remaining * 16 + (c - '0');
+                } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f'){
+                    remaining = remaining * 16 + ((c | 0x20) - 'a' + 10);
+                } else if (c == ';' || c == ' ' || c == '\t'){
+                    state = CHUNK_EXTENSION;
+                } else if (c == '\r'){
+                    state = CHUNK_SIZE_LF;
+                } else {
+                    error = true;
+                }
+                if (remaining > ((uint64_t)1 << 48)){
+                    error = true;
+                }
+                i++;
+                break;
+            case CHUNK_EXTENSION:
+                if (c == '\r'){
+                    state = CHUNK_SIZE_LF;
+                }
+                i++;
+                break;
+            case CHUNK_SIZE_LF:
+                if (c != '\n'){
+                    error = true;
+                }
+                state = remaining == 0 ? TRAILER_START : CHUNK_DATA;
+                i++;
+                break;
+            case CHUNK_DATA:{
+                size_t n = len - i;
+                if (n > remaining){
+                    n = (size_t)remaining;
+                }
+                remaining -= n;
+                i += n;
+                if (remaining == 0){
+                    state = CHUNK_DATA_CR;
+                }
+                break;
+            }
+            case CHUNK_DATA_CR:
+                error = c != '\r';
+                state = CHUNK_DATA_LF;
+                i++;
+                break;
+            case CHUNK_DATA_LF:
+                error = c != '\n';
+                state = CHUNK_SIZE;
+                i++;
+                break;
+            case TRAILER_START:
+                state = c == '\r' ? FINAL_LF : TRAILER_LINE;
+                i++;
+                break;
+            case TRAILER_LINE:
+                if (c == '\r'){
+                    state = TRAILER_LF;
+                }
+                i++;
+                break;
+            case TRAILER_LF:
+                error = c != '\n';
+                state = TRAILER_START;
+                i++;
+                break;
+            case FINAL_LF:
+                error = c != '\n';
+                done = !error;
+                i++;
+                break;
+        }
+    }
+    return i;
+}
+
+//End of stream completes a close-delimited body, any other unfinished body is truncated
+void HDE::BodyFramer::finish_on_close(){
+    if (mode == UNTIL_CLOSE){
+        done = true;
+    } else if (!done){
+        error = true;
+    }
+}
+
+HDE::BodyFramer::Mode HDE::BodyFramer::get_mode(){
+    return mode;
+}
+
+bool HDE::BodyFramer::is_done(){
+    return done;
+}
+
+bool HDE::BodyFramer::is_error(){
+    return error;
+}
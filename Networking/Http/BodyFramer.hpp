@@ -0,0 +1,46 @@
+#ifndef BodyFramer_hpp
+#define BodyFramer_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+
+namespace HDE{
+    //Finds where a message body ends without decoding it, so bodies can be forwarded verbatim
+    class BodyFramer{
+        public:
+            enum Mode{
+                NO_BODY,
+                LENGTH,
+                CHUNKED,
+                UNTIL_CLOSE
+            };
+        private:
+            enum ChunkState{
+                CHUNK_SIZE,
+                CHUNK_EXTENSION,
+                CHUNK_SIZE_LF,
+                CHUNK_DATA,
+                CHUNK_DATA_CR,
+                CHUNK_DATA_LF,
+                TRAILER_START,
+                TRAILER_LINE,
+                TRAILER_LF,
+                FINAL_LF
+            };
+            Mode mode;
+            ChunkState state;
+            uint64_t remaining;
+            bool done;
+            bool error;
+        public:
+            BodyFramer();
+            void reset(Mode mode, uint64_t length);
+            size_t feed(const char *data, size_t len);
+            void finish_on_close();
+            Mode get_mode();
+            bool is_done();
+            bool is_error();
+    };
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "CacheControl.hpp"
+#include <time.h>
+#include <strings.h>
+
+static int64_t parse_seconds(const std::string &value){
+    size_t start = 0;
+    size_t end = value.size();
+    if (end - start >= 2 && value[start] == '"' && value[end - 1] == '"'){
+        start++;
+        end--;
+    }
+    if (start == end || end - start > 12){
+        return -1;
+    }
+    int64_t seconds = 0;
+    for (size_t i = start; i < end; i++){
+        if (value[i] < '0' || value[i] > '9'){
+            return -1;
+        }
+        seconds = seconds * 10 + (value[i] - '0');
+    }
+    return seconds;
+}
+
+//Directives are comma separated, unknown ones are ignored as RFC 9111 requires
+HDE::CacheControl HDE::parse_cache_control(const std::string &value){
+    CacheControl cc = {false, false, false, false, false, -1, -1, -1};
+    size_t start = 0;
+    while (start < value.size()){
+        size_t end = value.find(',', start);
+        if (end == std::string::npos){
+            end = value.size();
+        }
+        while (start < end && (value[start] == ' ' || value[start] == '\t')){
+            start++;
+        }
+        size_t stop = end;
+        while (stop > start && (value[stop - 1] == ' ' || value[stop - 1] == '\t')){
+            stop--;
+        }
+        std::string directive = value.substr(start, stop - start);
+        std::string argument;
+        size_t eq = directive.find('=');
+        if (eq != std::string::npos){
+            argument = directive.substr(eq + 1);
+            directive.resize(eq);
+        }
+        const char *name = directive.c_str();
+        if (strcasecmp(name, "no-store") == 0){
+            cc.no_store = true;
+        } else if (strcasecmp(name, "no-cache") == 0){
+            cc.no_cache = true;
+        } else if (strcasecmp(name, "private") == 0){
+            cc.is_private = true;
+        } else if (strcasecmp(name, "public") == 0){
+            cc.is_public = true;
+        } else if (strcasecmp(name, "must-revalidate") == 0 || strcasecmp(name, "proxy-revalidate") == 0){
+            cc.must_revalidate = true;
+        } else if (strcasecmp(name, "max-age") == 0){
+            cc.max_age = parse_seconds(argument);
+        } else if (strcasecmp(name, "s-maxage") == 0){
+            cc.s_maxage = parse_seconds(argument);
+        } else if (strcasecmp(name, "stale-while-revalidate") == 0){
+            cc.stale_while_revalidate = parse_seconds(argument);
+        }
+        start = end + 1;
+    }
+    return cc;
+}
+
+//Parses an IMF-fixdate such as "Sun, 06 Nov 1994 08:49:37 GMT" into seconds since the epoch
+bool HDE::parse_http_date(const std::string &value, int64_t &seconds){
+    struct tm tm = {};
+    const char *end = strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == NULL || *end != '\0'){
+        return false;
+    }
+    seconds = timegm(&tm);
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef CacheControl_hpp
+#define CacheControl_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+namespace HDE{
+    //Cache-Control directives, numeric values are seconds or -1 when absent
+    struct CacheControl{
+        bool no_store;
+        bool no_cache;
+        bool is_private;
+        bool is_public;
+        bool must_revalidate;
+        int64_t max_age;
+        int64_t s_maxage;
+        int64_t stale_while_revalidate;
+    };
+
+    CacheControl parse_cache_control(const std::string &value);
+    bool parse_http_date(const std::string &value, int64_t &seconds);
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include "HttpRequest.hpp"
+#include <cstring>
+#include <strings.h>
+
+bool HDE::header_name_equals(const std::string &a, const std::string &b){
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+//Checks a comma separated header value such as Connection for a token, ignoring case
+bool HDE::header_has_token(const std::string &value, const std::string &token){
+    size_t start = 0;
+    while (start <= value.size()){
+        size_t end = value.find(',', start);
+        if (end == std::string::npos){
+            end = value.size();
+        }
+        size_t a = start;
+        size_t b = end;
+        while (a < b && (value[a] == ' ' || value[a] == '\t')){
+            a++;
+        }
+        while (b > a && (value[b - 1] == ' ' || value[b - 1] == '\t')){
+            b--;
+        }
+        if (b - a == token.size() && strncasecmp(value.data() + a, token.data(), token.size()) == 0){
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+//Constructor
+HDE::HttpRequest::HttpRequest(){
+    header_length = 0;
+}
+
+//Parses the request line and headers, returns the header length, 0 if incomplete or -1 if malformed
+int HDE::HttpRequest::parse(const char *data, size_t len){
+    const char *end = (const char *)memmem(data, len, "\r\n\r\n", 4);
+    if (end == NULL){
+        return 0;
+    }
+    headers.clear();
+    const char *line = data;
+    const char *line_end = (const char *)memmem(line, end + 2 - line, "\r\n", 2);
+    const char *sp1 = (const char *)memchr(line, ' ', line_end - line);
+    const char *sp2 = sp1 ? (const char *)memchr(sp1 + 1, ' ', line_end - sp1 - 1) : NULL;
+    if (sp1 == NULL || sp2 == NULL){
+        return -1;
+    }
+    method.assign(line, sp1 - line);
+    path.assign(sp1 + 1, sp2 - sp1 - 1);
+    version.assign(sp2 + 1, line_end - sp2 - 1);
+    line = line_end + 2;
+    while (line < end + 2){
+        line_end = (const char *)memmem(line, end + 2 - line, "\r\n", 2);
+        const char *colon = (const char *)memchr(line, ':', line_end - line);
+        if (colon == NULL){
+            return -1;
+        }
+        const char *value = colon + 1;
+        while (value < line_end && (*value == ' ' || *value == '\t')){
+            value++;
+        }
+        const char *value_end = line_end;
+        while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')){
+            value_end--;
+        }
+        headers.push_back(std::make_pair(std::string(line, colon - line), std::string(value, value_end - value)));
+        line = line_end + 2;
+    }
+    header_length = end + 4 - data;
+    return header_length;
+}
+
+const std::string & HDE::HttpRequest::get_method(){
+    return method;
+}
+
+const std::string & HDE::HttpRequest::get_path(){
+    return path;
+}
+
+const std::string & HDE::HttpRequest::get_version(){
+    return version;
+}
+
+//Header lookup is case-insensitive, missing headers return an empty string
+std::string HDE::HttpRequest::get_header(const std::string &name){
+    for (size_t i = 0; i < headers.size(); i++){
+        if (header_name_equals(headers[i].first, name)){
+            return headers[i].second;
+        }
+    }
+    return "";
+}
+
+bool HDE::HttpRequest::has_header(const std::string &name){
+    for (size_t i = 0; i < headers.size(); i++){
+        if (header_name_equals(headers[i].first, name)){
+            return true;
+        }
+    }
+    return false;
+}
+
+HDE::HttpRequest::Headers & HDE::HttpRequest::get_headers(){
+    return headers;
+}
+
+size_t HDE::HttpRequest::get_header_length(){
+    return header_length;
+}
@@ -0,0 +1,35 @@
+#ifndef HttpRequest_hpp
+#define HttpRequest_hpp
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace HDE{
+    class HttpRequest{
+        public:
+            typedef std::vector<std::pair<std::string, std::string> > Headers;
+        private:
+            std::string method;
+            std::string path;
+            std::string version;
+            Headers headers;
+            size_t header_length;
+        public:
+            HttpRequest();
+            int parse(const char *data, size_t len);
+            const std::string & get_method();
+            const std::string & get_path();
+            const std::string & get_version();
+            std::string get_header(const std::string &name);
+            bool has_header(const std::string &name);
+            Headers & get_headers();
+            size_t get_header_length();
+    };
+
+    bool header_name_equals(const std::string &a, const std::string &b);
+    bool header_has_token(const std::string &value, const std::string &token);
+}
+
+#endif
@@ -0,0 +1,149 @@
+#include "HttpResponse.hpp"
+#include <cstring>
+#include <stdlib.h>
+
+//Constructor
+HDE::HttpResponse::HttpResponse(){
+    version = "HTTP/1.1";
+    status = 0;
+    header_length = 0;
+}
+
+HDE::HttpResponse::HttpResponse(int status, const std::string &reason){
+    version = "HTTP/1.1";
+    this->status = status;
+    this->reason = reason;
+    header_length = 0;
+}
+
+//Parses the status line and headers, returns the header length, 0 if incomplete or -1 if malformed
+int HDE::HttpResponse::parse(const char *data, size_t len){
+    const char *end = (const char *)memmem(data, len, "\r\n\r\n", 4);
+    if (end == NULL){
+        return 0;
+    }
+    headers.clear();
+    const char *line_end = (const char *)memmem(data, end + 2 - data, "\r\n", 2);
+    const char *sp1 = (const char *)memchr(data, ' ', line_end - data);
+    if (sp1 == NULL || line_end - sp1 < 4){
+        return -1;
+    }
+    version.assign(data, sp1 - data);
+    status = atoi(std::string(sp1 + 1, 3).c_str());
+    if (status < 100 || status > 999){
+        return -1;
+    }
+    const char *reason_start = sp1 + 4 < line_end ? sp1 + 5 : line_end;
+    reason.assign(reason_start, line_end - reason_start);
+    const char *line = line_end + 2;
+    while (line < end + 2){
+        line_end = (const char *)memmem(line, end + 2 - line, "\r\n", 2);
+        const char *colon = (const char *)memchr(line, ':', line_end - line);
+        if (colon == NULL){
+            return -1;
+        }
+        const char *value = colon + 1;
+        while (value < line_end && (*value == ' ' || *value == '\t')){
+            value++;
+        }
+        const char *value_end = line_end;
+        while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')){
+            value_end--;
+        }
+        headers.push_back(std::make_pair(std::string(line, colon - line), std::string(value, value_end - value)));
+        line = line_end + 2;
+    }
+    header_length = end + 4 - data;
+    return header_length;
+}
+
+int HDE::HttpResponse::get_status(){
+    return status;
+}
+
+std::string HDE::HttpResponse::get_reason(){
+    return reason;
+}
+
+std::string HDE::HttpResponse::get_version(){
+    return version;
+}
+
+std::string HDE::HttpResponse::get_header(const std::string &name){
+    for (size_t i = 0; i < headers.size(); i++){
+        if (header_name_equals(headers[i].first, name)){
+            return headers[i].second;
+        }
+    }
+    return "";
+}
+
+bool HDE::HttpResponse::has_header(const std::string &name){
+    for (size_t i = 0; i < headers.size(); i++){
+        if (header_name_equals(headers[i].first, name)){
+            return true;
+        }
+    }
+    return false;
+}
+
+HDE::HttpRequest::Headers & HDE::HttpResponse::get_headers(){
+    return headers;
+}
+
+//Replaces every existing value of the header
+void HDE::HttpResponse::set_header(const std::string &name, const std::string &value){
+    remove_header(name);
+    add_header(name, value);
+}
+
+void HDE::HttpResponse::add_header(const std::string &name, const std::string &value){
+    headers.push_back(std::make_pair(name, value));
+}
+
+void HDE::HttpResponse::remove_header(const std::string &name){
+    for (size_t i = 0; i < headers.size();){
+        if (header_name_equals(headers[i].first, name)){
+            headers.erase(headers.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void HDE::HttpResponse::set_body(const std::string &body){
+    this->body = body;
+}
+
+std::string & HDE::HttpResponse::get_body(){
+    return body;
+}
+
+size_t HDE::HttpResponse::get_header_length(){
+    return header_length;
+}
+
+std::string HDE::HttpResponse::serialize_head(){
+    std::string out;
+    out.reserve(64 + headers.size() * 32);
+    out += version;
+    out += ' ';
+    out += std::to_string(status);
+    out += ' ';
+    out += reason;
+    out += "\r\n";
+    for (size_t i = 0; i < headers.size(); i++){
+        out += headers[i].first;
+        out += ": ";
+        out += headers[i].second;
+        out += "\r\n";
+    }
+    out += "\r\n";
+    return out;
+}
+
+//Serializes head and body, setting Content-Length from the body
+std::string HDE::HttpResponse::to_string(){
+    set_header("Content-Length", std::to_string(body.size()));
+    return serialize_head() + body;
+}
@@ -0,0 +1,38 @@
+#ifndef HttpResponse_hpp
+#define HttpResponse_hpp
+
+#include <stdio.h>
+#include <string>
+#include "HttpRequest.hpp"
+
+namespace HDE{
+    class HttpResponse{
+        private:
+            std::string version;
+            int status;
+            std::string reason;
+            HttpRequest::Headers headers;
+            std::string body;
+            size_t header_length;
+        public:
+            HttpResponse();
+            HttpResponse(int status, const std::string &reason);
+            int parse(const char *data, size_t len);
+            int get_status();
+            std::string get_reason();
+            std::string get_version();
+            std::string get_header(const std::string &name);
+            bool has_header(const std::string &name);
+            HttpRequest::Headers & get_headers();
+            void set_header(const std::string &name, const std::string &value);
+            void add_header(const std::string &name, const std::string &value);
+            void remove_header(const std::string &name);
+            void set_body(const std::string &body);
+            std::string & get_body();
+            size_t get_header_length();
+            std::string serialize_head();
+            std::string to_string();
+    };
+}
+
+#endif
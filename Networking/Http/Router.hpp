@@ -0,0 +1,55 @@
+#ifndef Router_hpp
+#define Router_hpp
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace HDE{
+    //Maps path prefixes to per-route settings, the longest matching prefix wins
+    template <typename T>
+    class Router{
+        private:
+            std::vector<std::pair<std::string, T> > routes;
+            T fallback;
+        public:
+            Router(T fallback) : fallback(fallback){}
+
+            void add(const std::string &prefix, T value){
+                for (size_t i = 0; i < routes.size(); i++){
+                    if (routes[i].first == prefix){
+                        routes[i].second = value;
+                        return;
+                    }
+                }
+                routes.push_back(std::make_pair(prefix, value));
+            }
+
+            const T & match(const std::string &path) const{
+                const T *best = &fallback;
+                size_t best_length = 0;
+                for (size_t i = 0; i < routes.size(); i++){
+                    const std::string &prefix = routes[i].first;
+                    if (prefix.size() >= best_length && path.compare(0, prefix.size(), prefix) == 0){
+                        best = &routes[i].second;
+                        best_length = prefix.size();
+                    }
+                }
+                return *best;
+            }
+
+            const std::string & match_prefix(const std::string &path) const{
+                static const std::string none;
+                const std::string *best = &none;
+                for (size_t i = 0; i < routes.size(); i++){
+                    const std::string &prefix = routes[i].first;
+                    if (prefix.size() >= best->size() && path.compare(0, prefix.size(), prefix) == 0){
+                        best = &prefix;
+                    }
+                }
+                return *best;
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef hdelibc_http_hpp
+#define hdelibc_http_hpp
+
+#include <stdio.h>
+#include "HttpRequest.hpp"
+#include "Router.hpp"
+#include "HttpResponse.hpp"
+#include "BodyFramer.hpp"
+#include "CacheControl.hpp"
+
+
+#endif
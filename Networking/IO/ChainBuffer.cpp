@@ -0,0 +1,205 @@
+#include "ChainBuffer.hpp"
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#define CHAIN_MAX_IOV 16
+#define CHAIN_MAX_SPARE 4
+
+//Constructor
+HDE::ChainBuffer::ChainBuffer(size_t block_size){
+    this->block_size = block_size;
+    total = 0;
+}
+
+HDE::ChainBuffer::~ChainBuffer(){
+    clear();
+    for (size_t i = 0; i < spare.size(); i++){
+        delete[] spare[i];
+    }
+}
+
+HDE::ChainBuffer::Block HDE::ChainBuffer::new_block(){
+    Block block;
+    if (!spare.empty()){
+        block.data = spare.back();
+        spare.pop_back();
+    } else {
+        block.data = new char[block_size];
+    }
+    block.start = 0;
+    block.end = 0;
+    return block;
+}
+
+void HDE::ChainBuffer::free_block(Block block){
+    if (spare.size() < CHAIN_MAX_SPARE){
+        spare.push_back(block.data);
+    } else {
+        delete[] block.data;
+    }
+}
+
+size_t HDE::ChainBuffer::size() const{
+    return total;
+}
+
+bool HDE::ChainBuffer::empty() const{
+    return total == 0;
+}
+
+void HDE::ChainBuffer::clear(){
+    while (!blocks.empty()){
+        free_block(blocks.front());
+        blocks.pop_front();
+    }
+    total = 0;
+}
+
+void HDE::ChainBuffer::append(const char *data, size_t len){
+    while (len > 0){
+        if (blocks.empty() || blocks.back().end == block_size){
+            blocks.push_back(new_block());
+        }
+        Block &tail = blocks.back();
+        size_t n = block_size - tail.end;
+        if (n > len){
+            n = len;
+        }
+        memcpy(tail.data + tail.end, data, n);
+        tail.end += n;
+        total += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void HDE::ChainBuffer::append(const std::string &data){
+    append(data.data(), data.size());
+}
+
+//Reads up to max bytes into the tail, returns the count, 0 on end of stream or -1 with errno set
+ssize_t HDE::ChainBuffer::read_from(int fd, size_t max){
+    if (blocks.empty() || blocks.back().end == block_size){
+        blocks.push_back(new_block());
+    }
+    Block &tail = blocks.back();
+    size_t room = block_size - tail.end;
+    if (room > max){
+        room = max;
+    }
+    ssize_t n;
+    do{
+        n = read(fd, tail.data + tail.end, room);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0){
+        tail.end += n;
+        total += n;
+    }
+    return n;
+}
+
+//Writes as much as the descriptor takes in one call, returns the count or -1 with errno set
+//flags are extra send flags, e.g. MSG_MORE when more data follows from elsewhere
+ssize_t HDE::ChainBuffer::write_to(int fd, int flags){
+    struct iovec iov[CHAIN_MAX_IOV];
+    int count = 0;
+    for (size_t i = 0; i < blocks.size() && count < CHAIN_MAX_IOV; i++){
+        iov[count].iov_base = blocks[i].data + blocks[i].start;
+        iov[count].iov_len = blocks[i].end - blocks[i].start;
+        count++;
+    }
+    if (count == 0){
+        return 0;
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    ssize_t n;
+    do{
+        // MSG_NOSIGNAL keeps a closed peer from raising SIGPIPE, non-sockets fall back to writev
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL | flags);
+        if (n < 0 && errno == ENOTSOCK){
+            n = writev(fd, iov, count);
+        }
+    } while (n < 0 && errno == EINTR);
+    if (n > 0){
+        consume(n);
+    }
+    return n;
+}
+
+void HDE::ChainBuffer::consume(size_t len){
+    while (len > 0 && !blocks.empty()){
+        Block &head = blocks.front();
+        size_t n = head.end - head.start;
+        if (n > len){
+            head.start += len;
+            total -= len;
+            return;
+        }
+        total -= n;
+        len -= n;
+        free_block(head);
+        blocks.pop_front();
+    }
+}
+
+//Moves len bytes to dst without copying whole blocks
+void HDE::ChainBuffer::move_to(ChainBuffer &dst, size_t len){
+    while (len > 0 && !blocks.empty()){
+        Block &head = blocks.front();
+        size_t n = head.end - head.start;
+        if (n <= len && dst.block_size == block_size){
+            dst.blocks.push_back(head);
+            dst.total += n;
+            total -= n;
+            len -= n;
+            blocks.pop_front();
+            continue;
+        }
+        if (n > len){
+            n = len;
+        }
+        dst.append(head.data + head.start, n);
+        consume(n);
+        len -= n;
+    }
+}
+
+size_t HDE::ChainBuffer::copy_out(char *dst, size_t len) const{
+    size_t copied = 0;
+    for (size_t i = 0; i < blocks.size() && copied < len; i++){
+        size_t n = blocks[i].end - blocks[i].start;
+        if (n > len - copied){
+            n = len - copied;
+        }
+        memcpy(dst + copied, blocks[i].data + blocks[i].start, n);
+        copied += n;
+    }
+    return copied;
+}
+
+std::string HDE::ChainBuffer::to_string(size_t len) const{
+    if (len > total){
+        len = total;
+    }
+    std::string out(len, '\0');
+    copy_out(&out[0], len);
+    return out;
+}
+
+size_t HDE::ChainBuffer::get_block_count() const{
+    return blocks.size();
+}
+
+const char * HDE::ChainBuffer::get_block_data(size_t index) const{
+    return blocks[index].data + blocks[index].start;
+}
+
+size_t HDE::ChainBuffer::get_block_size(size_t index) const{
+    return blocks[index].end - blocks[index].start;
+}
@@ -0,0 +1,47 @@
+#ifndef ChainBuffer_hpp
+#define ChainBuffer_hpp
+
+#include <stdio.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <sys/types.h>
+
+namespace HDE{
+    //Byte queue made of fixed-size blocks, moving data between buffers hands over whole blocks
+    class ChainBuffer{
+        private:
+            struct Block{
+                char *data;
+                size_t start;
+                size_t end;
+            };
+            std::deque<Block> blocks;
+            std::vector<char *> spare;
+            size_t total;
+            size_t block_size;
+            Block new_block();
+            void free_block(Block block);
+            ChainBuffer(const ChainBuffer &);
+            ChainBuffer & operator=(const ChainBuffer &);
+        public:
+            ChainBuffer(size_t block_size = 16384);
+            ~ChainBuffer();
+            size_t size() const;
+            bool empty() const;
+            void clear();
+            void append(const char *data, size_t len);
+            void append(const std::string &data);
+            ssize_t read_from(int fd, size_t max);
+            ssize_t write_to(int fd, int flags = 0);
+            void consume(size_t len);
+            void move_to(ChainBuffer &dst, size_t len);
+            size_t copy_out(char *dst, size_t len) const;
+            std::string to_string(size_t len) const;
+            size_t get_block_count() const;
+            const char * get_block_data(size_t index) const;
+            size_t get_block_size(size_t index) const;
+    };
+}
+
+#endif
@@ -0,0 +1,198 @@
+#include "MemoryTransport.hpp"
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <arpa/inet.h>
+
+//Constructor, the clock starts at one second so deadlines computed from it stay positive
+HDE::MemoryTransport::MemoryTransport(){
+    next_fd = MEMORY_TRANSPORT_FIRST_FD;
+    read_limit = 0;
+    write_limit = 0;
+    clock_ns = 1000000000LL;
+    accepted = 0;
+}
+
+HDE::MemoryTransport::Connection * HDE::MemoryTransport::find(int fd){
+    std::unordered_map<int, Connection>::iterator it = connections.find(fd);
+    if (it == connections.end() || it->second.closed){
+        errno = EBADF;
+        return NULL;
+    }
+    return &it->second;
+}
+
+int HDE::MemoryTransport::connect(const std::vector<std::string> &chunks, bool hold_open){
+    int fd = next_fd++;
+    if (next_fd < MEMORY_TRANSPORT_FIRST_FD){
+        next_fd = MEMORY_TRANSPORT_FIRST_FD;
+    }
+    Connection &connection = connections[fd];
+    connection.chunks = chunks;
+    connection.chunk = 0;
+    connection.offset = 0;
+    connection.hold_open = hold_open;
+    connection.shut = false;
+    connection.closed = false;
+    connection.output.clear();
+    pending.push_back(fd);
+    return fd;
+}
+
+int HDE::MemoryTransport::connect(const std::string &input){
+    return connect(std::vector<std::string>(1, input), false);
+}
+
+void HDE::MemoryTransport::set_read_limit(size_t bytes){
+    read_limit = bytes;
+}
+
+void HDE::MemoryTransport::set_write_limit(size_t bytes){
+    write_limit = bytes;
+}
+
+void HDE::MemoryTransport::advance(int64_t ns){
+    clock_ns += ns;
+}
+
+void HDE::MemoryTransport::set_time(int64_t ns){
+    clock_ns = ns;
+}
+
+const std::string & HDE::MemoryTransport::get_output(int fd){
+    static const std::string none;
+    std::unordered_map<int, Connection>::iterator it = connections.find(fd);
+    return it == connections.end() ? none : it->second.output;
+}
+
+bool HDE::MemoryTransport::is_closed(int fd){
+    std::unordered_map<int, Connection>::iterator it = connections.find(fd);
+    return it == connections.end() || it->second.closed;
+}
+
+void HDE::MemoryTransport::release(int fd){
+    connections.erase(fd);
+}
+
+size_t HDE::MemoryTransport::get_pending(){
+    return pending.size();
+}
+
+size_t HDE::MemoryTransport::get_connection_count(){
+    return connections.size();
+}
+
+uint64_t HDE::MemoryTransport::get_accepted(){
+    return accepted;
+}
+
+//The listener is ignored, every queued connection belongs to whichever listener accepts first
+int HDE::MemoryTransport::accept(int, struct sockaddr_in *address){
+    while (!pending.empty()){
+        int fd = pending.front();
+        pending.pop_front();
+        // A connection released before it was accepted is skipped
+        if (connections.find(fd) == connections.end()){
+            continue;
+        }
+        if (address != NULL){
+            memset(address, 0, sizeof(*address));
+            address->sin_family = AF_INET;
+            address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address->sin_port = htons((uint16_t)(fd & 0xffff));
+        }
+        accepted++;
+        return fd;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+ssize_t HDE::MemoryTransport::recv(int fd, char *buffer, size_t len){
+    Connection *connection = find(fd);
+    if (connection == NULL){
+        return -1;
+    }
+    while (connection->chunk < connection->chunks.size() && connection->offset == connection->chunks[connection->chunk].size()){
+        connection->chunk++;
+        connection->offset = 0;
+    }
+    if (connection->shut || connection->chunk == connection->chunks.size()){
+        if (connection->hold_open && !connection->shut){
+            errno = EAGAIN;
+            return -1;
+        }
+        return 0;
+    }
+    const std::string &chunk = connection->chunks[connection->chunk];
+    size_t n = chunk.size() - connection->offset;
+    n = n < len ? n : len;
+    n = read_limit > 0 && n > read_limit ? read_limit : n;
+    memcpy(buffer, chunk.data() + connection->offset, n);
+    connection->offset += n;
+    return n;
+}
+
+ssize_t HDE::MemoryTransport::send(int fd, const char *data, size_t len, int){
+    Connection *connection = find(fd);
+    if (connection == NULL){
+        return -1;
+    }
+    if (connection->shut){
+        errno = EPIPE;
+        return -1;
+    }
+    size_t n = write_limit > 0 && len > write_limit ? write_limit : len;
+    connection->output.append(data, n);
+    return n;
+}
+
+ssize_t HDE::MemoryTransport::send_file(int fd, int file_fd, off_t *offset, size_t count){
+    Connection *connection = find(fd);
+    if (connection == NULL){
+        return -1;
+    }
+    if (connection->shut){
+        errno = EPIPE;
+        return -1;
+    }
+    char chunk[16384];
+    size_t want = count < sizeof(chunk) ? count : sizeof(chunk);
+    want = write_limit > 0 && want > write_limit ? write_limit : want;
+    ssize_t n = pread(file_fd, chunk, want, *offset);
+    if (n > 0){
+        connection->output.append(chunk, n);
+        *offset += n;
+    }
+    return n;
+}
+
+int HDE::MemoryTransport::set_cork(int fd, bool){
+    return find(fd) == NULL ? -1 : 0;
+}
+
+int HDE::MemoryTransport::set_receive_timeout(int fd, int){
+    return find(fd) == NULL ? -1 : 0;
+}
+
+int HDE::MemoryTransport::shutdown(int fd){
+    Connection *connection = find(fd);
+    if (connection == NULL){
+        return -1;
+    }
+    connection->shut = true;
+    return 0;
+}
+
+int HDE::MemoryTransport::close(int fd){
+    Connection *connection = find(fd);
+    if (connection == NULL){
+        return -1;
+    }
+    connection->closed = true;
+    return 0;
+}
+
+int64_t HDE::MemoryTransport::now_ns(){
+    return clock_ns;
+}
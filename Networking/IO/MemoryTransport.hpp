@@ -0,0 +1,73 @@
+#ifndef MemoryTransport_hpp
+#define MemoryTransport_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include "Transport.hpp"
+
+//Descriptors handed out by MemoryTransport start here, above anything the kernel assigns, so a fake
+//descriptor that reaches a real syscall fails with EBADF instead of touching another file
+#define MEMORY_TRANSPORT_FIRST_FD (1 << 24)
+
+namespace HDE{
+    //Scripted in-process connections for driving a server without sockets. connect() queues a connection whose
+    //peer sends its chunks in order, accept() hands queued connections out and everything the server sends is kept
+    //per connection. Read and write limits cap every recv and send to force partial reads and writes, and the
+    //clock only moves when advance() or set_time() is called. Single-threaded
+    class MemoryTransport : public Transport{
+        private:
+            struct Connection{
+                std::vector<std::string> chunks;
+                size_t chunk;
+                size_t offset;
+                bool hold_open;
+                bool shut;
+                bool closed;
+                std::string output;
+            };
+            std::deque<int> pending;
+            std::unordered_map<int, Connection> connections;
+            int next_fd;
+            size_t read_limit;
+            size_t write_limit;
+            int64_t clock_ns;
+            uint64_t accepted;
+            Connection * find(int fd);
+            MemoryTransport(const MemoryTransport &);
+            MemoryTransport & operator=(const MemoryTransport &);
+        public:
+            MemoryTransport();
+            //Returns the connection's descriptor. One recv never returns bytes from two chunks. Once the chunks run
+            //out recv returns 0 as if the peer closed, or with hold_open fails with EAGAIN like an expired timeout
+            int connect(const std::vector<std::string> &chunks, bool hold_open = false);
+            int connect(const std::string &input);
+            //0 removes the limit
+            void set_read_limit(size_t bytes);
+            void set_write_limit(size_t bytes);
+            void advance(int64_t ns);
+            void set_time(int64_t ns);
+            //What the server sent, kept after close until release()
+            const std::string & get_output(int fd);
+            bool is_closed(int fd);
+            //Forgets a connection, a benchmark loop must release every one it opens
+            void release(int fd);
+            size_t get_pending();
+            size_t get_connection_count();
+            uint64_t get_accepted();
+            int accept(int listener, struct sockaddr_in *address);
+            ssize_t recv(int fd, char *buffer, size_t len);
+            ssize_t send(int fd, const char *data, size_t len, int flags);
+            ssize_t send_file(int fd, int file_fd, off_t *offset, size_t count);
+            int set_cork(int fd, bool on);
+            int set_receive_timeout(int fd, int seconds);
+            int shutdown(int fd);
+            int close(int fd);
+            int64_t now_ns();
+    };
+}
+
+#endif
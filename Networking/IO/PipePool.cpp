@@ -0,0 +1,49 @@
+#include "PipePool.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+
+//Constructor, a pipe_size of 0 keeps the kernel default capacity
+HDE::PipePool::PipePool(size_t max_idle, int pipe_size){
+    this->max_idle = max_idle;
+    this->pipe_size = pipe_size;
+}
+
+HDE::PipePool::~PipePool(){
+    for (size_t i = 0; i < idle.size(); i++){
+        close(idle[i].read_fd);
+        close(idle[i].write_fd);
+    }
+}
+
+//Returns 0 and fills pipe, or -1 if a new pipe could not be created
+int HDE::PipePool::acquire(Pipe &pipe){
+    if (!idle.empty()){
+        pipe = idle.back();
+        idle.pop_back();
+        return 0;
+    }
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0){
+        return -1;
+    }
+    if (pipe_size > 0){
+        fcntl(fds[1], F_SETPIPE_SZ, pipe_size);
+    }
+    pipe.read_fd = fds[0];
+    pipe.write_fd = fds[1];
+    return 0;
+}
+
+//Pipes still holding bytes can't be reused and are closed
+void HDE::PipePool::release(Pipe pipe, bool drained){
+    if (drained && idle.size() < max_idle){
+        idle.push_back(pipe);
+        return;
+    }
+    close(pipe.read_fd);
+    close(pipe.write_fd);
+}
+
+size_t HDE::PipePool::get_idle(){
+    return idle.size();
+}
@@ -0,0 +1,28 @@
+#ifndef PipePool_hpp
+#define PipePool_hpp
+
+#include <stdio.h>
+#include <vector>
+
+namespace HDE{
+    struct Pipe{
+        int read_fd;
+        int write_fd;
+    };
+
+    //Keeps empty non-blocking pipes around so splice paths don't create one per connection
+    class PipePool{
+        private:
+            std::vector<Pipe> idle;
+            size_t max_idle;
+            int pipe_size;
+        public:
+            PipePool(size_t max_idle, int pipe_size);
+            ~PipePool();
+            int acquire(Pipe &pipe);
+            void release(Pipe pipe, bool drained);
+            size_t get_idle();
+    };
+}
+
+#endif
@@ -0,0 +1,85 @@
+#include "ResponseWriter.hpp"
+#include <sys/socket.h>
+#include <errno.h>
+
+//Constructor
+HDE::ResponseWriter::ResponseWriter(int sock, CorkPolicy policy, Transport *transport){
+    this->sock = sock;
+    this->policy = policy;
+    this->transport = transport;
+    corked = false;
+    bytes_written = 0;
+}
+
+HDE::ResponseWriter::~ResponseWriter(){
+    finish();
+}
+
+void HDE::ResponseWriter::set_cork(bool on){
+    if (transport->set_cork(sock, on) == 0){
+        corked = on;
+    }
+}
+
+//Writes all of data, more marks that further parts of the response follow
+ssize_t HDE::ResponseWriter::write(const char *data, size_t len, bool more){
+    if (policy == CORK_TCP && !corked && more){
+        set_cork(true);
+    }
+    int flags = MSG_NOSIGNAL;
+    if (policy == CORK_MSG_MORE && more){
+        flags |= MSG_MORE;
+    }
+    size_t sent = 0;
+    while (sent < len){
+        ssize_t n = transport->send(sock, data + sent, len - sent, flags);
+        if (n < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        sent += n;
+    }
+    bytes_written += sent;
+    return sent;
+}
+
+ssize_t HDE::ResponseWriter::write_headers(const std::string &headers){
+    return write(headers.data(), headers.size(), true);
+}
+
+//Streams a file region with sendfile, the headers written before it share its first segment
+ssize_t HDE::ResponseWriter::send_file(int fd, off_t offset, size_t count){
+    size_t sent = 0;
+    while (sent < count){
+        ssize_t n = transport->send_file(sock, fd, &offset, count - sent);
+        if (n < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0){
+            break;
+        }
+        sent += n;
+    }
+    bytes_written += sent;
+    return sent;
+}
+
+//Ends the response and flushes anything held back by the cork
+void HDE::ResponseWriter::finish(){
+    if (corked){
+        set_cork(false);
+    }
+}
+
+uint64_t HDE::ResponseWriter::get_bytes_written(){
+    return bytes_written;
+}
+
+HDE::CorkPolicy HDE::ResponseWriter::get_policy(){
+    return policy;
+}
@@ -0,0 +1,38 @@
+#ifndef ResponseWriter_hpp
+#define ResponseWriter_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include "Transport.hpp"
+
+namespace HDE{
+    //How headers and body are coalesced into segments
+    enum CorkPolicy{
+        CORK_NONE,
+        CORK_MSG_MORE,
+        CORK_TCP
+    };
+
+    class ResponseWriter{
+        private:
+            int sock;
+            CorkPolicy policy;
+            Transport *transport;
+            bool corked;
+            uint64_t bytes_written;
+            void set_cork(bool on);
+        public:
+            ResponseWriter(int sock, CorkPolicy policy, Transport *transport = Transport::system());
+            ~ResponseWriter();
+            ssize_t write(const char *data, size_t len, bool more);
+            ssize_t write_headers(const std::string &headers);
+            ssize_t send_file(int fd, off_t offset, size_t count);
+            void finish();
+            uint64_t get_bytes_written();
+            CorkPolicy get_policy();
+    };
+}
+
+#endif
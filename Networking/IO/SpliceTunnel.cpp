@@ -0,0 +1,179 @@
+#include "SpliceTunnel.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#define SPLICE_CHUNK (64 * 1024)
+
+//Constructor, the tunnel owns both sockets and closes them when done, even if it never starts
+HDE::SpliceTunnel::SpliceTunnel(EventLoop *loop, PipePool *pool, int client, int upstream, std::function<void()> on_close){
+    this->loop = loop;
+    this->pool = pool;
+    this->client = client;
+    this->upstream = upstream;
+    this->on_close = on_close;
+    watching[0] = false;
+    watching[1] = false;
+    closed = false;
+    for (int i = 0; i < 2; i++){
+        flows[i].src = i == 0 ? client : upstream;
+        flows[i].dst = i == 0 ? upstream : client;
+        flows[i].pipe.read_fd = -1;
+        flows[i].pipe.write_fd = -1;
+        flows[i].buffered = 0;
+        flows[i].src_eof = false;
+        flows[i].done = false;
+        flows[i].bytes = 0;
+    }
+}
+
+HDE::SpliceTunnel::~SpliceTunnel(){
+    on_close = nullptr;
+    close_tunnel();
+}
+
+//Returns -1 after closing both sockets if no pipe could be had or the loop refused them
+int HDE::SpliceTunnel::start(){
+    if (pool->acquire(flows[0].pipe) < 0 || pool->acquire(flows[1].pipe) < 0){
+        close_tunnel();
+        return -1;
+    }
+    fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+    fcntl(upstream, F_SETFL, fcntl(upstream, F_GETFL) | O_NONBLOCK);
+    int c = client;
+    int u = upstream;
+    watching[0] = loop->add(c, interest(c), [this, c](uint32_t events){ on_event(c, events); }) == 0;
+    watching[1] = watching[0] && loop->add(u, interest(u), [this, u](uint32_t events){ on_event(u, events); }) == 0;
+    if (!watching[1]){
+        close_tunnel();
+        return -1;
+    }
+    return 0;
+}
+
+//Moves as much as possible for one direction, returns -1 on a fatal error
+int HDE::SpliceTunnel::pump(Flow &flow){
+    while (!flow.done){
+        if (flow.buffered > 0){
+            ssize_t n = splice(flow.pipe.read_fd, NULL, flow.dst, NULL, flow.buffered, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n < 0){
+                if (errno == EAGAIN || errno == EINTR){
+                    return 0;
+                }
+                return -1;
+            }
+            flow.buffered -= n;
+            flow.bytes += n;
+            continue;
+        }
+        if (flow.src_eof){
+            shutdown(flow.dst, SHUT_WR);
+            flow.done = true;
+            break;
+        }
+        ssize_t n = splice(flow.src, NULL, flow.pipe.write_fd, NULL, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0){
+            if (errno == EAGAIN || errno == EINTR){
+                return 0;
+            }
+            return -1;
+        }
+        if (n == 0){
+            flow.src_eof = true;
+        }
+        flow.buffered += n;
+    }
+    return 0;
+}
+
+//Reads are only wanted while the pipe is empty, writes only while it holds bytes
+uint32_t HDE::SpliceTunnel::interest(int fd){
+    uint32_t events = 0;
+    for (int i = 0; i < 2; i++){
+        Flow &flow = flows[i];
+        if (flow.src == fd && !flow.src_eof && flow.buffered == 0){
+            events |= EPOLLIN;
+        }
+        if (flow.dst == fd && flow.buffered > 0){
+            events |= EPOLLOUT;
+        }
+    }
+    return events;
+}
+
+void HDE::SpliceTunnel::update_interest(){
+    if (watching[0]){
+        loop->modify(client, interest(client));
+    }
+    if (watching[1]){
+        loop->modify(upstream, interest(upstream));
+    }
+}
+
+//Stops watching a hung up socket, epoll reports a hangup whatever the interest so it would wake every iteration
+void HDE::SpliceTunnel::unwatch(int fd){
+    int side = fd == client ? 0 : 1;
+    if (watching[side]){
+        loop->remove(fd);
+        watching[side] = false;
+    }
+}
+
+void HDE::SpliceTunnel::on_event(int fd, uint32_t events){
+    if (closed){
+        return;
+    }
+    // A socket error is final, what is still buffered can't be delivered
+    if (events & EPOLLERR){
+        close_tunnel();
+        return;
+    }
+    for (int i = 0; i < 2; i++){
+        Flow &flow = flows[i];
+        if (flow.src == fd || flow.dst == fd){
+            if (pump(flow) < 0){
+                close_tunnel();
+                return;
+            }
+        }
+    }
+    if (flows[0].done && flows[1].done){
+        close_tunnel();
+        return;
+    }
+    // A hangup without an error means the peer has finished sending, and writes to it either ended with our
+    // shutdown or fail on the next pump. Its unread bytes are already queued, so they keep flowing whenever
+    // the other socket takes more
+    if (events & EPOLLHUP){
+        unwatch(fd);
+    }
+    update_interest();
+}
+
+void HDE::SpliceTunnel::close_tunnel(){
+    if (closed){
+        return;
+    }
+    closed = true;
+    unwatch(client);
+    unwatch(upstream);
+    close(client);
+    close(upstream);
+    for (int i = 0; i < 2; i++){
+        if (flows[i].pipe.read_fd >= 0){
+            pool->release(flows[i].pipe, flows[i].buffered == 0);
+        }
+    }
+    if (on_close){
+        on_close();
+    }
+}
+
+uint64_t HDE::SpliceTunnel::get_bytes_up(){
+    return flows[0].bytes;
+}
+
+uint64_t HDE::SpliceTunnel::get_bytes_down(){
+    return flows[1].bytes;
+}
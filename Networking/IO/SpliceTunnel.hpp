@@ -0,0 +1,49 @@
+#ifndef SpliceTunnel_hpp
+#define SpliceTunnel_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <functional>
+#include "PipePool.hpp"
+#include "../Events/EventLoop.hpp"
+
+namespace HDE{
+    //Moves bytes between two sockets with splice() through pooled pipes, never copying into user space. A peer's
+    //half-close is passed on with shutdown(SHUT_WR) once its bytes are through, the tunnel closes when both directions
+    //are done, or at once on a socket error
+    class SpliceTunnel{
+        private:
+            struct Flow{
+                int src;
+                int dst;
+                Pipe pipe;
+                size_t buffered;
+                bool src_eof;
+                bool done;
+                uint64_t bytes;
+            };
+            EventLoop *loop;
+            PipePool *pool;
+            int client;
+            int upstream;
+            Flow flows[2];
+            //Whether client and upstream are registered with the loop
+            bool watching[2];
+            bool closed;
+            std::function<void()> on_close;
+            int pump(Flow &flow);
+            void on_event(int fd, uint32_t events);
+            void update_interest();
+            uint32_t interest(int fd);
+            void unwatch(int fd);
+        public:
+            SpliceTunnel(EventLoop *loop, PipePool *pool, int client, int upstream, std::function<void()> on_close);
+            ~SpliceTunnel();
+            int start();
+            void close_tunnel();
+            uint64_t get_bytes_up();
+            uint64_t get_bytes_down();
+    };
+}
+
+#endif
@@ -0,0 +1,54 @@
+#include "Transport.hpp"
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <time.h>
+
+HDE::Transport * HDE::Transport::system(){
+    static SocketTransport transport;
+    return &transport;
+}
+
+int HDE::SocketTransport::accept(int listener, struct sockaddr_in *address){
+    socklen_t len = sizeof(*address);
+    return ::accept(listener, (struct sockaddr *)address, address == NULL ? NULL : &len);
+}
+
+ssize_t HDE::SocketTransport::recv(int fd, char *buffer, size_t len){
+    return ::recv(fd, buffer, len, 0);
+}
+
+ssize_t HDE::SocketTransport::send(int fd, const char *data, size_t len, int flags){
+    return ::send(fd, data, len, flags);
+}
+
+ssize_t HDE::SocketTransport::send_file(int fd, int file_fd, off_t *offset, size_t count){
+    return sendfile(fd, file_fd, offset, count);
+}
+
+int HDE::SocketTransport::set_cork(int fd, bool on){
+    int value = on ? 1 : 0;
+    return setsockopt(fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+}
+
+int HDE::SocketTransport::set_receive_timeout(int fd, int seconds){
+    struct timeval tv;
+    tv.tv_sec = seconds;
+    tv.tv_usec = 0;
+    return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof(tv));
+}
+
+int HDE::SocketTransport::shutdown(int fd){
+    return ::shutdown(fd, SHUT_RDWR);
+}
+
+int HDE::SocketTransport::close(int fd){
+    return ::close(fd);
+}
+
+int64_t HDE::SocketTransport::now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
@@ -0,0 +1,49 @@
+#ifndef Transport_hpp
+#define Transport_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+namespace HDE{
+    //The calls a server makes on accepted connections and the clock it reads, so the request pipeline can run
+    //over something other than kernel sockets. Calls return what the matching syscall would, -1 with errno set
+    //on failure
+    class Transport{
+        public:
+            virtual ~Transport(){}
+            //address may be NULL
+            virtual int accept(int listener, struct sockaddr_in *address) = 0;
+            virtual ssize_t recv(int fd, char *buffer, size_t len) = 0;
+            //flags are send() flags, MSG_MORE and MSG_NOSIGNAL matter to the kernel transport
+            virtual ssize_t send(int fd, const char *data, size_t len, int flags) = 0;
+            virtual ssize_t send_file(int fd, int file_fd, off_t *offset, size_t count) = 0;
+            virtual int set_cork(int fd, bool on) = 0;
+            virtual int set_receive_timeout(int fd, int seconds) = 0;
+            virtual int shutdown(int fd) = 0;
+            virtual int close(int fd) = 0;
+            //Monotonic
+            virtual int64_t now_ns() = 0;
+            inline int64_t now_ms(){
+                return now_ns() / 1000000;
+            }
+            //Process-wide kernel transport, the default everywhere
+            static Transport * system();
+    };
+
+    class SocketTransport : public Transport{
+        public:
+            int accept(int listener, struct sockaddr_in *address);
+            ssize_t recv(int fd, char *buffer, size_t len);
+            ssize_t send(int fd, const char *data, size_t len, int flags);
+            ssize_t send_file(int fd, int file_fd, off_t *offset, size_t count);
+            int set_cork(int fd, bool on);
+            int set_receive_timeout(int fd, int seconds);
+            int shutdown(int fd);
+            int close(int fd);
+            int64_t now_ns();
+    };
+}
+
+#endif
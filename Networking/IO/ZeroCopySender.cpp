@@ -0,0 +1,215 @@
+#include "ZeroCopySender.hpp"
+#include <sys/socket.h>
+#include <poll.h>
+#include <linux/errqueue.h>
+#include <errno.h>
+#include <cstring>
+#include <iostream>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+//Constructor, zerocopy stays disabled when the kernel does not support SO_ZEROCOPY
+HDE::ZeroCopySender::ZeroCopySender(int sock, size_t threshold){
+    this->sock = sock;
+    this->threshold = threshold;
+    next_id = 0;
+    completed_id = 0;
+    zerocopy_bytes = 0;
+    copied_bytes = 0;
+    fallback_completions = 0;
+    int one = 1;
+    enabled = setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+}
+
+//Unsent bytes are dropped. Waits up to ZEROCOPY_DRAIN_MS for the kernel to finish with pinned buffers, if it hasn't
+//by then the connection is reset on close, since a retransmission would read the freed buffers
+HDE::ZeroCopySender::~ZeroCopySender(){
+    int64_t deadline = EventLoop::now_ms() + ZEROCOPY_DRAIN_MS;
+    bool waiting = true;
+    while (waiting){
+        waiting = false;
+        for (size_t i = 0; i < pending.size() && !waiting; i++){
+            waiting = in_flight(pending[i]);
+        }
+        int64_t left = deadline - EventLoop::now_ms();
+        if (!waiting || left <= 0){
+            break;
+        }
+        struct pollfd pfd;
+        pfd.fd = sock;
+        pfd.events = 0;
+        pfd.revents = 0;
+        if ((poll(&pfd, 1, (int)left) < 0 && errno != EINTR) || (pfd.revents & POLLNVAL)){
+            break;
+        }
+        process_completions();
+    }
+    if (waiting){
+        std::cerr << "Zerocopy sender destroyed with buffers in flight, resetting the connection" << std::endl;
+        struct linger reset;
+        reset.l_onoff = 1;
+        reset.l_linger = 0;
+        setsockopt(sock, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+    }
+}
+
+//Whether the kernel may still read the entry's pages
+bool HDE::ZeroCopySender::in_flight(const Pending &entry){
+    return entry.zerocopy && (int32_t)(entry.last_id - completed_id) >= 0;
+}
+
+//Drops sent buffers from the front once the kernel is done with them
+int HDE::ZeroCopySender::release(){
+    int released = 0;
+    while (!pending.empty() && pending.front().offset == pending.front().buffer->size() && !in_flight(pending.front())){
+        pending.pop_front();
+        released++;
+    }
+    return released;
+}
+
+int HDE::ZeroCopySender::send(std::string data){
+    return send(std::make_shared<const std::string>(std::move(data)));
+}
+
+//Queues the buffer behind any unsent bytes and sends what the socket takes, a shared buffer is not copied.
+//Returns 0 when everything is sent, 1 when some is kept for flush() and -1 on error
+int HDE::ZeroCopySender::send(std::shared_ptr<const std::string> data){
+    if (data->empty()){
+        return has_unsent() ? 1 : 0;
+    }
+    Pending entry;
+    entry.buffer = data;
+    entry.offset = 0;
+    entry.use_zerocopy = enabled && data->size() >= threshold;
+    entry.zerocopy = false;
+    entry.last_id = 0;
+    pending.push_back(entry);
+    return flush();
+}
+
+//Resumes the unsent bytes in order, same results as send()
+int HDE::ZeroCopySender::flush(){
+    for (size_t i = 0; i < pending.size(); i++){
+        Pending &entry = pending[i];
+        while (entry.offset < entry.buffer->size()){
+            const char *bytes = entry.buffer->data() + entry.offset;
+            size_t len = entry.buffer->size() - entry.offset;
+            ssize_t n = ::send(sock, bytes, len, entry.use_zerocopy ? MSG_ZEROCOPY | MSG_NOSIGNAL : MSG_NOSIGNAL);
+            if (n < 0){
+                if (errno == EINTR){
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK){
+                    return 1;
+                }
+                if (errno == ENOBUFS && entry.use_zerocopy){
+                    // Out of optmem for pinned pages, finish this buffer with ordinary copies
+                    entry.use_zerocopy = false;
+                    continue;
+                }
+                return -1;
+            }
+            if (entry.use_zerocopy){
+                // Every successful zerocopy send consumes one notification id
+                entry.last_id = next_id++;
+                entry.zerocopy = true;
+                zerocopy_bytes += n;
+            } else {
+                copied_bytes += n;
+            }
+            entry.offset += n;
+        }
+    }
+    release();
+    return 0;
+}
+
+//Drains zerocopy notifications from the error queue and releases completed buffers
+int HDE::ZeroCopySender::process_completions(){
+    while (true){
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0){
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+                std::cerr << "Zerocopy completion read failed: " << strerror(errno) << std::endl;
+            }
+            break;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)){
+            struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY){
+                continue;
+            }
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED){
+                fallback_completions++;
+            }
+            // Notifications cover the inclusive id range [ee_info, ee_data] and arrive in order
+            if ((int32_t)(serr->ee_data + 1 - completed_id) > 0){
+                completed_id = serr->ee_data + 1;
+            }
+        }
+    }
+    return release();
+}
+
+//For the owner's callback on the socket. Notifications raise EPOLLERR, which is cleared from the result unless the
+//socket also has an error, and EPOLLOUT resumes the unsent bytes, a failed send comes back as EPOLLERR
+uint32_t HDE::ZeroCopySender::handle_events(uint32_t events){
+    if (events & EPOLLERR){
+        process_completions();
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0){
+            events &= ~EPOLLERR;
+        }
+    }
+    if ((events & EPOLLOUT) && has_unsent() && flush() < 0){
+        events |= EPOLLERR;
+    }
+    return events;
+}
+
+bool HDE::ZeroCopySender::is_enabled(){
+    return enabled;
+}
+
+bool HDE::ZeroCopySender::has_unsent(){
+    return !pending.empty() && pending.back().offset < pending.back().buffer->size();
+}
+
+//Nothing left to send and no buffer held for the kernel
+bool HDE::ZeroCopySender::is_idle(){
+    return pending.empty();
+}
+
+size_t HDE::ZeroCopySender::get_pending(){
+    return pending.size();
+}
+
+uint64_t HDE::ZeroCopySender::get_zerocopy_bytes(){
+    return zerocopy_bytes;
+}
+
+uint64_t HDE::ZeroCopySender::get_copied_bytes(){
+    return copied_bytes;
+}
+
+//Completions where the kernel fell back to copying, e.g. on loopback
+uint64_t HDE::ZeroCopySender::get_fallback_completions(){
+    return fallback_completions;
+}
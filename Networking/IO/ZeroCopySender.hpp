@@ -0,0 +1,60 @@
+#ifndef ZeroCopySender_hpp
+#define ZeroCopySender_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <memory>
+#include <sys/types.h>
+#include "../Events/EventLoop.hpp"
+
+//How long the destructor waits for the kernel to finish with pinned buffers
+#define ZEROCOPY_DRAIN_MS 1000
+
+namespace HDE{
+    //Sends large buffers with MSG_ZEROCOPY and keeps them alive until the kernel reports completion, smaller ones
+    //are copied. On a non-blocking socket what the kernel didn't take is kept in order and resumed by flush().
+    //The socket stays registered by its owner, whose callback passes events through handle_events() first.
+    //Destroy it before closing the socket
+    class ZeroCopySender{
+        private:
+            struct Pending{
+                std::shared_ptr<const std::string> buffer;
+                size_t offset;
+                bool use_zerocopy;
+                bool zerocopy;
+                uint32_t last_id;
+            };
+            int sock;
+            size_t threshold;
+            bool enabled;
+            uint32_t next_id;
+            uint32_t completed_id;
+            std::deque<Pending> pending;
+            uint64_t zerocopy_bytes;
+            uint64_t copied_bytes;
+            uint64_t fallback_completions;
+            bool in_flight(const Pending &entry);
+            int release();
+            ZeroCopySender(const ZeroCopySender &);
+            ZeroCopySender & operator=(const ZeroCopySender &);
+        public:
+            ZeroCopySender(int sock, size_t threshold);
+            ~ZeroCopySender();
+            int send(std::string data);
+            int send(std::shared_ptr<const std::string> data);
+            int flush();
+            int process_completions();
+            uint32_t handle_events(uint32_t events);
+            bool is_enabled();
+            bool has_unsent();
+            bool is_idle();
+            size_t get_pending();
+            uint64_t get_zerocopy_bytes();
+            uint64_t get_copied_bytes();
+            uint64_t get_fallback_completions();
+    };
+}
+
+#endif
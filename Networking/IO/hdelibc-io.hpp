@@ -0,0 +1,14 @@
+#ifndef hdelibc_io_hpp
+#define hdelibc_io_hpp
+
+#include <stdio.h>
+#include "ZeroCopySender.hpp"
+#include "ResponseWriter.hpp"
+#include "PipePool.hpp"
+#include "SpliceTunnel.hpp"
+#include "ChainBuffer.hpp"
+#include "Transport.hpp"
+#include "MemoryTransport.hpp"
+
+
+#endif
@@ -0,0 +1,281 @@
+#include "AccessLog.hpp"
+#include <iostream>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <unordered_map>
+
+thread_local HDE::AccessLog::Ring * HDE::AccessLog::local_rings[ACCESS_LOG_TLS_SLOTS];
+
+static std::atomic<size_t> next_index(0);
+
+//Logs beyond the TLS slots find their thread's ring here instead
+static std::mutex overflow_lock;
+static std::unordered_map<const void *, std::unordered_map<std::thread::id, void *> > overflow;
+
+//Constructor
+HDE::AccessRecord::AccessRecord(){
+    time_us = 0;
+    duration_ns = 0;
+    bytes_in = 0;
+    bytes_out = 0;
+    trace_high = 0;
+    trace_low = 0;
+    client = 0;
+    status = 0;
+    method_len = 0;
+    path_len = 0;
+}
+
+void HDE::AccessRecord::set_method(const std::string &method){
+    method_len = method.size() < sizeof(this->method) ? method.size() : sizeof(this->method);
+    memcpy(this->method, method.data(), method_len);
+}
+
+void HDE::AccessRecord::set_path(const std::string &path){
+    path_len = path.size() < sizeof(this->path) ? path.size() : sizeof(this->path);
+    memcpy(this->path, path.data(), path_len);
+}
+
+//Constructor, ring_records is rounded up to a power of two, the writer thread starts at once
+HDE::AccessLog::AccessLog(AccessLogConfig config){
+    this->config = config;
+    index = next_index.fetch_add(1);
+    size_t capacity = 1;
+    while (capacity < config.ring_records){
+        capacity <<= 1;
+    }
+    mask = capacity - 1;
+    fd = -1;
+    file_bytes = 0;
+    written.store(0);
+    batches.store(0);
+    rotations.store(0);
+    formatted_second = -1;
+    formatted_time[0] = '\0';
+    running.store(open_file());
+    if (running.load()){
+        writer = std::thread([this](){ run(); });
+    }
+}
+
+HDE::AccessLog::~AccessLog(){
+    stop();
+    if (index < ACCESS_LOG_TLS_SLOTS){
+        local_rings[index] = NULL;
+    } else {
+        std::lock_guard<std::mutex> guard(overflow_lock);
+        overflow.erase(this);
+    }
+    for (size_t i = 0; i < rings.size(); i++){
+        delete rings[i];
+    }
+}
+
+//Drains what producers already pushed, later records are dropped
+void HDE::AccessLog::stop(){
+    if (!running.exchange(false)){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        wake.notify_one();
+    }
+    writer.join();
+    drain();
+    flush();
+    close(fd);
+    fd = -1;
+}
+
+bool HDE::AccessLog::open_file(){
+    if (config.path.empty()){
+        return false;
+    }
+    fd = open(config.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0){
+        std::cerr << "Failed to open access log " << config.path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    file_bytes = size > 0 ? size : 0;
+    return true;
+}
+
+bool HDE::AccessLog::is_open(){
+    return fd >= 0;
+}
+
+//First record from a thread creates its ring
+HDE::AccessLog::Ring * HDE::AccessLog::attach(){
+    if (index >= ACCESS_LOG_TLS_SLOTS){
+        std::lock_guard<std::mutex> guard(overflow_lock);
+        void *found = overflow[this][std::this_thread::get_id()];
+        if (found != NULL){
+            return (Ring *)found;
+        }
+    }
+    Ring *ring = new Ring();
+    ring->head.store(0);
+    ring->tail.store(0);
+    ring->dropped.store(0);
+    ring->slots.resize(mask + 1);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        rings.push_back(ring);
+    }
+    if (index < ACCESS_LOG_TLS_SLOTS){
+        local_rings[index] = ring;
+    } else {
+        std::lock_guard<std::mutex> guard(overflow_lock);
+        overflow[this][std::this_thread::get_id()] = ring;
+    }
+    return ring;
+}
+
+bool HDE::AccessLog::log(const AccessRecord &record){
+    if (!running.load(std::memory_order_relaxed)){
+        return false;
+    }
+    Ring *ring = index < ACCESS_LOG_TLS_SLOTS ? local_rings[index] : NULL;
+    if (ring == NULL){
+        ring = attach();
+    }
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) > mask){
+        ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+    }
+    ring->slots[head & mask] = record;
+    ring->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+//Writer thread, producers are never signalled so it wakes every flush_interval_ms,
+//a ring drops records once more than ring_records arrive within one interval
+void HDE::AccessLog::run(){
+    while (running.load()){
+        drain();
+        flush();
+        std::unique_lock<std::mutex> guard(lock);
+        wake.wait_for(guard, std::chrono::milliseconds(config.flush_interval_ms));
+    }
+}
+
+size_t HDE::AccessLog::drain(){
+    std::vector<Ring *> current;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current = rings;
+    }
+    size_t drained = 0;
+    for (size_t i = 0; i < current.size(); i++){
+        Ring *ring = current[i];
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        while (tail != head){
+            format(ring->slots[tail & mask]);
+            tail++;
+            drained++;
+            if (batch.size() >= config.batch_bytes){
+                ring->tail.store(tail, std::memory_order_release);
+                flush();
+            }
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+    return drained;
+}
+
+//logfmt, one line per request, the timestamp text is reused within a second
+void HDE::AccessLog::format(const AccessRecord &record){
+    int64_t second = record.time_us / 1000000;
+    if (second != formatted_second){
+        time_t seconds = second;
+        struct tm parts;
+        gmtime_r(&seconds, &parts);
+        strftime(formatted_time, sizeof(formatted_time), "%Y-%m-%dT%H:%M:%S", &parts);
+        formatted_second = second;
+    }
+    char client[INET_ADDRSTRLEN];
+    struct in_addr address;
+    address.s_addr = record.client;
+    inet_ntop(AF_INET, &address, client, sizeof(client));
+    char line[160];
+    snprintf(line, sizeof(line), "time=%s.%06lldZ client=%s method=", formatted_time, (long long)(record.time_us % 1000000), client);
+    batch += line;
+    batch.append(record.method, record.method_len);
+    batch += " path=";
+    batch.append(record.path, record.path_len);
+    snprintf(line, sizeof(line), " status=%u bytes_in=%llu bytes_out=%llu duration_us=%.1f", record.status,
+             (unsigned long long)record.bytes_in, (unsigned long long)record.bytes_out, record.duration_ns / 1000.0);
+    batch += line;
+    if (record.trace_high != 0 || record.trace_low != 0){
+        snprintf(line, sizeof(line), " request_id=%016llx%016llx", (unsigned long long)record.trace_high, (unsigned long long)record.trace_low);
+        batch += line;
+    }
+    batch += '\n';
+    written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HDE::AccessLog::flush(){
+    size_t offset = 0;
+    while (offset < batch.size() && fd >= 0){
+        ssize_t n = write(fd, batch.data() + offset, batch.size() - offset);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n < 0){
+            std::cerr << "Failed to write access log: " << strerror(errno) << std::endl;
+            break;
+        }
+        offset += n;
+    }
+    if (!batch.empty()){
+        batches.fetch_add(1, std::memory_order_relaxed);
+    }
+    file_bytes += offset;
+    batch.clear();
+    if (config.rotate_bytes > 0 && file_bytes >= config.rotate_bytes){
+        rotate();
+    }
+}
+
+//path becomes path.1, older files shift up and the one past max_files is overwritten
+void HDE::AccessLog::rotate(){
+    close(fd);
+    for (int i = config.max_files - 1; i >= 1; i--){
+        rename((config.path + "." + std::to_string(i)).c_str(), (config.path + "." + std::to_string(i + 1)).c_str());
+    }
+    if (config.max_files > 0){
+        rename(config.path.c_str(), (config.path + ".1").c_str());
+    } else {
+        unlink(config.path.c_str());
+    }
+    rotations.fetch_add(1, std::memory_order_relaxed);
+    open_file();
+}
+
+uint64_t HDE::AccessLog::get_written(){
+    return written.load(std::memory_order_relaxed);
+}
+
+uint64_t HDE::AccessLog::get_dropped(){
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t total = 0;
+    for (size_t i = 0; i < rings.size(); i++){
+        total += rings[i]->dropped.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t HDE::AccessLog::get_batches(){
+    return batches.load(std::memory_order_relaxed);
+}
+
+uint64_t HDE::AccessLog::get_rotations(){
+    return rotations.load(std::memory_order_relaxed);
+}
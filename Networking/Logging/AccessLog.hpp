@@ -0,0 +1,96 @@
+#ifndef AccessLog_hpp
+#define AccessLog_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#define ACCESS_LOG_TLS_SLOTS 16
+
+namespace HDE{
+    struct AccessLogConfig{
+        //Empty disables the log, log() then drops every record
+        std::string path;
+        size_t ring_records;
+        size_t batch_bytes;
+        size_t rotate_bytes;
+        int max_files;
+        int flush_interval_ms;
+    };
+
+    //One request, fixed size so producers copy it into a ring slot without allocating, long paths are cut
+    struct AccessRecord{
+        int64_t time_us;
+        uint64_t duration_ns;
+        uint64_t bytes_in;
+        uint64_t bytes_out;
+        uint64_t trace_high;
+        uint64_t trace_low;
+        uint32_t client;
+        uint16_t status;
+        uint8_t method_len;
+        uint8_t path_len;
+        char method[8];
+        char path[152];
+        AccessRecord();
+        void set_method(const std::string &method);
+        void set_path(const std::string &path);
+    };
+
+    //Structured access log, every worker thread pushes records into its own lock-free SPSC ring and
+    //a background thread formats them as logfmt lines, writes them in large batches and rotates the file.
+    //A full ring drops the record and counts it, log() never blocks or takes a lock after a thread's first call
+    //unless more than ACCESS_LOG_TLS_SLOTS logs exist, later ones look their ring up under a lock
+    class AccessLog{
+        private:
+            struct Ring{
+                alignas(64) std::atomic<uint64_t> head;
+                alignas(64) std::atomic<uint64_t> tail;
+                alignas(64) std::atomic<uint64_t> dropped;
+                std::vector<AccessRecord> slots;
+            };
+            AccessLogConfig config;
+            size_t index;
+            size_t mask;
+            int fd;
+            size_t file_bytes;
+            std::atomic<bool> running;
+            std::mutex lock;
+            std::condition_variable wake;
+            std::vector<Ring *> rings;
+            std::thread writer;
+            std::string batch;
+            std::atomic<uint64_t> written;
+            std::atomic<uint64_t> batches;
+            std::atomic<uint64_t> rotations;
+            int64_t formatted_second;
+            char formatted_time[32];
+            static thread_local Ring *local_rings[ACCESS_LOG_TLS_SLOTS];
+            Ring * attach();
+            void run();
+            size_t drain();
+            void format(const AccessRecord &record);
+            void flush();
+            void rotate();
+            bool open_file();
+            AccessLog(const AccessLog &);
+            AccessLog & operator=(const AccessLog &);
+        public:
+            AccessLog(AccessLogConfig config);
+            ~AccessLog();
+            bool log(const AccessRecord &record);
+            void stop();
+            bool is_open();
+            uint64_t get_written();
+            uint64_t get_dropped();
+            uint64_t get_batches();
+            uint64_t get_rotations();
+    };
+}
+
+#endif
@@ -0,0 +1,219 @@
+#include "BinaryLog.hpp"
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#define BINARY_LOG_MAGIC "HDEBLOG1"
+#define BINARY_LOG_FLUSH_MS 10
+
+std::atomic<bool> HDE::BinaryLog::running(false);
+size_t HDE::BinaryLog::mask = 0;
+thread_local HDE::BinaryLog::Buffer * HDE::BinaryLog::local = NULL;
+
+struct Site{
+    int level;
+    int line;
+    std::string file;
+    std::string format;
+    std::string signature;
+};
+
+static std::mutex lock;
+static std::condition_variable wake;
+static std::vector<Site> sites;
+static std::vector<HDE::BinaryLog::Buffer *> buffers;
+static std::thread writer;
+static std::atomic<uint64_t> written(0);
+static size_t sites_written = 0;
+static std::string pending;
+
+static void append(std::string &out, const void *data, size_t len){
+    out.append((const char *)data, len);
+}
+
+static void write_all(int fd, std::string &out){
+    size_t offset = 0;
+    while (offset < out.size()){
+        ssize_t n = write(fd, out.data() + offset, out.size() - offset);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n < 0){
+            std::cerr << "Failed to write binary log: " << strerror(errno) << std::endl;
+            break;
+        }
+        offset += n;
+    }
+    out.clear();
+}
+
+//Starts the writer thread, buffer_bytes per thread is rounded up to a power of two and fixed by the first open
+bool HDE::BinaryLog::open(const std::string &path, size_t buffer_bytes){
+    if (running.load()){
+        return false;
+    }
+    CycleClock::calibrate();
+    if (mask == 0){
+        size_t capacity = 4096;
+        while (capacity < buffer_bytes){
+            capacity <<= 1;
+        }
+        mask = capacity - 1;
+    }
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0){
+        std::cerr << "Failed to open binary log " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    //Header lets the decoder turn record timestamps into wall-clock time
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    uint64_t base_tick = CycleClock::now();
+    int64_t base_wall_ns = (int64_t)wall.tv_sec * 1000000000LL + wall.tv_nsec;
+    double ns_per_tick = CycleClock::get_ns_per_tick();
+    std::string header(BINARY_LOG_MAGIC);
+    append(header, &ns_per_tick, 8);
+    append(header, &base_tick, 8);
+    append(header, &base_wall_ns, 8);
+    write_all(fd, header);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        sites_written = 0;
+    }
+    running.store(true);
+    writer = std::thread([fd](){
+        while (running.load()){
+            drain(fd);
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait_for(guard, std::chrono::milliseconds(BINARY_LOG_FLUSH_MS));
+        }
+        drain(fd);
+        ::close(fd);
+    });
+    return true;
+}
+
+//Stops recording, drains every ring and closes the file
+void HDE::BinaryLog::close(){
+    if (!running.exchange(false)){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        wake.notify_one();
+    }
+    writer.join();
+}
+
+//Ids start at 1, 0 marks ring padding
+uint32_t HDE::BinaryLog::add_site(int level, const char *file, int line, const char *format, const std::string &signature){
+    std::lock_guard<std::mutex> guard(lock);
+    Site site;
+    site.level = level;
+    site.line = line;
+    site.file = file;
+    site.format = format;
+    site.signature = signature;
+    sites.push_back(site);
+    return sites.size();
+}
+
+HDE::BinaryLog::Buffer * HDE::BinaryLog::attach(){
+    std::lock_guard<std::mutex> guard(lock);
+    Buffer *buffer = new Buffer();
+    buffer->head.store(0);
+    buffer->tail.store(0);
+    buffer->dropped.store(0);
+    buffer->thread = buffers.size();
+    buffer->bytes = new char[mask + 1];
+    buffers.push_back(buffer);
+    local = buffer;
+    return buffer;
+}
+
+//A record never wraps, the end of the ring is padded with a site 0 record instead
+char * HDE::BinaryLog::reserve(Buffer *buffer, size_t size){
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    uint64_t tail = buffer->tail.load(std::memory_order_acquire);
+    size_t offset = head & mask;
+    size_t pad = offset + size > mask + 1 ? mask + 1 - offset : 0;
+    if (head + pad + size - tail > mask + 1){
+        buffer->dropped.store(buffer->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return NULL;
+    }
+    if (pad > 0){
+        uint32_t zero = 0;
+        uint32_t length = pad;
+        memcpy(buffer->bytes + offset, &zero, 4);
+        memcpy(buffer->bytes + offset + 4, &length, 4);
+        buffer->head.store(head + pad, std::memory_order_release);
+        offset = 0;
+    }
+    return buffer->bytes + offset;
+}
+
+//Writer thread, new call sites go out before the records that use them
+size_t HDE::BinaryLog::drain(int fd){
+    std::vector<Buffer *> current;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (; sites_written < sites.size(); sites_written++){
+            Site &site = sites[sites_written];
+            uint32_t id = sites_written + 1;
+            uint32_t sizes[5] = {(uint32_t)site.level, (uint32_t)site.line, (uint32_t)site.file.size(),
+                                 (uint32_t)site.format.size(), (uint32_t)site.signature.size()};
+            pending += 'D';
+            append(pending, &id, 4);
+            append(pending, sizes, sizeof(sizes));
+            pending += site.file + site.format + site.signature;
+        }
+        current = buffers;
+    }
+    size_t records = 0;
+    for (size_t i = 0; i < current.size(); i++){
+        Buffer *buffer = current[i];
+        uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        while (tail != head){
+            const char *record = buffer->bytes + (tail & mask);
+            uint32_t site = 0;
+            uint32_t length = 0;
+            memcpy(&site, record, 4);
+            memcpy(&length, record + 4, 4);
+            if (site != 0){
+                pending += 'L';
+                append(pending, &buffer->thread, 4);
+                append(pending, record, length);
+                records++;
+            }
+            tail += length;
+            if (pending.size() >= 64 * 1024){
+                buffer->tail.store(tail, std::memory_order_release);
+                write_all(fd, pending);
+            }
+        }
+        buffer->tail.store(tail, std::memory_order_release);
+    }
+    write_all(fd, pending);
+    written.fetch_add(records, std::memory_order_relaxed);
+    return records;
+}
+
+uint64_t HDE::BinaryLog::get_written(){
+    return written.load(std::memory_order_relaxed);
+}
+
+uint64_t HDE::BinaryLog::get_dropped(){
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t total = 0;
+    for (size_t i = 0; i < buffers.size(); i++){
+        total += buffers[i]->dropped.load(std::memory_order_relaxed);
+    }
+    return total;
+}
@@ -0,0 +1,159 @@
+#ifndef BinaryLog_hpp
+#define BinaryLog_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <cstring>
+#include <atomic>
+#include <type_traits>
+#include "../Metrics/CycleClock.hpp"
+
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_ERROR 3
+
+//Levels below HDE_LOG_LEVEL compile to nothing, build with -DHDE_LOG_LEVEL=LOG_DEBUG to keep debug sites
+#ifndef HDE_LOG_LEVEL
+#define HDE_LOG_LEVEL LOG_INFO
+#endif
+
+//printf-style, the format and the argument types are registered once per call site,
+//the hot path stores the site id, a timestamp and the raw arguments, formatting is left to Tools/LogDecoder
+#define HDE_LOG(level, format, ...) \
+    do { \
+        if constexpr ((level) >= HDE_LOG_LEVEL) { \
+            static const uint32_t hde_log_site = HDE::BinaryLog::add_site((level), __FILE__, __LINE__, (format), \
+                                                                           HDE::BinaryLog::signature(__VA_ARGS__)); \
+            HDE::BinaryLog::record(hde_log_site, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+namespace HDE{
+    //Bytes to be printed as hex by the decoder, for %s
+    struct LogHex{
+        const char *data;
+        size_t len;
+    };
+
+    //Deferred-format diagnostic log in the style of NanoLog, each thread appends binary records to its own
+    //lock-free byte ring and a background thread copies them unformatted to the log file together with
+    //a dictionary of call sites, a full ring drops the record and counts it
+    class BinaryLog{
+        public:
+            struct Buffer{
+                alignas(64) std::atomic<uint64_t> head;
+                alignas(64) std::atomic<uint64_t> tail;
+                alignas(64) std::atomic<uint64_t> dropped;
+                uint32_t thread;
+                char *bytes;
+            };
+        private:
+            static std::atomic<bool> running;
+            static size_t mask;
+            static thread_local Buffer *local;
+            static Buffer * attach();
+            static char * reserve(Buffer *buffer, size_t size);
+            static inline size_t encoded_size(const char *value){
+                return 4 + strlen(value);
+            }
+            static inline size_t encoded_size(const std::string &value){
+                return 4 + value.size();
+            }
+            static inline size_t encoded_size(const LogHex &value){
+                return 4 + value.len;
+            }
+            template <typename T>
+            static inline size_t encoded_size(const T &){
+                static_assert(std::is_arithmetic<T>::value || std::is_pointer<T>::value || std::is_enum<T>::value, "unsupported log argument");
+                return 8;
+            }
+            static inline void encode(char *&out, const char *data, size_t len){
+                uint32_t length = len;
+                memcpy(out, &length, 4);
+                memcpy(out + 4, data, len);
+                out += 4 + len;
+            }
+            static inline void encode(char *&out, const char *value){
+                encode(out, value, strlen(value));
+            }
+            static inline void encode(char *&out, const std::string &value){
+                encode(out, value.data(), value.size());
+            }
+            static inline void encode(char *&out, const LogHex &value){
+                encode(out, value.data, value.len);
+            }
+            template <typename T>
+            static inline void encode(char *&out, const T &value){
+                if constexpr (std::is_floating_point<T>::value){
+                    double number = value;
+                    memcpy(out, &number, 8);
+                } else if constexpr (std::is_pointer<T>::value){
+                    uint64_t number = (uintptr_t)value;
+                    memcpy(out, &number, 8);
+                } else if constexpr (std::is_signed<T>::value || std::is_enum<T>::value){
+                    int64_t number = (int64_t)value;
+                    memcpy(out, &number, 8);
+                } else {
+                    uint64_t number = value;
+                    memcpy(out, &number, 8);
+                }
+                out += 8;
+            }
+            template <typename T>
+            static inline char type_code(){
+                typedef typename std::decay<T>::type D;
+                if constexpr (std::is_same<D, const char *>::value || std::is_same<D, char *>::value || std::is_same<D, std::string>::value){
+                    return 's';
+                } else if constexpr (std::is_same<D, LogHex>::value){
+                    return 'x';
+                } else if constexpr (std::is_floating_point<D>::value){
+                    return 'd';
+                } else if constexpr (std::is_pointer<D>::value){
+                    return 'p';
+                } else if constexpr (std::is_signed<D>::value || std::is_enum<D>::value){
+                    return 'i';
+                } else {
+                    return 'u';
+                }
+            }
+            static size_t drain(int fd);
+        public:
+            static bool open(const std::string &path, size_t buffer_bytes);
+            static void close();
+            static uint32_t add_site(int level, const char *file, int line, const char *format, const std::string &signature);
+            template <typename... Args>
+            static std::string signature(const Args &...){
+                std::string codes;
+                ((codes += type_code<Args>()), ...);
+                return codes;
+            }
+            //Header is site id, record length and a CycleClock timestamp, records are padded to 8 bytes
+            template <typename... Args>
+            static void record(uint32_t site, const Args &... args){
+                if (!running.load(std::memory_order_relaxed)){
+                    return;
+                }
+                Buffer *buffer = local != NULL ? local : attach();
+                size_t size = (16 + (encoded_size(args) + ... + 0) + 7) & ~(size_t)7;
+                char *out = reserve(buffer, size);
+                if (out == NULL){
+                    return;
+                }
+                uint32_t length = size;
+                uint64_t now = CycleClock::now();
+                memcpy(out, &site, 4);
+                memcpy(out + 4, &length, 4);
+                memcpy(out + 8, &now, 8);
+                char *cursor = out + 16;
+                (encode(cursor, args), ...);
+                (void)cursor;
+                buffer->head.store(buffer->head.load(std::memory_order_relaxed) + size, std::memory_order_release);
+            }
+            static uint64_t get_written();
+            static uint64_t get_dropped();
+    };
+}
+
+#endif
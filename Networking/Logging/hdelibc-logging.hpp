@@ -0,0 +1,9 @@
+#ifndef hdelibc_logging_hpp
+#define hdelibc_logging_hpp
+
+#include <stdio.h>
+#include "AccessLog.hpp"
+#include "BinaryLog.hpp"
+
+
+#endif
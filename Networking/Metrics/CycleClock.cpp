@@ -0,0 +1,54 @@
+#include "CycleClock.hpp"
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+
+bool HDE::CycleClock::use_tsc = false;
+double HDE::CycleClock::ns_per_tick = 1.0;
+
+static int64_t monotonic_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//Times the TSC against CLOCK_MONOTONIC over 20ms, once per process, call it before any timing starts.
+//Without constant_tsc and nonstop_tsc the rate may change with frequency scaling or halt in idle states
+void HDE::CycleClock::calibrate(){
+    static std::once_flag done;
+    std::call_once(done, [](){
+#if defined(__x86_64__) || defined(__i386__)
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        bool invariant = false;
+        while (std::getline(cpuinfo, line)){
+            if (line.compare(0, 5, "flags") == 0){
+                invariant = line.find(" constant_tsc") != std::string::npos && line.find(" nonstop_tsc") != std::string::npos;
+                break;
+            }
+        }
+        if (!invariant){
+            return;
+        }
+        int64_t start_ns = monotonic_ns();
+        uint64_t start_ticks = __rdtsc();
+        usleep(20000);
+        int64_t elapsed_ns = monotonic_ns() - start_ns;
+        uint64_t elapsed_ticks = __rdtsc() - start_ticks;
+        if (elapsed_ticks == 0){
+            return;
+        }
+        ns_per_tick = (double)elapsed_ns / elapsed_ticks;
+        use_tsc = true;
+#endif
+    });
+}
+
+bool HDE::CycleClock::is_tsc(){
+    return use_tsc;
+}
+
+double HDE::CycleClock::get_ns_per_tick(){
+    return ns_per_tick;
+}
@@ -0,0 +1,38 @@
+#ifndef CycleClock_hpp
+#define CycleClock_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace HDE{
+    //Cheap timestamps for phase timing, the TSC when the CPU has an invariant one and CLOCK_MONOTONIC otherwise,
+    //ticks from now() become nanoseconds through to_ns() once calibrate() has run
+    class CycleClock{
+        private:
+            static bool use_tsc;
+            static double ns_per_tick;
+        public:
+            static void calibrate();
+            static inline uint64_t now(){
+#if defined(__x86_64__) || defined(__i386__)
+                if (use_tsc){
+                    return __rdtsc();
+                }
+#endif
+                struct timespec ts;
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+            }
+            static inline uint64_t to_ns(uint64_t ticks){
+                return (uint64_t)(ticks * ns_per_tick);
+            }
+            static bool is_tsc();
+            static double get_ns_per_tick();
+    };
+}
+
+#endif
@@ -0,0 +1,343 @@
+#include "MetricsRegistry.hpp"
+#include <cstring>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#define METRICS_LINE 64
+
+thread_local std::atomic<uint64_t> * HDE::MetricsRegistry::local_blocks[METRICS_TLS_SLOTS];
+
+static std::atomic<size_t> next_index(0);
+
+//Registries beyond the TLS slots find their thread's block here instead
+static std::mutex overflow_lock;
+static std::unordered_map<const void *, std::unordered_map<std::thread::id, std::atomic<uint64_t> *> > overflow;
+
+static void split_name(const std::string &name, std::string &base, std::string &labels){
+    size_t brace = name.find('{');
+    base = name.substr(0, brace);
+    labels = brace == std::string::npos ? std::string() : name.substr(brace + 1, name.size() - brace - 2);
+}
+
+static std::string format_value(double value){
+    char text[32];
+    snprintf(text, sizeof(text), "%.15g", value);
+    return text;
+}
+
+//Constructor, max_cells bounds every thread's block, a histogram takes one cell per bucket plus two and a latency
+//metric LATENCY_BUCKETS + 2, the default fits four latency metrics
+HDE::MetricsRegistry::MetricsRegistry(size_t max_cells){
+    index = next_index.fetch_add(1);
+    this->max_cells = (max_cells + METRICS_LINE / sizeof(uint64_t) - 1) / (METRICS_LINE / sizeof(uint64_t)) * (METRICS_LINE / sizeof(uint64_t));
+    used_cells = 0;
+    owners.resize(this->max_cells, -1);
+}
+
+HDE::MetricsRegistry::~MetricsRegistry(){
+    if (index < METRICS_TLS_SLOTS){
+        local_blocks[index] = NULL;
+    } else {
+        std::lock_guard<std::mutex> guard(overflow_lock);
+        overflow.erase(this);
+    }
+    for (size_t i = 0; i < blocks.size(); i++){
+        operator delete[](blocks[i], std::align_val_t(METRICS_LINE));
+    }
+}
+
+//First record from a thread, allocates its zeroed block on a line boundary
+std::atomic<uint64_t> * HDE::MetricsRegistry::attach(){
+    if (index >= METRICS_TLS_SLOTS){
+        std::lock_guard<std::mutex> guard(overflow_lock);
+        std::atomic<uint64_t> *&found = overflow[this][std::this_thread::get_id()];
+        if (found != NULL){
+            return found;
+        }
+    }
+    void *memory = operator new[](max_cells * sizeof(std::atomic<uint64_t>), std::align_val_t(METRICS_LINE));
+    std::atomic<uint64_t> *block = (std::atomic<uint64_t> *)memory;
+    for (size_t i = 0; i < max_cells; i++){
+        new (&block[i]) std::atomic<uint64_t>(0);
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        blocks.push_back(block);
+    }
+    if (index < METRICS_TLS_SLOTS){
+        local_blocks[index] = block;
+    } else {
+        std::lock_guard<std::mutex> guard(overflow_lock);
+        overflow[this][std::this_thread::get_id()] = block;
+    }
+    return block;
+}
+
+int HDE::MetricsRegistry::add(const std::string &name, const std::string &help, Type type, size_t cells, const std::vector<double> &bounds){
+    std::lock_guard<std::mutex> guard(lock);
+    if (used_cells + cells > max_cells){
+        return -1;
+    }
+    Metric metric;
+    metric.name = name;
+    metric.help = help;
+    metric.type = type;
+    metric.offset = used_cells;
+    metric.bounds = bounds;
+    owners[used_cells] = metrics.size();
+    used_cells += cells;
+    metrics.push_back(metric);
+    return metric.offset;
+}
+
+//Returns the metric id, or -1 once the block is full, recording with -1 is a no-op
+int HDE::MetricsRegistry::add_counter(const std::string &name, const std::string &help){
+    return add(name, help, COUNTER, 1, std::vector<double>());
+}
+
+int HDE::MetricsRegistry::add_gauge(const std::string &name, const std::string &help){
+    return add(name, help, GAUGE, 1, std::vector<double>());
+}
+
+//Nanosecond latencies rendered as a summary in seconds, quantile="1" is the exact maximum
+int HDE::MetricsRegistry::add_latency(const std::string &name, const std::string &help){
+    return add(name, help, LATENCY, LATENCY_BUCKETS + 2, std::vector<double>());
+}
+
+//bounds are the ascending upper bucket limits, +Inf is implied
+int HDE::MetricsRegistry::add_histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds){
+    return add(name, help, HISTOGRAM, bounds.size() + 3, bounds);
+}
+
+//Collectors append samples computed at scrape time, such as kernel socket statistics
+void HDE::MetricsRegistry::add_collector(Collector collector){
+    std::lock_guard<std::mutex> guard(lock);
+    collectors.push_back(collector);
+}
+
+void HDE::MetricsRegistry::observe(int id, double value){
+    if (id < 0){
+        return;
+    }
+    Metric &metric = metrics[owners[id]];
+    std::atomic<uint64_t> *block = cells() + id;
+    size_t bucket = 0;
+    while (bucket < metric.bounds.size() && value > metric.bounds[bucket]){
+        bucket++;
+    }
+    size_t buckets = metric.bounds.size() + 1;
+    block[bucket].store(block[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    block[buckets].store(block[buckets].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    uint64_t bits = block[buckets + 1].load(std::memory_order_relaxed);
+    double sum = 0;
+    memcpy(&sum, &bits, sizeof(sum));
+    sum += value;
+    memcpy(&bits, &sum, sizeof(bits));
+    block[buckets + 1].store(bits, std::memory_order_relaxed);
+}
+
+//Caller holds lock
+uint64_t HDE::MetricsRegistry::sum(size_t cell){
+    uint64_t total = 0;
+    for (size_t i = 0; i < blocks.size(); i++){
+        total += blocks[i][cell].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t HDE::MetricsRegistry::get_counter(int id){
+    if (id < 0){
+        return 0;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    return sum(id);
+}
+
+//Gauges are kept as per-thread deltas, a connection opened on one thread may be closed on another
+int64_t HDE::MetricsRegistry::get_gauge(int id){
+    return (int64_t)get_counter(id);
+}
+
+uint64_t HDE::MetricsRegistry::get_count(int id){
+    if (id < 0){
+        return 0;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    Metric &metric = metrics[owners[id]];
+    if (metric.type == LATENCY){
+        uint64_t total = 0;
+        for (size_t b = 0; b < LATENCY_BUCKETS; b++){
+            total += sum(id + b);
+        }
+        return total;
+    }
+    return sum(id + metric.bounds.size() + 1);
+}
+
+//Highest value that lands in the bucket
+uint64_t HDE::MetricsRegistry::bucket_limit(size_t bucket){
+    if (bucket < (2U << LATENCY_SUB_BITS)){
+        return bucket;
+    }
+    int shift = (bucket >> LATENCY_SUB_BITS) - 1;
+    uint64_t base = (bucket & ((1U << LATENCY_SUB_BITS) - 1)) + (1U << LATENCY_SUB_BITS);
+    return ((base + 1) << shift) - 1;
+}
+
+uint64_t HDE::MetricsRegistry::percentile_of(const std::vector<uint64_t> &counts, double percentile){
+    uint64_t total = 0;
+    for (size_t b = 0; b < counts.size(); b++){
+        total += counts[b];
+    }
+    if (total == 0){
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * total + 0.5);
+    rank = rank < 1 ? 1 : rank;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < counts.size(); b++){
+        seen += counts[b];
+        if (seen >= rank){
+            return bucket_limit(b);
+        }
+    }
+    return bucket_limit(counts.size() - 1);
+}
+
+//Caller holds lock, adds every thread's buckets into counts
+void HDE::MetricsRegistry::merge_latency(int id, std::vector<uint64_t> &counts){
+    counts.assign(LATENCY_BUCKETS, 0);
+    for (size_t t = 0; t < blocks.size(); t++){
+        for (size_t b = 0; b < LATENCY_BUCKETS; b++){
+            counts[b] += blocks[t][id + b].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+//Merged across threads, capped at the recorded maximum
+uint64_t HDE::MetricsRegistry::get_percentile_ns(int id, double percentile){
+    if (id < 0){
+        return 0;
+    }
+    std::vector<uint64_t> counts;
+    std::lock_guard<std::mutex> guard(lock);
+    merge_latency(id, counts);
+    uint64_t max = 0;
+    for (size_t t = 0; t < blocks.size(); t++){
+        uint64_t value = blocks[t][id + LATENCY_BUCKETS + 1].load(std::memory_order_relaxed);
+        max = value > max ? value : max;
+    }
+    uint64_t value = percentile_of(counts, percentile);
+    return value < max ? value : max;
+}
+
+//One line per latency metric with samples since the previous report, the interval max is its bucket's upper limit
+std::string HDE::MetricsRegistry::latency_report(){
+    std::string out;
+    std::vector<uint64_t> counts;
+    std::lock_guard<std::mutex> guard(lock);
+    reported.resize(max_cells, 0);
+    for (size_t i = 0; i < metrics.size(); i++){
+        if (metrics[i].type != LATENCY){
+            continue;
+        }
+        size_t id = metrics[i].offset;
+        merge_latency(id, counts);
+        uint64_t samples = 0;
+        size_t highest = 0;
+        for (size_t b = 0; b < LATENCY_BUCKETS; b++){
+            uint64_t total = counts[b];
+            counts[b] -= reported[id + b];
+            reported[id + b] = total;
+            samples += counts[b];
+            highest = counts[b] > 0 ? b : highest;
+        }
+        if (samples == 0){
+            continue;
+        }
+        char line[512];
+        snprintf(line, sizeof(line), "latency %s n=%llu p50=%.1fus p99=%.1fus p999=%.1fus max=%.1fus\n", metrics[i].name.c_str(),
+                 (unsigned long long)samples, percentile_of(counts, 50) / 1000.0, percentile_of(counts, 99) / 1000.0,
+                 percentile_of(counts, 99.9) / 1000.0, bucket_limit(highest) / 1000.0);
+        out += line;
+    }
+    return out;
+}
+
+void HDE::MetricsRegistry::write_header(std::string &out, const std::string &name, const std::string &help, const char *type){
+    out += "# HELP " + name + " " + help + "\n";
+    out += "# TYPE " + name + " " + type + "\n";
+}
+
+//Prometheus text exposition format 0.0.4
+std::string HDE::MetricsRegistry::render(){
+    static const char *types[] = {"counter", "gauge", "histogram", "summary"};
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    std::string out;
+    std::vector<uint64_t> counts;
+    std::unordered_set<std::string> described;
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t i = 0; i < metrics.size(); i++){
+        Metric &metric = metrics[i];
+        std::string base;
+        std::string labels;
+        split_name(metric.name, base, labels);
+        if (described.insert(base).second){
+            write_header(out, base, metric.help, types[metric.type]);
+        }
+        if (metric.type == COUNTER){
+            out += metric.name + " " + std::to_string(sum(metric.offset)) + "\n";
+            continue;
+        }
+        if (metric.type == GAUGE){
+            out += metric.name + " " + std::to_string((int64_t)sum(metric.offset)) + "\n";
+            continue;
+        }
+        std::string prefix = labels.empty() ? std::string("{") : "{" + labels + ",";
+        std::string suffix = labels.empty() ? std::string() : "{" + labels + "}";
+        if (metric.type == LATENCY){
+            merge_latency(metric.offset, counts);
+            uint64_t count = 0;
+            uint64_t total = 0;
+            uint64_t max = 0;
+            for (size_t b = 0; b < LATENCY_BUCKETS; b++){
+                count += counts[b];
+            }
+            for (size_t t = 0; t < blocks.size(); t++){
+                total += blocks[t][metric.offset + LATENCY_BUCKETS].load(std::memory_order_relaxed);
+                uint64_t value = blocks[t][metric.offset + LATENCY_BUCKETS + 1].load(std::memory_order_relaxed);
+                max = value > max ? value : max;
+            }
+            for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++){
+                uint64_t value = percentile_of(counts, quantiles[q] * 100);
+                value = value < max ? value : max;
+                out += base + prefix + "quantile=\"" + format_value(quantiles[q]) + "\"} " + format_value(value / 1e9) + "\n";
+            }
+            out += base + prefix + "quantile=\"1\"} " + format_value(max / 1e9) + "\n";
+            out += base + "_sum" + suffix + " " + format_value(total / 1e9) + "\n";
+            out += base + "_count" + suffix + " " + std::to_string(count) + "\n";
+            continue;
+        }
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b <= metric.bounds.size(); b++){
+            cumulative += sum(metric.offset + b);
+            std::string le = b < metric.bounds.size() ? format_value(metric.bounds[b]) : std::string("+Inf");
+            out += base + "_bucket" + prefix + "le=\"" + le + "\"} " + std::to_string(cumulative) + "\n";
+        }
+        double total = 0;
+        for (size_t t = 0; t < blocks.size(); t++){
+            uint64_t bits = blocks[t][metric.offset + metric.bounds.size() + 2].load(std::memory_order_relaxed);
+            double value = 0;
+            memcpy(&value, &bits, sizeof(value));
+            total += value;
+        }
+        out += base + "_sum" + suffix + " " + format_value(total) + "\n";
+        out += base + "_count" + suffix + " " + std::to_string(cumulative) + "\n";
+    }
+    for (size_t i = 0; i < collectors.size(); i++){
+        collectors[i](out);
+    }
+    return out;
+}
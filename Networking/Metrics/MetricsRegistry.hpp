@@ -0,0 +1,111 @@
+#ifndef MetricsRegistry_hpp
+#define MetricsRegistry_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <functional>
+
+#define METRICS_TLS_SLOTS 64
+#define LATENCY_SUB_BITS 5
+#define LATENCY_BUCKETS 1024
+
+namespace HDE{
+    //Counters, gauges and histograms kept in per-thread cells and summed only when read,
+    //each thread owns a cache-line aligned block so recording never shares a line or takes a lock.
+    //Metrics must be added before threads start recording, names may carry labels like name{kind="read"},
+    //an id is the metric's first cell so recording needs no descriptor lookup
+    class MetricsRegistry{
+        public:
+            enum Type{
+                COUNTER,
+                GAUGE,
+                HISTOGRAM,
+                LATENCY
+            };
+            typedef std::function<void(std::string &out)> Collector;
+        private:
+            struct Metric{
+                std::string name;
+                std::string help;
+                Type type;
+                size_t offset;
+                std::vector<double> bounds;
+            };
+            size_t index;
+            size_t max_cells;
+            size_t used_cells;
+            std::vector<Metric> metrics;
+            std::vector<int> owners;
+            std::vector<Collector> collectors;
+            std::mutex lock;
+            std::vector<std::atomic<uint64_t> *> blocks;
+            std::vector<uint64_t> reported;
+            static thread_local std::atomic<uint64_t> *local_blocks[METRICS_TLS_SLOTS];
+            std::atomic<uint64_t> * attach();
+            int add(const std::string &name, const std::string &help, Type type, size_t cells, const std::vector<double> &bounds);
+            uint64_t sum(size_t cell);
+            void merge_latency(int id, std::vector<uint64_t> &counts);
+            MetricsRegistry(const MetricsRegistry &);
+            MetricsRegistry & operator=(const MetricsRegistry &);
+        public:
+            MetricsRegistry(size_t max_cells = 4 * (LATENCY_BUCKETS + 2));
+            ~MetricsRegistry();
+            int add_counter(const std::string &name, const std::string &help);
+            int add_gauge(const std::string &name, const std::string &help);
+            int add_histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds);
+            int add_latency(const std::string &name, const std::string &help);
+            void add_collector(Collector collector);
+            //Hot path, inline so a counter bump is a TLS load plus a plain add on a thread-owned line
+            inline std::atomic<uint64_t> * cells(){
+                std::atomic<uint64_t> *block = index < METRICS_TLS_SLOTS ? local_blocks[index] : NULL;
+                return block != NULL ? block : attach();
+            }
+            inline void increment(int id, uint64_t n = 1){
+                if (id < 0){
+                    return;
+                }
+                std::atomic<uint64_t> &cell = cells()[id];
+                cell.store(cell.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+            }
+            inline void add(int id, int64_t delta){
+                increment(id, (uint64_t)delta);
+            }
+            void observe(int id, double value);
+            //Log-linear like HdrHistogram, exact below 64ns then 32 buckets per power of two (3% error) up to 68s
+            static inline size_t latency_bucket(uint64_t ns){
+                if (ns < (2ULL << LATENCY_SUB_BITS)){
+                    return ns;
+                }
+                int shift = 63 - __builtin_clzll(ns) - LATENCY_SUB_BITS;
+                size_t bucket = ((size_t)shift << LATENCY_SUB_BITS) + (ns >> shift);
+                return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+            }
+            inline void record_ns(int id, uint64_t ns){
+                if (id < 0){
+                    return;
+                }
+                std::atomic<uint64_t> *block = cells() + id;
+                std::atomic<uint64_t> &bucket = block[latency_bucket(ns)];
+                bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                block[LATENCY_BUCKETS].store(block[LATENCY_BUCKETS].load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+                if (ns > block[LATENCY_BUCKETS + 1].load(std::memory_order_relaxed)){
+                    block[LATENCY_BUCKETS + 1].store(ns, std::memory_order_relaxed);
+                }
+            }
+            uint64_t get_percentile_ns(int id, double percentile);
+            std::string latency_report();
+            static uint64_t bucket_limit(size_t bucket);
+            static uint64_t percentile_of(const std::vector<uint64_t> &counts, double percentile);
+            uint64_t get_counter(int id);
+            int64_t get_gauge(int id);
+            uint64_t get_count(int id);
+            std::string render();
+            static void write_header(std::string &out, const std::string &name, const std::string &help, const char *type);
+    };
+}
+
+#endif
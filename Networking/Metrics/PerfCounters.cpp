@@ -0,0 +1,150 @@
+#include "PerfCounters.hpp"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+
+static int open_event(uint64_t config, int group, bool kernel){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = !kernel;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+//Constructor, tries user plus kernel counting first and falls back to user only
+HDE::PerfCounters::PerfCounters(){
+    static const uint64_t configs[PERF_EVENT_COUNT] = {PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES,
+                                                       PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    available = false;
+    kernel = true;
+    error = 0;
+    for (int i = 0; i < PERF_EVENT_COUNT; i++){
+        fds[i] = -1;
+        ids[i] = 0;
+    }
+    fds[0] = open_event(configs[0], -1, true);
+    if (fds[0] < 0 && (errno == EACCES || errno == EPERM)){
+        kernel = false;
+        fds[0] = open_event(configs[0], -1, false);
+    }
+    if (fds[0] < 0){
+        error = errno;
+        return;
+    }
+    for (int i = 1; i < PERF_EVENT_COUNT; i++){
+        fds[i] = open_event(configs[i], fds[0], kernel);
+    }
+    for (int i = 0; i < PERF_EVENT_COUNT; i++){
+        if (fds[i] >= 0 && ioctl(fds[i], PERF_EVENT_IOC_ID, &ids[i]) < 0){
+            if (i == 0){
+                // Without the leader's id its values can't be matched, the whole group is unusable
+                error = errno;
+                for (int j = PERF_EVENT_COUNT - 1; j >= 0; j--){
+                    if (fds[j] >= 0){
+                        close(fds[j]);
+                        fds[j] = -1;
+                    }
+                }
+                return;
+            }
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+    ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    available = true;
+}
+
+HDE::PerfCounters::~PerfCounters(){
+    for (int i = PERF_EVENT_COUNT - 1; i >= 0; i--){
+        if (fds[i] >= 0){
+            close(fds[i]);
+        }
+    }
+}
+
+bool HDE::PerfCounters::is_available(){
+    return available;
+}
+
+bool HDE::PerfCounters::is_supported(PerfEvent event){
+    return fds[event] >= 0;
+}
+
+bool HDE::PerfCounters::counts_kernel(){
+    return available && kernel;
+}
+
+//errno from the failed open, 0 when the counters are available
+int HDE::PerfCounters::get_error(){
+    return error;
+}
+
+//Counts since the group was enabled, events are matched to the group's values by id
+bool HDE::PerfCounters::read(PerfSample &sample){
+    memset(&sample, 0, sizeof(sample));
+    if (!available){
+        return false;
+    }
+    // nr, time_enabled, time_running, then a value and id per event
+    uint64_t data[3 + 2 * PERF_EVENT_COUNT];
+    ssize_t n = ::read(fds[0], data, sizeof(data));
+    if (n < (ssize_t)(3 * sizeof(uint64_t))){
+        return false;
+    }
+    sample.time_enabled = data[1];
+    sample.time_running = data[2];
+    uint64_t count = data[0] < (uint64_t)PERF_EVENT_COUNT ? data[0] : (uint64_t)PERF_EVENT_COUNT;
+    for (uint64_t i = 0; i < count; i++){
+        for (int event = 0; event < PERF_EVENT_COUNT; event++){
+            if (fds[event] >= 0 && ids[event] == data[4 + 2 * i]){
+                sample.values[event] = data[3 + 2 * i];
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+HDE::PerfSample HDE::PerfCounters::difference(const PerfSample &end, const PerfSample &start){
+    PerfSample delta;
+    delta.time_enabled = end.time_enabled - start.time_enabled;
+    delta.time_running = end.time_running - start.time_running;
+    for (int event = 0; event < PERF_EVENT_COUNT; event++){
+        uint64_t value = end.values[event] - start.values[event];
+        if (delta.time_running == 0){
+            value = 0;
+        } else if (delta.time_running < delta.time_enabled){
+            value = (uint64_t)((double)value * delta.time_enabled / delta.time_running);
+        }
+        delta.values[event] = value;
+    }
+    return delta;
+}
+
+const char * HDE::PerfCounters::event_name(PerfEvent event){
+    static const char *names[PERF_EVENT_COUNT] = {"instructions", "cycles", "cache_misses", "branch_misses"};
+    return names[event];
+}
+
+std::string HDE::PerfCounters::format(const PerfSample &delta, uint64_t operations){
+    if (!available){
+        return std::string("perf counters unavailable: ") + strerror(error);
+    }
+    double per = operations > 0 ? (double)operations : 1;
+    char line[256];
+    snprintf(line, sizeof(line), "instructions=%.1f cycles=%.1f ipc=%.2f cache_misses=%.2f branch_misses=%.2f per op%s",
+             delta.values[PERF_INSTRUCTIONS] / per, delta.values[PERF_CYCLES] / per,
+             delta.values[PERF_CYCLES] > 0 ? (double)delta.values[PERF_INSTRUCTIONS] / delta.values[PERF_CYCLES] : 0.0,
+             delta.values[PERF_CACHE_MISSES] / per, delta.values[PERF_BRANCH_MISSES] / per, kernel ? "" : " (user only)");
+    return line;
+}
@@ -0,0 +1,54 @@
+#ifndef PerfCounters_hpp
+#define PerfCounters_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+namespace HDE{
+    enum PerfEvent{
+        PERF_INSTRUCTIONS,
+        PERF_CYCLES,
+        PERF_CACHE_MISSES,
+        PERF_BRANCH_MISSES,
+        PERF_EVENT_COUNT
+    };
+
+    //Counts since the group was enabled, plus the nanoseconds it was enabled and actually on the PMU
+    struct PerfSample{
+        uint64_t values[PERF_EVENT_COUNT];
+        uint64_t time_enabled;
+        uint64_t time_running;
+    };
+
+    //Hardware counters for the constructing thread, opened as one perf_event_open group so a single read()
+    //returns every event over the same interval. Kernel time is counted when perf_event_paranoid allows it.
+    //Without a PMU or permission the group stays closed, is_available() is false and read() returns false,
+    //an event the CPU lacks reads as 0 and is_supported() reports it
+    class PerfCounters{
+        private:
+            int fds[PERF_EVENT_COUNT];
+            uint64_t ids[PERF_EVENT_COUNT];
+            bool available;
+            bool kernel;
+            int error;
+            PerfCounters(const PerfCounters &);
+            PerfCounters & operator=(const PerfCounters &);
+        public:
+            PerfCounters();
+            ~PerfCounters();
+            bool is_available();
+            bool is_supported(PerfEvent event);
+            bool counts_kernel();
+            int get_error();
+            bool read(PerfSample &sample);
+            //When the kernel multiplexed the group the counts are scaled up by enabled over running time,
+            //an interval the group never ran in reads as all zeros
+            static PerfSample difference(const PerfSample &end, const PerfSample &start);
+            static const char * event_name(PerfEvent event);
+            //One line per-operation averages for benchmark output
+            std::string format(const PerfSample &delta, uint64_t operations);
+    };
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef hdelibc_metrics_hpp
+#define hdelibc_metrics_hpp
+
+#include <stdio.h>
+#include "CycleClock.hpp"
+#include "PerfCounters.hpp"
+#include "MetricsRegistry.hpp"
+
+
+#endif
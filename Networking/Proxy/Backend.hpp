@@ -0,0 +1,18 @@
+#ifndef Backend_hpp
+#define Backend_hpp
+
+#include <stdio.h>
+#include <string>
+#include <sys/types.h>
+
+namespace HDE{
+    //An upstream server, interface is the IPv4 address in host byte order as in SimpleSocket
+    struct Backend{
+        std::string name;
+        int port;
+        u_long interface;
+        int weight;
+    };
+}
+
+#endif
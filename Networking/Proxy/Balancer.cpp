@@ -0,0 +1,187 @@
+#include "Balancer.hpp"
+#include "BalancingPolicy.hpp"
+#include "../Events/EventLoop.hpp"
+
+//Constructor, takes ownership of the policy
+HDE::Balancer::Balancer(std::vector<Backend> backends, BalancingPolicy *policy) : backends(backends), loads(new BackendLoad[backends.size()]), policy(policy){
+    for (size_t i = 0; i < backends.size(); i++){
+        loads[i].outstanding.store(0);
+        loads[i].ewma_us.store(0);
+        loads[i].requests.store(0);
+        loads[i].failures.store(0);
+        loads[i].state.store(BACKEND_HEALTHY);
+        loads[i].consecutive_failures.store(0);
+        loads[i].ejected_until_ms.store(0);
+        loads[i].recovered_at_ms.store(0);
+        loads[i].ejections.store(0);
+        loads[i].recoveries.store(0);
+    }
+    outlier.consecutive_failures = 5;
+    outlier.base_ejection_ms = 10000;
+    outlier.max_ejection_ms = 300000;
+    outlier.ramp_ms = 10000;
+    outlier.max_ejected_percent = 50;
+    metrics = NULL;
+    this->policy->build(*this);
+}
+
+HDE::Balancer::~Balancer(){
+}
+
+void HDE::Balancer::set_outlier_config(OutlierConfig config){
+    outlier = config;
+}
+
+void HDE::Balancer::set_metrics(MetricsRegistry *metrics){
+    static const char *states[] = {"healthy", "ejected", "recovering"};
+    this->metrics = metrics;
+    state_metrics.clear();
+    for (size_t i = 0; i < backends.size(); i++){
+        for (size_t state = 0; state < sizeof(states) / sizeof(states[0]); state++){
+            state_metrics.push_back(metrics->add_counter("hdelibc_backend_transitions_total{backend=\"" + backends[i].name + "\",state=\"" +
+                                                         states[state] + "\"}", "Backend state changes, ejected counts ejections"));
+        }
+    }
+}
+
+void HDE::Balancer::count_state(size_t index, BackendState state){
+    if (metrics != NULL){
+        metrics->increment(state_metrics[index * 3 + state]);
+    }
+}
+
+//key is only used by hashing policies, e.g. a hash of the request path
+size_t HDE::Balancer::select(uint64_t key){
+    size_t attempts = backends.size() * 2;
+    for (size_t attempt = 0; attempt < attempts; attempt++){
+        size_t index = policy->select(*this, key + attempt * 0x9E3779B97F4A7C15ULL);
+        if (admit(index)){
+            return index;
+        }
+    }
+    // Everything is ejected, spreading load beats refusing it
+    return policy->select(*this, key);
+}
+
+//Ejected backends are refused until their time is up, recovering ones take a linearly growing share
+bool HDE::Balancer::admit(size_t index){
+    BackendLoad &load = loads[index];
+    int state = load.state.load(std::memory_order_acquire);
+    if (state == BACKEND_HEALTHY){
+        return true;
+    }
+    int64_t now = EventLoop::now_ms();
+    if (state == BACKEND_EJECTED){
+        if (now < load.ejected_until_ms.load(std::memory_order_relaxed)){
+            return false;
+        }
+        if (load.state.compare_exchange_strong(state, BACKEND_RECOVERING)){
+            load.recovered_at_ms.store(now, std::memory_order_relaxed);
+            load.recoveries.fetch_add(1, std::memory_order_relaxed);
+            count_state(index, BACKEND_RECOVERING);
+        }
+        state = BACKEND_RECOVERING;
+    }
+    int64_t elapsed = now - load.recovered_at_ms.load(std::memory_order_relaxed);
+    if (outlier.ramp_ms <= 0 || elapsed >= outlier.ramp_ms){
+        if (load.state.compare_exchange_strong(state, BACKEND_HEALTHY)){
+            count_state(index, BACKEND_HEALTHY);
+        }
+        return true;
+    }
+    int64_t share = elapsed > outlier.ramp_ms / 10 ? elapsed : outlier.ramp_ms / 10;
+    return (int64_t)(random_u64() % outlier.ramp_ms) < share;
+}
+
+//Holds the backend out until at least until_ms. Returns false when capped and too many other backends are out,
+//an already ejected backend keeps the later of its two deadlines so a passive ejection can't shorten mark_down's hold
+bool HDE::Balancer::eject(size_t index, int64_t until_ms, bool capped){
+    BackendLoad &load = loads[index];
+    int state = load.state.load(std::memory_order_acquire);
+    if (state != BACKEND_EJECTED && capped){
+        size_t ejected = 0;
+        for (size_t i = 0; i < backends.size(); i++){
+            if (i != index && loads[i].state.load(std::memory_order_relaxed) == BACKEND_EJECTED){
+                ejected++;
+            }
+        }
+        if ((ejected + 1) * 100 > backends.size() * (size_t)outlier.max_ejected_percent){
+            return false;
+        }
+    }
+    // The deadline goes in before the state so admit() never pairs EJECTED with a stale deadline, a backend that
+    // isn't ejected has a deadline in the past so taking the maximum always installs until_ms
+    int64_t until = load.ejected_until_ms.load(std::memory_order_relaxed);
+    while (until < until_ms && !load.ejected_until_ms.compare_exchange_weak(until, until_ms, std::memory_order_relaxed)){
+    }
+    while (state != BACKEND_EJECTED){
+        if (load.state.compare_exchange_weak(state, BACKEND_EJECTED, std::memory_order_acq_rel)){
+            load.ejections.fetch_add(1, std::memory_order_relaxed);
+            load.consecutive_failures.store(0, std::memory_order_relaxed);
+            count_state(index, BACKEND_EJECTED);
+            break;
+        }
+    }
+    return true;
+}
+
+//Active health check failure, held out until mark_up
+bool HDE::Balancer::mark_down(size_t index){
+    return eject(index, INT64_MAX, false);
+}
+
+//Active health check success, only lifts ejections made by mark_down
+void HDE::Balancer::mark_up(size_t index){
+    int64_t held = INT64_MAX;
+    loads[index].ejected_until_ms.compare_exchange_strong(held, EventLoop::now_ms());
+}
+
+bool HDE::Balancer::is_available(size_t index){
+    return loads[index].state.load(std::memory_order_relaxed) != BACKEND_EJECTED;
+}
+
+HDE::BackendState HDE::Balancer::get_state(size_t index){
+    return (BackendState)loads[index].state.load(std::memory_order_relaxed);
+}
+
+void HDE::Balancer::on_start(size_t index){
+    loads[index].outstanding.fetch_add(1, std::memory_order_relaxed);
+    loads[index].requests.fetch_add(1, std::memory_order_relaxed);
+}
+
+//Folds the latency into an EWMA with weight 1/8, as TCP does for its smoothed RTT, and counts failures toward ejection
+void HDE::Balancer::on_finish(size_t index, uint64_t latency_us, bool success){
+    BackendLoad &load = loads[index];
+    load.outstanding.fetch_sub(1, std::memory_order_relaxed);
+    if (success){
+        load.consecutive_failures.store(0, std::memory_order_relaxed);
+    } else {
+        load.failures.fetch_add(1, std::memory_order_relaxed);
+        uint32_t streak = load.consecutive_failures.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (outlier.consecutive_failures > 0 && streak >= outlier.consecutive_failures){
+            // Repeat offenders stay out longer, up to max_ejection_ms
+            int64_t backoff = (int64_t)outlier.base_ejection_ms * (int64_t)(load.ejections.load(std::memory_order_relaxed) + 1);
+            if (backoff > outlier.max_ejection_ms){
+                backoff = outlier.max_ejection_ms;
+            }
+            eject(index, EventLoop::now_ms() + backoff, true);
+        }
+    }
+    uint64_t old = load.ewma_us.load(std::memory_order_relaxed);
+    uint64_t next;
+    do{
+        next = old == 0 ? latency_us : (old * 7 + latency_us) / 8;
+    } while (!load.ewma_us.compare_exchange_weak(old, next, std::memory_order_relaxed));
+}
+
+size_t HDE::Balancer::get_size(){
+    return backends.size();
+}
+
+HDE::Backend & HDE::Balancer::get_backend(size_t index){
+    return backends[index];
+}
+
+HDE::BackendLoad & HDE::Balancer::get_load(size_t index){
+    return loads[index];
+}
@@ -0,0 +1,76 @@
+#ifndef Balancer_hpp
+#define Balancer_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "Backend.hpp"
+#include "../Metrics/MetricsRegistry.hpp"
+
+namespace HDE{
+    class BalancingPolicy;
+
+    enum BackendState{
+        BACKEND_HEALTHY,
+        BACKEND_EJECTED,
+        BACKEND_RECOVERING
+    };
+
+    //Per-backend load and health shared by every worker, padded so backends don't share a cache line
+    struct alignas(64) BackendLoad{
+        std::atomic<int64_t> outstanding;
+        std::atomic<uint64_t> ewma_us;
+        std::atomic<uint64_t> requests;
+        std::atomic<uint64_t> failures;
+        std::atomic<int> state;
+        std::atomic<uint32_t> consecutive_failures;
+        std::atomic<int64_t> ejected_until_ms;
+        std::atomic<int64_t> recovered_at_ms;
+        std::atomic<uint64_t> ejections;
+        std::atomic<uint64_t> recoveries;
+    };
+
+    //Passive outlier detection, a backend is ejected after consecutive failures and ramped back in
+    struct OutlierConfig{
+        uint32_t consecutive_failures;
+        int base_ejection_ms;
+        int max_ejection_ms;
+        int ramp_ms;
+        int max_ejected_percent;
+    };
+
+    //Picks a backend for each request, selection only touches atomics so workers share one Balancer
+    class Balancer{
+        private:
+            std::vector<Backend> backends;
+            std::unique_ptr<BackendLoad[]> loads;
+            std::unique_ptr<BalancingPolicy> policy;
+            OutlierConfig outlier;
+            MetricsRegistry *metrics;
+            std::vector<int> state_metrics;
+            bool admit(size_t index);
+            bool eject(size_t index, int64_t until_ms, bool capped);
+            void count_state(size_t index, BackendState state);
+        public:
+            Balancer(std::vector<Backend> backends, BalancingPolicy *policy);
+            ~Balancer();
+            size_t select(uint64_t key);
+            void on_start(size_t index);
+            void on_finish(size_t index, uint64_t latency_us, bool success);
+            void set_outlier_config(OutlierConfig config);
+            //Counts every state change per backend, call before workers start selecting
+            void set_metrics(MetricsRegistry *metrics);
+            //Not subject to max_ejected_percent, returns whether the backend is now held out
+            bool mark_down(size_t index);
+            void mark_up(size_t index);
+            bool is_available(size_t index);
+            BackendState get_state(size_t index);
+            size_t get_size();
+            Backend & get_backend(size_t index);
+            BackendLoad & get_load(size_t index);
+    };
+}
+
+#endif
@@ -0,0 +1,165 @@
+#include "BalancingPolicy.hpp"
+#include <string>
+
+//FNV-1a, used for request keys and Maglev permutations
+uint64_t HDE::hash_key(const char *data, size_t len){
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++){
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//Per-thread xorshift, cheap enough for every request
+uint64_t HDE::random_u64(){
+    static thread_local uint64_t state = 0;
+    if (state == 0){
+        state = (uint64_t)(uintptr_t)&state ^ 0x9E3779B97F4A7C15ULL;
+    }
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+//Picks two distinct random backends
+static void pick_two(size_t size, size_t &a, size_t &b){
+    a = HDE::random_u64() % size;
+    b = size > 1 ? (a + 1 + HDE::random_u64() % (size - 1)) % size : a;
+}
+
+HDE::BalancingPolicy::~BalancingPolicy(){
+}
+
+void HDE::BalancingPolicy::build(Balancer &){
+}
+
+//Constructor
+HDE::RoundRobinPolicy::RoundRobinPolicy() : next(0){
+}
+
+size_t HDE::RoundRobinPolicy::select(Balancer &balancer, uint64_t){
+    return next.fetch_add(1, std::memory_order_relaxed) % balancer.get_size();
+}
+
+//Constructor
+HDE::SmoothWeightedPolicy::SmoothWeightedPolicy() : next(0){
+}
+
+//Runs one full cycle of the smooth algorithm, spreading heavy backends between light ones
+void HDE::SmoothWeightedPolicy::build(Balancer &balancer){
+    size_t size = balancer.get_size();
+    std::vector<int64_t> current(size, 0);
+    int64_t total = 0;
+    for (size_t i = 0; i < size; i++){
+        total += balancer.get_backend(i).weight > 0 ? balancer.get_backend(i).weight : 1;
+    }
+    sequence.clear();
+    for (int64_t step = 0; step < total; step++){
+        size_t best = 0;
+        for (size_t i = 0; i < size; i++){
+            int weight = balancer.get_backend(i).weight > 0 ? balancer.get_backend(i).weight : 1;
+            current[i] += weight;
+            if (current[i] > current[best]){
+                best = i;
+            }
+        }
+        current[best] -= total;
+        sequence.push_back(best);
+    }
+}
+
+size_t HDE::SmoothWeightedPolicy::select(Balancer &, uint64_t){
+    return sequence[next.fetch_add(1, std::memory_order_relaxed) % sequence.size()];
+}
+
+size_t HDE::PowerOfTwoPolicy::select(Balancer &balancer, uint64_t){
+    size_t a;
+    size_t b;
+    pick_two(balancer.get_size(), a, b);
+    if (!balancer.is_available(a)){
+        return b;
+    }
+    if (!balancer.is_available(b)){
+        return a;
+    }
+    int64_t load_a = balancer.get_load(a).outstanding.load(std::memory_order_relaxed);
+    int64_t load_b = balancer.get_load(b).outstanding.load(std::memory_order_relaxed);
+    return load_b < load_a ? b : a;
+}
+
+size_t HDE::EwmaPolicy::select(Balancer &balancer, uint64_t){
+    size_t a;
+    size_t b;
+    pick_two(balancer.get_size(), a, b);
+    if (!balancer.is_available(a)){
+        return b;
+    }
+    if (!balancer.is_available(b)){
+        return a;
+    }
+    BackendLoad &load_a = balancer.get_load(a);
+    BackendLoad &load_b = balancer.get_load(b);
+    // Unmeasured backends score as 1us so they get tried
+    uint64_t cost_a = (load_a.ewma_us.load(std::memory_order_relaxed) + 1) * (load_a.outstanding.load(std::memory_order_relaxed) + 1);
+    uint64_t cost_b = (load_b.ewma_us.load(std::memory_order_relaxed) + 1) * (load_b.outstanding.load(std::memory_order_relaxed) + 1);
+    return cost_b < cost_a ? b : a;
+}
+
+//Smallest prime at or above n, trial division is plenty for table sizes
+static size_t next_prime(size_t n){
+    for (n = n < 2 ? 2 : n; ; n++){
+        bool prime = true;
+        for (size_t d = 2; d * d <= n && prime; d++){
+            prime = n % d != 0;
+        }
+        if (prime){
+            return n;
+        }
+    }
+}
+
+//Constructor, table_size should be well above the backend count and is rounded up to the next prime
+HDE::MaglevPolicy::MaglevPolicy(size_t table_size){
+    this->table_size = next_prime(table_size);
+}
+
+size_t HDE::MaglevPolicy::get_table_size(){
+    return table_size;
+}
+
+//Fills the lookup table from each backend's permutation in turn, weights are ignored
+void HDE::MaglevPolicy::build(Balancer &balancer){
+    size_t size = balancer.get_size();
+    table.assign(table_size, UINT32_MAX);
+    if (size == 0){
+        return;
+    }
+    std::vector<uint64_t> offset(size);
+    std::vector<uint64_t> skip(size);
+    std::vector<uint64_t> position(size, 0);
+    for (size_t i = 0; i < size; i++){
+        const std::string &name = balancer.get_backend(i).name;
+        uint64_t h = hash_key(name.data(), name.size());
+        offset[i] = h % table_size;
+        skip[i] = (h >> 32) % (table_size - 1) + 1;
+    }
+    size_t filled = 0;
+    while (filled < table_size){
+        for (size_t i = 0; i < size && filled < table_size; i++){
+            uint64_t slot = (offset[i] + position[i] * skip[i]) % table_size;
+            while (table[slot] != UINT32_MAX){
+                position[i]++;
+                slot = (offset[i] + position[i] * skip[i]) % table_size;
+            }
+            table[slot] = i;
+            position[i]++;
+            filled++;
+        }
+    }
+}
+
+size_t HDE::MaglevPolicy::select(Balancer &, uint64_t key){
+    return table[key % table_size];
+}
@@ -0,0 +1,66 @@
+#ifndef BalancingPolicy_hpp
+#define BalancingPolicy_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "Balancer.hpp"
+
+namespace HDE{
+    class BalancingPolicy{
+        public:
+            virtual ~BalancingPolicy();
+            virtual void build(Balancer &balancer);
+            virtual size_t select(Balancer &balancer, uint64_t key) = 0;
+    };
+
+    class RoundRobinPolicy : public BalancingPolicy{
+        private:
+            std::atomic<uint64_t> next;
+        public:
+            RoundRobinPolicy();
+            size_t select(Balancer &balancer, uint64_t key);
+    };
+
+    //nginx smooth weighted round-robin, precomputed so selection is one atomic increment
+    class SmoothWeightedPolicy : public BalancingPolicy{
+        private:
+            std::vector<size_t> sequence;
+            std::atomic<uint64_t> next;
+        public:
+            SmoothWeightedPolicy();
+            void build(Balancer &balancer);
+            size_t select(Balancer &balancer, uint64_t key);
+    };
+
+    //Power of two choices, the less loaded of two random backends by outstanding requests, ejected backends lose
+    class PowerOfTwoPolicy : public BalancingPolicy{
+        public:
+            size_t select(Balancer &balancer, uint64_t key);
+    };
+
+    //Power of two choices scored by latency EWMA times outstanding requests
+    class EwmaPolicy : public BalancingPolicy{
+        public:
+            size_t select(Balancer &balancer, uint64_t key);
+    };
+
+    //Maglev consistent hashing, the same key keeps landing on the same backend. The table size is rounded up to a
+    //prime of at least 2, every backend's probe sequence only visits all slots when the size is prime
+    class MaglevPolicy : public BalancingPolicy{
+        private:
+            size_t table_size;
+            std::vector<uint32_t> table;
+        public:
+            MaglevPolicy(size_t table_size = 65537);
+            void build(Balancer &balancer);
+            size_t select(Balancer &balancer, uint64_t key);
+            size_t get_table_size();
+    };
+
+    uint64_t hash_key(const char *data, size_t len);
+    uint64_t random_u64();
+}
+
+#endif
@@ -0,0 +1,170 @@
+#include "HealthChecker.hpp"
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+//Constructor
+HDE::HealthChecker::HealthChecker(EventLoop *loop, Balancer *balancer, HealthCheckConfig config) : connector(loop, config.timeout_ms){
+    this->loop = loop;
+    this->balancer = balancer;
+    this->config = config;
+    timer = 0;
+    probes_sent = 0;
+    probes_failed = 0;
+    transitions = 0;
+    metrics = NULL;
+    Probe blank;
+    blank.sock = -1;
+    blank.timer = 0;
+    blank.successes = 0;
+    blank.failures = 0;
+    blank.in_flight = false;
+    blank.down = false;
+    probes.assign(balancer->get_size(), blank);
+}
+
+HDE::HealthChecker::~HealthChecker(){
+    stop();
+    for (size_t i = 0; i < probes.size(); i++){
+        if (probes[i].sock >= 0){
+            loop->cancel_timer(probes[i].timer);
+            loop->remove(probes[i].sock);
+            close(probes[i].sock);
+        }
+    }
+}
+
+void HDE::HealthChecker::set_metrics(MetricsRegistry *metrics){
+    this->metrics = metrics;
+    transition_metrics.clear();
+    for (size_t i = 0; i < probes.size(); i++){
+        std::string labels = "{backend=\"" + balancer->get_backend(i).name + "\",state=\"";
+        transition_metrics.push_back(metrics->add_counter("hdelibc_health_transitions_total" + labels + "up\"}", "Active health check transitions"));
+        transition_metrics.push_back(metrics->add_counter("hdelibc_health_transitions_total" + labels + "down\"}", "Active health check transitions"));
+    }
+}
+
+void HDE::HealthChecker::start(){
+    if (timer == 0){
+        run();
+    }
+}
+
+void HDE::HealthChecker::stop(){
+    loop->cancel_timer(timer);
+    timer = 0;
+}
+
+void HDE::HealthChecker::run(){
+    for (size_t i = 0; i < probes.size(); i++){
+        probe(i);
+    }
+    timer = loop->run_after(config.interval_ms, [this](){ run(); });
+}
+
+void HDE::HealthChecker::probe(size_t index){
+    if (probes[index].in_flight){
+        return;
+    }
+    probes[index].in_flight = true;
+    probes[index].response.clear();
+    probes_sent++;
+    Backend &backend = balancer->get_backend(index);
+    connector.connect(backend.port, backend.interface, [this, index](int sock, int){
+        if (sock < 0){
+            finish(index, false);
+            return;
+        }
+        Backend &target = balancer->get_backend(index);
+        std::string request = "GET " + config.path + " HTTP/1.1\r\nHost: " + target.name +
+                              "\r\nUser-Agent: hdelibc-health\r\nConnection: close\r\n\r\n";
+        // A fresh socket's send buffer always takes a request this small
+        if (send(sock, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()){
+            close(sock);
+            finish(index, false);
+            return;
+        }
+        probes[index].sock = sock;
+        loop->add(sock, EPOLLIN, [this, index](uint32_t){ on_readable(index); });
+        probes[index].timer = loop->run_after(config.timeout_ms, [this, index](){
+            probes[index].timer = 0;
+            finish(index, false);
+        });
+    });
+}
+
+//Only the status line matters, 2xx and 3xx count as healthy
+void HDE::HealthChecker::on_readable(size_t index){
+    Probe &probe = probes[index];
+    char chunk[512];
+    ssize_t n = recv(probe.sock, chunk, sizeof(chunk), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)){
+        return;
+    }
+    if (n > 0){
+        probe.response.append(chunk, n);
+    }
+    size_t line_end = probe.response.find("\r\n");
+    if (line_end == std::string::npos){
+        if (n <= 0 || probe.response.size() > 4096){
+            finish(index, false);
+        }
+        return;
+    }
+    size_t space = probe.response.find(' ');
+    int status = space < line_end ? atoi(probe.response.c_str() + space + 1) : 0;
+    finish(index, status >= 200 && status < 400);
+}
+
+void HDE::HealthChecker::finish(size_t index, bool healthy){
+    Probe &probe = probes[index];
+    if (probe.sock >= 0){
+        loop->cancel_timer(probe.timer);
+        loop->remove(probe.sock);
+        close(probe.sock);
+        probe.sock = -1;
+    }
+    probe.timer = 0;
+    probe.in_flight = false;
+    if (healthy){
+        probe.failures = 0;
+        probe.successes++;
+        if (probe.down && probe.successes >= config.healthy_threshold){
+            probe.down = false;
+            transitions++;
+            if (metrics != NULL){
+                metrics->increment(transition_metrics[index * 2]);
+            }
+            balancer->mark_up(index);
+        }
+        return;
+    }
+    probes_failed++;
+    probe.successes = 0;
+    probe.failures++;
+    // Only a hold the balancer took counts, a refused one is retried on the next failed probe
+    if (!probe.down && probe.failures >= config.unhealthy_threshold && balancer->mark_down(index)){
+        probe.down = true;
+        transitions++;
+        if (metrics != NULL){
+            metrics->increment(transition_metrics[index * 2 + 1]);
+        }
+    }
+}
+
+bool HDE::HealthChecker::is_down(size_t index){
+    return probes[index].down;
+}
+
+uint64_t HDE::HealthChecker::get_probes_sent(){
+    return probes_sent;
+}
+
+uint64_t HDE::HealthChecker::get_probes_failed(){
+    return probes_failed;
+}
+
+uint64_t HDE::HealthChecker::get_transitions(){
+    return transitions;
+}
@@ -0,0 +1,63 @@
+#ifndef HealthChecker_hpp
+#define HealthChecker_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Balancer.hpp"
+#include "../Metrics/MetricsRegistry.hpp"
+#include "../Sockets/Connector.hpp"
+#include "../Events/EventLoop.hpp"
+
+namespace HDE{
+    struct HealthCheckConfig{
+        int interval_ms;
+        int timeout_ms;
+        std::string path;
+        int unhealthy_threshold;
+        int healthy_threshold;
+    };
+
+    //Probes every backend of a Balancer with GET requests from one event loop's timers
+    class HealthChecker{
+        private:
+            struct Probe{
+                int sock;
+                uint64_t timer;
+                std::string response;
+                int successes;
+                int failures;
+                bool in_flight;
+                bool down;
+            };
+            EventLoop *loop;
+            Balancer *balancer;
+            HealthCheckConfig config;
+            Connector connector;
+            std::vector<Probe> probes;
+            uint64_t timer;
+            uint64_t probes_sent;
+            uint64_t probes_failed;
+            uint64_t transitions;
+            MetricsRegistry *metrics;
+            std::vector<int> transition_metrics;
+            void run();
+            void probe(size_t index);
+            void on_readable(size_t index);
+            void finish(size_t index, bool healthy);
+        public:
+            HealthChecker(EventLoop *loop, Balancer *balancer, HealthCheckConfig config);
+            ~HealthChecker();
+            //Counts up and down transitions per backend, call before start()
+            void set_metrics(MetricsRegistry *metrics);
+            void start();
+            void stop();
+            bool is_down(size_t index);
+            uint64_t get_probes_sent();
+            uint64_t get_probes_failed();
+            uint64_t get_transitions();
+    };
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include "HedgePolicy.hpp"
+
+//Constructor, percentile is a fraction such as 0.95, the delay starts at max_delay_us until samples arrive
+HDE::HedgePolicy::HedgePolicy(double percentile, int64_t min_delay_us, int64_t max_delay_us){
+    for (size_t i = 0; i < HEDGE_BUCKETS; i++){
+        buckets[i].store(0);
+    }
+    samples.store(0);
+    delay_us.store(max_delay_us);
+    this->percentile = percentile;
+    this->min_delay_us = min_delay_us;
+    this->max_delay_us = max_delay_us;
+    refresh_every = 1024;
+}
+
+//Log-linear buckets, four per power of two
+size_t HDE::HedgePolicy::bucket_for(uint64_t value){
+    if (value < 4){
+        return value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    size_t sub = (value >> (exponent - 2)) & 3;
+    size_t index = (exponent - 1) * 4 + sub;
+    return index < HEDGE_BUCKETS ? index : HEDGE_BUCKETS - 1;
+}
+
+//Exclusive upper bound of a bucket
+uint64_t HDE::HedgePolicy::bucket_limit(size_t index){
+    if (index < 4){
+        return index + 1;
+    }
+    int exponent = index / 4 + 1;
+    uint64_t sub = index % 4;
+    return (4 + sub + 1) << (exponent - 2);
+}
+
+void HDE::HedgePolicy::record(uint64_t latency_us){
+    buckets[bucket_for(latency_us)].fetch_add(1, std::memory_order_relaxed);
+    if (samples.fetch_add(1, std::memory_order_relaxed) % refresh_every == refresh_every - 1){
+        refresh();
+    }
+}
+
+//Recomputes the delay then halves every bucket so old samples fade out
+void HDE::HedgePolicy::refresh(){
+    uint64_t counts[HEDGE_BUCKETS];
+    uint64_t total = 0;
+    for (size_t i = 0; i < HEDGE_BUCKETS; i++){
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0){
+        return;
+    }
+    uint64_t target = (uint64_t)(total * percentile);
+    uint64_t seen = 0;
+    int64_t delay = max_delay_us;
+    for (size_t i = 0; i < HEDGE_BUCKETS; i++){
+        seen += counts[i];
+        if (seen > target){
+            delay = bucket_limit(i);
+            break;
+        }
+    }
+    if (delay < min_delay_us){
+        delay = min_delay_us;
+    }
+    if (delay > max_delay_us){
+        delay = max_delay_us;
+    }
+    delay_us.store(delay, std::memory_order_relaxed);
+    for (size_t i = 0; i < HEDGE_BUCKETS; i++){
+        buckets[i].fetch_sub(counts[i] / 2, std::memory_order_relaxed);
+    }
+}
+
+int64_t HDE::HedgePolicy::get_delay_us(){
+    return delay_us.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,31 @@
+#ifndef HedgePolicy_hpp
+#define HedgePolicy_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+
+#define HEDGE_BUCKETS 256
+
+namespace HDE{
+    //Chooses the hedge delay as a percentile of recent response-head latency, shared lock-free by workers
+    class HedgePolicy{
+        private:
+            std::atomic<uint64_t> buckets[HEDGE_BUCKETS];
+            std::atomic<uint64_t> samples;
+            std::atomic<int64_t> delay_us;
+            double percentile;
+            int64_t min_delay_us;
+            int64_t max_delay_us;
+            uint64_t refresh_every;
+            void refresh();
+        public:
+            HedgePolicy(double percentile, int64_t min_delay_us, int64_t max_delay_us);
+            void record(uint64_t latency_us);
+            int64_t get_delay_us();
+            static size_t bucket_for(uint64_t value);
+            static uint64_t bucket_limit(size_t index);
+    };
+}
+
+#endif
@@ -0,0 +1,44 @@
+#include "RetryBudget.hpp"
+
+//Constructor, ratio is the extra requests allowed per ordinary request, e.g. 0.1
+HDE::RetryBudget::RetryBudget(double ratio, int initial_tokens, int max_tokens){
+    ratio_milli = (int64_t)(ratio * 1000);
+    max_milli = (int64_t)max_tokens * 1000;
+    balance_milli.store((int64_t)initial_tokens * 1000);
+    granted.store(0);
+    denied.store(0);
+}
+
+void HDE::RetryBudget::deposit(){
+    int64_t old = balance_milli.load(std::memory_order_relaxed);
+    while (old < max_milli){
+        int64_t next = old + ratio_milli > max_milli ? max_milli : old + ratio_milli;
+        if (balance_milli.compare_exchange_weak(old, next, std::memory_order_relaxed)){
+            return;
+        }
+    }
+}
+
+bool HDE::RetryBudget::withdraw(){
+    int64_t old = balance_milli.load(std::memory_order_relaxed);
+    while (old >= 1000){
+        if (balance_milli.compare_exchange_weak(old, old - 1000, std::memory_order_relaxed)){
+            granted.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    denied.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+uint64_t HDE::RetryBudget::get_granted(){
+    return granted.load(std::memory_order_relaxed);
+}
+
+uint64_t HDE::RetryBudget::get_denied(){
+    return denied.load(std::memory_order_relaxed);
+}
+
+double HDE::RetryBudget::get_balance(){
+    return balance_milli.load(std::memory_order_relaxed) / 1000.0;
+}
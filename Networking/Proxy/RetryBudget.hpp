@@ -0,0 +1,27 @@
+#ifndef RetryBudget_hpp
+#define RetryBudget_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace HDE{
+    //Token bucket filled by ordinary requests and drained by hedges and retries, capping their amplification
+    class RetryBudget{
+        private:
+            std::atomic<int64_t> balance_milli;
+            int64_t ratio_milli;
+            int64_t max_milli;
+            std::atomic<uint64_t> granted;
+            std::atomic<uint64_t> denied;
+        public:
+            RetryBudget(double ratio, int initial_tokens, int max_tokens);
+            void deposit();
+            bool withdraw();
+            uint64_t get_granted();
+            uint64_t get_denied();
+            double get_balance();
+    };
+}
+
+#endif
@@ -0,0 +1,1522 @@
+#include "ReverseProxy.hpp"
+#include "../IO/ChainBuffer.hpp"
+#include "../IO/ZeroCopySender.hpp"
+#include "../Http/BodyFramer.hpp"
+#include "../Metrics/CycleClock.hpp"
+#include "BalancingPolicy.hpp"
+#include <memory>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define PROXY_READ_CHUNK 65536
+
+//Headers that describe one connection and must not be forwarded, Transfer-Encoding is kept because bodies pass through verbatim
+static bool is_hop_by_hop(const std::string &name, const std::string &connection){
+    static const char *names[] = {"Connection", "Keep-Alive", "Proxy-Connection", "Proxy-Authenticate",
+                                  "Proxy-Authorization", "TE", "Trailer", "Upgrade"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++){
+        if (HDE::header_name_equals(name, names[i])){
+            return true;
+        }
+    }
+    return !connection.empty() && HDE::header_has_token(connection, name);
+}
+
+static bool parse_length(const std::string &value, uint64_t &length){
+    if (value.empty() || value.size() > 15){
+        return false;
+    }
+    length = 0;
+    for (size_t i = 0; i < value.size(); i++){
+        if (value[i] < '0' || value[i] > '9'){
+            return false;
+        }
+        length = length * 10 + (value[i] - '0');
+    }
+    return true;
+}
+
+//The last coding of every Transfer-Encoding header taken together, a body is only delimited by chunked when it comes last
+static bool chunked_is_last(HDE::HttpRequest::Headers &headers){
+    std::string last;
+    for (size_t i = 0; i < headers.size(); i++){
+        if (!HDE::header_name_equals(headers[i].first, "Transfer-Encoding")){
+            continue;
+        }
+        const std::string &value = headers[i].second;
+        size_t start = 0;
+        while (start <= value.size()){
+            size_t end = value.find(',', start);
+            end = end == std::string::npos ? value.size() : end;
+            size_t a = start;
+            size_t b = end;
+            while (a < b && (value[a] == ' ' || value[a] == '\t')){
+                a++;
+            }
+            while (b > a && (value[b - 1] == ' ' || value[b - 1] == '\t')){
+                b--;
+            }
+            // Empty list elements are allowed and don't count as a coding
+            if (b > a){
+                last = value.substr(a, b - a);
+            }
+            start = end + 1;
+        }
+    }
+    return HDE::header_name_equals(last, "chunked");
+}
+
+static size_t count_headers(HDE::HttpRequest::Headers &headers, const char *name){
+    size_t count = 0;
+    for (size_t i = 0; i < headers.size(); i++){
+        count += HDE::header_name_equals(headers[i].first, name) ? 1 : 0;
+    }
+    return count;
+}
+
+static std::string protocol_version(const std::string &version){
+    return version.compare(0, 5, "HTTP/") == 0 ? version.substr(5) : version;
+}
+
+//How a final response's body is delimited, per RFC 9112 section 6.3
+static HDE::BodyFramer::Mode response_framing(HDE::HttpResponse &response, bool head_request, uint64_t &length){
+    int status = response.get_status();
+    std::string encoding = response.get_header("Transfer-Encoding");
+    length = 0;
+    if (head_request || status == 204 || status == 304){
+        return HDE::BodyFramer::NO_BODY;
+    }
+    if (!encoding.empty() && HDE::header_has_token(encoding, "chunked")){
+        return HDE::BodyFramer::CHUNKED;
+    }
+    if (response.has_header("Content-Length") && parse_length(response.get_header("Content-Length"), length)){
+        return HDE::BodyFramer::LENGTH;
+    }
+    return HDE::BodyFramer::UNTIL_CLOSE;
+}
+
+//Moves the bytes framer accepts from in to out, keeping a copy when copy is given
+static void forward_body(HDE::ChainBuffer &in, HDE::ChainBuffer &out, HDE::BodyFramer &framer, std::string *copy){
+    size_t take = 0;
+    for (size_t i = 0; i < in.get_block_count() && !framer.is_done() && !framer.is_error(); i++){
+        size_t n = in.get_block_size(i);
+        size_t used = framer.feed(in.get_block_data(i), n);
+        if (copy != NULL){
+            copy->append(in.get_block_data(i), used);
+        }
+        take += used;
+        if (used < n){
+            break;
+        }
+    }
+    in.move_to(out, take);
+}
+
+//Adds validators from a stale entry to a rewritten request head
+static std::string conditional_head(const std::string &head, const HDE::CacheEntry &entry){
+    std::string out = head.substr(0, head.size() - 2);
+    if (!entry.etag.empty()){
+        out += "If-None-Match: " + entry.etag + "\r\n";
+    }
+    if (!entry.last_modified.empty()){
+        out += "If-Modified-Since: " + entry.last_modified + "\r\n";
+    }
+    out += "\r\n";
+    return out;
+}
+
+//A non-empty traceparent replaces the client's
+std::string HDE::ReverseProxy::rewrite_request_head(HttpRequest &request, const std::string &client_ip, const std::string &via,
+                                                    const std::string &traceparent){
+    HttpRequest::Headers &headers = request.get_headers();
+    std::string connection = request.get_header("Connection");
+    std::string forwarded_for = request.get_header("X-Forwarded-For");
+    std::string previous_via = request.get_header("Via");
+    bool chunked = request.has_header("Transfer-Encoding");
+    std::string out;
+    out.reserve(256 + headers.size() * 32);
+    out += request.get_method();
+    out += ' ';
+    out += request.get_path();
+    out += " HTTP/1.1\r\n";
+    for (size_t i = 0; i < headers.size(); i++){
+        const std::string &name = headers[i].first;
+        // A chunked body is delimited by its chunks alone, a Content-Length beside it would let the upstream frame it differently
+        if (is_hop_by_hop(name, connection) || header_name_equals(name, "X-Forwarded-For") || header_name_equals(name, "Via") ||
+            (chunked && header_name_equals(name, "Content-Length")) ||
+            (!traceparent.empty() && header_name_equals(name, "traceparent"))){
+            continue;
+        }
+        out += name;
+        out += ": ";
+        out += headers[i].second;
+        out += "\r\n";
+    }
+    if (!traceparent.empty()){
+        out += "traceparent: " + traceparent + "\r\n";
+    }
+    out += "X-Forwarded-For: ";
+    out += forwarded_for.empty() ? client_ip : forwarded_for + ", " + client_ip;
+    out += "\r\nVia: ";
+    if (!previous_via.empty()){
+        out += previous_via + ", ";
+    }
+    out += protocol_version(request.get_version()) + " " + via;
+    out += "\r\nConnection: keep-alive\r\n\r\n";
+    return out;
+}
+
+std::string HDE::ReverseProxy::rewrite_response_head(HttpResponse &response, bool keep_alive, const std::string &via){
+    HttpRequest::Headers &headers = response.get_headers();
+    std::string connection = response.get_header("Connection");
+    std::string previous_via = response.get_header("Via");
+    std::string out;
+    out.reserve(256 + headers.size() * 32);
+    out += "HTTP/1.1 ";
+    out += std::to_string(response.get_status());
+    out += ' ';
+    out += response.get_reason();
+    out += "\r\n";
+    for (size_t i = 0; i < headers.size(); i++){
+        const std::string &name = headers[i].first;
+        if (is_hop_by_hop(name, connection) || header_name_equals(name, "Via")){
+            continue;
+        }
+        out += name;
+        out += ": ";
+        out += headers[i].second;
+        out += "\r\n";
+    }
+    out += "Via: ";
+    if (!previous_via.empty()){
+        out += previous_via + ", ";
+    }
+    out += protocol_version(response.get_version()) + " " + via;
+    out += keep_alive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+    return out;
+}
+
+//One client connection, requests are forwarded one at a time over a pooled upstream connection
+class HDE::ReverseProxy::Session{
+    public:
+        enum RequestState{
+            REQUEST_HEAD,
+            REQUEST_BODY,
+            REQUEST_DONE
+        };
+        enum ResponseState{
+            RESPONSE_IDLE,
+            RESPONSE_WAITING,
+            RESPONSE_CONNECTING,
+            RESPONSE_HEAD,
+            RESPONSE_BODY,
+            RESPONSE_DONE
+        };
+        ReverseProxy *proxy;
+        UpstreamPool *pool;
+        int client;
+        int upstream;
+        int backend;
+        uint64_t request_key;
+        uint64_t attempt;
+        int64_t started_us;
+        uint64_t first_byte_us;
+        int response_status;
+        std::string client_ip;
+        std::string replay_head;
+        bool replayable;
+        int retries;
+        int hedge;
+        int hedge_backend;
+        UpstreamPool *hedge_pool;
+        int64_t hedge_started_us;
+        uint64_t hedge_attempt;
+        uint64_t hedge_timer;
+        uint32_t hedge_events;
+        bool hedge_eof;
+        ChainBuffer hedge_in;
+        ChainBuffer hedge_out;
+        std::string cache_key;
+        HttpRequest cache_request;
+        bool cache_lookup;
+        bool cache_conditional;
+        std::shared_ptr<const CacheEntry> cache_stale;
+        std::shared_ptr<CacheEntry> fill;
+        std::string fill_body;
+        std::shared_ptr<const CacheEntry> serving;
+        size_t serving_offset;
+        std::unique_ptr<ZeroCopySender> zerocopy;
+        bool flight_leader;
+        uint64_t flight_id;
+        uint64_t flight_timer;
+        TraceContext trace;
+        uint64_t trace_start;
+        uint64_t upstream_span;
+        uint64_t upstream_start;
+        ChainBuffer client_in;
+        ChainBuffer up_out;
+        ChainBuffer upstream_in;
+        ChainBuffer down_out;
+        BodyFramer request_body;
+        BodyFramer response_body;
+        RequestState request_state;
+        ResponseState response_state;
+        uint32_t client_events;
+        uint32_t upstream_events;
+        uint64_t timer;
+        bool keep_alive;
+        bool head_request;
+        bool client_eof;
+        bool upstream_eof;
+        bool upstream_reusable;
+        bool response_started;
+        bool closing;
+        bool finished;
+        bool in_process;
+        std::shared_ptr<bool> alive;
+
+        Session(ReverseProxy *proxy, int client, const std::string &client_ip){
+            this->proxy = proxy;
+            this->client = client;
+            this->client_ip = client_ip;
+            pool = NULL;
+            upstream = -1;
+            backend = -1;
+            request_key = 0;
+            attempt = 0;
+            started_us = 0;
+            first_byte_us = 0;
+            response_status = 0;
+            replayable = false;
+            retries = 0;
+            hedge = -1;
+            hedge_backend = -1;
+            hedge_pool = NULL;
+            hedge_started_us = 0;
+            hedge_attempt = 0;
+            hedge_timer = 0;
+            hedge_events = 0;
+            hedge_eof = false;
+            cache_lookup = false;
+            cache_conditional = false;
+            serving_offset = 0;
+            flight_leader = false;
+            flight_id = 0;
+            flight_timer = 0;
+            trace = TraceContext();
+            trace_start = 0;
+            upstream_span = 0;
+            upstream_start = 0;
+            request_state = REQUEST_HEAD;
+            response_state = RESPONSE_IDLE;
+            client_events = 0;
+            upstream_events = 0;
+            timer = 0;
+            keep_alive = false;
+            head_request = false;
+            client_eof = false;
+            upstream_eof = false;
+            upstream_reusable = false;
+            response_started = false;
+            closing = false;
+            finished = false;
+            in_process = false;
+            alive = std::make_shared<bool>(true);
+        }
+
+        ~Session(){
+            *alive = false;
+            proxy->loop->cancel_timer(timer);
+            drop_hedge(true);
+            stop_waiting();
+            end_flight();
+            release_upstream(false);
+            finish_backend(false);
+            if (zerocopy){
+                proxy->zerocopy_bytes += zerocopy->get_zerocopy_bytes();
+                zerocopy.reset();
+            }
+            proxy->loop->remove(client);
+            close(client);
+        }
+
+        int start(){
+            client_events = EPOLLIN;
+            return proxy->loop->add(client, client_events, [this](uint32_t events){ on_client(events); });
+        }
+
+        //Deletes the session once it is finished, must be the last thing an event handler does
+        void finish_event(){
+            if (finished && !in_process){
+                proxy->sessions.erase(client);
+                delete this;
+            }
+        }
+
+        //A cached body is still going out, from serving or as the zerocopy sender's unsent bytes
+        bool sending_body(){
+            return serving || (zerocopy && zerocopy->has_unsent());
+        }
+
+        //Also waits for the kernel to finish with zerocopy buffers, so the session never blocks in the sender's destructor
+        bool draining(){
+            return sending_body() || (zerocopy && !zerocopy->is_idle());
+        }
+
+        void on_client(uint32_t events){
+            if (zerocopy){
+                // Zerocopy completions raise EPOLLERR on this registration
+                events = zerocopy->handle_events(events);
+            }
+            if (events & (EPOLLHUP | EPOLLERR)){
+                finished = true;
+            } else if (events & EPOLLIN){
+                read_client();
+            }
+            if (!finished){
+                process();
+            }
+            finish_event();
+        }
+
+        void on_upstream(uint32_t events){
+            if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)){
+                read_upstream((events & (EPOLLHUP | EPOLLERR)) != 0);
+            }
+            if (!finished){
+                process();
+            }
+            finish_event();
+        }
+
+        void on_upstream_ready(int sock, int error){
+            if (response_state != RESPONSE_CONNECTING){
+                if (sock >= 0){
+                    pool->release(sock, true);
+                }
+                return;
+            }
+            // A retry can complete synchronously, only the outermost call may process and delete
+            bool outermost = !in_process;
+            in_process = true;
+            if (sock < 0){
+                proxy->upstream_errors++;
+                int failed = backend;
+                finish_backend(false);
+                int other = retries == 0 && replayable && proxy->budget != NULL ? pick_other(failed) : -1;
+                if (other >= 0 && proxy->budget->withdraw()){
+                    // Nothing reached the failed backend, so the request is replayed once elsewhere
+                    retries++;
+                    proxy->retries++;
+                    use_backend(other);
+                    start_attempt();
+                } else {
+                    fail(error == ETIMEDOUT ? 504 : 502, error == ETIMEDOUT ? "Gateway Timeout" : "Bad Gateway");
+                }
+            } else {
+                upstream = sock;
+                upstream_eof = false;
+                upstream_events = EPOLLIN | EPOLLOUT;
+                proxy->loop->add(upstream, upstream_events, [this](uint32_t events){ on_upstream(events); });
+                response_state = RESPONSE_HEAD;
+            }
+            if (outermost){
+                process();
+                finish_event();
+            }
+        }
+
+        //Sends a copy of a slow idempotent request to a second backend, the first response head wins
+        void on_hedge_timer(){
+            hedge_timer = 0;
+            if (response_started || hedge_backend >= 0 || (response_state != RESPONSE_CONNECTING && response_state != RESPONSE_HEAD)){
+                return;
+            }
+            int other = pick_other(backend);
+            if (other < 0 || !proxy->budget->withdraw()){
+                return;
+            }
+            proxy->hedges++;
+            hedge_backend = other;
+            hedge_pool = proxy->pools[other];
+            hedge_started_us = EventLoop::now_us();
+            proxy->balancer->on_start(other);
+            uint64_t id = ++hedge_attempt;
+            std::shared_ptr<bool> token = alive;
+            UpstreamPool *pool = hedge_pool;
+            pool->acquire([this, token, pool, id](int sock, int error){
+                if (!*token || id != hedge_attempt){
+                    if (sock >= 0){
+                        pool->release(sock, true);
+                    }
+                    return;
+                }
+                on_hedge_ready(sock, error);
+            });
+        }
+
+        void on_hedge_ready(int sock, int error){
+            (void)error;
+            if (sock < 0){
+                drop_hedge(false);
+                return;
+            }
+            hedge = sock;
+            hedge_eof = false;
+            hedge_out.append(replay_head);
+            hedge_events = EPOLLIN | EPOLLOUT;
+            proxy->loop->add(hedge, hedge_events, [this](uint32_t events){ on_hedge(events); });
+        }
+
+        void on_hedge(uint32_t events){
+            if ((events & EPOLLOUT) && !hedge_out.empty()){
+                ssize_t n = hedge_out.write_to(hedge);
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK){
+                    drop_hedge(false);
+                    return;
+                }
+            }
+            while (hedge >= 0 && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !hedge_eof && hedge_in.size() < proxy->config.max_buffer){
+                ssize_t n = hedge_in.read_from(hedge, PROXY_READ_CHUNK);
+                if (n > 0){
+                    continue;
+                }
+                if (n == 0){
+                    hedge_eof = true;
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK){
+                    drop_hedge(false);
+                    return;
+                }
+                break;
+            }
+            size_t limit = hedge_in.size() < proxy->config.max_header ? hedge_in.size() : proxy->config.max_header;
+            std::string head = hedge_in.to_string(limit);
+            size_t end = head.find("\r\n\r\n");
+            if (end == std::string::npos){
+                if (hedge_eof || hedge_in.size() >= proxy->config.max_header){
+                    drop_hedge(false);
+                } else if (hedge_out.empty() && hedge_events != EPOLLIN){
+                    hedge_events = EPOLLIN;
+                    proxy->loop->modify(hedge, hedge_events);
+                }
+                return;
+            }
+            HttpResponse response;
+            if (response.parse(head.data(), end + 4) <= 0 || response.get_status() >= 500){
+                drop_hedge(false);
+                return;
+            }
+            adopt_hedge();
+            process();
+            finish_event();
+        }
+
+        //The hedge answered first, it becomes the upstream and the primary attempt is abandoned
+        void adopt_hedge(){
+            proxy->hedge_wins++;
+            attempt++;
+            release_upstream(false);
+            finish_backend(true);
+            proxy->loop->remove(hedge);
+            upstream = hedge;
+            pool = hedge_pool;
+            backend = hedge_backend;
+            started_us = hedge_started_us;
+            first_byte_us = 0;
+            hedge_in.move_to(upstream_in, hedge_in.size());
+            hedge_out.move_to(up_out, hedge_out.size());
+            upstream_eof = hedge_eof;
+            hedge = -1;
+            hedge_backend = -1;
+            hedge_attempt++;
+            upstream_events = EPOLLIN | EPOLLOUT;
+            proxy->loop->add(upstream, upstream_events, [this](uint32_t events){ on_upstream(events); });
+            response_state = RESPONSE_HEAD;
+        }
+
+        //Abandons an outstanding hedge, success tells the balancer whether its backend misbehaved
+        void drop_hedge(bool success){
+            proxy->loop->cancel_timer(hedge_timer);
+            hedge_timer = 0;
+            hedge_attempt++;
+            if (hedge >= 0){
+                proxy->loop->remove(hedge);
+                hedge_pool->release(hedge, false);
+                hedge = -1;
+            }
+            hedge_in.clear();
+            hedge_out.clear();
+            if (hedge_backend >= 0){
+                proxy->balancer->on_finish(hedge_backend, EventLoop::now_us() - hedge_started_us, success);
+                hedge_backend = -1;
+            }
+        }
+
+        void on_timeout(){
+            timer = 0;
+            if (!response_started){
+                proxy->upstream_errors++;
+                fail(504, "Gateway Timeout");
+            }
+            process();
+            finish_event();
+        }
+
+        void read_client(){
+            while (!client_eof && client_in.size() + up_out.size() < proxy->config.max_buffer){
+                ssize_t n = client_in.read_from(client, PROXY_READ_CHUNK);
+                if (n > 0){
+                    continue;
+                }
+                if (n == 0){
+                    client_eof = true;
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK){
+                    finished = true;
+                }
+                break;
+            }
+        }
+
+        //A hang-up or error is drained past the buffer bound, the socket can't signal again
+        void read_upstream(bool force){
+            if (upstream < 0 || (response_state != RESPONSE_HEAD && response_state != RESPONSE_BODY)){
+                if (force){
+                    upstream_failed();
+                }
+                return;
+            }
+            while (!upstream_eof && (force || upstream_in.size() + down_out.size() < proxy->config.max_buffer)){
+                ssize_t n = upstream_in.read_from(upstream, PROXY_READ_CHUNK);
+                if (n > 0){
+                    continue;
+                }
+                if (n == 0){
+                    upstream_eof = true;
+                } else if (errno != EAGAIN && errno != EWOULDBLOCK){
+                    upstream_failed();
+                }
+                break;
+            }
+        }
+
+        void upstream_failed(){
+            proxy->upstream_errors++;
+            finish_backend(false);
+            if (!response_started){
+                fail(502, "Bad Gateway");
+                return;
+            }
+            release_upstream(false);
+            finished = true;
+        }
+
+        void release_upstream(bool reusable){
+            if (upstream < 0){
+                return;
+            }
+            int sock = upstream;
+            upstream = -1;
+            reusable = reusable && upstream_in.empty() && up_out.empty() && !upstream_eof;
+            upstream_in.clear();
+            up_out.clear();
+            proxy->loop->remove(sock);
+            pool->release(sock, reusable);
+        }
+
+        //Records the request's spans once, cache hits have no upstream span
+        void finish_trace(){
+            if (trace_start == 0){
+                return;
+            }
+            uint64_t now = CycleClock::now();
+            if (upstream_span != 0){
+                proxy->tracer->record(trace, "upstream", upstream_span, trace.span_id, upstream_start, now);
+            }
+            proxy->tracer->record(trace, "proxy", trace_start, now);
+            trace_start = 0;
+            upstream_span = 0;
+        }
+
+        //Reports the request to the balancer once, latency is time to the response head
+        void finish_backend(bool success){
+            if (backend < 0){
+                return;
+            }
+            uint64_t latency = first_byte_us;
+            if (latency == 0){
+                latency = EventLoop::now_us() - started_us;
+            }
+            proxy->balancer->on_finish(backend, latency, success);
+            backend = -1;
+        }
+
+        void use_backend(int index){
+            backend = index;
+            proxy->balancer->on_start(backend);
+            pool = proxy->pools[backend];
+            started_us = EventLoop::now_us();
+            first_byte_us = 0;
+        }
+
+        void choose_backend(){
+            response_status = 0;
+            if (proxy->balancer == NULL){
+                pool = proxy->pools[0];
+                return;
+            }
+            use_backend(proxy->balancer->select(request_key));
+        }
+
+        //A backend other than exclude, or -1, the key is salted so hashing policies spread the extra attempt
+        int pick_other(int exclude){
+            for (int i = 0; i < 3; i++){
+                int index = proxy->balancer->select(request_key ^ random_u64());
+                if (index != exclude){
+                    return index;
+                }
+            }
+            return -1;
+        }
+
+        void start_attempt(){
+            uint64_t id = ++attempt;
+            std::shared_ptr<bool> token = alive;
+            UpstreamPool *pool = this->pool;
+            pool->acquire([this, token, pool, id](int sock, int error){
+                if (!*token || id != attempt){
+                    if (sock >= 0){
+                        pool->release(sock, true);
+                    }
+                    return;
+                }
+                on_upstream_ready(sock, error);
+            });
+        }
+
+        //Answers the client with an error and closes, unless part of a response already went out
+        void fail(int status, const char *reason){
+            proxy->loop->cancel_timer(timer);
+            timer = 0;
+            drop_hedge(true);
+            stop_waiting();
+            end_flight();
+            fill.reset();
+            release_upstream(false);
+            if (response_started){
+                finished = true;
+                return;
+            }
+            HttpResponse response(status, reason);
+            response.add_header("Content-Type", "text/plain");
+            response.add_header("Connection", "close");
+            response.set_body(std::string(reason) + "\r\n");
+            down_out.append(response.to_string());
+            response_started = true;
+            request_state = REQUEST_DONE;
+            response_state = RESPONSE_DONE;
+            keep_alive = false;
+            closing = true;
+        }
+
+        //Answers from the cache when the entry may be used without the origin, a stale one is refreshed in the background
+        bool lookup_cache(HttpRequest &request){
+            cache_key = HttpCache::key_for(request);
+            std::shared_ptr<const CacheEntry> entry;
+            CacheStatus status = proxy->cache->lookup(cache_key, request, EventLoop::now_ms(), entry);
+            if (status == CACHE_FRESH || status == CACHE_STALE_WHILE_REVALIDATE){
+                if (status == CACHE_STALE_WHILE_REVALIDATE && !entry->refreshing.exchange(true)){
+                    proxy->refresh(cache_key, request, client_ip, entry);
+                }
+                proxy->requests++;
+                serve_entry(entry, request);
+                return true;
+            }
+            cache_lookup = status != CACHE_BYPASS;
+            if (status == CACHE_STALE){
+                cache_stale = entry;
+            }
+            if (cache_lookup){
+                cache_request = request;
+            }
+            return false;
+        }
+
+        //Queues the stored head, the body is later sent straight from the shared entry
+        void serve_entry(std::shared_ptr<const CacheEntry> entry, HttpRequest &request){
+            bool not_modified = false;
+            std::string match = request.get_header("If-None-Match");
+            if (!match.empty()){
+                not_modified = !entry->etag.empty() && (match == "*" || header_has_token(match, entry->etag));
+            } else if (request.has_header("If-Modified-Since")){
+                not_modified = !entry->last_modified.empty() && request.get_header("If-Modified-Since") == entry->last_modified;
+            }
+            std::string head;
+            if (not_modified){
+                head = "HTTP/1.1 304 Not Modified\r\n";
+                head.append(entry->head, entry->status_line, std::string::npos);
+            } else {
+                head = entry->head;
+            }
+            head += "Age: " + std::to_string(entry->get_age_ms(EventLoop::now_ms()) / 1000);
+            head += keep_alive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+            down_out.append(head);
+            if (!head_request && !not_modified){
+                serving = entry;
+                serving_offset = 0;
+            }
+            proxy->cache_served++;
+            response_started = true;
+            response_status = not_modified ? 304 : entry->status;
+            request_state = REQUEST_DONE;
+            response_state = RESPONSE_DONE;
+        }
+
+        //A miss becomes the flight for its key or waits on the running one, the waiter's head stays in up_out
+        bool coalesce(){
+            std::shared_ptr<bool> token = alive;
+            flight_id = proxy->flights.join(cache_key, [this, token](){
+                if (*token){
+                    on_flight_done();
+                }
+            });
+            if (flight_id == 0){
+                flight_leader = proxy->flights.begin(cache_key);
+                return false;
+            }
+            response_state = RESPONSE_WAITING;
+            flight_timer = proxy->loop->run_after(proxy->coalesce_timeout_ms, [this](){
+                flight_timer = 0;
+                stop_waiting();
+                proxy->coalesce_timeouts++;
+                in_process = true;
+                start_upstream();
+                process();
+                finish_event();
+            });
+            return true;
+        }
+
+        //The flight ended, its response is in the cache unless it failed or could not be stored
+        void on_flight_done(){
+            flight_id = 0;
+            proxy->loop->cancel_timer(flight_timer);
+            flight_timer = 0;
+            if (response_state != RESPONSE_WAITING){
+                return;
+            }
+            // The upstream may be acquired synchronously, only the outermost call may process and delete
+            bool outermost = !in_process;
+            in_process = true;
+            std::shared_ptr<const CacheEntry> entry;
+            CacheStatus status = proxy->cache->lookup(cache_key, cache_request, EventLoop::now_ms(), entry);
+            if (status == CACHE_FRESH || status == CACHE_STALE_WHILE_REVALIDATE){
+                up_out.clear();
+                serve_entry(entry, cache_request);
+            } else {
+                start_upstream();
+            }
+            if (outermost){
+                process();
+                finish_event();
+            }
+        }
+
+        void stop_waiting(){
+            proxy->loop->cancel_timer(flight_timer);
+            flight_timer = 0;
+            if (flight_id != 0){
+                proxy->flights.leave(cache_key, flight_id);
+                flight_id = 0;
+            }
+        }
+
+        //Wakes the misses waiting on this session's fetch, called once the response is stored or known uncacheable
+        void end_flight(){
+            if (flight_leader){
+                flight_leader = false;
+                proxy->flights.finish(cache_key);
+            }
+        }
+
+        void start_upstream(){
+            response_state = RESPONSE_CONNECTING;
+            choose_backend();
+            timer = proxy->loop->run_after(proxy->config.response_timeout_ms, [this](){ on_timeout(); });
+            if (replayable && proxy->hedge != NULL){
+                int64_t delay_ms = (proxy->hedge->get_delay_us() + 999) / 1000;
+                hedge_timer = proxy->loop->run_after(delay_ms, [this](){
+                    on_hedge_timer();
+                    if (!in_process){
+                        process();
+                        finish_event();
+                    }
+                });
+            }
+            start_attempt();
+        }
+
+        bool parse_request(){
+            if (client_in.empty()){
+                return false;
+            }
+            size_t limit = client_in.size() < proxy->config.max_header ? client_in.size() : proxy->config.max_header;
+            std::string head = client_in.to_string(limit);
+            size_t end = head.find("\r\n\r\n");
+            if (end == std::string::npos){
+                if (client_in.size() >= proxy->config.max_header){
+                    fail(431, "Request Header Fields Too Large");
+                }
+                return false;
+            }
+            HttpRequest request;
+            if (request.parse(head.data(), end + 4) <= 0 || request.get_version().compare(0, 7, "HTTP/1.") != 0){
+                fail(400, "Bad Request");
+                return false;
+            }
+            client_in.consume(end + 4);
+            std::string connection = request.get_header("Connection");
+            if (request.get_version() == "HTTP/1.0"){
+                keep_alive = header_has_token(connection, "keep-alive");
+            } else {
+                keep_alive = !header_has_token(connection, "close");
+            }
+            head_request = request.get_method() == "HEAD";
+            if (proxy->tracer != NULL){
+                trace = proxy->tracer->start(request.get_header("traceparent"));
+                trace_start = CycleClock::now();
+            }
+            // Framing the upstream could read differently from this hop is refused outright, RFC 9112 section 6.3:
+            // chunked must be the final coding, and Transfer-Encoding with Content-Length or repeated Content-Length
+            // headers are request smuggling vectors
+            HttpRequest::Headers &headers = request.get_headers();
+            size_t lengths = count_headers(headers, "Content-Length");
+            uint64_t length = 0;
+            if (count_headers(headers, "Transfer-Encoding") > 0){
+                if (!chunked_is_last(headers) || lengths > 0){
+                    fail(400, "Bad Request");
+                    return false;
+                }
+                request_body.reset(BodyFramer::CHUNKED, 0);
+            } else if (lengths > 0){
+                if (lengths > 1 || !parse_length(request.get_header("Content-Length"), length)){
+                    fail(400, "Bad Request");
+                    return false;
+                }
+                request_body.reset(BodyFramer::LENGTH, length);
+            } else {
+                request_body.reset(BodyFramer::NO_BODY, 0);
+            }
+            cache_lookup = false;
+            cache_conditional = false;
+            cache_stale.reset();
+            fill.reset();
+            if (proxy->cache != NULL && request_body.is_done() && (head_request || request.get_method() == "GET") &&
+                lookup_cache(request)){
+                return true;
+            }
+            // The upstream sees its own span as parent, the trace continues even when this hop isn't sampled
+            upstream_span = proxy->tracer != NULL ? Tracer::new_id() : 0;
+            upstream_start = CycleClock::now();
+            std::string rewritten = rewrite_request_head(request, client_ip, proxy->config.via,
+                                                         upstream_span != 0 ? Tracer::format_traceparent(trace, upstream_span) : std::string());
+            if (cache_stale && !request.has_header("If-None-Match") && !request.has_header("If-Modified-Since")){
+                rewritten = conditional_head(rewritten, *cache_stale);
+                cache_conditional = true;
+            }
+            replayable = proxy->budget != NULL && proxy->balancer != NULL && proxy->balancer->get_size() > 1 &&
+                         request_body.is_done() && (head_request || request.get_method() == "GET");
+            replay_head = replayable ? rewritten : std::string();
+            retries = 0;
+            up_out.append(rewritten);
+            request_state = request_body.is_done() ? REQUEST_DONE : REQUEST_BODY;
+            response_started = false;
+            upstream_reusable = true;
+            proxy->requests++;
+            if (proxy->budget != NULL){
+                proxy->budget->deposit();
+            }
+            if (proxy->balancer != NULL){
+                std::string key = request.get_header("Host") + request.get_path();
+                request_key = hash_key(key.data(), key.size());
+            }
+            if (cache_lookup && proxy->coalesce_timeout_ms > 0 && coalesce()){
+                return true;
+            }
+            start_upstream();
+            return true;
+        }
+
+        bool parse_response(){
+            if (upstream_in.empty()){
+                if (upstream_eof){
+                    upstream_failed();
+                }
+                return false;
+            }
+            size_t limit = upstream_in.size() < proxy->config.max_header ? upstream_in.size() : proxy->config.max_header;
+            std::string head = upstream_in.to_string(limit);
+            size_t end = head.find("\r\n\r\n");
+            if (end == std::string::npos){
+                if (upstream_in.size() >= proxy->config.max_header || upstream_eof){
+                    upstream_failed();
+                }
+                return false;
+            }
+            HttpResponse response;
+            if (response.parse(head.data(), end + 4) <= 0){
+                upstream_failed();
+                return false;
+            }
+            upstream_in.consume(end + 4);
+            int status = response.get_status();
+            if (status < 200){
+                // Interim responses are relayed, upgrades are refused since Upgrade is never forwarded
+                if (status == 101){
+                    upstream_failed();
+                    return false;
+                }
+                down_out.append(rewrite_response_head(response, true, proxy->config.via));
+                return true;
+            }
+            proxy->loop->cancel_timer(timer);
+            timer = 0;
+            response_started = true;
+            response_status = status;
+            drop_hedge(true);
+            if (backend >= 0){
+                first_byte_us = EventLoop::now_us() - started_us;
+                if (proxy->hedge != NULL){
+                    proxy->hedge->record(first_byte_us);
+                }
+            }
+            if (response.get_version() != "HTTP/1.1" || header_has_token(response.get_header("Connection"), "close")){
+                upstream_reusable = false;
+            }
+            if (status == 304 && cache_conditional){
+                std::shared_ptr<CacheEntry> fresh = proxy->cache->refreshed(*cache_stale, response, EventLoop::now_ms());
+                proxy->cache->store(cache_key, fresh);
+                cache_stale.reset();
+                serve_entry(fresh, cache_request);
+                end_flight();
+                return true;
+            }
+            uint64_t length = 0;
+            BodyFramer::Mode mode = response_framing(response, head_request, length);
+            response_body.reset(mode, length);
+            if (mode == BodyFramer::UNTIL_CLOSE){
+                keep_alive = false;
+                upstream_reusable = false;
+            }
+            down_out.append(rewrite_response_head(response, keep_alive, proxy->config.via));
+            if (cache_lookup && !head_request){
+                fill = proxy->prepare_entry(cache_request, response, mode);
+                fill_body.clear();
+                if (!fill && cache_stale){
+                    proxy->cache->remove(cache_key);
+                }
+            }
+            if (!fill){
+                end_flight();
+            }
+            response_state = response_body.is_done() ? RESPONSE_DONE : RESPONSE_BODY;
+            return true;
+        }
+
+        //Runs every step that can make progress, then recomputes epoll interest
+        void process(){
+            in_process = true;
+            bool progress = true;
+            while (progress && !finished){
+                progress = false;
+                if (request_state == REQUEST_HEAD && response_state == RESPONSE_IDLE && !closing && !sending_body()){
+                    progress = parse_request() || progress;
+                }
+                if (request_state == REQUEST_BODY){
+                    size_t before = client_in.size();
+                    forward_body(client_in, up_out, request_body, NULL);
+                    if (request_body.is_done()){
+                        request_state = REQUEST_DONE;
+                        progress = true;
+                    } else if (request_body.is_error()){
+                        fail(400, "Bad Request");
+                        continue;
+                    } else if (client_eof && client_in.empty()){
+                        finished = true;
+                        continue;
+                    }
+                    progress = progress || client_in.size() != before;
+                }
+                if (upstream >= 0 && !up_out.empty()){
+                    ssize_t n = up_out.write_to(upstream);
+                    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK){
+                        upstream_failed();
+                        continue;
+                    }
+                    progress = progress || n > 0;
+                }
+                if (response_state == RESPONSE_HEAD){
+                    progress = parse_response() || progress;
+                }
+                if (response_state == RESPONSE_BODY){
+                    size_t before = upstream_in.size();
+                    forward_body(upstream_in, down_out, response_body, fill ? &fill_body : NULL);
+                    if (fill && fill_body.size() > proxy->cache->get_max_object()){
+                        fill.reset();
+                        fill_body.clear();
+                        end_flight();
+                    }
+                    if (upstream_eof && upstream_in.empty()){
+                        response_body.finish_on_close();
+                    }
+                    if (response_body.is_done()){
+                        response_state = RESPONSE_DONE;
+                        progress = true;
+                    } else if (response_body.is_error()){
+                        release_upstream(false);
+                        response_state = RESPONSE_DONE;
+                        keep_alive = false;
+                        closing = true;
+                        progress = true;
+                    }
+                    progress = progress || upstream_in.size() != before;
+                }
+                if (!down_out.empty()){
+                    // A cached body follows the head, MSG_MORE lets both leave in one segment
+                    ssize_t n = down_out.write_to(client, serving ? MSG_MORE : 0);
+                    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK){
+                        finished = true;
+                        continue;
+                    }
+                    progress = progress || n > 0;
+                }
+                if (down_out.empty() && serving && proxy->zerocopy_threshold > 0 && serving_offset == 0 &&
+                    serving->body->size() >= proxy->zerocopy_threshold){
+                    if (!zerocopy){
+                        zerocopy.reset(new ZeroCopySender(client, proxy->zerocopy_threshold));
+                    }
+                    // The sender holds the shared body until the kernel is done with its pages
+                    if (zerocopy->send(serving->body) < 0){
+                        finished = true;
+                        continue;
+                    }
+                    serving.reset();
+                    progress = true;
+                }
+                if (down_out.empty() && serving){
+                    const std::string &body = *serving->body;
+                    ssize_t n = send(client, body.data() + serving_offset, body.size() - serving_offset, MSG_NOSIGNAL);
+                    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK){
+                        finished = true;
+                        continue;
+                    }
+                    if (n > 0){
+                        serving_offset += n;
+                        progress = true;
+                    }
+                    if (serving_offset == body.size()){
+                        serving.reset();
+                    }
+                }
+                if (response_state == RESPONSE_DONE){
+                    finish_backend(response_status < 500);
+                    finish_trace();
+                    if (fill && response_body.is_done()){
+                        fill->body = std::make_shared<const std::string>(std::move(fill_body));
+                        proxy->cache->store(cache_key, fill);
+                    }
+                    fill.reset();
+                    fill_body.clear();
+                    end_flight();
+                    if (request_state != REQUEST_DONE){
+                        // The upstream answered before the request body finished, the connection can't be reused
+                        release_upstream(false);
+                        keep_alive = false;
+                        closing = true;
+                    } else {
+                        release_upstream(upstream_reusable);
+                    }
+                    if (keep_alive && !closing){
+                        request_state = REQUEST_HEAD;
+                        response_state = RESPONSE_IDLE;
+                        progress = true;
+                    } else {
+                        closing = true;
+                    }
+                }
+                if (closing && down_out.empty() && !draining()){
+                    finished = true;
+                }
+                if (request_state == REQUEST_HEAD && response_state == RESPONSE_IDLE && client_eof && down_out.empty() && !draining()){
+                    finished = true;
+                }
+            }
+            in_process = false;
+            if (!finished){
+                update_interest();
+            }
+        }
+
+        //Reads stop while a direction holds max_buffer bytes, so a slow peer holds back only its sender
+        void update_interest(){
+            uint32_t events = 0;
+            if (!client_eof && !closing && client_in.size() + up_out.size() < proxy->config.max_buffer){
+                events |= EPOLLIN;
+            }
+            if (!down_out.empty() || sending_body()){
+                events |= EPOLLOUT;
+            }
+            if (events != client_events){
+                client_events = events;
+                proxy->loop->modify(client, events);
+            }
+            if (upstream < 0){
+                return;
+            }
+            events = 0;
+            if ((response_state == RESPONSE_HEAD || response_state == RESPONSE_BODY) && !upstream_eof &&
+                upstream_in.size() + down_out.size() < proxy->config.max_buffer){
+                events |= EPOLLIN;
+            }
+            if (!up_out.empty()){
+                events |= EPOLLOUT;
+            }
+            if (events != upstream_events){
+                upstream_events = events;
+                proxy->loop->modify(upstream, events);
+            }
+        }
+};
+
+//Revalidates one stale cache entry in the background while clients are served the stale copy
+class HDE::ReverseProxy::Refresh{
+    public:
+        ReverseProxy *proxy;
+        std::string key;
+        HttpRequest request;
+        std::shared_ptr<const CacheEntry> entry;
+        std::shared_ptr<CacheEntry> fill;
+        std::string fill_body;
+        UpstreamPool *pool;
+        int backend;
+        int sock;
+        int64_t started_us;
+        uint64_t timer;
+        bool have_head;
+        bool reusable;
+        ChainBuffer out;
+        ChainBuffer in;
+        ChainBuffer sink;
+        BodyFramer framer;
+        std::shared_ptr<bool> alive;
+
+        Refresh(ReverseProxy *proxy, const std::string &key, HttpRequest &request, const std::string &client_ip, std::shared_ptr<const CacheEntry> entry){
+            this->proxy = proxy;
+            this->key = key;
+            this->request = request;
+            this->entry = entry;
+            pool = proxy->pools[0];
+            backend = -1;
+            sock = -1;
+            started_us = EventLoop::now_us();
+            timer = 0;
+            have_head = false;
+            reusable = true;
+            alive = std::make_shared<bool>(true);
+            out.append(conditional_head(rewrite_request_head(request, client_ip, proxy->config.via), *entry));
+        }
+
+        ~Refresh(){
+            *alive = false;
+            proxy->loop->cancel_timer(timer);
+            if (sock >= 0){
+                proxy->loop->remove(sock);
+                pool->release(sock, reusable && in.empty() && have_head && framer.is_done());
+            }
+            if (backend >= 0){
+                proxy->balancer->on_finish(backend, EventLoop::now_us() - started_us, have_head);
+            }
+            entry->refreshing.store(false);
+        }
+
+        void start(){
+            if (proxy->balancer != NULL){
+                backend = proxy->balancer->select(hash_key(key.data(), key.size()));
+                proxy->balancer->on_start(backend);
+                pool = proxy->pools[backend];
+            }
+            timer = proxy->loop->run_after(proxy->config.response_timeout_ms, [this](){
+                timer = 0;
+                finish();
+            });
+            std::shared_ptr<bool> token = alive;
+            UpstreamPool *pool = this->pool;
+            pool->acquire([this, token, pool](int sock, int error){
+                (void)error;
+                if (!*token){
+                    if (sock >= 0){
+                        pool->release(sock, true);
+                    }
+                    return;
+                }
+                if (sock < 0){
+                    finish();
+                    return;
+                }
+                this->sock = sock;
+                proxy->loop->add(sock, EPOLLIN | EPOLLOUT, [this](uint32_t events){ on_event(events); });
+            });
+        }
+
+        void finish(){
+            proxy->refreshes.erase(this);
+            delete this;
+        }
+
+        void on_event(uint32_t events){
+            if ((events & EPOLLOUT) && !out.empty()){
+                ssize_t n = out.write_to(sock);
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK){
+                    reusable = false;
+                    finish();
+                    return;
+                }
+                if (out.empty()){
+                    proxy->loop->modify(sock, EPOLLIN);
+                }
+            }
+            bool eof = false;
+            while (events & (EPOLLIN | EPOLLHUP | EPOLLERR)){
+                ssize_t n = in.read_from(sock, PROXY_READ_CHUNK);
+                if (n > 0){
+                    continue;
+                }
+                if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)){
+                    eof = true;
+                    reusable = false;
+                }
+                break;
+            }
+            if (!have_head && !parse_head()){
+                if (eof || in.size() >= proxy->config.max_header){
+                    finish();
+                }
+                return;
+            }
+            forward_body(in, sink, framer, fill ? &fill_body : NULL);
+            sink.clear();
+            if (eof && in.empty()){
+                framer.finish_on_close();
+            }
+            if (fill && fill_body.size() > proxy->cache->get_max_object()){
+                fill.reset();
+            }
+            if (framer.is_done() || framer.is_error() || eof){
+                if (fill && framer.is_done()){
+                    fill->body = std::make_shared<const std::string>(std::move(fill_body));
+                    proxy->cache->store(key, fill);
+                }
+                finish();
+            }
+        }
+
+        bool parse_head(){
+            size_t limit = in.size() < proxy->config.max_header ? in.size() : proxy->config.max_header;
+            std::string head = in.to_string(limit);
+            size_t end = head.find("\r\n\r\n");
+            HttpResponse response;
+            if (end == std::string::npos || response.parse(head.data(), end + 4) <= 0){
+                return false;
+            }
+            in.consume(end + 4);
+            if (response.get_status() < 200){
+                return parse_head();
+            }
+            have_head = true;
+            if (response.get_version() != "HTTP/1.1" || header_has_token(response.get_header("Connection"), "close")){
+                reusable = false;
+            }
+            if (response.get_status() == 304){
+                proxy->cache->store(key, proxy->cache->refreshed(*entry, response, EventLoop::now_ms()));
+                framer.reset(BodyFramer::NO_BODY, 0);
+                return true;
+            }
+            uint64_t length = 0;
+            BodyFramer::Mode mode = response_framing(response, false, length);
+            framer.reset(mode, length);
+            fill = proxy->prepare_entry(request, response, mode);
+            if (!fill){
+                proxy->cache->remove(key);
+            }
+            return true;
+        }
+};
+
+//Constructor
+HDE::ReverseProxy::ReverseProxy(EventLoop *loop, UpstreamPool *pool, ReverseProxyConfig config){
+    this->loop = loop;
+    this->balancer = NULL;
+    this->pools.push_back(pool);
+    this->config = config;
+    requests = 0;
+    upstream_errors = 0;
+    hedge = NULL;
+    budget = NULL;
+    hedges = 0;
+    hedge_wins = 0;
+    retries = 0;
+    cache = NULL;
+    cache_served = 0;
+    coalesce_timeout_ms = 0;
+    zerocopy_threshold = 0;
+    zerocopy_bytes = 0;
+    coalesce_timeouts = 0;
+    tracer = NULL;
+}
+
+HDE::ReverseProxy::ReverseProxy(EventLoop *loop, Balancer *balancer, std::vector<UpstreamPool *> pools, ReverseProxyConfig config){
+    this->loop = loop;
+    this->balancer = balancer;
+    this->pools = pools;
+    this->config = config;
+    requests = 0;
+    upstream_errors = 0;
+    hedge = NULL;
+    budget = NULL;
+    hedges = 0;
+    hedge_wins = 0;
+    retries = 0;
+    cache = NULL;
+    cache_served = 0;
+    coalesce_timeout_ms = 0;
+    zerocopy_threshold = 0;
+    zerocopy_bytes = 0;
+    coalesce_timeouts = 0;
+    tracer = NULL;
+}
+
+HDE::ReverseProxy::~ReverseProxy(){
+    std::unordered_map<int, Session *> open = sessions;
+    sessions.clear();
+    for (std::unordered_map<int, Session *>::iterator it = open.begin(); it != open.end(); ++it){
+        delete it->second;
+    }
+    std::unordered_set<Refresh *> pending = refreshes;
+    refreshes.clear();
+    for (std::unordered_set<Refresh *>::iterator it = pending.begin(); it != pending.end(); ++it){
+        delete *it;
+    }
+}
+
+//Takes ownership of an accepted client socket, fits ListenerConfig::on_connection
+void HDE::ReverseProxy::handle(int client){
+    struct sockaddr_in peer;
+    socklen_t len = sizeof(peer);
+    char ip[INET_ADDRSTRLEN] = "unknown";
+    if (getpeername(client, (struct sockaddr *)&peer, &len) == 0 && peer.sin_family == AF_INET){
+        inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+    }
+    fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+    Session *session = new Session(this, client, ip);
+    sessions[client] = session;
+    if (session->start() < 0){
+        sessions.erase(client);
+        delete session;
+    }
+}
+
+size_t HDE::ReverseProxy::get_active(){
+    return sessions.size();
+}
+
+uint64_t HDE::ReverseProxy::get_requests(){
+    return requests;
+}
+
+uint64_t HDE::ReverseProxy::get_upstream_errors(){
+    return upstream_errors;
+}
+
+//Hedges idempotent requests after hedge's delay and retries failed connects once, both draw on budget,
+//needs a Balancer with two or more backends, a NULL budget turns both off and a NULL hedge keeps only retries
+void HDE::ReverseProxy::set_hedging(HedgePolicy *hedge, RetryBudget *budget){
+    this->hedge = hedge;
+    this->budget = budget;
+}
+
+uint64_t HDE::ReverseProxy::get_hedges(){
+    return hedges;
+}
+
+uint64_t HDE::ReverseProxy::get_hedge_wins(){
+    return hedge_wins;
+}
+
+uint64_t HDE::ReverseProxy::get_retries(){
+    return retries;
+}
+
+//Serves GET and HEAD from cache and stores cacheable responses, cache may be shared by several proxies
+void HDE::ReverseProxy::set_cache(HttpCache *cache){
+    this->cache = cache;
+}
+
+//Records a proxy span and an upstream span per sampled request, and forwards traceparent naming the upstream span
+void HDE::ReverseProxy::set_tracer(Tracer *tracer){
+    this->tracer = tracer;
+}
+
+uint64_t HDE::ReverseProxy::get_cache_served(){
+    return cache_served;
+}
+
+//Cached bodies of at least threshold bytes go out with MSG_ZEROCOPY straight from the shared entry, 0 turns it off
+void HDE::ReverseProxy::set_zerocopy(size_t threshold){
+    zerocopy_threshold = threshold;
+}
+
+//Bytes sent with MSG_ZEROCOPY by sessions that have ended
+uint64_t HDE::ReverseProxy::get_zerocopy_bytes(){
+    return zerocopy_bytes;
+}
+
+//Builds a cache entry whose head already carries this proxy's Via, bodies delimited by close are not stored
+std::shared_ptr<HDE::CacheEntry> HDE::ReverseProxy::prepare_entry(HttpRequest &request, HttpResponse &response, BodyFramer::Mode mode){
+    std::shared_ptr<CacheEntry> entry;
+    if (mode == BodyFramer::UNTIL_CLOSE){
+        return entry;
+    }
+    entry = cache->prepare(request, response, EventLoop::now_ms());
+    if (!entry){
+        return entry;
+    }
+    response.remove_header("Age");
+    std::string head = rewrite_response_head(response, true, config.via);
+    head.resize(head.size() - strlen("\r\nConnection: keep-alive\r\n\r\n"));
+    entry->head = head + "\r\n";
+    entry->status_line = head.find("\r\n") + 2;
+    return entry;
+}
+
+void HDE::ReverseProxy::refresh(const std::string &key, HttpRequest &request, const std::string &client_ip, std::shared_ptr<const CacheEntry> entry){
+    Refresh *refresh = new Refresh(this, key, request, client_ip, entry);
+    refreshes.insert(refresh);
+    refresh->start();
+}
+
+//Concurrent cache misses for one key wait up to timeout_ms for a single upstream fetch, 0 turns coalescing off
+void HDE::ReverseProxy::set_coalescing(int timeout_ms){
+    coalesce_timeout_ms = timeout_ms;
+}
+
+HDE::SingleFlight & HDE::ReverseProxy::get_flights(){
+    return flights;
+}
+
+uint64_t HDE::ReverseProxy::get_coalesce_timeouts(){
+    return coalesce_timeouts;
+}
@@ -0,0 +1,86 @@
+#ifndef ReverseProxy_hpp
+#define ReverseProxy_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <vector>
+#include "UpstreamPool.hpp"
+#include "Balancer.hpp"
+#include "HedgePolicy.hpp"
+#include "RetryBudget.hpp"
+#include "../Cache/HttpCache.hpp"
+#include "../Cache/SingleFlight.hpp"
+#include "../Http/BodyFramer.hpp"
+#include "../Http/HttpRequest.hpp"
+#include "../Http/HttpResponse.hpp"
+#include "../Events/EventLoop.hpp"
+#include "../Tracing/Tracer.hpp"
+
+namespace HDE{
+    struct ReverseProxyConfig{
+        size_t max_buffer;
+        size_t max_header;
+        int response_timeout_ms;
+        std::string via;
+    };
+
+    //Streams HTTP/1.1 requests and responses between clients and upstream pools with bounded buffers,
+    //with a Balancer pools[i] must connect to the balancer's backend i
+    class ReverseProxy{
+        private:
+            class Session;
+            class Refresh;
+            EventLoop *loop;
+            Balancer *balancer;
+            std::vector<UpstreamPool *> pools;
+            ReverseProxyConfig config;
+            std::unordered_map<int, Session *> sessions;
+            uint64_t requests;
+            uint64_t upstream_errors;
+            HedgePolicy *hedge;
+            RetryBudget *budget;
+            uint64_t hedges;
+            uint64_t hedge_wins;
+            uint64_t retries;
+            HttpCache *cache;
+            std::unordered_set<Refresh *> refreshes;
+            uint64_t cache_served;
+            SingleFlight flights;
+            int coalesce_timeout_ms;
+            uint64_t coalesce_timeouts;
+            Tracer *tracer;
+            size_t zerocopy_threshold;
+            uint64_t zerocopy_bytes;
+            std::shared_ptr<CacheEntry> prepare_entry(HttpRequest &request, HttpResponse &response, BodyFramer::Mode mode);
+            void refresh(const std::string &key, HttpRequest &request, const std::string &client_ip, std::shared_ptr<const CacheEntry> entry);
+        public:
+            ReverseProxy(EventLoop *loop, UpstreamPool *pool, ReverseProxyConfig config);
+            ReverseProxy(EventLoop *loop, Balancer *balancer, std::vector<UpstreamPool *> pools, ReverseProxyConfig config);
+            ~ReverseProxy();
+            void handle(int client);
+            size_t get_active();
+            uint64_t get_requests();
+            uint64_t get_upstream_errors();
+            void set_hedging(HedgePolicy *hedge, RetryBudget *budget);
+            uint64_t get_hedges();
+            uint64_t get_hedge_wins();
+            uint64_t get_retries();
+            void set_cache(HttpCache *cache);
+            uint64_t get_cache_served();
+            void set_coalescing(int timeout_ms);
+            SingleFlight & get_flights();
+            uint64_t get_coalesce_timeouts();
+            void set_tracer(Tracer *tracer);
+            void set_zerocopy(size_t threshold);
+            uint64_t get_zerocopy_bytes();
+            static std::string rewrite_request_head(HttpRequest &request, const std::string &client_ip, const std::string &via,
+                                                    const std::string &traceparent = std::string());
+            static std::string rewrite_response_head(HttpResponse &response, bool keep_alive, const std::string &via);
+    };
+}
+
+#endif
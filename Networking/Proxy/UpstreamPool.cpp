@@ -0,0 +1,217 @@
+#include "UpstreamPool.hpp"
+#include <unistd.h>
+#include <errno.h>
+
+//Constructor
+HDE::UpstreamPool::UpstreamPool(EventLoop *loop, Backend backend, UpstreamPoolConfig config) : connector(loop, config.connect_timeout_ms){
+    this->loop = loop;
+    this->backend = backend;
+    this->config = config;
+    connecting = 0;
+    next_waiter = 1;
+    acquires = 0;
+    reuses = 0;
+    handshakes = 0;
+    health_closes = 0;
+    wait_timeouts = 0;
+    sweep_timer = 0;
+    sweep();
+}
+
+//Closes idle connections, leased ones remain owned by their callers
+HDE::UpstreamPool::~UpstreamPool(){
+    loop->cancel_timer(sweep_timer);
+    for (size_t i = 0; i < idle.size(); i++){
+        loop->remove(idle[i].sock);
+        close(idle[i].sock);
+    }
+    for (size_t i = 0; i < waiters.size(); i++){
+        loop->cancel_timer(waiters[i].timer);
+    }
+}
+
+bool HDE::UpstreamPool::expired(int sock, int64_t now){
+    if (config.max_age_ms <= 0){
+        return false;
+    }
+    std::unordered_map<int, int64_t>::iterator it = created.find(sock);
+    return it != created.end() && now - it->second > config.max_age_ms;
+}
+
+void HDE::UpstreamPool::discard(int sock){
+    created.erase(sock);
+    close(sock);
+}
+
+void HDE::UpstreamPool::drop_idle(int sock){
+    for (std::deque<Idle>::iterator it = idle.begin(); it != idle.end(); ++it){
+        if (it->sock == sock){
+            idle.erase(it);
+            break;
+        }
+    }
+    loop->remove(sock);
+    discard(sock);
+}
+
+void HDE::UpstreamPool::open_connection(Callback done){
+    connecting++;
+    handshakes++;
+    connector.connect(backend.port, backend.interface, [this, done](int sock, int error){
+        connecting--;
+        if (sock >= 0){
+            created[sock] = EventLoop::now_ms();
+        }
+        done(sock, error);
+        if (sock < 0){
+            serve_waiter();
+        }
+    });
+}
+
+//Hands out the most recently used healthy connection, opens a new one, or queues the caller in FIFO order
+void HDE::UpstreamPool::acquire(Callback done){
+    acquires++;
+    int64_t now = EventLoop::now_ms();
+    while (!idle.empty()){
+        int sock = idle.back().sock;
+        idle.pop_back();
+        loop->remove(sock);
+        if (expired(sock, now)){
+            discard(sock);
+            continue;
+        }
+        reuses++;
+        done(sock, 0);
+        return;
+    }
+    if (created.size() + connecting < config.max_connections){
+        open_connection(done);
+        return;
+    }
+    if (waiters.size() >= config.max_waiters){
+        done(-1, EAGAIN);
+        return;
+    }
+    Waiter waiter;
+    waiter.id = next_waiter++;
+    waiter.done = done;
+    uint64_t id = waiter.id;
+    waiter.timer = loop->run_after(config.wait_timeout_ms, [this, id](){
+        for (std::deque<Waiter>::iterator it = waiters.begin(); it != waiters.end(); ++it){
+            if (it->id == id){
+                Callback expired_done = it->done;
+                waiters.erase(it);
+                wait_timeouts++;
+                expired_done(-1, ETIMEDOUT);
+                return;
+            }
+        }
+    });
+    waiters.push_back(waiter);
+}
+
+//Returns a leased connection, reusable is false when the response left it in an unknown state
+void HDE::UpstreamPool::release(int sock, bool reusable){
+    if (created.find(sock) == created.end()){
+        close(sock);
+        return;
+    }
+    if (!reusable || expired(sock, EventLoop::now_ms())){
+        discard(sock);
+        serve_waiter();
+        return;
+    }
+    if (!waiters.empty()){
+        Waiter waiter = waiters.front();
+        waiters.pop_front();
+        loop->cancel_timer(waiter.timer);
+        reuses++;
+        waiter.done(sock, 0);
+        return;
+    }
+    if (idle.size() >= config.max_idle){
+        discard(sock);
+        return;
+    }
+    Idle entry;
+    entry.sock = sock;
+    entry.idle_since = EventLoop::now_ms();
+    idle.push_back(entry);
+    // An idle upstream should stay silent, readability means it closed or misbehaved
+    loop->add(sock, EPOLLIN | EPOLLRDHUP, [this, sock](uint32_t events){ on_idle_event(sock, events); });
+}
+
+void HDE::UpstreamPool::on_idle_event(int sock, uint32_t){
+    health_closes++;
+    drop_idle(sock);
+}
+
+void HDE::UpstreamPool::serve_waiter(){
+    if (waiters.empty() || created.size() + connecting >= config.max_connections){
+        return;
+    }
+    Waiter waiter = waiters.front();
+    waiters.pop_front();
+    loop->cancel_timer(waiter.timer);
+    open_connection(waiter.done);
+}
+
+//Closes connections past their idle timeout or maximum age
+void HDE::UpstreamPool::sweep(){
+    int64_t now = EventLoop::now_ms();
+    while (!idle.empty()){
+        Idle &oldest = idle.front();
+        if ((config.idle_timeout_ms > 0 && now - oldest.idle_since > config.idle_timeout_ms) || expired(oldest.sock, now)){
+            drop_idle(oldest.sock);
+            continue;
+        }
+        break;
+    }
+    int interval = config.idle_timeout_ms / 2;
+    if (interval < 100){
+        interval = 100;
+    }
+    sweep_timer = loop->run_after(interval, [this](){ sweep(); });
+}
+
+HDE::Backend & HDE::UpstreamPool::get_backend(){
+    return backend;
+}
+
+size_t HDE::UpstreamPool::get_idle(){
+    return idle.size();
+}
+
+size_t HDE::UpstreamPool::get_open(){
+    return created.size() + connecting;
+}
+
+size_t HDE::UpstreamPool::get_waiting(){
+    return waiters.size();
+}
+
+uint64_t HDE::UpstreamPool::get_acquires(){
+    return acquires;
+}
+
+//Every reuse is a TCP handshake saved
+uint64_t HDE::UpstreamPool::get_reuses(){
+    return reuses;
+}
+
+uint64_t HDE::UpstreamPool::get_handshakes(){
+    return handshakes;
+}
+
+uint64_t HDE::UpstreamPool::get_health_closes(){
+    return health_closes;
+}
+
+uint64_t HDE::UpstreamPool::get_wait_timeouts(){
+    return wait_timeouts;
+}
+
+double HDE::UpstreamPool::get_reuse_ratio(){
+    return acquires == 0 ? 0.0 : (double)reuses / acquires;
+}
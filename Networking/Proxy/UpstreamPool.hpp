@@ -0,0 +1,77 @@
+#ifndef UpstreamPool_hpp
+#define UpstreamPool_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <deque>
+#include <unordered_map>
+#include "Backend.hpp"
+#include "../Sockets/Connector.hpp"
+#include "../Events/EventLoop.hpp"
+
+namespace HDE{
+    struct UpstreamPoolConfig{
+        size_t max_idle;
+        size_t max_connections;
+        size_t max_waiters;
+        int max_age_ms;
+        int idle_timeout_ms;
+        int connect_timeout_ms;
+        int wait_timeout_ms;
+    };
+
+    //Keep-alive connections to one backend, owned by a single event loop (one pool per worker per backend)
+    class UpstreamPool{
+        public:
+            typedef Connector::Callback Callback;
+        private:
+            struct Idle{
+                int sock;
+                int64_t idle_since;
+            };
+            struct Waiter{
+                uint64_t id;
+                uint64_t timer;
+                Callback done;
+            };
+            EventLoop *loop;
+            Connector connector;
+            Backend backend;
+            UpstreamPoolConfig config;
+            std::deque<Idle> idle;
+            std::deque<Waiter> waiters;
+            std::unordered_map<int, int64_t> created;
+            size_t connecting;
+            uint64_t next_waiter;
+            uint64_t sweep_timer;
+            uint64_t acquires;
+            uint64_t reuses;
+            uint64_t handshakes;
+            uint64_t health_closes;
+            uint64_t wait_timeouts;
+            void open_connection(Callback done);
+            void discard(int sock);
+            void drop_idle(int sock);
+            void on_idle_event(int sock, uint32_t events);
+            void serve_waiter();
+            void sweep();
+            bool expired(int sock, int64_t now);
+        public:
+            UpstreamPool(EventLoop *loop, Backend backend, UpstreamPoolConfig config);
+            ~UpstreamPool();
+            void acquire(Callback done);
+            void release(int sock, bool reusable);
+            Backend & get_backend();
+            size_t get_idle();
+            size_t get_open();
+            size_t get_waiting();
+            uint64_t get_acquires();
+            uint64_t get_reuses();
+            uint64_t get_handshakes();
+            uint64_t get_health_closes();
+            uint64_t get_wait_timeouts();
+            double get_reuse_ratio();
+    };
+}
+
+#endif
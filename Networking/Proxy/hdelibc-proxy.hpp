@@ -0,0 +1,15 @@
+#ifndef hdelibc_proxy_hpp
+#define hdelibc_proxy_hpp
+
+#include <stdio.h>
+#include "Backend.hpp"
+#include "UpstreamPool.hpp"
+#include "ReverseProxy.hpp"
+#include "Balancer.hpp"
+#include "BalancingPolicy.hpp"
+#include "HealthChecker.hpp"
+#include "HedgePolicy.hpp"
+#include "RetryBudget.hpp"
+
+
+#endif
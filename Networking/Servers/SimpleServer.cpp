@@ -1,9 +1,173 @@
 #include "SimpleServer.hpp"
+#include <sys/socket.h>
+#include <errno.h>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
-HDE::SimpleServer::SimpleServer(int domain, int service, int protocol, int port, u_long interface, int bcklg){
-    socket = new ListeningSocket(domain, service, protocol, port, interface, bcklg);
+//Constructor, the metrics block leaves room for a few dozen latency series per thread
+HDE::SimpleServer::SimpleServer(int domain, int service, int protocol, int port, u_long interface, int bcklg) : metrics(1 << 15){
+    transport = Transport::system();
+    setup(new ListeningSocket(domain, service, protocol, port, interface, bcklg));
 }
 
+HDE::SimpleServer::SimpleServer(Transport *transport) : metrics(1 << 15){
+    this->transport = transport;
+    setup(NULL);
+}
+
+void HDE::SimpleServer::setup(ListeningSocket *socket){
+    current = 0;
+    latency_log_ms = 0;
+    latency_timer = 0;
+    CycleClock::calibrate();
+    ListenerConfig config;
+    config.name = "default";
+    config.protocol = "http";
+    add_listener(socket, config);
+    metrics.add_collector([this](std::string &out){ collect_accept_queues(out); });
+}
+
+HDE::SimpleServer::~SimpleServer(){
+    for (size_t i = 0; i < listeners.size(); i++){
+        if (listeners[i].socket != NULL){
+            close(listeners[i].socket->get_sock());
+            delete listeners[i].socket;
+        }
+    }
+}
+
+//Takes ownership of the socket, a NULL socket adds a listener whose connections only come from the transport
+size_t HDE::SimpleServer::add_listener(ListeningSocket *socket, ListenerConfig config){
+    Listener listener;
+    listener.socket = socket;
+    listener.config = config;
+    listeners.push_back(listener);
+    return listeners.size() - 1;
+}
+
+size_t HDE::SimpleServer::add_listener(int domain, int service, int protocol, int port, u_long interface, int bcklg, ListenerConfig config){
+    return add_listener(new ListeningSocket(domain, service, protocol, port, interface, bcklg), config);
+}
+
+//Registers every listener with the shared event loop
+void HDE::SimpleServer::register_listeners(){
+    for (size_t i = 0; i < listeners.size(); i++){
+        if (listeners[i].socket == NULL){
+            continue;
+        }
+        int sock = listeners[i].socket->get_sock();
+        if (loop.add(sock, EPOLLIN, [this, i](uint32_t){ dispatch(i); }) < 0){
+            std::cerr << "Failed to register listener " << listeners[i].config.name << ": " << strerror(errno) << std::endl;
+        }
+    }
+}
+
+void HDE::SimpleServer::dispatch(size_t index){
+    current = index;
+    Listener &listener = listeners[index];
+    if (!listener.config.on_connection){
+        acceptor();
+        handler();
+        responder();
+        return;
+    }
+    int client = transport->accept(listener.socket != NULL ? listener.socket->get_sock() : -1, NULL);
+    if (client < 0){
+        std::cerr << "Accept failed on " << listener.config.name << ": " << strerror(errno) << std::endl;
+        return;
+    }
+    listener.config.on_connection(client);
+}
+
+//Returns the listener currently being served
 HDE::ListeningSocket * HDE::SimpleServer::get_socket(){
-    return socket;
-}
\ No newline at end of file
+    return listeners[current].socket;
+}
+
+HDE::ListeningSocket * HDE::SimpleServer::get_socket(size_t index){
+    return listeners[index].socket;
+}
+
+const HDE::ListenerConfig & HDE::SimpleServer::get_listener_config(){
+    return listeners[current].config;
+}
+
+size_t HDE::SimpleServer::get_listener_count(){
+    return listeners.size();
+}
+
+HDE::EventLoop * HDE::SimpleServer::get_loop(){
+    return &loop;
+}
+
+HDE::MetricsRegistry * HDE::SimpleServer::get_metrics(){
+    return &metrics;
+}
+
+void HDE::SimpleServer::set_transport(Transport *transport){
+    this->transport = transport;
+}
+
+HDE::Transport * HDE::SimpleServer::get_transport(){
+    return transport;
+}
+
+//Prints p50/p99/p999/max for every latency metric every interval_ms on the server's loop, 0 turns it off
+void HDE::SimpleServer::set_latency_log(int interval_ms){
+    if (latency_timer != 0){
+        loop.cancel_timer(latency_timer);
+        latency_timer = 0;
+    }
+    latency_log_ms = interval_ms;
+    if (interval_ms > 0){
+        latency_timer = loop.run_after(interval_ms, [this](){ log_latency(); });
+    }
+}
+
+void HDE::SimpleServer::log_latency(){
+    std::cout << metrics.latency_report() << std::flush;
+    latency_timer = loop.run_after(latency_log_ms, [this](){ log_latency(); });
+}
+
+//On a listening socket TCP_INFO reports the accept queue length in tcpi_unacked and its limit in tcpi_sacked,
+//overflows and drops are host-wide TcpExt counters
+void HDE::SimpleServer::collect_accept_queues(std::string &out){
+    std::string length;
+    std::string limit;
+    for (size_t i = 0; i < listeners.size(); i++){
+        struct tcp_info info;
+        socklen_t size = sizeof(info);
+        if (listeners[i].socket == NULL || getsockopt(listeners[i].socket->get_sock(), IPPROTO_TCP, TCP_INFO, &info, &size) < 0){
+            continue;
+        }
+        std::string labels = "{listener=\"" + listeners[i].config.name + "\"} ";
+        length += "hdelibc_accept_queue_length" + labels + std::to_string(info.tcpi_unacked) + "\n";
+        limit += "hdelibc_accept_queue_limit" + labels + std::to_string(info.tcpi_sacked) + "\n";
+    }
+    MetricsRegistry::write_header(out, "hdelibc_accept_queue_length", "Connections waiting to be accepted", "gauge");
+    out += length;
+    MetricsRegistry::write_header(out, "hdelibc_accept_queue_limit", "Accept queue capacity", "gauge");
+    out += limit;
+    std::ifstream netstat("/proc/net/netstat");
+    std::string names;
+    std::string values;
+    while (std::getline(netstat, names) && std::getline(netstat, values)){
+        if (names.compare(0, 7, "TcpExt:") != 0){
+            continue;
+        }
+        std::istringstream name_stream(names);
+        std::istringstream value_stream(values);
+        std::string name;
+        std::string value;
+        while (name_stream >> name && value_stream >> value){
+            if (name == "ListenOverflows" || name == "ListenDrops"){
+                std::string metric = name == "ListenOverflows" ? "hdelibc_listen_overflows_total" : "hdelibc_listen_drops_total";
+                MetricsRegistry::write_header(out, metric, "Host-wide " + name + " from /proc/net/netstat", "counter");
+                out += metric + " " + value + "\n";
+            }
+        }
+    }
+}
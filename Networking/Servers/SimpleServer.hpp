@@ -3,19 +3,61 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <string>
+#include <vector>
+#include <functional>
 #include "../hdelibc-networking.hpp"
 
 namespace HDE{
+    //Per-listener configuration, an empty on_connection runs the acceptor/handler/responder pipeline
+    struct ListenerConfig{
+        std::string name;
+        std::string protocol;
+        std::function<void(int client_socket)> on_connection;
+    };
+
     class SimpleServer{
         private:
-            ListeningSocket *socket;
+            struct Listener{
+                ListeningSocket *socket;
+                ListenerConfig config;
+            };
+            std::vector<Listener> listeners;
+            size_t current;
+            EventLoop loop;
+            MetricsRegistry metrics;
+            Transport *transport;
+            int latency_log_ms;
+            uint64_t latency_timer;
+            void setup(ListeningSocket *socket);
+            void log_latency();
+            void collect_accept_queues(std::string &out);
             virtual void acceptor() = 0;
             virtual void handler() = 0;
             virtual void responder() = 0;
         public:
             SimpleServer(int domain, int service, int protocol, int port, u_long interface, int bcklg);
+            //Binds nothing, the default listener has no socket and every connection comes from transport
+            SimpleServer(Transport *transport);
+            virtual ~SimpleServer();
             virtual void launch() = 0;
+            size_t add_listener(ListeningSocket *socket, ListenerConfig config);
+            size_t add_listener(int domain, int service, int protocol, int port, u_long interface, int bcklg, ListenerConfig config);
+            void register_listeners();
+            //Serves one connection from listener index, the event loop calls it when the listener is readable and
+            //a server on a MemoryTransport is driven by calling it directly
+            void dispatch(size_t index);
+            //NULL for the socketless listener of a server built on a transport
             ListeningSocket * get_socket();
+            ListeningSocket * get_socket(size_t index);
+            const ListenerConfig & get_listener_config();
+            size_t get_listener_count();
+            EventLoop * get_loop();
+            MetricsRegistry * get_metrics();
+            //Not owned, connections are accepted, read, written and closed through it
+            void set_transport(Transport *transport);
+            Transport * get_transport();
+            void set_latency_log(int interval_ms);
     };
 }
 
@@ -2,97 +2,374 @@
 #include <cstring>
 #include <unistd.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/signalfd.h>
 
-HDE::TestServer::TestServer() : SimpleServer(AF_INET, SOCK_STREAM, 0, 3000, INADDR_ANY, 10) {
-    memset(buffer, 0, sizeof(buffer));
+//Status code of a complete response, which always starts with "HTTP/1.1 "
+static int response_status(const std::string &response) {
+    return response.size() > 12 ? atoi(response.c_str() + 9) : 0;
+}
+
+HDE::TestServer::TestServer() : TestServer(default_config()) {
+}
+
+HDE::TestServer::TestServer(TestServerConfig config) : SimpleServer(AF_INET, SOCK_STREAM, 0, 3000, INADDR_ANY, 10),
+    cork_policies(CORK_MSG_MORE), microcache(1 << 20), latency_routes(0), tracer(0.01), access_log(config.access_log) {
+    setup(config);
+    if (!perf.is_available()) {
+        std::cerr << "Hardware counters unavailable: " << strerror(perf.get_error()) << std::endl;
+    }
+    set_latency_log(10000);
+    ListenerConfig admin;
+    admin.name = "admin";
+    admin.protocol = "http";
+    add_listener(AF_INET, SOCK_STREAM, 0, TEST_SERVER_ADMIN_PORT, INADDR_LOOPBACK, 10, admin);
     launch();
 }
 
+HDE::TestServer::TestServer(Transport *transport, TestServerConfig config) : SimpleServer(transport),
+    cork_policies(CORK_MSG_MORE), microcache(1 << 20), latency_routes(0), tracer(0.01), access_log(config.access_log) {
+    setup(config);
+}
+
+HDE::TestServerConfig HDE::TestServer::default_config() {
+    return TestServerConfig{AccessLogConfig{"access.log", 16384, 64 * 1024, 64 << 20, 5, 20}, "diagnostics.blog", false};
+}
+
+//Shared by both constructors, everything the server needs to serve a request
+void HDE::TestServer::setup(const TestServerConfig &config) {
+    memset(buffer, 0, sizeof(buffer));
+    new_socket = -1;
+    cached_response = NULL;
+    admin_request = false;
+    MetricsRegistry *metrics = get_metrics();
+    requests_metric = metrics->add_counter("hdelibc_requests_total", "Requests answered");
+    connections_metric = metrics->add_counter("hdelibc_connections_total", "Connections accepted");
+    active_metric = metrics->add_gauge("hdelibc_active_connections", "Connections currently open");
+    received_metric = metrics->add_counter("hdelibc_received_bytes_total", "Request bytes read");
+    sent_metric = metrics->add_counter("hdelibc_sent_bytes_total", "Response bytes written");
+    accept_errors_metric = metrics->add_counter("hdelibc_errors_total{kind=\"accept\"}", "Failed accepts, reads and writes");
+    read_errors_metric = metrics->add_counter("hdelibc_errors_total{kind=\"read\"}", "Failed accepts, reads and writes");
+    write_errors_metric = metrics->add_counter("hdelibc_errors_total{kind=\"write\"}", "Failed accepts, reads and writes");
+    parsed = false;
+    started = 0;
+    memset(span_ticks, 0, sizeof(span_ticks));
+    memset(perf_marks, 0, sizeof(perf_marks));
+    perf_requests = 0;
+    perf_sampled = false;
+    trace = TraceContext();
+    add_latency_route("/");
+    add_latency_route("/stream/");
+    add_latency_route("/metrics");
+    if (config.watchdog) {
+        // Requests are served synchronously on the loop, so a client that stalls its request stalls the loop
+        watchdog.reset(new LoopWatchdog(LoopWatchdogConfig{100, 10, 250, true}, get_metrics()));
+        watchdog->watch(get_loop(), "main");
+    }
+    diagnostics_open = !config.diagnostics_path.empty() && BinaryLog::open(config.diagnostics_path, 1 << 20);
+    metrics->add_collector([this](std::string &out){
+        MetricsRegistry::write_header(out, "hdelibc_access_log_dropped_total", "Access log records dropped on full rings", "counter");
+        out += "hdelibc_access_log_dropped_total " + std::to_string(access_log.get_dropped()) + "\n";
+        MetricsRegistry::write_header(out, "hdelibc_perf_available", "Whether hardware counters are being recorded", "gauge");
+        out += std::string("hdelibc_perf_available ") + (perf.is_available() ? "1" : "0") + "\n";
+    });
+    cork_policies.add("/stream/", CORK_NONE);
+    // Responses may be up to one second stale, repeats skip handler() and the responder's formatting
+    microcache.add_route("/", 1000, std::vector<std::string>());
+}
+
+HDE::TestServer::~TestServer() {
+    if (diagnostics_open) {
+        BinaryLog::close();
+    }
+}
+
+//One latency series per phase for requests under prefix, plus hardware event totals per stage when counters
+//are available, the first route also takes unmatched paths
+void HDE::TestServer::add_latency_route(const std::string &prefix) {
+    static const char *phases[PHASE_COUNT] = {"accept", "read", "handler", "write", "total"};
+    static const char *stages[STAGE_COUNT] = {"acceptor", "handler", "responder"};
+    latency_routes.add(prefix, phase_metrics.size() / PHASE_COUNT);
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        std::string name = "hdelibc_phase_seconds{phase=\"" + std::string(phases[phase]) + "\",route=\"" + prefix + "\"}";
+        phase_metrics.push_back(get_metrics()->add_latency(name, "Time spent in each request phase"));
+    }
+    if (!perf.is_available()) {
+        return;
+    }
+    perf_metrics.push_back(get_metrics()->add_counter("hdelibc_perf_samples_total{route=\"" + prefix + "\"}", "Requests whose hardware events were counted"));
+    for (int stage = 0; stage < STAGE_COUNT; stage++) {
+        for (int event = 0; event < PERF_EVENT_COUNT; event++) {
+            std::string name = "hdelibc_perf_events_total{event=\"" + std::string(PerfCounters::event_name((PerfEvent)event)) +
+                               "\",stage=\"" + stages[stage] + "\",route=\"" + prefix + "\"}";
+            perf_metrics.push_back(get_metrics()->add_counter(name, "Hardware events counted in each request stage"));
+        }
+    }
+}
+
+//Also hands the finished request to the access log and its spans to the tracer, status is the one sent and is
+//logged as 0 when the write failed
+void HDE::TestServer::finish_request(ssize_t sent, int status) {
+    static const int phase_spans[PHASE_TOTAL] = {SPAN_ACCEPT, SPAN_READ, SPAN_HANDLER, SPAN_WRITE};
+    static const char *span_names[SPAN_COUNT] = {"accept", "read", "parse", "route", "handler", "write"};
+    MetricsRegistry *metrics = get_metrics();
+    size_t route = parsed ? latency_routes.match(request.get_path()) : 0;
+    uint64_t finished = CycleClock::now();
+    for (int phase = 0; phase < PHASE_TOTAL; phase++) {
+        const uint64_t *ticks = span_ticks[phase_spans[phase]];
+        // A phase that never ran, like the handler on a microcache hit, would otherwise record a zero
+        if (ticks[1] == 0) {
+            continue;
+        }
+        metrics->record_ns(phase_metrics[route * PHASE_COUNT + phase], CycleClock::to_ns(ticks[1] - ticks[0]));
+    }
+    metrics->record_ns(phase_metrics[route * PHASE_COUNT + PHASE_TOTAL], CycleClock::to_ns(finished - started));
+    if (perf_sampled && perf.read(perf_marks[STAGE_COUNT])) {
+        // Per route the samples counter comes first, event totals divide by it for per-request averages
+        size_t base = route * (1 + STAGE_COUNT * PERF_EVENT_COUNT);
+        metrics->increment(perf_metrics[base]);
+        for (int stage = 0; stage < STAGE_COUNT; stage++) {
+            PerfSample delta = PerfCounters::difference(perf_marks[stage + 1], perf_marks[stage]);
+            for (int event = 0; event < PERF_EVENT_COUNT; event++) {
+                metrics->increment(perf_metrics[base + 1 + stage * PERF_EVENT_COUNT + event], delta.values[event]);
+            }
+        }
+    }
+    if (trace.sampled) {
+        tracer.record(trace, "request", started, finished);
+        for (int span = 0; span < SPAN_COUNT; span++) {
+            // Skipped phases leave no span either
+            if (span_ticks[span][1] != 0) {
+                tracer.record(trace, span_names[span], Tracer::new_id(), trace.span_id, span_ticks[span][0], span_ticks[span][1]);
+            }
+        }
+    }
+    access.status = sent < 0 ? 0 : status;
+    access.bytes_out = sent < 0 ? 0 : sent;
+    access.duration_ns = CycleClock::to_ns(finished - started);
+    access_log.log(access);
+}
+
+// dispatch() runs every phase even after the acceptor gave up, so the socket is closed and counted once
+void HDE::TestServer::close_connection() {
+    if (new_socket < 0) {
+        return;
+    }
+    get_transport()->close(new_socket);
+    new_socket = -1;
+    get_metrics()->add(active_metric, -1);
+}
+
 void HDE::TestServer::acceptor() {
-    struct sockaddr_in address = get_socket()->get_address();
-    int addr_len = sizeof(address);
+    perf_sampled = perf.is_available() && perf_requests++ % PERF_SAMPLE_INTERVAL == 0;
+    if (perf_sampled) {
+        perf.read(perf_marks[STAGE_ACCEPTOR]);
+    }
+    cached_response = NULL;
+    admin_request = false;
+    parsed = false;
+    memset(span_ticks, 0, sizeof(span_ticks));
+    trace = TraceContext();
+    MetricsRegistry *metrics = get_metrics();
+    Transport *transport = get_transport();
+    started = CycleClock::now();
+    access = AccessRecord();
+    // The admin listener only serves /metrics and /debug/trace, which must never be answered from the microcache
+    admin_request = get_listener_config().name == "admin";
+    // A server on a transport has a listener without a socket
+    ListeningSocket *listening = get_socket();
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
     
-    std::cout << "Attempting to accept connection..." << std::endl;
-    new_socket = accept(get_socket()->get_sock(), (struct sockaddr *)&address, (socklen_t *)&addr_len);
+    new_socket = transport->accept(listening != NULL ? listening->get_sock() : -1, &address);
     
     if (new_socket < 0) {
         std::cerr << "Accept failed with error: " << strerror(errno) << std::endl;
+        metrics->increment(accept_errors_metric);
         return;
     }
-    
-    std::cout << "Connection accepted on socket: " << new_socket << std::endl;
+    metrics->increment(connections_metric);
+    metrics->add(active_metric, 1);
+    uint64_t accepted = CycleClock::now();
+    span_ticks[SPAN_ACCEPT][0] = started;
+    span_ticks[SPAN_ACCEPT][1] = accepted;
+    access.time_us = EventLoop::wall_us();
+    access.client = address.sin_addr.s_addr;
     
     // Clear buffer before each read
     memset(buffer, 0, sizeof(buffer));
     
     // Set a receive timeout
-    struct timeval tv;
-    tv.tv_sec = 5;  // 5 seconds timeout
-    tv.tv_usec = 0;
-    setsockopt(new_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
+    transport->set_receive_timeout(new_socket, 5);  // 5 seconds timeout
     
     // Read with detailed error checking
-    std::cout << "Reading from socket..." << std::endl;
-    ssize_t bytes_read = recv(new_socket, buffer, 30000, 0);  // Using recv instead of read
+    // With SO_RCVTIMEO set, the watchdog's stack signal interrupts recv instead of restarting it
+    ssize_t bytes_read;
+    do {
+        bytes_read = transport->recv(new_socket, buffer, sizeof(buffer) - 1);  // Leaves room for the terminator
+    } while (bytes_read < 0 && errno == EINTR);
     
     if (bytes_read < 0) {
         std::cerr << "Read failed with error: " << strerror(errno) << std::endl;
-        close(new_socket);
+        metrics->increment(read_errors_metric);
+        close_connection();
         return;
     } else if (bytes_read == 0) {
         std::cerr << "Client closed connection" << std::endl;
-        close(new_socket);
+        close_connection();
         return;
     }
+    metrics->increment(received_metric, bytes_read);
+    span_ticks[SPAN_READ][0] = accepted;
+    span_ticks[SPAN_READ][1] = CycleClock::now();
+    access.bytes_in = bytes_read;
     
-    std::cout << "Bytes read: " << bytes_read << std::endl;
     buffer[bytes_read] = '\0';
-    
-    // Print the raw bytes for debugging
-    std::cout << "Raw received data (hex):" << std::endl;
-    for(int i = 0; i < bytes_read && i < 50; i++) {  // Print first 50 bytes
-        printf("%02x ", (unsigned char)buffer[i]);
+    span_ticks[SPAN_PARSE][0] = span_ticks[SPAN_READ][1];
+    parsed = request.parse(buffer, bytes_read) > 0;
+    span_ticks[SPAN_PARSE][1] = CycleClock::now();
+    // A request without a valid traceparent starts its own trace, which also serves as its request id
+    trace = tracer.start(parsed ? request.get_header("traceparent") : std::string());
+    access.trace_high = trace.trace_high;
+    access.trace_low = trace.trace_low;
+    if (parsed) {
+        access.set_method(request.get_method());
+        access.set_path(request.get_path());
+        // Only a stall report reads the label, building it costs an allocation and a lock
+        if (watchdog) {
+            get_loop()->set_label(request.get_method() + " " + request.get_path());
+        }
+        span_ticks[SPAN_ROUTE][0] = span_ticks[SPAN_PARSE][1];
+        cached_response = admin_request ? NULL : microcache.lookup(request, transport->now_ms());
+        span_ticks[SPAN_ROUTE][1] = CycleClock::now();
     }
-    std::cout << std::endl;
+    
+    // First 50 raw bytes for debugging, hex formatting happens in the decoder
+    HDE_LOG(LOG_DEBUG, "Raw received data (hex): %s", LogHex{buffer, (size_t)(bytes_read < 50 ? bytes_read : 50)});
 }
 
 void HDE::TestServer::handler() {
+    if (perf_sampled) {
+        perf.read(perf_marks[STAGE_HANDLER]);
+    }
+    if (cached_response != NULL || admin_request) {
+        return;
+    }
+    span_ticks[SPAN_HANDLER][0] = CycleClock::now();
     if (strlen(buffer) > 0) {
-        std::cout << "\nReceived Request (" << strlen(buffer) << " bytes):" << std::endl;
-        std::cout << "--- Begin Request ---" << std::endl;
-        std::cout << buffer << std::endl;
-        std::cout << "--- End Request ---" << std::endl;
+        HDE_LOG(LOG_DEBUG, "Received Request (%zu bytes):\n--- Begin Request ---\n%s\n--- End Request ---", strlen(buffer), buffer);
     } else {
-        std::cout << "Empty request received" << std::endl;
+        HDE_LOG(LOG_DEBUG, "Empty request received");
     }
+    span_ticks[SPAN_HANDLER][1] = CycleClock::now();
 }
 
 void HDE::TestServer::responder() {
-    const char* response = "HTTP/1.1 200 OK\r\n"
-                          "Content-Type: text/plain\r\n"
-                          "Connection: close\r\n"
-                          "Content-Length: 19\r\n"
-                          "\r\n"
-                          "Hello from Server!\r\n";
+    if (new_socket < 0) {
+        return;
+    }
+    if (perf_sampled) {
+        perf.read(perf_marks[STAGE_RESPONDER]);
+    }
+    MetricsRegistry *metrics = get_metrics();
+    span_ticks[SPAN_WRITE][0] = CycleClock::now();
+    if (cached_response != NULL || admin_request) {
+        std::string exposition;
+        if (admin_request) {
+            std::string status = "200 OK";
+            std::string type = "text/plain; version=0.0.4";
+            std::string body;
+            if (parsed && request.get_path() == "/metrics") {
+                body = metrics->render();
+            } else if (parsed && request.get_path() == "/debug/trace") {
+                type = "application/json";
+                body = tracer.export_json();
+            } else {
+                status = "404 Not Found";
+                type = "text/plain";
+                body = "Not Found\r\n";
+            }
+            exposition = "HTTP/1.1 " + status + "\r\n"
+                         "Content-Type: " + type + "\r\n"
+                         "Connection: close\r\n"
+                         "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                         "\r\n" + body;
+        }
+        const std::string &response = admin_request ? exposition : *cached_response;
+        ResponseWriter writer(new_socket, CORK_NONE, get_transport());
+        ssize_t sent = writer.write(response.data(), response.size(), false);
+        if (sent < 0) {
+            std::cerr << "Failed to send response: " << strerror(errno) << std::endl;
+            metrics->increment(write_errors_metric);
+        } else {
+            metrics->increment(requests_metric);
+            metrics->increment(sent_metric, writer.get_bytes_written());
+        }
+        span_ticks[SPAN_WRITE][1] = CycleClock::now();
+        finish_request(sent < 0 ? -1 : (ssize_t)writer.get_bytes_written(), response_status(response));
+        get_transport()->shutdown(new_socket);
+        close_connection();
+        return;
+    }
+    // Content-Length comes from the body, the microcache replays these bytes verbatim
+    static const std::string body = "Hello from Server!\r\n";
+    static const std::string headers = "HTTP/1.1 200 OK\r\n"
+                                       "Content-Type: text/plain\r\n"
+                                       "Connection: close\r\n"
+                                       "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                                       "\r\n";
     
-    ssize_t bytes_sent = send(new_socket, response, strlen(response), 0);  // Using send instead of write
-    if (bytes_sent < 0) {
+    // Headers are held back by the route's cork policy so they leave in the body's segment, an unparsed request
+    // still holds the previous request's path so it gets the default policy
+    CorkPolicy cork = parsed ? cork_policies.match(request.get_path()) : CORK_MSG_MORE;
+    ResponseWriter writer(new_socket, cork, get_transport());
+    ssize_t header_bytes = writer.write_headers(headers);
+    ssize_t body_bytes = header_bytes < 0 ? -1 : writer.write(body.data(), body.size(), false);
+    writer.finish();
+    if (body_bytes < 0) {
         std::cerr << "Failed to send response: " << strerror(errno) << std::endl;
+        metrics->increment(write_errors_metric);
     } else {
-        std::cout << "Sent " << bytes_sent << " bytes as response" << std::endl;
+        metrics->increment(requests_metric);
+        metrics->increment(sent_metric, writer.get_bytes_written());
+        if (parsed && microcache.is_cacheable(request)) {
+            microcache.store(request, headers + body, get_transport()->now_ms());
+        }
     }
     
+    span_ticks[SPAN_WRITE][1] = CycleClock::now();
+    finish_request(body_bytes < 0 ? -1 : (ssize_t)writer.get_bytes_written(), response_status(headers));
+    
     // Properly shutdown the socket
-    shutdown(new_socket, SHUT_RDWR);
-    close(new_socket);
+    get_transport()->shutdown(new_socket);
+    close_connection();
 }
 
 void HDE::TestServer::launch() {
-    while(true) {
-        std::cout << "\n=== Waiting for new connection ====" << std::endl;
-        acceptor();
-        handler();
-        responder();
-        std::cout << "=== Connection handled ====" << std::endl;
+    // Every listener is served from the one event loop, each ready listener runs acceptor/handler/responder
+    std::cout << "\n=== Waiting for new connections on " << get_listener_count() << " listener(s) ====" << std::endl;
+    register_listeners();
+    // SIGINT/SIGTERM stop the loop when main has blocked them, so the server unwinds and exits normally
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    int signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        std::cerr << "Failed to open signalfd: " << strerror(errno) << std::endl;
+    } else {
+        get_loop()->add(signal_fd, EPOLLIN, [this, signal_fd](uint32_t) {
+            struct signalfd_siginfo info;
+            if (read(signal_fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {
+                std::cout << "\n=== Stopping on " << strsignal(info.ssi_signo) << " ====" << std::endl;
+                get_loop()->stop();
+            }
+        });
+    }
+    get_loop()->run();
+    if (signal_fd >= 0) {
+        get_loop()->remove(signal_fd);
+        close(signal_fd);
     }
 }
\ No newline at end of file
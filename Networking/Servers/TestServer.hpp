@@ -4,19 +4,104 @@
 #include <iostream>
 #include <stdio.h>
 #include <cstring>
+#include <memory>
 #include "SimpleServer.hpp"
 
+//A group read is a syscall, only one request in this many is counted
+#define PERF_SAMPLE_INTERVAL 16
+//Loopback port serving /metrics and /debug/trace, kept off the public listener
+#define TEST_SERVER_ADMIN_PORT 3001
+
 namespace HDE{
+    struct TestServerConfig{
+        //An empty path leaves the access log closed
+        AccessLogConfig access_log;
+        //Opens the process-wide BinaryLog here, empty leaves it alone
+        std::string diagnostics_path;
+        //Starts a LoopWatchdog thread, which installs a process-wide WATCHDOG_STACK_SIGNAL handler and dumps a
+        //backtrace whenever a client stalls the loop, off by default
+        bool watchdog;
+    };
+
+    enum TestServerPhase{
+        PHASE_ACCEPT,
+        PHASE_READ,
+        PHASE_HANDLER,
+        PHASE_WRITE,
+        PHASE_TOTAL,
+        PHASE_COUNT
+    };
+
+    enum TestServerSpan{
+        SPAN_ACCEPT,
+        SPAN_READ,
+        SPAN_PARSE,
+        SPAN_ROUTE,
+        SPAN_HANDLER,
+        SPAN_WRITE,
+        SPAN_COUNT
+    };
+
+    //Hardware counters are read at the boundaries of dispatch()'s three calls
+    enum TestServerStage{
+        STAGE_ACCEPTOR,
+        STAGE_HANDLER,
+        STAGE_RESPONDER,
+        STAGE_COUNT
+    };
+
     class TestServer : public SimpleServer{
         private:
             char buffer[30000] = {0};
             int new_socket;
+            HttpRequest request;
+            Router<CorkPolicy> cork_policies;
+            MicroCache microcache;
+            const std::string *cached_response;
+            bool admin_request;
+            int requests_metric;
+            int connections_metric;
+            int active_metric;
+            int received_metric;
+            int sent_metric;
+            int accept_errors_metric;
+            int read_errors_metric;
+            int write_errors_metric;
+            Router<size_t> latency_routes;
+            std::vector<int> phase_metrics;
+            bool parsed;
+            uint64_t started;
+            uint64_t span_ticks[SPAN_COUNT][2];
+            PerfCounters perf;
+            PerfSample perf_marks[STAGE_COUNT + 1];
+            uint64_t perf_requests;
+            bool perf_sampled;
+            std::vector<int> perf_metrics;
+            Tracer tracer;
+            TraceContext trace;
+            AccessLog access_log;
+            AccessRecord access;
+            std::unique_ptr<LoopWatchdog> watchdog;
+            bool diagnostics_open;
+            void setup(const TestServerConfig &config);
+            void close_connection();
+            void add_latency_route(const std::string &prefix);
+            void finish_request(ssize_t sent, int status);
             void acceptor();
             void handler();
             void responder();
         public:
+            //Listens on port 3000, plus TEST_SERVER_ADMIN_PORT on loopback for the admin endpoints, and serves
+            //until SIGINT or SIGTERM
             TestServer();
+            TestServer(TestServerConfig config);
+            //Binds no socket and prints nothing, connections come from transport and the caller serves each one
+            //with dispatch(0). Only what config asks for touches the process or the filesystem
+            TestServer(Transport *transport, TestServerConfig config);
+            ~TestServer();
             void launch();
+            //What TestServer() runs with
+            static TestServerConfig default_config();
     };
 }
 
@@ -1,7 +1,26 @@
 #include <stdio.h>
+#include <signal.h>
+#include <cstring>
+#include <iostream>
 #include "TestServer.hpp"
 
-int main(){
-    HDE::TestServer t;
+//Usage: server [--watchdog], --watchdog reports loop stalls with a backtrace of the stalled thread
+int main(int argc, char **argv){
+    HDE::TestServerConfig config = HDE::TestServer::default_config();
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--watchdog") == 0){
+            config.watchdog = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--watchdog]" << std::endl;
+            return 2;
+        }
+    }
+    // Blocked before any thread starts so every thread leaves them to the server's signalfd
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    HDE::TestServer t(config);
     return 0;
-}
\ No newline at end of file
+}
@@ -3,12 +3,16 @@
 //Constructor
 HDE::BindingSocket::BindingSocket(int domain, int service, int protocol, int port, u_long interface) : SimpleSocket(domain, service, protocol, port, interface){
     //Network Connection
-    set_connection(connect_to_nw(get_sock(), get_address()));
+    binding = connect_to_nw(get_sock(), get_address());
+    set_connection(binding);
     test_connection(binding);
 }
 
 //Definition of connect to nw virtual function
 int HDE::BindingSocket::connect_to_nw(int sock, struct sockaddr_in address){
+    //A restarted server can take the port back while the last one's closed connections sit in TIME_WAIT
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
     return bind(sock, (struct sockaddr *)&address ,sizeof(address));
 }
 
@@ -1,13 +1,40 @@
 #include "ConnectingSocket.hpp"
+#include <errno.h>
+#include <fcntl.h>
 
-//Constructor
-HDE::ConnectingSocket::ConnectingSocket(int domain, int service, int protocol, int port, u_long interface) : SimpleSocket(domain, service, protocol, port, interface){
+//Constructor, connects in blocking mode
+HDE::ConnectingSocket::ConnectingSocket(int domain, int service, int protocol, int port, u_long interface) : ConnectingSocket(domain, service, protocol, port, interface, false){
+}
+
+//Socket and connect failures are recorded in get_error() instead of exiting, a non-blocking connect reports EINPROGRESS
+HDE::ConnectingSocket::ConnectingSocket(int domain, int service, int protocol, int port, u_long interface, bool nonblocking) : SimpleSocket(domain, service, protocol, port, interface, false){
+    if (get_sock() < 0){
+        error = errno;
+        set_connection(-1);
+        return;
+    }
+    if (nonblocking){
+        fcntl(get_sock(), F_SETFL, fcntl(get_sock(), F_GETFL) | O_NONBLOCK);
+    }
     //Network Connection
-    set_connection(connect_to_nw(get_sock(), get_address()));
-    test_connection(get_connection());
+    int result = connect_to_nw(get_sock(), get_address());
+    error = result < 0 ? errno : 0;
+    set_connection(result);
 }
 
 //Definition of connect to nw virtual function
 int HDE::ConnectingSocket::connect_to_nw(int sock, struct sockaddr_in address){
     return connect(sock, (struct sockaddr *)&address ,sizeof(address));
-}
\ No newline at end of file
+}
+
+int HDE::ConnectingSocket::get_error(){
+    return error;
+}
+
+bool HDE::ConnectingSocket::is_connected(){
+    return error == 0;
+}
+
+bool HDE::ConnectingSocket::is_pending(){
+    return error == EINPROGRESS;
+}
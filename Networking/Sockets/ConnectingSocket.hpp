@@ -6,10 +6,16 @@
 
 namespace HDE{
     class ConnectingSocket: public SimpleSocket{
+        private:
+            int error;
         public:
-            ConnectingSocket(int domain, int service, int protocol, int port, u_long interface) : SimpleSocket(domain, service, protocol, port, interface){};
+            ConnectingSocket(int domain, int service, int protocol, int port, u_long interface);
+            ConnectingSocket(int domain, int service, int protocol, int port, u_long interface, bool nonblocking);
             int connect_to_nw(int sock, sockaddr_in address);
+            int get_error();
+            bool is_connected();
+            bool is_pending();
     };
 }
 
-#endif
\ No newline at end of file
+#endif
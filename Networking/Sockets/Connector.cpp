@@ -0,0 +1,79 @@
+#include "Connector.hpp"
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+//Constructor
+HDE::Connector::Connector(EventLoop *loop, int timeout_ms){
+    this->loop = loop;
+    this->timeout_ms = timeout_ms;
+}
+
+//Abandons connects still in flight without running their callbacks
+HDE::Connector::~Connector(){
+    for (std::unordered_map<int, Pending>::iterator it = pending.begin(); it != pending.end(); ++it){
+        loop->remove(it->first);
+        loop->cancel_timer(it->second.timer);
+        close(it->first);
+    }
+}
+
+//Starts a connect, done runs exactly once and may run before connect() returns
+void HDE::Connector::connect(int port, u_long interface, Callback done){
+    ConnectingSocket socket(AF_INET, SOCK_STREAM, 0, port, interface, true);
+    int sock = socket.get_sock();
+    if (socket.is_connected()){
+        done(sock, 0);
+        return;
+    }
+    if (!socket.is_pending()){
+        // sock is -1 when socket() itself failed
+        if (sock >= 0){
+            close(sock);
+        }
+        done(-1, socket.get_error());
+        return;
+    }
+    if (loop->add(sock, EPOLLOUT, [this, sock](uint32_t){
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len) < 0){
+                error = errno;
+            }
+            complete(sock, error);
+        }) < 0){
+        int error = errno;
+        close(sock);
+        done(-1, error);
+        return;
+    }
+    Pending entry;
+    entry.done = done;
+    entry.timer = loop->run_after(timeout_ms, [this, sock](){ complete(sock, ETIMEDOUT); });
+    pending[sock] = entry;
+}
+
+void HDE::Connector::complete(int sock, int error){
+    std::unordered_map<int, Pending>::iterator it = pending.find(sock);
+    if (it == pending.end()){
+        return;
+    }
+    Callback done = it->second.done;
+    loop->cancel_timer(it->second.timer);
+    pending.erase(it);
+    loop->remove(sock);
+    if (error != 0){
+        close(sock);
+        done(-1, error);
+        return;
+    }
+    done(sock, 0);
+}
+
+size_t HDE::Connector::get_pending(){
+    return pending.size();
+}
+
+int HDE::Connector::get_timeout(){
+    return timeout_ms;
+}
@@ -0,0 +1,34 @@
+#ifndef Connector_hpp
+#define Connector_hpp
+
+#include <stdio.h>
+#include <functional>
+#include <unordered_map>
+#include "ConnectingSocket.hpp"
+#include "../Events/EventLoop.hpp"
+
+namespace HDE{
+    //Drives non-blocking ConnectingSockets on an event loop with a connect timeout
+    class Connector{
+        public:
+            //sock is the connected descriptor, or -1 with error set to the errno of the failure
+            typedef std::function<void(int sock, int error)> Callback;
+        private:
+            struct Pending{
+                uint64_t timer;
+                Callback done;
+            };
+            EventLoop *loop;
+            int timeout_ms;
+            std::unordered_map<int, Pending> pending;
+            void complete(int sock, int error);
+        public:
+            Connector(EventLoop *loop, int timeout_ms);
+            ~Connector();
+            void connect(int port, u_long interface, Callback done);
+            size_t get_pending();
+            int get_timeout();
+    };
+}
+
+#endif
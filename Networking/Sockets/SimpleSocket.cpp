@@ -2,13 +2,22 @@
 
 //Constructor
 
-HDE::SimpleSocket::SimpleSocket(int domain, int service, int protocol, int port, u_long interface){
+HDE::SimpleSocket::SimpleSocket(int domain, int service, int protocol, int port, u_long interface) : SimpleSocket(domain, service, protocol, port, interface, true){
+}
+
+HDE::SimpleSocket::SimpleSocket(int domain, int service, int protocol, int port, u_long interface, bool exit_on_failure){
     address.sin_family = domain;
     address.sin_port = htons(port);
     address.sin_addr.s_addr = htonl(interface);
+    connection = -1;
     //Socket 
     sock = socket(domain, service, protocol);
-    test_connection(sock);
+    if (exit_on_failure){
+        test_connection(sock);
+    }
+}
+
+HDE::SimpleSocket::~SimpleSocket(){
 }
 
 
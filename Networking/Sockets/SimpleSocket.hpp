@@ -14,6 +14,9 @@ namespace HDE{
             int connection;
         public:
             SimpleSocket(int domain, int service, int protocol, int port, u_long interface);
+            //Without exit_on_failure a failed socket() leaves get_sock() at -1 and errno set for the caller to report
+            SimpleSocket(int domain, int service, int protocol, int port, u_long interface, bool exit_on_failure);
+            virtual ~SimpleSocket();
             virtual int connect_to_nw(int sock, struct sockaddr_in address) = 0;
             void test_connection(int item_to_test);
             struct sockaddr_in get_address();
@@ -6,6 +6,7 @@
 #include "BindingSocket.hpp"
 #include "ListeningSocket.hpp"
 #include "ConnectingSocket.hpp"
+#include "Connector.hpp"
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "Tracer.hpp"
+#include "../Metrics/CycleClock.hpp"
+#include <unistd.h>
+#include <thread>
+#include <unordered_map>
+
+thread_local HDE::Tracer::Buffer * HDE::Tracer::local_buffers[TRACE_TLS_SLOTS];
+
+static std::atomic<size_t> next_index(0);
+static std::atomic<uint32_t> next_thread(1);
+
+//Tracers beyond the TLS slots find their thread's ring here instead
+static std::mutex overflow_lock;
+static std::unordered_map<const void *, std::unordered_map<std::thread::id, void *> > overflow;
+
+static int hex_value(char c){
+    if (c >= '0' && c <= '9'){
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f'){
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+//Lowercase hex only, as traceparent requires
+static bool parse_hex(const std::string &text, size_t offset, size_t digits, uint64_t &value){
+    value = 0;
+    for (size_t i = 0; i < digits; i++){
+        int digit = hex_value(text[offset + i]);
+        if (digit < 0){
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+    return true;
+}
+
+//Constructor, spans_per_thread is rounded up to a power of two
+HDE::Tracer::Tracer(double sample_rate, size_t spans_per_thread){
+    CycleClock::calibrate();
+    index = next_index.fetch_add(1);
+    size_t capacity = 1;
+    while (capacity < spans_per_thread){
+        capacity <<= 1;
+    }
+    mask = capacity - 1;
+    base_tick = CycleClock::now();
+    set_sample_rate(sample_rate);
+}
+
+HDE::Tracer::~Tracer(){
+    if (index < TRACE_TLS_SLOTS){
+        local_buffers[index] = NULL;
+    } else {
+        std::lock_guard<std::mutex> guard(overflow_lock);
+        overflow.erase(this);
+    }
+    for (size_t i = 0; i < buffers.size(); i++){
+        delete[] buffers[i]->spans;
+        delete buffers[i];
+    }
+}
+
+//First span from a thread, allocates its ring
+HDE::Tracer::Buffer * HDE::Tracer::attach(){
+    if (index >= TRACE_TLS_SLOTS){
+        std::lock_guard<std::mutex> guard(overflow_lock);
+        void *found = overflow[this][std::this_thread::get_id()];
+        if (found != NULL){
+            return (Buffer *)found;
+        }
+    }
+    Buffer *buffer = new Buffer();
+    buffer->head.store(0);
+    buffer->thread = next_thread.fetch_add(1);
+    buffer->spans = new Span[mask + 1];
+    for (size_t i = 0; i <= mask; i++){
+        buffer->spans[i].sequence.store(0);
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        buffers.push_back(buffer);
+    }
+    if (index < TRACE_TLS_SLOTS){
+        local_buffers[index] = buffer;
+    } else {
+        std::lock_guard<std::mutex> guard(overflow_lock);
+        overflow[this][std::this_thread::get_id()] = buffer;
+    }
+    return buffer;
+}
+
+//Rate is the share of new traces recorded, 0 records none and 1 every one
+void HDE::Tracer::set_sample_rate(double sample_rate){
+    if (sample_rate < 0){
+        sample_rate = 0;
+    }
+    // Compared against the top 53 bits of the trace id, which are uniformly random
+    sample_limit.store(sample_rate >= 1 ? (1ULL << 53) : (uint64_t)(sample_rate * (double)(1ULL << 53)));
+}
+
+double HDE::Tracer::get_sample_rate(){
+    return sample_limit.load() / (double)(1ULL << 53);
+}
+
+HDE::TraceContext HDE::Tracer::start(const std::string &traceparent){
+    TraceContext context;
+    if (!parse_traceparent(traceparent, context)){
+        context.trace_high = new_id();
+        context.trace_low = new_id();
+        context.parent_id = 0;
+        context.sampled = (context.trace_low >> 11) < sample_limit.load(std::memory_order_relaxed);
+    }
+    context.span_id = new_id();
+    return context;
+}
+
+//Per-thread splitmix64 seeded from the clock, the process and the thread, never 0 since 0 marks an invalid id
+uint64_t HDE::Tracer::new_id(){
+    static thread_local uint64_t state = 0;
+    if (state == 0){
+        state = CycleClock::now() ^ ((uint64_t)getpid() << 32) ^ (uint64_t)(uintptr_t)&state;
+    }
+    uint64_t id = 0;
+    while (id == 0){
+        state += 0x9E3779B97F4A7C15ULL;
+        id = state;
+        id = (id ^ (id >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        id = (id ^ (id >> 27)) * 0x94D049BB133111EBULL;
+        id ^= id >> 31;
+    }
+    return id;
+}
+
+//version-traceid-parentid-flags, later versions may append fields after the flags
+bool HDE::Tracer::parse_traceparent(const std::string &header, TraceContext &context){
+    if (header.size() < 55 || header[2] != '-' || header[35] != '-' || header[52] != '-'){
+        return false;
+    }
+    uint64_t version = 0;
+    uint64_t flags = 0;
+    if (!parse_hex(header, 0, 2, version) || version == 0xff || (version == 0 && header.size() != 55) ||
+        (header.size() > 55 && header[55] != '-')){
+        return false;
+    }
+    if (!parse_hex(header, 3, 16, context.trace_high) || !parse_hex(header, 19, 16, context.trace_low) ||
+        !parse_hex(header, 36, 16, context.parent_id) || !parse_hex(header, 53, 2, flags)){
+        return false;
+    }
+    if ((context.trace_high == 0 && context.trace_low == 0) || context.parent_id == 0){
+        return false;
+    }
+    context.sampled = (flags & 1) != 0;
+    return true;
+}
+
+//The header to send upstream, span_id is the span the upstream call is recorded under
+std::string HDE::Tracer::format_traceparent(const TraceContext &context, uint64_t span_id){
+    char text[56];
+    snprintf(text, sizeof(text), "00-%016llx%016llx-%016llx-%02x", (unsigned long long)context.trace_high,
+             (unsigned long long)context.trace_low, (unsigned long long)span_id, context.sampled ? 1 : 0);
+    return text;
+}
+
+std::string HDE::Tracer::request_id(const TraceContext &context){
+    char text[33];
+    snprintf(text, sizeof(text), "%016llx%016llx", (unsigned long long)context.trace_high, (unsigned long long)context.trace_low);
+    return text;
+}
+
+uint64_t HDE::Tracer::get_recorded(){
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t total = 0;
+    for (size_t i = 0; i < buffers.size(); i++){
+        total += buffers[i]->head.load(std::memory_order_acquire);
+    }
+    return total;
+}
+
+//Complete ("X") events in microseconds since the tracer started, one tid per recording thread
+std::string HDE::Tracer::export_json(){
+    std::lock_guard<std::mutex> guard(lock);
+    int pid = getpid();
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    char line[384];
+    for (size_t b = 0; b < buffers.size(); b++){
+        Buffer *buffer = buffers[b];
+        snprintf(line, sizeof(line), "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                 first ? "" : ",", pid, buffer->thread, buffer->thread);
+        out += line;
+        first = false;
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t oldest = head > mask + 1 ? head - mask - 1 : 0;
+        for (uint64_t i = oldest; i < head; i++){
+            Span &span = buffer->spans[i & mask];
+            uint64_t sequence = span.sequence.load(std::memory_order_acquire);
+            if (sequence != i * 2 + 2){
+                continue;
+            }
+            uint64_t trace_high = span.trace_high.load(std::memory_order_relaxed);
+            uint64_t trace_low = span.trace_low.load(std::memory_order_relaxed);
+            uint64_t span_id = span.span_id.load(std::memory_order_relaxed);
+            uint64_t parent_id = span.parent_id.load(std::memory_order_relaxed);
+            uint64_t start = span.start.load(std::memory_order_relaxed);
+            uint64_t end = span.end.load(std::memory_order_relaxed);
+            const char *name = span.name.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (span.sequence.load(std::memory_order_relaxed) != sequence){
+                continue;
+            }
+            double ts = start > base_tick ? CycleClock::to_ns(start - base_tick) / 1000.0 : 0;
+            double dur = end > start ? CycleClock::to_ns(end - start) / 1000.0 : 0;
+            snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,"
+                     "\"args\":{\"request_id\":\"%016llx%016llx\",\"span_id\":\"%016llx\",\"parent_id\":\"%016llx\"}}",
+                     name, ts, dur, pid, buffer->thread, (unsigned long long)trace_high, (unsigned long long)trace_low,
+                     (unsigned long long)span_id, (unsigned long long)parent_id);
+            out += line;
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
@@ -0,0 +1,100 @@
+#ifndef Tracer_hpp
+#define Tracer_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#define TRACE_TLS_SLOTS 16
+
+namespace HDE{
+    //W3C trace context for one request, span_id is this hop's span and parent_id the caller's (0 at the root).
+    //The trace id doubles as the request id in logs and exported spans
+    struct TraceContext{
+        uint64_t trace_high;
+        uint64_t trace_low;
+        uint64_t span_id;
+        uint64_t parent_id;
+        bool sampled;
+    };
+
+    //Request spans kept in per-thread rings of fixed slots, a thread only writes its own ring and the oldest
+    //spans are overwritten, so recording never allocates or locks after a thread's first span.
+    //export_json() copies whatever the rings hold as Chrome trace events for chrome://tracing or Perfetto.
+    //A span's name must outlive the tracer, string literals are expected
+    class Tracer{
+        private:
+            //Fields are written under a per-slot sequence so export skips a slot the owner is rewriting
+            struct Span{
+                std::atomic<uint64_t> sequence;
+                std::atomic<uint64_t> trace_high;
+                std::atomic<uint64_t> trace_low;
+                std::atomic<uint64_t> span_id;
+                std::atomic<uint64_t> parent_id;
+                std::atomic<uint64_t> start;
+                std::atomic<uint64_t> end;
+                std::atomic<const char *> name;
+            };
+            struct Buffer{
+                alignas(64) std::atomic<uint64_t> head;
+                uint32_t thread;
+                Span *spans;
+            };
+            size_t index;
+            size_t mask;
+            std::atomic<uint64_t> sample_limit;
+            uint64_t base_tick;
+            std::mutex lock;
+            std::vector<Buffer *> buffers;
+            static thread_local Buffer *local_buffers[TRACE_TLS_SLOTS];
+            Buffer * attach();
+            Tracer(const Tracer &);
+            Tracer & operator=(const Tracer &);
+        public:
+            Tracer(double sample_rate = 0.01, size_t spans_per_thread = 4096);
+            ~Tracer();
+            void set_sample_rate(double sample_rate);
+            double get_sample_rate();
+            //Continues the caller's trace when traceparent is valid and keeps its sampling decision,
+            //otherwise starts a new trace sampled at the configured rate
+            TraceContext start(const std::string &traceparent);
+            inline void record(const TraceContext &context, const char *name, uint64_t span_id, uint64_t parent_id,
+                               uint64_t start_tick, uint64_t end_tick){
+                if (!context.sampled){
+                    return;
+                }
+                Buffer *buffer = index < TRACE_TLS_SLOTS ? local_buffers[index] : NULL;
+                if (buffer == NULL){
+                    buffer = attach();
+                }
+                uint64_t head = buffer->head.load(std::memory_order_relaxed);
+                Span &span = buffer->spans[head & mask];
+                span.sequence.store(head * 2 + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                span.trace_high.store(context.trace_high, std::memory_order_relaxed);
+                span.trace_low.store(context.trace_low, std::memory_order_relaxed);
+                span.span_id.store(span_id, std::memory_order_relaxed);
+                span.parent_id.store(parent_id, std::memory_order_relaxed);
+                span.start.store(start_tick, std::memory_order_relaxed);
+                span.end.store(end_tick, std::memory_order_relaxed);
+                span.name.store(name, std::memory_order_relaxed);
+                span.sequence.store(head * 2 + 2, std::memory_order_release);
+                buffer->head.store(head + 1, std::memory_order_release);
+            }
+            //The request's own span, parented to the caller's
+            inline void record(const TraceContext &context, const char *name, uint64_t start_tick, uint64_t end_tick){
+                record(context, name, context.span_id, context.parent_id, start_tick, end_tick);
+            }
+            std::string export_json();
+            uint64_t get_recorded();
+            static uint64_t new_id();
+            static bool parse_traceparent(const std::string &header, TraceContext &context);
+            static std::string format_traceparent(const TraceContext &context, uint64_t span_id);
+            static std::string request_id(const TraceContext &context);
+    };
+}
+
+#endif
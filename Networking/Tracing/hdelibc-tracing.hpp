@@ -0,0 +1,8 @@
+#ifndef hdelibc_tracing_hpp
+#define hdelibc_tracing_hpp
+
+#include <stdio.h>
+#include "Tracer.hpp"
+
+
+#endif
@@ -3,6 +3,14 @@
 
 #include <stdio.h>
 #include "Sockets/hdelibc-sockets.hpp"
+#include "Events/hdelibc-events.hpp"
+#include "IO/hdelibc-io.hpp"
+#include "Http/hdelibc-http.hpp"
+#include "Proxy/hdelibc-proxy.hpp"
+#include "Cache/hdelibc-cache.hpp"
+#include "Metrics/hdelibc-metrics.hpp"
+#include "Logging/hdelibc-logging.hpp"
+#include "Tracing/hdelibc-tracing.hpp"
 
 
-#endif
\ No newline at end of file
+#endif
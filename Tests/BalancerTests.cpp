@@ -0,0 +1,106 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <netinet/in.h>
+#include "UnitTest.hpp"
+#include "../Networking/Proxy/Balancer.hpp"
+#include "../Networking/Proxy/BalancingPolicy.hpp"
+#include "../Networking/Metrics/MetricsRegistry.hpp"
+
+//A balancer of n equal backends named b0, b1, ... ejecting after two failures for ejection_ms
+static HDE::Balancer * make_balancer(size_t n, int ejection_ms, int max_ejected_percent){
+    std::vector<HDE::Backend> backends;
+    for (size_t i = 0; i < n; i++){
+        backends.push_back(HDE::Backend{"b" + std::to_string(i), (int)(8000 + i), INADDR_LOOPBACK, 1});
+    }
+    HDE::Balancer *balancer = new HDE::Balancer(backends, new HDE::RoundRobinPolicy());
+    balancer->set_outlier_config(HDE::OutlierConfig{2, ejection_ms, ejection_ms, 0, max_ejected_percent});
+    return balancer;
+}
+
+static void fail_requests(HDE::Balancer &balancer, size_t index, int count){
+    for (int i = 0; i < count; i++){
+        balancer.on_start(index);
+        balancer.on_finish(index, 100, false);
+    }
+}
+
+TEST(balancer_ejects_after_consecutive_failures){
+    HDE::Balancer *balancer = make_balancer(4, 60000, 50);
+    fail_requests(*balancer, 1, 1);
+    CHECK(balancer->get_state(1) == HDE::BACKEND_HEALTHY);
+    fail_requests(*balancer, 1, 1);
+    CHECK(balancer->get_state(1) == HDE::BACKEND_EJECTED);
+    CHECK(!balancer->is_available(1));
+    CHECK(balancer->get_load(1).ejections.load() == 1);
+    for (int i = 0; i < 16; i++){
+        CHECK(balancer->select(i) != 1);
+    }
+    delete balancer;
+}
+
+TEST(balancer_caps_ejected_share){
+    HDE::Balancer *balancer = make_balancer(2, 60000, 50);
+    fail_requests(*balancer, 0, 2);
+    fail_requests(*balancer, 1, 2);
+    CHECK(balancer->get_state(0) == HDE::BACKEND_EJECTED);
+    CHECK(balancer->get_state(1) == HDE::BACKEND_HEALTHY);
+    // Active checks aren't capped
+    CHECK(balancer->mark_down(1));
+    CHECK(balancer->get_state(1) == HDE::BACKEND_EJECTED);
+    delete balancer;
+}
+
+TEST(balancer_passive_ejection_keeps_active_hold){
+    HDE::Balancer *balancer = make_balancer(4, 1, 100);
+    CHECK(balancer->mark_down(2));
+    CHECK(balancer->get_load(2).ejected_until_ms.load() == INT64_MAX);
+    // Only reachable when everything else is out, a failure then must not shorten the hold
+    fail_requests(*balancer, 2, 2);
+    CHECK(balancer->get_load(2).ejected_until_ms.load() == INT64_MAX);
+    CHECK(balancer->get_load(2).ejections.load() == 1);
+    usleep(5000);
+    for (int i = 0; i < 8; i++){
+        balancer->select(i);
+    }
+    CHECK(balancer->get_state(2) == HDE::BACKEND_EJECTED);
+    balancer->mark_up(2);
+    for (int i = 0; i < 8; i++){
+        balancer->select(i);
+    }
+    CHECK(balancer->get_state(2) == HDE::BACKEND_HEALTHY);
+    delete balancer;
+}
+
+TEST(balancer_recovers_after_deadline){
+    HDE::Balancer *balancer = make_balancer(3, 1, 50);
+    HDE::MetricsRegistry metrics;
+    balancer->set_metrics(&metrics);
+    fail_requests(*balancer, 0, 2);
+    CHECK(balancer->get_state(0) == HDE::BACKEND_EJECTED);
+    usleep(5000);
+    for (int i = 0; i < 6; i++){
+        balancer->select(i);
+    }
+    CHECK(balancer->get_state(0) == HDE::BACKEND_HEALTHY);
+    CHECK(balancer->get_load(0).recoveries.load() == 1);
+    std::string text = metrics.render();
+    CHECK(text.find("hdelibc_backend_transitions_total{backend=\"b0\",state=\"ejected\"} 1") != std::string::npos);
+    CHECK(text.find("hdelibc_backend_transitions_total{backend=\"b0\",state=\"healthy\"} 1") != std::string::npos);
+    delete balancer;
+}
+
+TEST(balancer_maglev_table_size_is_prime){
+    std::vector<HDE::Backend> backends;
+    for (int i = 0; i < 3; i++){
+        backends.push_back(HDE::Backend{"b" + std::to_string(i), 8000 + i, INADDR_LOOPBACK, 1});
+    }
+    // 1000 is even, the old constructor kept it and never finished filling the table
+    HDE::MaglevPolicy *policy = new HDE::MaglevPolicy(1000);
+    HDE::Balancer balancer(backends, policy);
+    CHECK(policy->get_table_size() == 1009);
+    for (uint64_t key = 0; key < 64; key++){
+        CHECK(balancer.select(key) == balancer.select(key));
+    }
+}
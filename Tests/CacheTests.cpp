@@ -0,0 +1,326 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <string>
+#include <memory>
+#include <vector>
+#include "UnitTest.hpp"
+#include "../Networking/Cache/HttpCache.hpp"
+#include "../Networking/Cache/PersistentStore.hpp"
+#include "../Networking/Cache/SingleFlight.hpp"
+#include "../Networking/Events/EventLoop.hpp"
+
+#define STORE_CAPACITY 65536
+#define STORE_SLOTS 64
+
+static std::string store_path(){
+    return "/tmp/hdelibc_cache_test_" + std::to_string(getpid());
+}
+
+//Rewrites the bytes at offset in the closed store file
+static bool patch_file(const std::string &path, off_t offset, const std::string &bytes){
+    int fd = open(path.c_str(), O_RDWR);
+    if (fd < 0){
+        return false;
+    }
+    bool written = pwrite(fd, bytes.data(), bytes.size(), offset) == (ssize_t)bytes.size();
+    close(fd);
+    return written;
+}
+
+static off_t find_in_file(const std::string &path, const std::string &needle){
+    std::string contents;
+    char buffer[4096];
+    int fd = open(path.c_str(), O_RDONLY);
+    ssize_t n = 0;
+    while (fd >= 0 && (n = read(fd, buffer, sizeof(buffer))) > 0){
+        contents.append(buffer, n);
+    }
+    if (fd >= 0){
+        close(fd);
+    }
+    size_t at = contents.find(needle);
+    return at == std::string::npos ? -1 : (off_t)at;
+}
+
+static void parse_request(HDE::HttpRequest &request, const std::string &text){
+    CHECK(request.parse(text.data(), text.size()) == (int)text.size());
+}
+
+//Prepares an entry the way the proxy does, with the head cut before the blank line
+static std::shared_ptr<HDE::CacheEntry> cache_entry(HDE::HttpCache &cache, HDE::HttpRequest &request, const std::string &response_head,
+                                                    const std::string &body, int64_t now_ms){
+    HDE::HttpResponse response;
+    CHECK(response.parse(response_head.data(), response_head.size()) > 0);
+    std::shared_ptr<HDE::CacheEntry> entry = cache.prepare(request, response, now_ms);
+    if (entry){
+        entry->head = response_head.substr(0, response_head.size() - 2);
+        entry->status_line = response_head.find("\r\n") + 2;
+        entry->body = std::make_shared<const std::string>(body);
+    }
+    return entry;
+}
+
+TEST(httpcache_store_survives_reopen){
+    std::string path = store_path();
+    unlink(path.c_str());
+    {
+        HDE::PersistentStore store(path, STORE_CAPACITY, STORE_SLOTS);
+        CHECK(store.is_open());
+        CHECK(!store.was_recovered());
+        CHECK(store.put("alpha", "first", 5));
+        CHECK(store.put("beta", "second", 6));
+        CHECK(store.put("alpha", "third", 5));
+    }
+    HDE::PersistentStore store(path, STORE_CAPACITY, STORE_SLOTS);
+    std::string value;
+    CHECK(store.was_recovered());
+    CHECK(store.get("alpha", value) && value == "third");
+    CHECK(store.get("beta", value) && value == "second");
+    store.remove("beta");
+    CHECK(!store.get("beta", value));
+    CHECK(store.for_each([](const std::string &, const char *, size_t){}) == 1);
+    CHECK(store.get_discarded() == 0);
+    unlink(path.c_str());
+}
+
+TEST(httpcache_store_rejects_corrupted_record){
+    std::string path = store_path();
+    unlink(path.c_str());
+    {
+        HDE::PersistentStore store(path, STORE_CAPACITY, STORE_SLOTS);
+        CHECK(store.put("alpha", "intact", 6));
+        CHECK(store.put("beta", "damaged", 7));
+    }
+    off_t at = find_in_file(path, "damaged");
+    CHECK(at > 0);
+    CHECK(patch_file(path, at, "D"));
+    HDE::PersistentStore store(path, STORE_CAPACITY, STORE_SLOTS);
+    std::string value;
+    CHECK(store.was_recovered());
+    CHECK(!store.get("beta", value));
+    CHECK(store.get("alpha", value) && value == "intact");
+    CHECK(store.for_each([](const std::string &, const char *, size_t){}) == 1);
+    CHECK(store.get_discarded() == 1);
+    unlink(path.c_str());
+}
+
+TEST(httpcache_store_resets_on_version_or_geometry_change){
+    std::string path = store_path();
+    unlink(path.c_str());
+    {
+        HDE::PersistentStore store(path, STORE_CAPACITY, STORE_SLOTS);
+        CHECK(store.put("alpha", "first", 5));
+    }
+    std::string value;
+    {
+        HDE::PersistentStore store(path, STORE_CAPACITY * 2, STORE_SLOTS);
+        CHECK(store.is_open());
+        CHECK(!store.was_recovered());
+        CHECK(!store.get("alpha", value));
+        CHECK(store.put("alpha", "first", 5));
+    }
+    {
+        HDE::PersistentStore store(path, STORE_CAPACITY * 2, STORE_SLOTS * 2);
+        CHECK(!store.was_recovered());
+        CHECK(!store.get("alpha", value));
+        CHECK(store.put("alpha", "first", 5));
+    }
+    // The version follows the 8 byte magic
+    uint32_t version = 99;
+    CHECK(patch_file(path, 8, std::string((const char *)&version, sizeof(version))));
+    HDE::PersistentStore store(path, STORE_CAPACITY * 2, STORE_SLOTS * 2);
+    CHECK(!store.was_recovered());
+    CHECK(!store.get("alpha", value));
+    unlink(path.c_str());
+}
+
+TEST(httpcache_load_restores_entries_after_reopen){
+    std::string path = store_path();
+    unlink(path.c_str());
+    const std::string head = "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nVary: Accept-Encoding\r\nContent-Length: 4\r\n\r\n";
+    HDE::HttpRequest plain;
+    HDE::HttpRequest gzip;
+    parse_request(plain, "GET /a HTTP/1.1\r\nHost: h\r\n\r\n");
+    parse_request(gzip, "GET /a HTTP/1.1\r\nHost: h\r\nAccept-Encoding: gzip\r\n\r\n");
+    std::string key = HDE::HttpCache::key_for(plain);
+    {
+        HDE::PersistentStore store(path, STORE_CAPACITY, STORE_SLOTS);
+        HDE::HttpCache cache(HDE::HttpCacheConfig{1 << 20, 1 << 16, 2});
+        cache.set_store(&store);
+        cache.store(key, cache_entry(cache, plain, head, "text", HDE::EventLoop::now_ms()));
+        cache.store(key, cache_entry(cache, gzip, head, "gzip", HDE::EventLoop::now_ms()));
+    }
+    {
+        HDE::PersistentStore store(path, STORE_CAPACITY, STORE_SLOTS);
+        HDE::HttpCache cache(HDE::HttpCacheConfig{1 << 20, 1 << 16, 2});
+        cache.set_store(&store);
+        CHECK(store.was_recovered());
+        CHECK(cache.load(HDE::EventLoop::now_ms()) == 2);
+        std::shared_ptr<const HDE::CacheEntry> entry;
+        CHECK(cache.lookup(key, plain, HDE::EventLoop::now_ms(), entry) == HDE::CACHE_FRESH);
+        CHECK(entry && *entry->body == "text" && entry->head.find("Vary: Accept-Encoding") != std::string::npos);
+        CHECK(cache.lookup(key, gzip, HDE::EventLoop::now_ms(), entry) == HDE::CACHE_FRESH);
+        CHECK(entry && *entry->body == "gzip");
+        cache.remove(key);
+        CHECK(cache.lookup(key, plain, HDE::EventLoop::now_ms(), entry) == HDE::CACHE_MISS);
+    }
+    // remove() reached the file too
+    HDE::PersistentStore store(path, STORE_CAPACITY, STORE_SLOTS);
+    HDE::HttpCache cache(HDE::HttpCacheConfig{1 << 20, 1 << 16, 2});
+    cache.set_store(&store);
+    CHECK(cache.load(HDE::EventLoop::now_ms()) == 0);
+    unlink(path.c_str());
+}
+
+TEST(httpcache_freshness_follows_max_age_and_age){
+    HDE::HttpCache cache(HDE::HttpCacheConfig{1 << 20, 1 << 16, 1});
+    HDE::HttpRequest request;
+    HDE::HttpRequest no_cache;
+    parse_request(request, "GET /a HTTP/1.1\r\nHost: h\r\n\r\n");
+    parse_request(no_cache, "GET /a HTTP/1.1\r\nHost: h\r\nCache-Control: no-cache\r\n\r\n");
+    std::string key = HDE::HttpCache::key_for(request);
+    std::shared_ptr<const HDE::CacheEntry> entry;
+    CHECK(cache.lookup(key, request, 1000, entry) == HDE::CACHE_MISS);
+    cache.store(key, cache_entry(cache, request, "HTTP/1.1 200 OK\r\nCache-Control: max-age=10\r\nAge: 4\r\n\r\n", "body", 1000));
+    CHECK(cache.lookup(key, request, 6999, entry) == HDE::CACHE_FRESH);
+    CHECK(entry && entry->get_age_ms(6999) == 9999);
+    CHECK(cache.lookup(key, no_cache, 6999, entry) == HDE::CACHE_MISS);
+    // Without a validator an expired entry is as good as missing
+    CHECK(cache.lookup(key, request, 7000, entry) == HDE::CACHE_MISS);
+    CHECK(!entry);
+    CHECK(cache.get_hits() == 1);
+    CHECK(!cache_entry(cache, request, "HTTP/1.1 200 OK\r\nCache-Control: private, max-age=10\r\n\r\n", "", 1000));
+    CHECK(!cache_entry(cache, request, "HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\n", "", 1000));
+}
+
+TEST(httpcache_vary_keeps_one_entry_per_variant){
+    HDE::HttpCache cache(HDE::HttpCacheConfig{1 << 20, 1 << 16, 1});
+    const std::string head = "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nVary: Accept-Encoding\r\n\r\n";
+    HDE::HttpRequest plain;
+    HDE::HttpRequest gzip;
+    parse_request(plain, "GET /a HTTP/1.1\r\nHost: h\r\n\r\n");
+    parse_request(gzip, "GET /a HTTP/1.1\r\nHost: h\r\nAccept-Encoding: gzip\r\n\r\n");
+    std::string key = HDE::HttpCache::key_for(plain);
+    std::shared_ptr<const HDE::CacheEntry> entry;
+    cache.store(key, cache_entry(cache, gzip, head, "gzip", 0));
+    CHECK(cache.lookup(key, plain, 0, entry) == HDE::CACHE_MISS);
+    CHECK(cache.lookup(key, gzip, 0, entry) == HDE::CACHE_FRESH && *entry->body == "gzip");
+    cache.store(key, cache_entry(cache, plain, head, "text", 0));
+    size_t bytes = cache.get_bytes();
+    cache.store(key, cache_entry(cache, gzip, head, "GZIP", 0));
+    CHECK(cache.get_bytes() == bytes);
+    CHECK(cache.lookup(key, plain, 0, entry) == HDE::CACHE_FRESH && *entry->body == "text");
+    CHECK(cache.lookup(key, gzip, 0, entry) == HDE::CACHE_FRESH && *entry->body == "GZIP");
+    CHECK(!cache_entry(cache, plain, "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nVary: *\r\n\r\n", "", 0));
+}
+
+TEST(httpcache_revalidation_renews_a_stale_entry){
+    HDE::HttpCache cache(HDE::HttpCacheConfig{1 << 20, 1 << 16, 1});
+    HDE::HttpRequest request;
+    parse_request(request, "GET /a HTTP/1.1\r\nHost: h\r\n\r\n");
+    std::string key = HDE::HttpCache::key_for(request);
+    cache.store(key, cache_entry(cache, request, "HTTP/1.1 200 OK\r\nCache-Control: max-age=1\r\nETag: \"v1\"\r\n\r\n", "body", 0));
+    std::shared_ptr<const HDE::CacheEntry> stale;
+    CHECK(cache.lookup(key, request, 2000, stale) == HDE::CACHE_STALE);
+    CHECK(stale && stale->etag == "\"v1\"");
+    HDE::HttpResponse not_modified;
+    const std::string head = "HTTP/1.1 304 Not Modified\r\nCache-Control: max-age=30\r\n\r\n";
+    CHECK(not_modified.parse(head.data(), head.size()) > 0);
+    cache.store(key, cache.refreshed(*stale, not_modified, 2000));
+    std::shared_ptr<const HDE::CacheEntry> entry;
+    CHECK(cache.lookup(key, request, 31999, entry) == HDE::CACHE_FRESH);
+    CHECK(entry && entry->body == stale->body && entry->etag == "\"v1\"");
+    CHECK(cache.lookup(key, request, 32000, entry) == HDE::CACHE_STALE);
+    CHECK(cache.get_revalidations() == 1);
+}
+
+TEST(httpcache_stale_while_revalidate_window){
+    HDE::HttpCache cache(HDE::HttpCacheConfig{1 << 20, 1 << 16, 1});
+    HDE::HttpRequest request;
+    HDE::HttpRequest strict;
+    parse_request(request, "GET /a HTTP/1.1\r\nHost: h\r\n\r\n");
+    parse_request(strict, "GET /b HTTP/1.1\r\nHost: h\r\n\r\n");
+    std::string key = HDE::HttpCache::key_for(request);
+    std::string strict_key = HDE::HttpCache::key_for(strict);
+    cache.store(key, cache_entry(cache, request, "HTTP/1.1 200 OK\r\nCache-Control: max-age=1, stale-while-revalidate=5\r\n"
+                                                 "Last-Modified: Mon, 01 Jan 2024 00:00:00 GMT\r\n\r\n", "body", 0));
+    cache.store(strict_key, cache_entry(cache, strict, "HTTP/1.1 200 OK\r\nCache-Control: max-age=1, stale-while-revalidate=5, must-revalidate\r\n"
+                                                      "ETag: \"v1\"\r\n\r\n", "body", 0));
+    std::shared_ptr<const HDE::CacheEntry> entry;
+    CHECK(cache.lookup(key, request, 999, entry) == HDE::CACHE_FRESH);
+    CHECK(cache.lookup(key, request, 1000, entry) == HDE::CACHE_STALE_WHILE_REVALIDATE);
+    CHECK(cache.lookup(key, request, 5999, entry) == HDE::CACHE_STALE_WHILE_REVALIDATE);
+    CHECK(cache.lookup(key, request, 6000, entry) == HDE::CACHE_STALE);
+    CHECK(cache.lookup(strict_key, strict, 3000, entry) == HDE::CACHE_STALE);
+    CHECK(cache.get_stale_hits() == 2);
+}
+
+//A key stored again after remove() goes to the back of the clock, so the older key is the one evicted
+TEST(httpcache_removed_keys_leave_the_clock){
+    HDE::HttpRequest requests[3];
+    parse_request(requests[0], "GET /a HTTP/1.1\r\nHost: h\r\n\r\n");
+    parse_request(requests[1], "GET /b HTTP/1.1\r\nHost: h\r\n\r\n");
+    parse_request(requests[2], "GET /c HTTP/1.1\r\nHost: h\r\n\r\n");
+    const std::string head = "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\n\r\n";
+    HDE::HttpCache sizing(HDE::HttpCacheConfig{1 << 20, 1 << 16, 1});
+    size_t bytes = cache_entry(sizing, requests[0], head, "body", 0)->get_bytes() + HDE::HttpCache::key_for(requests[0]).size();
+    HDE::HttpCache cache(HDE::HttpCacheConfig{bytes * 2 + bytes / 2, 1 << 16, 1});
+    std::string keys[3];
+    for (int i = 0; i < 3; i++){
+        keys[i] = HDE::HttpCache::key_for(requests[i]);
+    }
+    cache.store(keys[0], cache_entry(cache, requests[0], head, "body", 0));
+    cache.store(keys[1], cache_entry(cache, requests[1], head, "body", 0));
+    for (int round = 0; round < 100; round++){
+        cache.remove(keys[0]);
+        cache.store(keys[0], cache_entry(cache, requests[0], head, "body", 0));
+    }
+    CHECK(cache.get_evictions() == 0);
+    cache.store(keys[2], cache_entry(cache, requests[2], head, "body", 0));
+    std::shared_ptr<const HDE::CacheEntry> entry;
+    CHECK(cache.get_evictions() == 1);
+    CHECK(cache.get_bytes() == bytes * 2);
+    CHECK(cache.lookup(keys[1], requests[1], 0, entry) == HDE::CACHE_MISS);
+    CHECK(cache.lookup(keys[0], requests[0], 0, entry) == HDE::CACHE_FRESH);
+    CHECK(cache.lookup(keys[2], requests[2], 0, entry) == HDE::CACHE_FRESH);
+}
+
+TEST(httpcache_singleflight_wakes_every_waiter_once){
+    HDE::SingleFlight flights;
+    CHECK(flights.join("/a", [](){}) == 0);
+    CHECK(flights.begin("/a"));
+    CHECK(!flights.begin("/a"));
+    CHECK(flights.begin("/b"));
+    std::vector<int> woken;
+    for (int i = 0; i < 5; i++){
+        CHECK(flights.join("/a", [&woken, i](){ woken.push_back(i); }) != 0);
+    }
+    CHECK(flights.get_in_flight() == 2);
+    flights.finish("/a");
+    CHECK(woken == std::vector<int>({0, 1, 2, 3, 4}));
+    CHECK(flights.get_in_flight() == 1);
+    flights.finish("/a");
+    CHECK(woken.size() == 5);
+    CHECK(flights.get_leaders() == 2);
+    CHECK(flights.get_coalesced() == 5);
+}
+
+//A waiter that leaves isn't woken, and a woken waiter can lead the next flight for the same key
+TEST(httpcache_singleflight_waiters_leave_and_lead){
+    HDE::SingleFlight flights;
+    CHECK(flights.begin("/a"));
+    int woken = 0;
+    uint64_t first = flights.join("/a", [&](){ woken++; });
+    uint64_t second = flights.join("/a", [&](){
+        woken++;
+        CHECK(flights.begin("/a"));
+    });
+    flights.leave("/a", first);
+    flights.leave("/a", first);
+    CHECK(flights.get_abandoned() == 1);
+    flights.finish("/a");
+    CHECK(woken == 1);
+    CHECK(second != first);
+    CHECK(flights.get_in_flight() == 1);
+    CHECK(flights.get_leaders() == 2);
+}
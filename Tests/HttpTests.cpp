@@ -0,0 +1,79 @@
+#include <string>
+#include "UnitTest.hpp"
+#include "../Networking/Http/HttpRequest.hpp"
+#include "../Networking/Http/BodyFramer.hpp"
+#include "../Networking/Proxy/ReverseProxy.hpp"
+
+TEST(http_parse_request){
+    const std::string head = "GET /items?page=2 HTTP/1.1\r\nHost: localhost\r\nX-Trace:  abc \r\n\r\nbody";
+    HDE::HttpRequest request;
+    CHECK(request.parse(head.data(), head.size()) == (int)head.size() - 4);
+    CHECK(request.get_method() == "GET");
+    CHECK(request.get_path() == "/items?page=2");
+    CHECK(request.get_version() == "HTTP/1.1");
+    CHECK(request.get_header("host") == "localhost");
+    CHECK(request.get_header("x-trace") == "abc");
+    CHECK(!request.has_header("Content-Length"));
+}
+
+TEST(http_parse_incomplete_and_malformed){
+    HDE::HttpRequest request;
+    const std::string partial = "GET / HTTP/1.1\r\nHost: a\r\n";
+    const std::string no_version = "GET /\r\n\r\n";
+    const std::string no_colon = "GET / HTTP/1.1\r\nHost\r\n\r\n";
+    CHECK(request.parse(partial.data(), partial.size()) == 0);
+    CHECK(request.parse(no_version.data(), no_version.size()) == -1);
+    CHECK(request.parse(no_colon.data(), no_colon.size()) == -1);
+}
+
+TEST(http_length_body){
+    HDE::BodyFramer framer;
+    framer.reset(HDE::BodyFramer::LENGTH, 5);
+    CHECK(framer.feed("abc", 3) == 3);
+    CHECK(!framer.is_done());
+    CHECK(framer.feed("deGET", 5) == 2);
+    CHECK(framer.is_done());
+    CHECK(framer.feed("x", 1) == 0);
+}
+
+TEST(http_chunked_body_byte_by_byte){
+    const std::string body = "4;ext=1\r\nWiki\r\n5\r\npedia\r\n0\r\nTrailer: x\r\n\r\n";
+    const std::string next = "GET / HTTP/1.1\r\n\r\n";
+    const std::string input = body + next;
+    HDE::BodyFramer framer;
+    framer.reset(HDE::BodyFramer::CHUNKED, 0);
+    size_t used = 0;
+    for (size_t i = 0; i < input.size() && !framer.is_done(); i++){
+        used += framer.feed(input.data() + i, 1);
+    }
+    CHECK(framer.is_done());
+    CHECK(!framer.is_error());
+    CHECK(used == body.size());
+}
+
+TEST(http_framing_errors){
+    HDE::BodyFramer framer;
+    framer.reset(HDE::BodyFramer::CHUNKED, 0);
+    framer.feed("zz\r\n", 4);
+    CHECK(framer.is_error());
+    framer.reset(HDE::BodyFramer::LENGTH, 10);
+    framer.feed("abc", 3);
+    framer.finish_on_close();
+    CHECK(framer.is_error());
+    framer.reset(HDE::BodyFramer::UNTIL_CLOSE, 0);
+    CHECK(framer.feed("anything", 8) == 8);
+    framer.finish_on_close();
+    CHECK(framer.is_done());
+}
+
+TEST(http_rewrite_strips_length_from_chunked){
+    const std::string text = "POST /up HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\nContent-Length: 3\r\n"
+                             "Connection: close\r\n\r\n";
+    HDE::HttpRequest request;
+    CHECK(request.parse(text.data(), text.size()) == (int)text.size());
+    std::string head = HDE::ReverseProxy::rewrite_request_head(request, "10.0.0.1", "proxy");
+    CHECK(head.find("Transfer-Encoding: chunked\r\n") != std::string::npos);
+    CHECK(head.find("Content-Length") == std::string::npos);
+    CHECK(head.find("Connection: close") == std::string::npos);
+    CHECK(head.find("X-Forwarded-For: 10.0.0.1\r\n") != std::string::npos);
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+#include <arpa/inet.h>
+#include "UnitTest.hpp"
+#include "../Networking/Logging/AccessLog.hpp"
+#include "../Networking/Logging/BinaryLog.hpp"
+
+static std::string log_path(const std::string &name){
+    return "/tmp/hdelibc_" + name + "_" + std::to_string(getpid());
+}
+
+static std::string read_file(const std::string &path){
+    std::string content;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        return content;
+    }
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0){
+        content.append(buffer, n);
+    }
+    close(fd);
+    return content;
+}
+
+static void remove_logs(const std::string &path, int max_files){
+    unlink(path.c_str());
+    for (int i = 1; i <= max_files + 1; i++){
+        unlink((path + "." + std::to_string(i)).c_str());
+    }
+}
+
+static HDE::AccessRecord access_record(const std::string &path, uint16_t status){
+    HDE::AccessRecord record;
+    record.time_us = 1700000000123456LL;
+    record.duration_ns = 2500;
+    record.bytes_in = 78;
+    record.bytes_out = 1024;
+    record.client = inet_addr("10.0.0.1");
+    record.status = status;
+    record.set_method("GET");
+    record.set_path(path);
+    return record;
+}
+
+//Flushes happen only on stop(), so the test controls when the writer drains
+static HDE::AccessLogConfig access_config(const std::string &path, size_t ring_records, size_t batch_bytes, size_t rotate_bytes, int max_files){
+    return HDE::AccessLogConfig{path, ring_records, batch_bytes, rotate_bytes, max_files, 60000};
+}
+
+TEST(logging_access_lines_are_logfmt){
+    std::string path = log_path("access_format");
+    remove_logs(path, 0);
+    HDE::AccessLog log(access_config(path, 16, 65536, 0, 0));
+    CHECK(log.is_open());
+    CHECK(log.log(access_record("/index.html", 200)));
+    HDE::AccessRecord traced = access_record(std::string(200, 'p'), 404);
+    traced.trace_high = 0x0123456789abcdefULL;
+    traced.trace_low = 1;
+    CHECK(log.log(traced));
+    log.stop();
+    CHECK(!log.log(access_record("/late", 200)));
+    CHECK(log.get_written() == 2);
+    std::string expected = "time=2023-11-14T22:13:20.123456Z client=10.0.0.1 method=GET path=/index.html status=200 bytes_in=78 "
+                           "bytes_out=1024 duration_us=2.5\n"
+                           "time=2023-11-14T22:13:20.123456Z client=10.0.0.1 method=GET path=" + std::string(152, 'p') +
+                           " status=404 bytes_in=78 bytes_out=1024 duration_us=2.5 request_id=0123456789abcdef0000000000000001\n";
+    CHECK(read_file(path) == expected);
+    remove_logs(path, 0);
+}
+
+//The writer is asleep for the whole test, so the ring (5 records rounded up to 8) takes the first 8 and drops the rest
+TEST(logging_access_full_ring_drops_and_counts){
+    std::string path = log_path("access_drop");
+    remove_logs(path, 0);
+    HDE::AccessLog log(access_config(path, 5, 65536, 0, 0));
+    // Lets the writer's first pass run before any record is pushed
+    usleep(50000);
+    int accepted = 0;
+    for (int i = 0; i < 20; i++){
+        accepted += log.log(access_record("/" + std::to_string(i), 200)) ? 1 : 0;
+    }
+    CHECK(accepted == 8);
+    CHECK(log.get_dropped() == 12);
+    log.stop();
+    CHECK(log.get_written() == 8);
+    std::string content = read_file(path);
+    CHECK(content.find("path=/7 ") != std::string::npos);
+    CHECK(content.find("path=/8 ") == std::string::npos);
+    remove_logs(path, 0);
+}
+
+//Every line is flushed on its own and the file rotates once it reaches 200 bytes, two lines each. With two kept
+//files the oldest pair is overwritten
+TEST(logging_access_rotates_and_keeps_max_files){
+    std::string path = log_path("access_rotate");
+    remove_logs(path, 2);
+    HDE::AccessLog log(access_config(path, 16, 1, 200, 2));
+    for (int i = 1; i <= 7; i++){
+        CHECK(log.log(access_record("/" + std::to_string(i), 200)));
+    }
+    log.stop();
+    CHECK(log.get_written() == 7);
+    CHECK(log.get_rotations() == 3);
+    std::string current = read_file(path);
+    std::string first = read_file(path + ".1");
+    std::string second = read_file(path + ".2");
+    CHECK(current.find("path=/7 ") != std::string::npos && current.find("path=/6 ") == std::string::npos);
+    CHECK(first.find("path=/5 ") != std::string::npos && first.find("path=/6 ") != std::string::npos);
+    CHECK(second.find("path=/3 ") != std::string::npos && second.find("path=/4 ") != std::string::npos);
+    CHECK(second.find("path=/1 ") == std::string::npos);
+    CHECK(access((path + ".3").c_str(), F_OK) != 0);
+    remove_logs(path, 2);
+}
+
+//Runs Tools/LogDecoder on a binary log and returns its output with the timestamp stripped from each line
+static std::string decode(const std::string &path, int min_level){
+    std::string command = std::string(HDE_LOG_DECODER) + " " + path + " " + std::to_string(min_level) + " 2>&1";
+    FILE *pipe = popen(command.c_str(), "r");
+    if (pipe == NULL){
+        return "";
+    }
+    std::string out;
+    char line[4096];
+    while (fgets(line, sizeof(line), pipe) != NULL){
+        std::string text(line);
+        // 2023-11-14T22:13:20.123456Z
+        out += text.size() > 28 && text[26] == 'Z' ? text.substr(28) : "<bad stamp> " + text;
+    }
+    pclose(pipe);
+    return out;
+}
+
+TEST(logging_binary_round_trips_through_the_decoder){
+    std::string path = log_path("binary_round_trip");
+    CHECK(HDE::BinaryLog::open(path, 4096));
+    CHECK(!HDE::BinaryLog::open(path, 4096));
+    uint64_t written = HDE::BinaryLog::get_written();
+    std::string name("backend-1");
+    const char bytes[] = {0x00, 0x7f, (char)0xff};
+    int line = __LINE__ + 1;
+    HDE_LOG(LOG_INFO, "connect %s:%d took %.3f ms", name, -42, 1.5);
+    HDE_LOG(LOG_WARN, "%5s|%-4u|%x|%c%%", "ab", 7u, 255, 'z');
+    HDE_LOG(LOG_ERROR, "raw %s at %p", HDE::LogHex{bytes, 3}, (void *)0x1000);
+    HDE_LOG(LOG_DEBUG, "compiled out %d", 1);
+    HDE_LOG(LOG_INFO, "no arguments");
+    HDE::BinaryLog::close();
+    CHECK(HDE::BinaryLog::get_written() - written == 4);
+    // Nothing is recorded while the log is closed
+    HDE_LOG(LOG_ERROR, "after close %d", 1);
+    std::string site = "[0] " __FILE__ ":";
+    std::string expected =
+        "INFO  " + site + std::to_string(line) + " connect backend-1:-42 took 1.500 ms\n" +
+        "WARN  " + site + std::to_string(line + 1) + "    ab|7   |ff|z%\n" +
+        "ERROR " + site + std::to_string(line + 2) + " raw 00 7f ff at 0x1000\n" +
+        "INFO  " + site + std::to_string(line + 4) + " no arguments\n";
+    std::string decoded = decode(path, LOG_DEBUG);
+    // Thread numbers follow the order threads first logged, this one may not be the first in the process
+    for (size_t at = decoded.find(" ["); at != std::string::npos; at = decoded.find(" [", at + 1)){
+        decoded.replace(at + 2, decoded.find(']', at) - at - 2, "0");
+    }
+    CHECK(decoded == expected);
+    CHECK(decode(path, LOG_WARN).find("connect") == std::string::npos);
+    unlink(path.c_str());
+}
+
+//Records that don't fit in a thread's ring are dropped and counted, everything accepted reaches the file
+TEST(logging_binary_counts_drops_from_a_full_ring){
+    std::string path = log_path("binary_drops");
+    CHECK(HDE::BinaryLog::open(path, 4096));
+    uint64_t written = HDE::BinaryLog::get_written();
+    uint64_t dropped = HDE::BinaryLog::get_dropped();
+    // A fresh thread gets its own ring, a burst far larger than it overflows before the writer wakes
+    std::thread burst([](){
+        std::string payload(200, 'x');
+        for (int i = 0; i < 1000; i++){
+            HDE_LOG(LOG_INFO, "burst %d %s", i, payload);
+        }
+    });
+    burst.join();
+    HDE::BinaryLog::close();
+    uint64_t accepted = HDE::BinaryLog::get_written() - written;
+    CHECK(HDE::BinaryLog::get_dropped() - dropped > 0);
+    CHECK(accepted + HDE::BinaryLog::get_dropped() - dropped == 1000);
+    std::string decoded = decode(path, LOG_DEBUG);
+    size_t lines = 0;
+    for (size_t at = decoded.find('\n'); at != std::string::npos; at = decoded.find('\n', at + 1)){
+        lines++;
+    }
+    CHECK(lines == accepted);
+    CHECK(decoded.find("burst 0 ") != std::string::npos);
+    unlink(path.c_str());
+}
@@ -0,0 +1,48 @@
+#ifndef Loopback_hpp
+#define Loopback_hpp
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+//Loopback TCP sockets for the tests that need a real kernel socket
+
+//A listener on an ephemeral loopback port, or -1
+inline int loopback_listener(int &port){
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 64) < 0 ||
+        getsockname(listener, (struct sockaddr *)&address, &length) < 0){
+        if (listener >= 0){
+            close(listener);
+        }
+        return -1;
+    }
+    port = ntohs(address.sin_port);
+    return listener;
+}
+
+//A connected pair of loopback TCP sockets
+inline bool tcp_pair(int fds[2]){
+    int port = 0;
+    int listener = loopback_listener(port);
+    if (listener < 0){
+        return false;
+    }
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+    fds[1] = connect(fds[0], (struct sockaddr *)&address, sizeof(address)) == 0 ? accept(listener, NULL, NULL) : -1;
+    close(listener);
+    return fds[1] >= 0;
+}
+
+#endif /* Loopback_hpp */
@@ -0,0 +1,207 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include "UnitTest.hpp"
+#include "../Networking/Metrics/MetricsRegistry.hpp"
+#include "../Networking/Metrics/PerfCounters.hpp"
+
+TEST(metrics_counters_and_gauges_sum_across_threads){
+    HDE::MetricsRegistry metrics;
+    int requests = metrics.add_counter("requests_total", "Requests");
+    int open = metrics.add_gauge("open", "Open connections");
+    metrics.increment(requests, 3);
+    metrics.add(open, 5);
+    // A gauge raised on one thread and lowered on another still sums to the right value
+    std::thread other([&](){
+        metrics.increment(requests, 4);
+        metrics.add(open, -2);
+    });
+    other.join();
+    CHECK(metrics.get_counter(requests) == 7);
+    CHECK(metrics.get_gauge(open) == 3);
+}
+
+//Metrics sharing a base name get one HELP and TYPE, histogram buckets are cumulative with le inclusive
+TEST(metrics_render_prometheus_text){
+    HDE::MetricsRegistry metrics;
+    int reads = metrics.add_counter("req_total{kind=\"read\"}", "Requests");
+    int writes = metrics.add_counter("req_total{kind=\"write\"}", "Requests");
+    int open = metrics.add_gauge("open", "Open connections");
+    int size = metrics.add_histogram("size_seconds", "Sizes", std::vector<double>({0.5, 1}));
+    int routed = metrics.add_histogram("route_seconds{route=\"/a\"}", "Routes", std::vector<double>({1}));
+    metrics.add_collector([](std::string &out){ out += "extra 1\n"; });
+    metrics.increment(reads, 2);
+    metrics.increment(writes);
+    metrics.add(open, -1);
+    metrics.observe(size, 0.25);
+    metrics.observe(size, 0.5);
+    metrics.observe(size, 0.75);
+    metrics.observe(size, 4);
+    metrics.observe(routed, 2);
+    CHECK(metrics.get_count(size) == 4);
+    std::string expected =
+        "# HELP req_total Requests\n"
+        "# TYPE req_total counter\n"
+        "req_total{kind=\"read\"} 2\n"
+        "req_total{kind=\"write\"} 1\n"
+        "# HELP open Open connections\n"
+        "# TYPE open gauge\n"
+        "open -1\n"
+        "# HELP size_seconds Sizes\n"
+        "# TYPE size_seconds histogram\n"
+        "size_seconds_bucket{le=\"0.5\"} 2\n"
+        "size_seconds_bucket{le=\"1\"} 3\n"
+        "size_seconds_bucket{le=\"+Inf\"} 4\n"
+        "size_seconds_sum 5.5\n"
+        "size_seconds_count 4\n"
+        "# HELP route_seconds Routes\n"
+        "# TYPE route_seconds histogram\n"
+        "route_seconds_bucket{route=\"/a\",le=\"1\"} 0\n"
+        "route_seconds_bucket{route=\"/a\",le=\"+Inf\"} 1\n"
+        "route_seconds_sum{route=\"/a\"} 2\n"
+        "route_seconds_count{route=\"/a\"} 1\n"
+        "extra 1\n";
+    CHECK(metrics.render() == expected);
+}
+
+//Every thread's block has a fixed size, metrics that don't fit get -1 and recording with it does nothing
+TEST(metrics_full_registry_hands_out_negative_ids){
+    HDE::MetricsRegistry metrics(16);
+    int histogram = metrics.add_histogram("wide", "Wide", std::vector<double>(10, 1.0));
+    CHECK(histogram >= 0);
+    CHECK(metrics.add_histogram("wider", "Wider", std::vector<double>(10, 1.0)) == -1);
+    CHECK(metrics.add_latency("latency", "Latency") == -1);
+    int counter = metrics.add_counter("fits", "Fits");
+    CHECK(counter >= 0);
+    metrics.increment(-1);
+    metrics.observe(-1, 1.0);
+    metrics.record_ns(-1, 100);
+    metrics.increment(counter);
+    CHECK(metrics.get_counter(counter) == 1);
+    CHECK(metrics.get_counter(-1) == 0);
+    CHECK(metrics.render().find("wider") == std::string::npos);
+}
+
+//Exact below 64ns, above that a bucket's upper limit is within 1/32 of every value it holds
+TEST(metrics_latency_buckets_bound_the_error){
+    for (uint64_t ns = 0; ns < 64; ns++){
+        CHECK(HDE::MetricsRegistry::latency_bucket(ns) == ns);
+        CHECK(HDE::MetricsRegistry::bucket_limit(ns) == ns);
+    }
+    size_t previous = 0;
+    for (uint64_t ns = 64; ns < (1ULL << 36); ns += ns / 7 + 1){
+        size_t bucket = HDE::MetricsRegistry::latency_bucket(ns);
+        uint64_t limit = HDE::MetricsRegistry::bucket_limit(bucket);
+        CHECK(bucket >= previous);
+        CHECK(limit >= ns);
+        CHECK(limit - ns <= ns / 32);
+        CHECK(ns > HDE::MetricsRegistry::bucket_limit(bucket - 1));
+        previous = bucket;
+    }
+    CHECK(HDE::MetricsRegistry::latency_bucket(1ULL << 62) == LATENCY_BUCKETS - 1);
+}
+
+TEST(metrics_percentile_of_counts_ranks){
+    std::vector<uint64_t> counts(LATENCY_BUCKETS, 0);
+    CHECK(HDE::MetricsRegistry::percentile_of(counts, 50) == 0);
+    counts[10] = 90;
+    counts[100] = 10;
+    CHECK(HDE::MetricsRegistry::percentile_of(counts, 0) == 10);
+    CHECK(HDE::MetricsRegistry::percentile_of(counts, 50) == 10);
+    CHECK(HDE::MetricsRegistry::percentile_of(counts, 90) == 10);
+    CHECK(HDE::MetricsRegistry::percentile_of(counts, 91) == HDE::MetricsRegistry::bucket_limit(100));
+    CHECK(HDE::MetricsRegistry::percentile_of(counts, 100) == HDE::MetricsRegistry::bucket_limit(100));
+}
+
+//99 samples of 1us on one thread and a 1ms one on another, percentiles merge both and are capped at the exact maximum
+TEST(metrics_latency_percentiles_merge_threads){
+    HDE::MetricsRegistry metrics;
+    int latency = metrics.add_latency("lat_seconds{phase=\"handler\"}", "Handler latency");
+    CHECK(latency >= 0);
+    for (int i = 0; i < 99; i++){
+        metrics.record_ns(latency, 1000);
+    }
+    std::thread other([&](){ metrics.record_ns(latency, 1000000); });
+    other.join();
+    uint64_t bucket_1us = HDE::MetricsRegistry::bucket_limit(HDE::MetricsRegistry::latency_bucket(1000));
+    CHECK(bucket_1us == 1007);
+    CHECK(metrics.get_count(latency) == 100);
+    CHECK(metrics.get_percentile_ns(latency, 50) == bucket_1us);
+    CHECK(metrics.get_percentile_ns(latency, 99) == bucket_1us);
+    CHECK(metrics.get_percentile_ns(latency, 99.9) == 1000000);
+    std::string text = metrics.render();
+    CHECK(text.find("# TYPE lat_seconds summary\n") != std::string::npos);
+    CHECK(text.find("lat_seconds{phase=\"handler\",quantile=\"0.5\"} 1.007e-06\n") != std::string::npos);
+    CHECK(text.find("lat_seconds{phase=\"handler\",quantile=\"0.999\"} 0.001\n") != std::string::npos);
+    CHECK(text.find("lat_seconds{phase=\"handler\",quantile=\"1\"} 0.001\n") != std::string::npos);
+    CHECK(text.find("lat_seconds_sum{phase=\"handler\"} 0.001099\n") != std::string::npos);
+    CHECK(text.find("lat_seconds_count{phase=\"handler\"} 100\n") != std::string::npos);
+}
+
+//Each report covers only the samples since the previous one
+TEST(metrics_latency_report_covers_each_interval){
+    HDE::MetricsRegistry metrics;
+    int latency = metrics.add_latency("phase_read", "Read latency");
+    CHECK(latency >= 0);
+    CHECK(metrics.add_latency("phase_idle", "Never recorded") >= 0);
+    for (int i = 0; i < 10; i++){
+        metrics.record_ns(latency, 2000);
+    }
+    std::string first = metrics.latency_report();
+    CHECK(starts_with(first, "latency phase_read n=10 p50=2.0us "));
+    CHECK(first.find("phase_idle") == std::string::npos);
+    CHECK(metrics.latency_report().empty());
+    metrics.record_ns(latency, 50000);
+    std::string second = metrics.latency_report();
+    CHECK(starts_with(second, "latency phase_read n=1 p50=50.2us "));
+    CHECK(metrics.get_count(latency) == 11);
+}
+
+static HDE::PerfSample perf_sample(uint64_t instructions, uint64_t cycles, uint64_t enabled, uint64_t running){
+    HDE::PerfSample sample = {{instructions, cycles, 0, 0}, enabled, running};
+    return sample;
+}
+
+//Counts of a multiplexed group are scaled by enabled over running time, a group that never ran reads as zeros
+TEST(metrics_perf_difference_scales_multiplexed_counts){
+    HDE::PerfSample start = perf_sample(1000, 2000, 100, 100);
+    HDE::PerfSample exact = HDE::PerfCounters::difference(perf_sample(1600, 2800, 300, 300), start);
+    CHECK(exact.values[HDE::PERF_INSTRUCTIONS] == 600);
+    CHECK(exact.values[HDE::PERF_CYCLES] == 800);
+    CHECK(exact.time_enabled == 200 && exact.time_running == 200);
+    HDE::PerfSample scaled = HDE::PerfCounters::difference(perf_sample(1600, 2800, 500, 200), start);
+    CHECK(scaled.values[HDE::PERF_INSTRUCTIONS] == 2400);
+    CHECK(scaled.values[HDE::PERF_CYCLES] == 3200);
+    CHECK(scaled.values[HDE::PERF_CACHE_MISSES] == 0);
+    HDE::PerfSample idle = HDE::PerfCounters::difference(perf_sample(1600, 2800, 300, 100), start);
+    CHECK(idle.values[HDE::PERF_INSTRUCTIONS] == 0 && idle.values[HDE::PERF_CYCLES] == 0);
+    CHECK(std::string(HDE::PerfCounters::event_name(HDE::PERF_BRANCH_MISSES)) == "branch_misses");
+}
+
+//Hardware counters are often missing in VMs and containers, both outcomes are checked
+TEST(metrics_perf_counters_count_or_report_why_not){
+    HDE::PerfCounters perf;
+    HDE::PerfSample before;
+    HDE::PerfSample after;
+    if (!perf.is_available()){
+        CHECK(perf.get_error() != 0);
+        CHECK(!perf.counts_kernel());
+        CHECK(!perf.read(before));
+        CHECK(before.values[HDE::PERF_INSTRUCTIONS] == 0 && before.time_enabled == 0);
+        CHECK(starts_with(perf.format(before, 1), "perf counters unavailable: "));
+        return;
+    }
+    CHECK(perf.get_error() == 0);
+    CHECK(perf.is_supported(HDE::PERF_INSTRUCTIONS));
+    CHECK(perf.read(before));
+    volatile uint64_t sum = 0;
+    for (uint64_t i = 0; i < 1000000; i++){
+        sum += i;
+    }
+    CHECK(perf.read(after));
+    HDE::PerfSample delta = HDE::PerfCounters::difference(after, before);
+    CHECK(delta.time_enabled >= delta.time_running);
+    CHECK(delta.time_running == 0 || delta.values[HDE::PERF_INSTRUCTIONS] >= 1000000);
+    CHECK(starts_with(perf.format(delta, 1000000), "instructions="));
+}
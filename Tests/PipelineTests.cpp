@@ -0,0 +1,175 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include "UnitTest.hpp"
+#include "../Networking/IO/MemoryTransport.hpp"
+#include "../Networking/Servers/TestServer.hpp"
+
+//Writes nothing outside the test, no access log, BinaryLog or watchdog
+static HDE::TestServerConfig quiet_config(){
+    return HDE::TestServerConfig{HDE::AccessLogConfig{"", 16, 4096, 1 << 20, 1, 20}, "", false};
+}
+
+//How often the handler ran for route /, microcache hits skip it
+static uint64_t handler_runs(HDE::TestServer &server){
+    const std::string key = "hdelibc_phase_seconds_count{phase=\"handler\",route=\"/\"} ";
+    std::string text = server.get_metrics()->render();
+    size_t at = text.find(key);
+    return at == std::string::npos ? 0 : strtoull(text.c_str() + at + key.size(), NULL, 10);
+}
+
+//True when the response's Content-Length matches the bytes after the head
+static bool framed(const std::string &response){
+    size_t head_end = response.find("\r\n\r\n");
+    size_t at = response.find("Content-Length: ");
+    if (head_end == std::string::npos || at == std::string::npos || at > head_end){
+        return false;
+    }
+    return strtoull(response.c_str() + at + 16, NULL, 10) == response.size() - head_end - 4;
+}
+
+//Serves one connection carrying input and returns what the server sent
+static std::string serve(HDE::MemoryTransport &transport, HDE::TestServer &server, const std::string &input){
+    int fd = transport.connect(input);
+    server.dispatch(0);
+    std::string output = transport.get_output(fd);
+    CHECK(transport.is_closed(fd));
+    transport.release(fd);
+    return output;
+}
+
+TEST(transport_read_limit_and_chunks){
+    HDE::MemoryTransport transport;
+    std::vector<std::string> chunks;
+    chunks.push_back("abcdef");
+    chunks.push_back("gh");
+    int fd = transport.connect(chunks);
+    CHECK(transport.accept(-1, NULL) == fd);
+    transport.set_read_limit(4);
+    char buffer[16];
+    CHECK(transport.recv(fd, buffer, sizeof(buffer)) == 4 && memcmp(buffer, "abcd", 4) == 0);
+    // One recv never returns bytes from two chunks
+    CHECK(transport.recv(fd, buffer, sizeof(buffer)) == 2 && memcmp(buffer, "ef", 2) == 0);
+    CHECK(transport.recv(fd, buffer, sizeof(buffer)) == 2 && memcmp(buffer, "gh", 2) == 0);
+    CHECK(transport.recv(fd, buffer, sizeof(buffer)) == 0);
+    transport.set_write_limit(3);
+    CHECK(transport.send(fd, "hello", 5, 0) == 3);
+    CHECK(transport.get_output(fd) == "hel");
+    CHECK(transport.shutdown(fd) == 0);
+    CHECK(transport.send(fd, "lo", 2, 0) == -1 && errno == EPIPE);
+    CHECK(transport.close(fd) == 0);
+    CHECK(transport.recv(fd, buffer, sizeof(buffer)) == -1 && errno == EBADF);
+    CHECK(transport.accept(-1, NULL) == -1 && errno == EAGAIN);
+}
+
+TEST(transport_hold_open_would_block){
+    HDE::MemoryTransport transport;
+    int fd = transport.connect(std::vector<std::string>(1, "x"), true);
+    char buffer[4];
+    CHECK(transport.recv(fd, buffer, sizeof(buffer)) == 1);
+    CHECK(transport.recv(fd, buffer, sizeof(buffer)) == -1 && errno == EAGAIN);
+    CHECK(transport.recv(fd, buffer, sizeof(buffer)) == -1 && errno == EAGAIN);
+    transport.shutdown(fd);
+    CHECK(transport.recv(fd, buffer, sizeof(buffer)) == 0);
+}
+
+TEST(pipeline_serves_hello){
+    HDE::MemoryTransport transport;
+    HDE::TestServer server(&transport, quiet_config());
+    int fd = transport.connect("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    server.dispatch(0);
+    const std::string &output = transport.get_output(fd);
+    CHECK(starts_with(output, "HTTP/1.1 200 OK\r\n"));
+    CHECK(output.find("Content-Length: 20\r\n") != std::string::npos);
+    CHECK(ends_with(output, "\r\n\r\nHello from Server!\r\n"));
+    CHECK(framed(output));
+    CHECK(transport.is_closed(fd));
+    CHECK(transport.get_pending() == 0);
+}
+
+TEST(pipeline_labels_requests_only_when_watched){
+    HDE::MemoryTransport transport;
+    HDE::TestServer server(&transport, quiet_config());
+    serve(transport, server, "GET /page HTTP/1.1\r\n\r\n");
+    // Outside run_once the loop isn't busy, so a label set while serving would belong to iteration 0
+    CHECK(server.get_loop()->get_label(0).empty());
+    CHECK(!HDE::TestServer::default_config().watchdog);
+}
+
+TEST(pipeline_admin_listener){
+    HDE::MemoryTransport transport;
+    HDE::TestServer server(&transport, quiet_config());
+    HDE::ListenerConfig admin;
+    admin.name = "admin";
+    admin.protocol = "http";
+    size_t admin_index = server.add_listener(NULL, admin);
+    int metrics_fd = transport.connect("GET /metrics HTTP/1.1\r\n\r\n");
+    server.dispatch(admin_index);
+    int missing_fd = transport.connect("GET /missing HTTP/1.1\r\n\r\n");
+    server.dispatch(admin_index);
+    int public_fd = transport.connect("GET /metrics HTTP/1.1\r\n\r\n");
+    server.dispatch(0);
+    CHECK(starts_with(transport.get_output(metrics_fd), "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"));
+    CHECK(transport.get_output(metrics_fd).find("hdelibc_requests_total 0\n") != std::string::npos);
+    CHECK(starts_with(transport.get_output(missing_fd), "HTTP/1.1 404 Not Found\r\n"));
+    CHECK(framed(transport.get_output(metrics_fd)));
+    CHECK(framed(transport.get_output(missing_fd)));
+    // The public listener never exposes metrics
+    CHECK(ends_with(transport.get_output(public_fd), "Hello from Server!\r\n"));
+}
+
+TEST(pipeline_hold_open_read_times_out){
+    HDE::MemoryTransport transport;
+    HDE::TestServer server(&transport, quiet_config());
+    // A peer that never sends looks like an expired SO_RCVTIMEO, the server gives up without answering
+    int fd = transport.connect(std::vector<std::string>(), true);
+    server.dispatch(0);
+    CHECK(transport.get_output(fd).empty());
+    CHECK(transport.is_closed(fd));
+    CHECK(server.get_metrics()->render().find("hdelibc_errors_total{kind=\"read\"} 1\n") != std::string::npos);
+}
+
+TEST(pipeline_partial_writes){
+    HDE::MemoryTransport transport;
+    HDE::TestServer server(&transport, quiet_config());
+    const std::string request = "GET /stream/a HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    std::string whole = serve(transport, server, request);
+    transport.set_write_limit(7);
+    std::string pieces = serve(transport, server, request);
+    CHECK(ends_with(whole, "Hello from Server!\r\n"));
+    CHECK(framed(whole));
+    CHECK(pieces == whole);
+}
+
+TEST(pipeline_microcache_expiry){
+    HDE::MemoryTransport transport;
+    HDE::TestServer server(&transport, quiet_config());
+    const std::string request = "GET /page HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    std::string miss = serve(transport, server, request);
+    CHECK(framed(miss));
+    CHECK(handler_runs(server) == 1);
+    transport.advance(999000000LL);
+    CHECK(serve(transport, server, request) == miss);
+    CHECK(handler_runs(server) == 1);
+    // The route's TTL is one second
+    transport.advance(2000000LL);
+    CHECK(serve(transport, server, request) == miss);
+    CHECK(handler_runs(server) == 2);
+}
+
+TEST(pipeline_partial_read_is_not_cached){
+    HDE::MemoryTransport transport;
+    HDE::TestServer server(&transport, quiet_config());
+    const std::string request = "GET /page HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    // The acceptor reads once, a cut-off head can't be parsed and must not be stored
+    transport.set_read_limit(10);
+    CHECK(starts_with(serve(transport, server, request), "HTTP/1.1 200 OK\r\n"));
+    transport.set_read_limit(0);
+    serve(transport, server, request);
+    CHECK(handler_runs(server) == 2);
+    serve(transport, server, request);
+    CHECK(handler_runs(server) == 2);
+}
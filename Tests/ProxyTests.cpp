@@ -0,0 +1,608 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "UnitTest.hpp"
+#include "Loopback.hpp"
+#include "../Networking/Events/EventLoop.hpp"
+#include "../Networking/Http/HttpResponse.hpp"
+#include "../Networking/Cache/HttpCache.hpp"
+#include "../Networking/IO/ZeroCopySender.hpp"
+#include "../Networking/Proxy/UpstreamPool.hpp"
+#include "../Networking/Proxy/Balancer.hpp"
+#include "../Networking/Proxy/BalancingPolicy.hpp"
+#include "../Networking/Proxy/HedgePolicy.hpp"
+#include "../Networking/Proxy/RetryBudget.hpp"
+#include "../Networking/Proxy/ReverseProxy.hpp"
+
+//A loopback upstream served by the test's own loop. Each request head it reads is answered with reply, unless mode
+//says to stay silent or to hang up, and replies go out as fast as the socket takes them
+struct Origin{
+    enum Mode{
+        ORIGIN_REPLY,
+        ORIGIN_SILENT,
+        ORIGIN_HANG_UP
+    };
+    struct Connection{
+        std::string in;
+        std::string out;
+    };
+    HDE::EventLoop *loop;
+    int listener;
+    int port;
+    Mode mode;
+    std::string reply;
+    int connections;
+    int requests;
+    uint64_t written;
+    std::map<int, Connection> open;
+
+    Origin(HDE::EventLoop *loop, const std::string &reply){
+        this->loop = loop;
+        this->reply = reply;
+        mode = ORIGIN_REPLY;
+        port = 0;
+        connections = 0;
+        requests = 0;
+        written = 0;
+        listener = loopback_listener(port);
+        fcntl(listener, F_SETFL, O_NONBLOCK);
+        loop->add(listener, EPOLLIN, [this](uint32_t){ accept_all(); });
+    }
+
+    ~Origin(){
+        while (!open.empty()){
+            drop(open.begin()->first);
+        }
+        loop->remove(listener);
+        close(listener);
+    }
+
+    void accept_all(){
+        int fd;
+        while ((fd = accept(listener, NULL, NULL)) >= 0){
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            connections++;
+            open[fd] = Connection();
+            loop->add(fd, EPOLLIN, [this, fd](uint32_t){ on_event(fd); });
+        }
+    }
+
+    void drop(int fd){
+        loop->remove(fd);
+        close(fd);
+        open.erase(fd);
+    }
+
+    void on_event(int fd){
+        Connection &connection = open[fd];
+        char buffer[65536];
+        ssize_t n;
+        while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0){
+            connection.in.append(buffer, n);
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)){
+            drop(fd);
+            return;
+        }
+        size_t end;
+        while ((end = connection.in.find("\r\n\r\n")) != std::string::npos){
+            connection.in.erase(0, end + 4);
+            requests++;
+            if (mode == ORIGIN_HANG_UP){
+                drop(fd);
+                return;
+            }
+            if (mode == ORIGIN_REPLY){
+                connection.out += reply;
+            }
+        }
+        flush(fd);
+    }
+
+    //Sends data on every open connection, for responses written in several pieces
+    void write(const std::string &data){
+        for (std::map<int, Connection>::iterator it = open.begin(); it != open.end(); ++it){
+            it->second.out += data;
+            flush(it->first);
+        }
+    }
+
+    void flush(int fd){
+        Connection &connection = open[fd];
+        while (!connection.out.empty()){
+            ssize_t n = send(fd, connection.out.data(), connection.out.size(), MSG_NOSIGNAL);
+            if (n <= 0){
+                break;
+            }
+            written += n;
+            connection.out.erase(0, n);
+        }
+        // EPOLLIN also covers EPOLLOUT's wakeups, on_event flushes whatever is left
+        loop->modify(fd, connection.out.empty() ? (uint32_t)EPOLLIN : EPOLLIN | EPOLLOUT);
+    }
+};
+
+static HDE::Backend origin_backend(Origin &origin){
+    return HDE::Backend{"origin", origin.port, INADDR_LOOPBACK, 1};
+}
+
+static HDE::UpstreamPoolConfig test_pool_config(){
+    return HDE::UpstreamPoolConfig{8, 16, 64, 60000, 5000, 500, 1000};
+}
+
+static HDE::ReverseProxyConfig test_proxy_config(){
+    return HDE::ReverseProxyConfig{64 * 1024, 16 * 1024, 2000, "test"};
+}
+
+static std::string reply_of(const std::string &body){
+    return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+static std::string body_of(size_t size){
+    std::string body(size, '\0');
+    for (size_t i = 0; i < size; i++){
+        body[i] = 'a' + (char)(i % 23);
+    }
+    return body;
+}
+
+//Hands the proxy one end of a loopback connection and returns the client's end, non-blocking
+static int connect_client(HDE::ReverseProxy &proxy){
+    int fds[2];
+    if (!tcp_pair(fds)){
+        return -1;
+    }
+    proxy.handle(fds[1]);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    return fds[0];
+}
+
+//Runs the loop until the client holds one complete Content-Length response and takes it from received, empty on
+//timeout or when the proxy closes first
+static std::string read_response(HDE::EventLoop &loop, int user, std::string &received, int timeout_ms){
+    int64_t deadline = HDE::EventLoop::now_ms() + timeout_ms;
+    while (HDE::EventLoop::now_ms() < deadline){
+        size_t end = received.find("\r\n\r\n");
+        if (end != std::string::npos){
+            HDE::HttpResponse response;
+            response.parse(received.data(), end + 4);
+            size_t total = end + 4 + strtoull(response.get_header("Content-Length").c_str(), NULL, 10);
+            if (received.size() >= total){
+                std::string complete = received.substr(0, total);
+                received.erase(0, total);
+                return complete;
+            }
+        }
+        char buffer[65536];
+        ssize_t n = recv(user, buffer, sizeof(buffer), 0);
+        if (n == 0){
+            break;
+        }
+        if (n > 0){
+            received.append(buffer, n);
+        }
+        loop.run_once(n > 0 ? 0 : 1);
+    }
+    return std::string();
+}
+
+static std::string exchange(HDE::EventLoop &loop, int user, const std::string &request, std::string &received){
+    CHECK(send(user, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size());
+    return read_response(loop, user, received, 3000);
+}
+
+//Runs the loop without reading the client, for as long as the origin keeps writing
+static void run_while_origin_writes(HDE::EventLoop &loop, Origin &origin){
+    uint64_t written = origin.written;
+    for (int quiet = 0; quiet < 50; ){
+        loop.run_once(2);
+        quiet = origin.written == written ? quiet + 1 : 0;
+        written = origin.written;
+    }
+}
+
+static void run_until_idle(HDE::EventLoop &loop, HDE::ReverseProxy &proxy){
+    for (int spins = 0; spins < 1000 && proxy.get_active() > 0; spins++){
+        loop.run_once(1);
+    }
+}
+
+static bool zerocopy_supported(){
+    int fds[2];
+    if (!tcp_pair(fds)){
+        return false;
+    }
+    bool enabled;
+    {
+        HDE::ZeroCopySender probe(fds[0], 1);
+        enabled = probe.is_enabled();
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return enabled;
+}
+
+//The origin's first response fills the cache, the hit is sent from the shared entry to a client too slow to take it
+//at once, so the sender's unsent bytes are resumed on EPOLLOUT
+TEST(proxy_serves_cached_body_with_zerocopy){
+    HDE::EventLoop loop;
+    const std::string body = body_of(1 << 20);
+    Origin origin(&loop, "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nContent-Length: " + std::to_string(body.size()) +
+                         "\r\n\r\n" + body);
+    HDE::UpstreamPool pool(&loop, origin_backend(origin), test_pool_config());
+    HDE::ReverseProxy proxy(&loop, &pool, test_proxy_config());
+    HDE::HttpCache cache(HDE::HttpCacheConfig{8 << 20, 4 << 20, 1});
+    proxy.set_cache(&cache);
+    proxy.set_zerocopy(64 * 1024);
+    int user = connect_client(proxy);
+    int small = 16384;
+    setsockopt(user, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    std::string received;
+    std::string first = exchange(loop, user, "GET /large HTTP/1.1\r\nHost: test\r\n\r\n", received);
+    CHECK(ends_with(first, body));
+    CHECK(proxy.get_cache_served() == 0);
+    std::string second = exchange(loop, user, "GET /large HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n", received);
+    CHECK(starts_with(second, "HTTP/1.1 200 OK\r\n"));
+    CHECK(ends_with(second, body));
+    run_until_idle(loop, proxy);
+    CHECK(proxy.get_active() == 0);
+    CHECK(proxy.get_cache_served() == 1);
+    CHECK(origin.requests == 1);
+    CHECK(proxy.get_zerocopy_bytes() == (zerocopy_supported() ? body.size() : 0));
+    close(user);
+}
+
+TEST(proxy_copies_cached_bodies_below_the_zerocopy_threshold){
+    HDE::EventLoop loop;
+    const std::string body = body_of(4096);
+    Origin origin(&loop, "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nContent-Length: " + std::to_string(body.size()) +
+                         "\r\n\r\n" + body);
+    HDE::UpstreamPool pool(&loop, origin_backend(origin), test_pool_config());
+    HDE::ReverseProxy proxy(&loop, &pool, test_proxy_config());
+    HDE::HttpCache cache(HDE::HttpCacheConfig{8 << 20, 4 << 20, 1});
+    proxy.set_cache(&cache);
+    proxy.set_zerocopy(64 * 1024);
+    int user = connect_client(proxy);
+    std::string received;
+    CHECK(ends_with(exchange(loop, user, "GET /small HTTP/1.1\r\nHost: test\r\n\r\n", received), body));
+    CHECK(ends_with(exchange(loop, user, "GET /small HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n", received), body));
+    run_until_idle(loop, proxy);
+    CHECK(proxy.get_cache_served() == 1);
+    CHECK(proxy.get_zerocopy_bytes() == 0);
+    close(user);
+}
+
+//The head and the first half of the body reach the client before the origin has written the rest
+TEST(proxy_streams_responses_before_they_complete){
+    HDE::EventLoop loop;
+    const std::string body = body_of(100000);
+    const std::string reply = reply_of(body);
+    const size_t half = reply.size() - body.size() / 2;
+    Origin origin(&loop, reply.substr(0, half));
+    HDE::UpstreamPool pool(&loop, origin_backend(origin), test_pool_config());
+    HDE::ReverseProxy proxy(&loop, &pool, test_proxy_config());
+    int user = connect_client(proxy);
+    const std::string request = "GET /stream HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n";
+    CHECK(send(user, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size());
+    std::string received;
+    char buffer[65536];
+    for (int spins = 0; spins < 3000 && !ends_with(received, body.substr(0, body.size() / 2)); spins++){
+        ssize_t n = recv(user, buffer, sizeof(buffer), 0);
+        if (n > 0){
+            received.append(buffer, n);
+        }
+        loop.run_once(n > 0 ? 0 : 1);
+    }
+    CHECK(starts_with(received, "HTTP/1.1 200 OK\r\n"));
+    CHECK(ends_with(received, body.substr(0, body.size() / 2)));
+    origin.write(reply.substr(half));
+    std::string response = read_response(loop, user, received, 3000);
+    CHECK(ends_with(response, body));
+    run_until_idle(loop, proxy);
+    CHECK(proxy.get_active() == 0);
+    close(user);
+}
+
+//A client that doesn't read holds the origin back after max_buffer plus the sockets' buffers, not the whole body
+TEST(proxy_bounds_buffering_for_slow_clients){
+    HDE::EventLoop loop;
+    const std::string body = body_of(32 << 20);
+    Origin origin(&loop, reply_of(body));
+    HDE::UpstreamPool pool(&loop, origin_backend(origin), test_pool_config());
+    HDE::ReverseProxy proxy(&loop, &pool, test_proxy_config());
+    int user = connect_client(proxy);
+    int small = 16384;
+    setsockopt(user, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    const std::string request = "GET /large HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n";
+    CHECK(send(user, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size());
+    run_while_origin_writes(loop, origin);
+    uint64_t stalled = origin.written;
+    CHECK(stalled > 0);
+    CHECK(stalled < body.size() / 2);
+    std::string received;
+    std::string response = read_response(loop, user, received, 20000);
+    CHECK(response.size() > body.size());
+    CHECK(response.compare(response.size() - body.size(), body.size(), body) == 0);
+    CHECK(origin.written == reply_of(body).size());
+    close(user);
+}
+
+//Both requests on one client connection and a later client's request share one upstream connection
+TEST(proxy_reuses_keep_alive_upstream_connections){
+    HDE::EventLoop loop;
+    const std::string body = body_of(1000);
+    Origin origin(&loop, reply_of(body));
+    HDE::UpstreamPool pool(&loop, origin_backend(origin), test_pool_config());
+    HDE::ReverseProxy proxy(&loop, &pool, test_proxy_config());
+    int user = connect_client(proxy);
+    std::string received;
+    CHECK(ends_with(exchange(loop, user, "GET /a HTTP/1.1\r\nHost: test\r\n\r\n", received), body));
+    CHECK(ends_with(exchange(loop, user, "GET /b HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n", received), body));
+    run_until_idle(loop, proxy);
+    close(user);
+    user = connect_client(proxy);
+    CHECK(ends_with(exchange(loop, user, "GET /c HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n", received), body));
+    run_until_idle(loop, proxy);
+    CHECK(origin.requests == 3);
+    CHECK(origin.connections == 1);
+    CHECK(proxy.get_requests() == 3);
+    close(user);
+}
+
+//An origin that hangs up before answering and one that refuses the connection both become 502
+TEST(proxy_answers_upstream_errors_with_502){
+    HDE::EventLoop loop;
+    Origin origin(&loop, reply_of("unused"));
+    origin.mode = Origin::ORIGIN_HANG_UP;
+    HDE::UpstreamPool pool(&loop, origin_backend(origin), test_pool_config());
+    HDE::ReverseProxy proxy(&loop, &pool, test_proxy_config());
+    int user = connect_client(proxy);
+    std::string received;
+    CHECK(starts_with(exchange(loop, user, "GET /a HTTP/1.1\r\nHost: test\r\n\r\n", received), "HTTP/1.1 502 "));
+    CHECK(origin.requests == 1);
+    CHECK(proxy.get_upstream_errors() == 1);
+    close(user);
+    run_until_idle(loop, proxy);
+
+    int closed_port;
+    close(loopback_listener(closed_port));
+    HDE::UpstreamPool refused(&loop, HDE::Backend{"closed", closed_port, INADDR_LOOPBACK, 1}, test_pool_config());
+    HDE::ReverseProxy other(&loop, &refused, test_proxy_config());
+    user = connect_client(other);
+    received.clear();
+    CHECK(starts_with(exchange(loop, user, "GET /a HTTP/1.1\r\nHost: test\r\n\r\n", received), "HTTP/1.1 502 "));
+    CHECK(other.get_upstream_errors() == 1);
+    close(user);
+    run_until_idle(loop, other);
+}
+
+TEST(proxy_times_out_silent_upstreams_with_504){
+    HDE::EventLoop loop;
+    Origin origin(&loop, reply_of("unused"));
+    origin.mode = Origin::ORIGIN_SILENT;
+    HDE::UpstreamPool pool(&loop, origin_backend(origin), test_pool_config());
+    HDE::ReverseProxyConfig config = test_proxy_config();
+    config.response_timeout_ms = 200;
+    HDE::ReverseProxy proxy(&loop, &pool, config);
+    int user = connect_client(proxy);
+    std::string received;
+    int64_t started = HDE::EventLoop::now_ms();
+    CHECK(starts_with(exchange(loop, user, "GET /slow HTTP/1.1\r\nHost: test\r\n\r\n", received), "HTTP/1.1 504 "));
+    int64_t elapsed = HDE::EventLoop::now_ms() - started;
+    CHECK(elapsed >= 190 && elapsed < 2000);
+    CHECK(origin.requests == 1);
+    CHECK(proxy.get_upstream_errors() == 1);
+    close(user);
+    run_until_idle(loop, proxy);
+}
+
+TEST(proxy_hedge_delay_starts_at_the_maximum){
+    HDE::HedgePolicy hedge(0.95, 1000, 50000);
+    CHECK(hedge.get_delay_us() == 50000);
+    // The delay is recomputed every 1024 samples
+    for (int i = 0; i < 1023; i++){
+        hedge.record(2000);
+    }
+    CHECK(hedge.get_delay_us() == 50000);
+    hedge.record(2000);
+    CHECK(hedge.get_delay_us() == (int64_t)HDE::HedgePolicy::bucket_limit(HDE::HedgePolicy::bucket_for(2000)));
+}
+
+//96% of responses take 2ms and the slowest 4% take 40ms, the p95 delay lands in 2ms's bucket
+TEST(proxy_hedge_delay_follows_the_percentile){
+    HDE::HedgePolicy hedge(0.95, 100, 100000);
+    for (int i = 0; i < 1024; i++){
+        hedge.record(i % 25 == 0 ? 40000 : 2000);
+    }
+    int64_t delay = hedge.get_delay_us();
+    CHECK(delay > 2000 && delay <= 2560);
+    // Faster responses are clamped to the minimum, slower ones to the maximum
+    HDE::HedgePolicy fast(0.95, 1000, 50000);
+    HDE::HedgePolicy slow(0.95, 1000, 50000);
+    for (int i = 0; i < 1024; i++){
+        fast.record(10);
+        slow.record(1000000);
+    }
+    CHECK(fast.get_delay_us() == 1000);
+    CHECK(slow.get_delay_us() == 50000);
+}
+
+TEST(proxy_hedge_buckets_cover_every_value){
+    uint64_t values[] = {0, 1, 3, 4, 5, 7, 8, 100, 1023, 1024, 1025, 65535, 1000000, 123456789};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++){
+        size_t bucket = HDE::HedgePolicy::bucket_for(values[i]);
+        CHECK(values[i] < HDE::HedgePolicy::bucket_limit(bucket));
+        CHECK(bucket == 0 || values[i] >= HDE::HedgePolicy::bucket_limit(bucket - 1));
+    }
+}
+
+TEST(proxy_retry_budget_runs_out_and_refills){
+    HDE::RetryBudget budget(0.1, 2, 3);
+    CHECK(budget.withdraw());
+    CHECK(budget.withdraw());
+    CHECK(!budget.withdraw());
+    CHECK(budget.get_granted() == 2);
+    CHECK(budget.get_denied() == 1);
+    // Each ordinary request deposits a tenth of a token
+    for (int i = 0; i < 9; i++){
+        budget.deposit();
+    }
+    CHECK(!budget.withdraw());
+    budget.deposit();
+    CHECK(budget.withdraw());
+    // Deposits stop at the maximum
+    for (int i = 0; i < 100; i++){
+        budget.deposit();
+    }
+    CHECK(budget.get_balance() == 3.0);
+    CHECK(budget.get_denied() == 2);
+}
+
+//Round-robin sends the first request to a silent origin, the hedge after the maximum delay reaches the other one
+struct HedgedProxy{
+    HDE::EventLoop loop;
+    Origin silent;
+    Origin answering;
+    std::vector<HDE::UpstreamPool *> pools;
+    HDE::Balancer balancer;
+    HDE::ReverseProxy proxy;
+
+    HedgedProxy(const std::string &reply, HDE::ReverseProxyConfig config)
+        : silent(&loop, reply), answering(&loop, reply),
+          balancer(std::vector<HDE::Backend>{origin_backend(silent), origin_backend(answering)}, new HDE::RoundRobinPolicy()),
+          proxy(&loop, &balancer, make_pools(), config){
+        silent.mode = Origin::ORIGIN_SILENT;
+    }
+
+    ~HedgedProxy(){
+        for (size_t i = 0; i < pools.size(); i++){
+            delete pools[i];
+        }
+    }
+
+    std::vector<HDE::UpstreamPool *> make_pools(){
+        pools.push_back(new HDE::UpstreamPool(&loop, origin_backend(silent), test_pool_config()));
+        pools.push_back(new HDE::UpstreamPool(&loop, origin_backend(answering), test_pool_config()));
+        return pools;
+    }
+};
+
+TEST(proxy_hedges_slow_requests_to_another_backend){
+    const std::string body = body_of(1000);
+    HedgedProxy hedged(reply_of(body), test_proxy_config());
+    HDE::HedgePolicy hedge(0.95, 1000, 30000);
+    HDE::RetryBudget budget(0.1, 1, 10);
+    hedged.proxy.set_hedging(&hedge, &budget);
+    int user = connect_client(hedged.proxy);
+    std::string received;
+    int64_t started = HDE::EventLoop::now_ms();
+    CHECK(ends_with(exchange(hedged.loop, user, "GET /a HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n", received), body));
+    int64_t elapsed = HDE::EventLoop::now_ms() - started;
+    CHECK(elapsed >= 29 && elapsed < 1000);
+    CHECK(hedged.silent.requests == 1);
+    CHECK(hedged.answering.requests == 1);
+    CHECK(hedged.proxy.get_hedges() == 1);
+    CHECK(hedged.proxy.get_hedge_wins() == 1);
+    CHECK(budget.get_granted() == 1);
+    close(user);
+    run_until_idle(hedged.loop, hedged.proxy);
+}
+
+//Without a token the slow request isn't hedged and times out
+TEST(proxy_hedging_stops_when_the_budget_is_empty){
+    HDE::ReverseProxyConfig config = test_proxy_config();
+    config.response_timeout_ms = 200;
+    HedgedProxy hedged(reply_of("unused"), config);
+    HDE::HedgePolicy hedge(0.95, 1000, 30000);
+    HDE::RetryBudget budget(0.1, 0, 10);
+    hedged.proxy.set_hedging(&hedge, &budget);
+    int user = connect_client(hedged.proxy);
+    std::string received;
+    CHECK(starts_with(exchange(hedged.loop, user, "GET /a HTTP/1.1\r\nHost: test\r\n\r\n", received), "HTTP/1.1 504 "));
+    CHECK(hedged.answering.requests == 0);
+    CHECK(hedged.proxy.get_hedges() == 0);
+    CHECK(budget.get_denied() == 1);
+    close(user);
+    run_until_idle(hedged.loop, hedged.proxy);
+}
+
+//Requests for one key missing at once share the leader's fetch and are served from the entry it stores
+TEST(proxy_coalesces_concurrent_misses_into_one_fetch){
+    HDE::EventLoop loop;
+    const std::string body = body_of(5000);
+    const std::string reply = "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nContent-Length: " + std::to_string(body.size()) +
+                              "\r\n\r\n" + body;
+    Origin origin(&loop, reply);
+    origin.mode = Origin::ORIGIN_SILENT;
+    HDE::UpstreamPool pool(&loop, origin_backend(origin), test_pool_config());
+    HDE::ReverseProxy proxy(&loop, &pool, test_proxy_config());
+    HDE::HttpCache cache(HDE::HttpCacheConfig{8 << 20, 4 << 20, 1});
+    proxy.set_cache(&cache);
+    proxy.set_coalescing(1000);
+    const std::string request = "GET /hot HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n";
+    int users[8];
+    for (int i = 0; i < 8; i++){
+        users[i] = connect_client(proxy);
+        CHECK(send(users[i], request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size());
+    }
+    for (int spins = 0; spins < 1000 && (origin.requests < 1 || proxy.get_flights().get_coalesced() < 7); spins++){
+        loop.run_once(1);
+    }
+    CHECK(proxy.get_flights().get_leaders() == 1);
+    CHECK(proxy.get_flights().get_coalesced() == 7);
+    origin.write(reply);
+    for (int i = 0; i < 8; i++){
+        std::string received;
+        CHECK(ends_with(read_response(loop, users[i], received, 3000), body));
+        close(users[i]);
+    }
+    run_until_idle(loop, proxy);
+    CHECK(origin.requests == 1);
+    CHECK(proxy.get_cache_served() == 7);
+    CHECK(proxy.get_coalesce_timeouts() == 0);
+    CHECK(proxy.get_flights().get_in_flight() == 0);
+}
+
+//Waiters give up on a flight that outlasts the coalescing timeout and fetch for themselves
+TEST(proxy_coalesced_waiters_time_out_to_the_origin){
+    HDE::EventLoop loop;
+    const std::string body = body_of(5000);
+    const std::string reply = "HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\nContent-Length: " + std::to_string(body.size()) +
+                              "\r\n\r\n" + body;
+    Origin origin(&loop, reply);
+    origin.mode = Origin::ORIGIN_SILENT;
+    HDE::UpstreamPool pool(&loop, origin_backend(origin), test_pool_config());
+    HDE::ReverseProxy proxy(&loop, &pool, test_proxy_config());
+    HDE::HttpCache cache(HDE::HttpCacheConfig{8 << 20, 4 << 20, 1});
+    proxy.set_cache(&cache);
+    proxy.set_coalescing(100);
+    const std::string request = "GET /hot HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n";
+    int users[3];
+    for (int i = 0; i < 3; i++){
+        users[i] = connect_client(proxy);
+        CHECK(send(users[i], request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size());
+    }
+    int64_t deadline = HDE::EventLoop::now_ms() + 1000;
+    while (HDE::EventLoop::now_ms() < deadline && origin.requests < 3){
+        loop.run_once(5);
+    }
+    CHECK(origin.requests == 3);
+    CHECK(proxy.get_coalesce_timeouts() == 2);
+    CHECK(proxy.get_flights().get_abandoned() == 2);
+    origin.write(reply);
+    for (int i = 0; i < 3; i++){
+        std::string received;
+        CHECK(ends_with(read_response(loop, users[i], received, 3000), body));
+        close(users[i]);
+    }
+    run_until_idle(loop, proxy);
+    CHECK(proxy.get_cache_served() == 0);
+}
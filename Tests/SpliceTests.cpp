@@ -0,0 +1,171 @@
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include "UnitTest.hpp"
+#include "Loopback.hpp"
+#include "../Networking/Events/EventLoop.hpp"
+#include "../Networking/IO/PipePool.hpp"
+#include "../Networking/IO/SpliceTunnel.hpp"
+
+//The pattern repeats every 251 bytes, so a dropped or reordered range shows up as a mismatch
+#define SPLICE_TEST_BLOCK (251 * 256)
+
+struct Transfer{
+    uint64_t received;
+    bool in_order;
+    std::string reply;
+    bool closed;
+};
+
+//Sends size bytes from client[0] through a tunnel between client[1] and upstream[0] and ends with a half-close, or a
+//full close with close_client. upstream[1] first sends reply and half-closes, then reads to EOF. upstream_buffer
+//shrinks the upstream socket buffers, 0 keeps the defaults
+static Transfer transfer(int client[2], int upstream[2], uint64_t size, bool close_client, const std::string &reply,
+                         int upstream_buffer){
+    // Small upstream buffers keep bytes queued in the tunnel when the client's end arrives
+    if (upstream_buffer > 0){
+        setsockopt(upstream[0], SOL_SOCKET, SO_SNDBUF, &upstream_buffer, sizeof(upstream_buffer));
+        setsockopt(upstream[1], SOL_SOCKET, SO_RCVBUF, &upstream_buffer, sizeof(upstream_buffer));
+    }
+    HDE::EventLoop loop;
+    HDE::PipePool pool(2, 0);
+    Transfer result{0, true, std::string(), false};
+    HDE::SpliceTunnel tunnel(&loop, &pool, client[1], upstream[0], [&result](){ result.closed = true; });
+    CHECK(tunnel.start() == 0);
+    int user = client[0];
+    int backend = upstream[1];
+    fcntl(user, F_SETFL, O_NONBLOCK);
+    fcntl(backend, F_SETFL, O_NONBLOCK);
+    char data[SPLICE_TEST_BLOCK];
+    for (int i = 0; i < SPLICE_TEST_BLOCK; i++){
+        data[i] = (char)(i % 251);
+    }
+    // Once the reply is through, the tunnel has shut down its write side to the client, so the client's FIN
+    // brings EPOLLHUP while its last bytes are still queued
+    CHECK(send(backend, reply.data(), reply.size(), MSG_NOSIGNAL) == (ssize_t)reply.size());
+    shutdown(backend, SHUT_WR);
+    uint64_t sent = 0;
+    bool user_eof = false;
+    char buffer[SPLICE_TEST_BLOCK];
+    for (int spins = 0; spins < 100000 && !(result.closed && user_eof && backend < 0); spins++){
+        while (sent < size){
+            size_t offset = sent % SPLICE_TEST_BLOCK;
+            size_t want = size - sent < SPLICE_TEST_BLOCK - offset ? size - sent : SPLICE_TEST_BLOCK - offset;
+            ssize_t n = send(user, data + offset, want, MSG_NOSIGNAL);
+            if (n <= 0){
+                break;
+            }
+            sent += n;
+            if (sent == size && close_client){
+                close(user);
+                user = -1;
+                user_eof = true;
+            } else if (sent == size){
+                shutdown(user, SHUT_WR);
+            }
+        }
+        ssize_t n;
+        while (backend >= 0 && (n = recv(backend, buffer, sizeof(buffer), 0)) > 0){
+            for (ssize_t i = 0; i < n && result.in_order; i++){
+                result.in_order = buffer[i] == (char)((result.received + i) % SPLICE_TEST_BLOCK % 251);
+            }
+            result.received += n;
+        }
+        if (backend >= 0 && n == 0){
+            close(backend);
+            backend = -1;
+        }
+        while (user >= 0 && (n = recv(user, buffer, sizeof(buffer), 0)) > 0){
+            result.reply.append(buffer, n);
+        }
+        if (user >= 0 && n == 0){
+            user_eof = true;
+        }
+        loop.run_once(10);
+    }
+    if (user >= 0){
+        close(user);
+    }
+    if (backend >= 0){
+        close(backend);
+    }
+    CHECK(tunnel.get_bytes_up() == result.received);
+    CHECK(tunnel.get_bytes_down() == reply.size() || close_client);
+    return result;
+}
+
+static bool is_open(int fd){
+    return fcntl(fd, F_GETFD) >= 0 || errno != EBADF;
+}
+
+TEST(splice_tcp_half_close_delivers_everything){
+    int client[2];
+    int upstream[2];
+    CHECK(tcp_pair(client) && tcp_pair(upstream));
+    Transfer result = transfer(client, upstream, 32 << 20, false, "done", 0);
+    CHECK(result.received == 32 << 20);
+    CHECK(result.in_order);
+    CHECK(result.reply == "done");
+    CHECK(result.closed);
+}
+
+TEST(splice_tcp_half_close_behind_slow_upstream){
+    int client[2];
+    int upstream[2];
+    CHECK(tcp_pair(client) && tcp_pair(upstream));
+    // The client's FIN turns into EPOLLHUP while the pipe still holds bytes the upstream hasn't taken
+    Transfer result = transfer(client, upstream, 1 << 20, false, "done", 32768);
+    CHECK(result.received == 1 << 20);
+    CHECK(result.in_order);
+    CHECK(result.reply == "done");
+    CHECK(result.closed);
+}
+
+TEST(splice_socketpair_close_delivers_everything){
+    int client[2];
+    int upstream[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, client) == 0 && socketpair(AF_UNIX, SOCK_STREAM, 0, upstream) == 0);
+    // A closed unix peer reports EPOLLHUP whatever the other direction did
+    Transfer result = transfer(client, upstream, 8 << 20, true, "", 4096);
+    CHECK(result.received == 8 << 20);
+    CHECK(result.in_order);
+    CHECK(result.closed);
+}
+
+TEST(splice_failed_start_closes_sockets){
+    int client[2];
+    int upstream[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, client) == 0 && socketpair(AF_UNIX, SOCK_STREAM, 0, upstream) == 0);
+    HDE::EventLoop loop;
+    HDE::PipePool pool(2, 0);
+    bool closed = false;
+    // With no descriptor left for a pipe, start() fails in acquire()
+    struct rlimit saved;
+    getrlimit(RLIMIT_NOFILE, &saved);
+    int next = dup(0);
+    close(next);
+    struct rlimit tight = saved;
+    tight.rlim_cur = next;
+    setrlimit(RLIMIT_NOFILE, &tight);
+    HDE::SpliceTunnel *tunnel = new HDE::SpliceTunnel(&loop, &pool, client[1], upstream[0], [&closed](){ closed = true; });
+    int started = tunnel->start();
+    setrlimit(RLIMIT_NOFILE, &saved);
+    CHECK(started == -1);
+    CHECK(closed);
+    CHECK(!is_open(client[1]) && !is_open(upstream[0]));
+    delete tunnel;
+    // A tunnel that is never started still owns its sockets
+    int spare[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, spare) == 0);
+    delete new HDE::SpliceTunnel(&loop, &pool, spare[0], spare[1], nullptr);
+    CHECK(!is_open(spare[0]) && !is_open(spare[1]));
+    close(client[0]);
+    close(upstream[1]);
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include "UnitTest.hpp"
+#include "../Networking/Metrics/CycleClock.hpp"
+#include "../Networking/Tracing/Tracer.hpp"
+
+static size_t count_of(const std::string &text, const std::string &needle){
+    size_t count = 0;
+    for (size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1)){
+        count++;
+    }
+    return count;
+}
+
+TEST(tracing_parses_traceparent){
+    HDE::TraceContext context;
+    CHECK(HDE::Tracer::parse_traceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01", context));
+    CHECK(context.trace_high == 0x4bf92f3577b34da6ULL);
+    CHECK(context.trace_low == 0xa3ce929d0e0e4736ULL);
+    CHECK(context.parent_id == 0x00f067aa0ba902b7ULL);
+    CHECK(context.sampled);
+    CHECK(HDE::Tracer::request_id(context) == "4bf92f3577b34da6a3ce929d0e0e4736");
+    CHECK(HDE::Tracer::format_traceparent(context, 0x1234) == "00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000001234-01");
+    CHECK(HDE::Tracer::parse_traceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00", context));
+    CHECK(!context.sampled);
+    CHECK(HDE::Tracer::format_traceparent(context, 1) == "00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000000001-00");
+    // Later versions may append fields, version 00 may not
+    CHECK(HDE::Tracer::parse_traceparent("01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-future", context));
+    CHECK(!HDE::Tracer::parse_traceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-future", context));
+    CHECK(!HDE::Tracer::parse_traceparent("01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01x", context));
+    CHECK(!HDE::Tracer::parse_traceparent("ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01", context));
+    CHECK(!HDE::Tracer::parse_traceparent("00-4BF92F3577B34DA6A3CE929D0E0E4736-00f067aa0ba902b7-01", context));
+    CHECK(!HDE::Tracer::parse_traceparent("00-00000000000000000000000000000000-00f067aa0ba902b7-01", context));
+    CHECK(!HDE::Tracer::parse_traceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000000000-01", context));
+    CHECK(!HDE::Tracer::parse_traceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-1", context));
+    CHECK(!HDE::Tracer::parse_traceparent("00_4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01", context));
+    CHECK(!HDE::Tracer::parse_traceparent("", context));
+}
+
+//A valid header keeps the caller's trace and sampling decision, anything else starts a trace at the configured rate
+TEST(tracing_start_continues_or_samples_new_traces){
+    HDE::Tracer never(0);
+    HDE::TraceContext continued = never.start("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+    CHECK(continued.trace_high == 0x4bf92f3577b34da6ULL && continued.trace_low == 0xa3ce929d0e0e4736ULL);
+    CHECK(continued.parent_id == 0x00f067aa0ba902b7ULL);
+    CHECK(continued.span_id != 0 && continued.span_id != continued.parent_id);
+    CHECK(continued.sampled);
+    for (int i = 0; i < 100; i++){
+        HDE::TraceContext fresh = never.start("not a traceparent");
+        CHECK(!fresh.sampled);
+        CHECK(fresh.parent_id == 0);
+        CHECK(fresh.span_id != 0);
+    }
+    HDE::Tracer always(5);
+    CHECK(always.get_sample_rate() == 1);
+    HDE::TraceContext first = always.start("");
+    HDE::TraceContext second = always.start("");
+    CHECK(first.sampled && second.sampled);
+    CHECK(first.trace_low != second.trace_low);
+    always.set_sample_rate(-1);
+    CHECK(always.get_sample_rate() == 0);
+    always.set_sample_rate(0.5);
+    CHECK(always.get_sample_rate() == 0.5);
+}
+
+//Spans starting at tick 0 export with ts 0, so every field of an event is known. A 4-slot ring keeps the newest 4
+TEST(tracing_exports_chrome_json){
+    HDE::Tracer tracer(1, 3);
+    HDE::TraceContext unsampled = tracer.start("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00");
+    tracer.record(unsampled, "dropped", 0, 100);
+    CHECK(tracer.get_recorded() == 0);
+    CHECK(tracer.export_json() == "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n]}\n");
+    HDE::TraceContext context = tracer.start("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+    static const char *names[] = {"span0", "span1", "span2", "span3", "span4", "span5"};
+    for (int i = 0; i < 6; i++){
+        tracer.record(context, names[i], 0x10 + i, context.span_id, 0, 1000);
+    }
+    std::thread other([&](){ tracer.record(context, "other", 0, 1000); });
+    other.join();
+    CHECK(tracer.get_recorded() == 7);
+    std::string json = tracer.export_json();
+    CHECK(starts_with(json, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n{\"name\":\"thread_name\",\"ph\":\"M\""));
+    CHECK(ends_with(json, "}}\n]}\n"));
+    CHECK(count_of(json, "\"thread_name\"") == 2);
+    CHECK(count_of(json, "\"ph\":\"X\"") == 5);
+    CHECK(json.find("\"span1\"") == std::string::npos);
+    CHECK(json.find("\"span2\"") != std::string::npos);
+    size_t tid_at = json.find("\"tid\":") + 6;
+    unsigned tid = strtoul(json.c_str() + tid_at, NULL, 10);
+    char expected[512];
+    snprintf(expected, sizeof(expected), ",\n{\"name\":\"span5\",\"cat\":\"request\",\"ph\":\"X\",\"ts\":0.000,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,"
+             "\"args\":{\"request_id\":\"4bf92f3577b34da6a3ce929d0e0e4736\",\"span_id\":\"0000000000000015\",\"parent_id\":\"%016llx\"}}",
+             HDE::CycleClock::to_ns(1000) / 1000.0, getpid(), tid, (unsigned long long)context.span_id);
+    CHECK(json.find(expected) != std::string::npos);
+    // The other thread's span is its request span, parented to the caller
+    snprintf(expected, sizeof(expected), "\"span_id\":\"%016llx\",\"parent_id\":\"00f067aa0ba902b7\"}}", (unsigned long long)context.span_id);
+    CHECK(json.find(expected) != std::string::npos);
+}
@@ -0,0 +1,41 @@
+#ifndef UnitTest_hpp
+#define UnitTest_hpp
+
+#include <string>
+#include <vector>
+
+//Shared by the test files, UnitTests.cpp holds main and the registry. Each file defines its cases with TEST(name),
+//the name's prefix up to the first underscore is the group ctest runs it in
+
+struct Test{
+    const char *name;
+    void (*run)();
+};
+
+std::vector<Test> & test_registry();
+
+struct TestRegistrar{
+    TestRegistrar(const char *name, void (*run)()){
+        test_registry().push_back(Test{name, run});
+    }
+};
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistrar name##_registrar(#name, name); \
+    static void name()
+
+//Reports and counts a failure without stopping the test, so one run shows every broken expectation
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+void check(bool passed, const char *condition, const char *file, int line);
+
+inline bool starts_with(const std::string &text, const std::string &prefix){
+    return text.compare(0, prefix.size(), prefix) == 0;
+}
+
+inline bool ends_with(const std::string &text, const std::string &suffix){
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+#endif /* UnitTest_hpp */
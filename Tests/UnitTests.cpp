@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstring>
+#include "UnitTest.hpp"
+
+//Runs the cases every Tests/*Tests.cpp registered, in link order. Usage: UnitTests [--filter text]
+
+static int failures = 0;
+
+std::vector<Test> & test_registry(){
+    static std::vector<Test> registry;
+    return registry;
+}
+
+void check(bool passed, const char *condition, const char *file, int line){
+    if (!passed){
+        failures++;
+        std::cerr << file << ":" << line << ": CHECK(" << condition << ") failed" << std::endl;
+    }
+}
+
+int main(int argc, char **argv){
+    std::string filter;
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc){
+            filter = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--filter text]" << std::endl;
+            return 2;
+        }
+    }
+    int ran = 0;
+    int failed = 0;
+    std::vector<Test> &list = test_registry();
+    for (size_t i = 0; i < list.size(); i++){
+        if (!filter.empty() && std::string(list[i].name).find(filter) == std::string::npos){
+            continue;
+        }
+        int before = failures;
+        list[i].run();
+        ran++;
+        failed += failures > before;
+        std::cout << (failures > before ? "FAIL " : "ok   ") << list[i].name << std::endl;
+    }
+    std::cout << ran << " tests, " << failed << " failed" << std::endl;
+    return ran == 0 || failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,313 @@
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "UnitTest.hpp"
+#include "Loopback.hpp"
+#include "../Networking/Events/EventLoop.hpp"
+#include "../Networking/Sockets/Connector.hpp"
+#include "../Networking/Proxy/UpstreamPool.hpp"
+
+//A listener that never accepts, its one-entry queue is filled so the kernel drops further SYNs and connects stall.
+//The filler connections are returned for the caller to close
+static int stalled_listener(int &port, std::vector<int> &fillers){
+    int listener = loopback_listener(port);
+    if (listener < 0 || listen(listener, 0) < 0){
+        return -1;
+    }
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    for (int i = 0; i < 8; i++){
+        int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        fillers.push_back(sock);
+        connect(sock, (struct sockaddr *)&address, sizeof(address));
+        struct pollfd entry = {sock, POLLOUT, 0};
+        if (poll(&entry, 1, 100) == 0){
+            break;
+        }
+    }
+    return listener;
+}
+
+static void close_all(std::vector<int> &fds){
+    for (size_t i = 0; i < fds.size(); i++){
+        close(fds[i]);
+    }
+    fds.clear();
+}
+
+struct Outcome{
+    int calls;
+    int sock;
+    int error;
+};
+
+static HDE::Connector::Callback record(Outcome &outcome){
+    outcome.calls = 0;
+    outcome.sock = -1;
+    outcome.error = 0;
+    return [&outcome](int sock, int error){
+        outcome.calls++;
+        outcome.sock = sock;
+        outcome.error = error;
+    };
+}
+
+static void run_until_called(HDE::EventLoop &loop, Outcome &outcome, int timeout_ms){
+    int64_t deadline = HDE::EventLoop::now_ms() + timeout_ms;
+    while (outcome.calls == 0 && HDE::EventLoop::now_ms() < deadline){
+        loop.run_once(5);
+    }
+}
+
+TEST(connector_connects_non_blocking_sockets){
+    HDE::EventLoop loop;
+    int port = 0;
+    int listener = loopback_listener(port);
+    CHECK(listener >= 0);
+    HDE::Connector connector(&loop, 1000);
+    Outcome outcome;
+    connector.connect(port, INADDR_LOOPBACK, record(outcome));
+    run_until_called(loop, outcome, 1000);
+    CHECK(outcome.calls == 1);
+    CHECK(outcome.error == 0);
+    CHECK(outcome.sock >= 0);
+    CHECK((fcntl(outcome.sock, F_GETFL) & O_NONBLOCK) != 0);
+    CHECK(connector.get_pending() == 0);
+    int accepted = accept(listener, NULL, NULL);
+    CHECK(accepted >= 0);
+    CHECK(send(outcome.sock, "ping", 4, MSG_NOSIGNAL) == 4);
+    char buffer[4];
+    CHECK(recv(accepted, buffer, 4, 0) == 4);
+    close(accepted);
+    close(outcome.sock);
+    close(listener);
+}
+
+TEST(connector_reports_refused_connections){
+    HDE::EventLoop loop;
+    int port = 0;
+    close(loopback_listener(port));
+    HDE::Connector connector(&loop, 1000);
+    Outcome outcome;
+    connector.connect(port, INADDR_LOOPBACK, record(outcome));
+    run_until_called(loop, outcome, 1000);
+    CHECK(outcome.calls == 1);
+    CHECK(outcome.sock == -1);
+    CHECK(outcome.error == ECONNREFUSED);
+    CHECK(connector.get_pending() == 0);
+}
+
+TEST(connector_times_out_stalled_handshakes){
+    HDE::EventLoop loop;
+    int port = 0;
+    std::vector<int> fillers;
+    int listener = stalled_listener(port, fillers);
+    CHECK(listener >= 0);
+    HDE::Connector connector(&loop, 150);
+    Outcome outcome;
+    int64_t started = HDE::EventLoop::now_ms();
+    connector.connect(port, INADDR_LOOPBACK, record(outcome));
+    CHECK(connector.get_pending() == 1);
+    run_until_called(loop, outcome, 2000);
+    int64_t elapsed = HDE::EventLoop::now_ms() - started;
+    CHECK(outcome.calls == 1);
+    CHECK(outcome.sock == -1);
+    CHECK(outcome.error == ETIMEDOUT);
+    CHECK(elapsed >= 145 && elapsed < 1000);
+    CHECK(connector.get_pending() == 0);
+    close_all(fillers);
+    close(listener);
+}
+
+//Connects still in flight are closed without running their callbacks
+TEST(connector_destructor_abandons_pending_connects){
+    HDE::EventLoop loop;
+    int port = 0;
+    std::vector<int> fillers;
+    int listener = stalled_listener(port, fillers);
+    Outcome outcome;
+    {
+        HDE::Connector connector(&loop, 5000);
+        connector.connect(port, INADDR_LOOPBACK, record(outcome));
+        CHECK(connector.get_pending() == 1);
+    }
+    for (int spins = 0; spins < 20; spins++){
+        loop.run_once(5);
+    }
+    CHECK(outcome.calls == 0);
+    close_all(fillers);
+    close(listener);
+}
+
+static HDE::Backend loopback_backend(int port){
+    return HDE::Backend{"loopback", port, INADDR_LOOPBACK, 1};
+}
+
+//max_idle 4, max_age 60s, connect timeout 1s, the rest as given
+static HDE::UpstreamPoolConfig pool_config(size_t max_connections, size_t max_waiters, int idle_timeout_ms, int wait_timeout_ms){
+    return HDE::UpstreamPoolConfig{4, max_connections, max_waiters, 60000, idle_timeout_ms, 1000, wait_timeout_ms};
+}
+
+static void acquire_and_wait(HDE::EventLoop &loop, HDE::UpstreamPool &pool, Outcome &outcome){
+    pool.acquire(record(outcome));
+    run_until_called(loop, outcome, 2000);
+}
+
+TEST(pool_reuses_idle_connections){
+    HDE::EventLoop loop;
+    int port = 0;
+    int listener = loopback_listener(port);
+    HDE::UpstreamPool pool(&loop, loopback_backend(port), pool_config(8, 8, 60000, 1000));
+    Outcome first;
+    acquire_and_wait(loop, pool, first);
+    CHECK(first.sock >= 0);
+    pool.release(first.sock, true);
+    CHECK(pool.get_idle() == 1);
+    // An idle connection is handed out before acquire() returns
+    Outcome second;
+    pool.acquire(record(second));
+    CHECK(second.calls == 1);
+    CHECK(second.sock == first.sock);
+    CHECK(pool.get_idle() == 0);
+    CHECK(pool.get_handshakes() == 1);
+    CHECK(pool.get_reuses() == 1);
+    CHECK(pool.get_reuse_ratio() == 0.5);
+    // A connection left in an unknown state is closed, the next acquire opens a new one
+    pool.release(second.sock, false);
+    CHECK(pool.get_open() == 0);
+    Outcome third;
+    acquire_and_wait(loop, pool, third);
+    CHECK(third.sock >= 0);
+    CHECK(pool.get_handshakes() == 2);
+    pool.release(third.sock, true);
+    close(listener);
+}
+
+TEST(pool_closes_connections_idle_past_the_timeout){
+    HDE::EventLoop loop;
+    int port = 0;
+    int listener = loopback_listener(port);
+    HDE::UpstreamPool pool(&loop, loopback_backend(port), pool_config(8, 8, 100, 1000));
+    Outcome outcome;
+    acquire_and_wait(loop, pool, outcome);
+    int accepted = accept(listener, NULL, NULL);
+    pool.release(outcome.sock, true);
+    CHECK(pool.get_idle() == 1);
+    int64_t deadline = HDE::EventLoop::now_ms() + 1000;
+    while (pool.get_idle() > 0 && HDE::EventLoop::now_ms() < deadline){
+        loop.run_once(10);
+    }
+    CHECK(pool.get_idle() == 0);
+    CHECK(pool.get_open() == 0);
+    CHECK(pool.get_health_closes() == 0);
+    // The backend sees the connection closed
+    char byte;
+    CHECK(recv(accepted, &byte, 1, 0) == 0);
+    close(accepted);
+    close(listener);
+}
+
+//An idle connection that turns readable was closed or misused by the backend and is dropped, not handed out
+TEST(pool_drops_idle_connections_the_backend_closes){
+    HDE::EventLoop loop;
+    int port = 0;
+    int listener = loopback_listener(port);
+    HDE::UpstreamPool pool(&loop, loopback_backend(port), pool_config(8, 8, 60000, 1000));
+    Outcome outcome;
+    acquire_and_wait(loop, pool, outcome);
+    pool.release(outcome.sock, true);
+    close(accept(listener, NULL, NULL));
+    for (int spins = 0; spins < 100 && pool.get_idle() > 0; spins++){
+        loop.run_once(5);
+    }
+    CHECK(pool.get_idle() == 0);
+    CHECK(pool.get_health_closes() == 1);
+    Outcome next;
+    acquire_and_wait(loop, pool, next);
+    CHECK(next.sock >= 0);
+    CHECK(pool.get_reuses() == 0);
+    pool.release(next.sock, false);
+    close(listener);
+}
+
+//Two connections at most: the third caller waits for a release, a fourth is refused and a waiter can time out
+TEST(pool_caps_connections_per_backend){
+    HDE::EventLoop loop;
+    int port = 0;
+    int listener = loopback_listener(port);
+    HDE::UpstreamPool pool(&loop, loopback_backend(port), pool_config(2, 1, 60000, 150));
+    Outcome first;
+    Outcome second;
+    acquire_and_wait(loop, pool, first);
+    acquire_and_wait(loop, pool, second);
+    CHECK(first.sock >= 0 && second.sock >= 0);
+    CHECK(pool.get_open() == 2);
+    Outcome waiting;
+    pool.acquire(record(waiting));
+    CHECK(waiting.calls == 0);
+    CHECK(pool.get_waiting() == 1);
+    Outcome refused;
+    pool.acquire(record(refused));
+    CHECK(refused.calls == 1);
+    CHECK(refused.error == EAGAIN);
+    pool.release(first.sock, true);
+    CHECK(waiting.calls == 1);
+    CHECK(waiting.sock == first.sock);
+    CHECK(pool.get_open() == 2);
+    Outcome expired;
+    int64_t started = HDE::EventLoop::now_ms();
+    acquire_and_wait(loop, pool, expired);
+    CHECK(expired.sock == -1);
+    CHECK(expired.error == ETIMEDOUT);
+    CHECK(HDE::EventLoop::now_ms() - started >= 145);
+    CHECK(pool.get_wait_timeouts() == 1);
+    // A connection closed as unreusable makes room for a new one
+    pool.release(second.sock, false);
+    Outcome third;
+    acquire_and_wait(loop, pool, third);
+    CHECK(third.sock >= 0);
+    CHECK(pool.get_open() == 2);
+    pool.release(waiting.sock, false);
+    pool.release(third.sock, false);
+    CHECK(pool.get_open() == 0);
+    close(listener);
+}
+
+//A stalled handshake fails the caller after connect_timeout_ms and frees its slot for the next waiter
+TEST(pool_times_out_connects){
+    HDE::EventLoop loop;
+    int port = 0;
+    std::vector<int> fillers;
+    int listener = stalled_listener(port, fillers);
+    HDE::UpstreamPoolConfig config = pool_config(1, 4, 60000, 5000);
+    config.connect_timeout_ms = 150;
+    HDE::UpstreamPool pool(&loop, loopback_backend(port), config);
+    Outcome first;
+    Outcome waiting;
+    pool.acquire(record(first));
+    pool.acquire(record(waiting));
+    CHECK(pool.get_waiting() == 1);
+    int64_t started = HDE::EventLoop::now_ms();
+    run_until_called(loop, first, 2000);
+    CHECK(first.sock == -1);
+    CHECK(first.error == ETIMEDOUT);
+    CHECK(HDE::EventLoop::now_ms() - started >= 145);
+    // The waiter got the freed slot and is connecting in turn
+    CHECK(pool.get_waiting() == 0);
+    CHECK(pool.get_open() == 1);
+    run_until_called(loop, waiting, 2000);
+    CHECK(waiting.error == ETIMEDOUT);
+    CHECK(pool.get_open() == 0);
+    CHECK(pool.get_handshakes() == 2);
+    close_all(fillers);
+    close(listener);
+}
@@ -0,0 +1,35 @@
+#include <unistd.h>
+#include <string>
+#include "UnitTest.hpp"
+#include "../Networking/Events/EventLoop.hpp"
+#include "../Networking/Events/LoopWatchdog.hpp"
+#include "../Networking/Metrics/MetricsRegistry.hpp"
+
+TEST(watchdog_reports_stalled_callback){
+    HDE::EventLoop loop;
+    HDE::MetricsRegistry metrics;
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    // No stack traces, the test must not install a process-wide signal handler
+    HDE::LoopWatchdog *watchdog = new HDE::LoopWatchdog(HDE::LoopWatchdogConfig{50, 5, 1000, false}, &metrics);
+    watchdog->watch(&loop, "tests");
+    int read_fd = fds[0];
+    loop.add(read_fd, EPOLLIN, [&loop, read_fd](uint32_t){
+        char byte;
+        CHECK(read(read_fd, &byte, 1) == 1);
+        loop.set_label("slow pipe");
+        usleep(200000);
+    });
+    CHECK(write(fds[1], "x", 1) == 1);
+    loop.run_once(1000);
+    CHECK(watchdog->get_stalls() == 1);
+    std::string report = watchdog->get_last_report();
+    CHECK(report.find("Event loop tests stalled") != std::string::npos);
+    CHECK(report.find("in descriptor " + std::to_string(read_fd)) != std::string::npos);
+    CHECK(report.find("serving slow pipe") != std::string::npos);
+    CHECK(metrics.render().find("hdelibc_loop_stalls_total{loop=\"tests\"} 1") != std::string::npos);
+    delete watchdog;
+    loop.remove(read_fd);
+    close(fds[0]);
+    close(fds[1]);
+}
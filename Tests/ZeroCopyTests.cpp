@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string>
+#include <memory>
+#include <sys/socket.h>
+#include "UnitTest.hpp"
+#include "Loopback.hpp"
+#include "../Networking/Events/EventLoop.hpp"
+#include "../Networking/IO/ZeroCopySender.hpp"
+
+static std::string pattern(size_t size, int seed){
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; i++){
+        data[i] = (char)((i + seed) % 251);
+    }
+    return data;
+}
+
+//Shrinks the sender's buffer so a large send leaves bytes behind. The receiver's is left alone, loopback paced by a
+//small receive window can take seconds per megabyte
+static void small_buffers(int fds[2]){
+    int size = 16384;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+}
+
+TEST(zerocopy_resumes_unsent_bytes_in_order){
+    int fds[2];
+    CHECK(tcp_pair(fds));
+    small_buffers(fds);
+    HDE::EventLoop loop;
+    HDE::ZeroCopySender sender(fds[0], 65536);
+    const std::string large = pattern(1 << 20, 0);
+    const std::string small = pattern(1000, 7);
+    std::string expected = large + small;
+    // The owner's registration is the only one, the sender only sees the events passed to it
+    bool failed = false;
+    CHECK(loop.add(fds[0], EPOLLOUT, [&](uint32_t events){
+        events = sender.handle_events(events);
+        failed = failed || (events & EPOLLERR) != 0;
+        loop.modify(fds[0], sender.has_unsent() ? (uint32_t)EPOLLOUT : 0);
+    }) == 0);
+    CHECK(sender.send(large) == 1);
+    CHECK(sender.has_unsent());
+    // Queued behind the large buffer's tail rather than sent ahead of it
+    CHECK(sender.send(small) == 1);
+    std::string received;
+    char buffer[65536];
+    int64_t deadline = HDE::EventLoop::now_ms() + 10000;
+    while ((received.size() < expected.size() || !sender.is_idle()) && HDE::EventLoop::now_ms() < deadline){
+        ssize_t n = recv(fds[1], buffer, sizeof(buffer), 0);
+        if (n > 0){
+            received.append(buffer, n);
+        }
+        loop.run_once(n > 0 ? 0 : 1);
+    }
+    CHECK(!failed);
+    CHECK(received == expected);
+    CHECK(!sender.has_unsent());
+    CHECK(sender.is_idle());
+    CHECK(sender.get_zerocopy_bytes() + sender.get_copied_bytes() == expected.size());
+    CHECK(sender.get_copied_bytes() >= small.size());
+    if (sender.is_enabled()){
+        CHECK(sender.get_zerocopy_bytes() == large.size());
+    }
+    loop.remove(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(zerocopy_copies_small_buffers){
+    int fds[2];
+    CHECK(tcp_pair(fds));
+    HDE::ZeroCopySender sender(fds[0], 1 << 20);
+    CHECK(sender.send(pattern(1024, 0)) == 0);
+    CHECK(sender.get_copied_bytes() == 1024);
+    CHECK(sender.get_zerocopy_bytes() == 0);
+    CHECK(sender.is_idle());
+    CHECK(sender.get_pending() == 0);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+//Loopback completes zerocopy sends by copying, which is reported rather than hidden
+TEST(zerocopy_completions_release_shared_buffers){
+    int fds[2];
+    CHECK(tcp_pair(fds));
+    std::shared_ptr<const std::string> body = std::make_shared<const std::string>(pattern(256 * 1024, 0));
+    std::weak_ptr<const std::string> watch = body;
+    {
+        HDE::ZeroCopySender sender(fds[0], 65536);
+        CHECK(sender.send(body) == 0);
+        body.reset();
+        size_t received = 0;
+        char buffer[65536];
+        for (int spins = 0; spins < 1000 && (received < 256 * 1024 || !sender.is_idle()); spins++){
+            ssize_t n = recv(fds[1], buffer, sizeof(buffer), MSG_DONTWAIT);
+            received += n > 0 ? n : 0;
+            if (n <= 0){
+                usleep(1000);
+            }
+            sender.handle_events(EPOLLERR);
+        }
+        CHECK(received == 256 * 1024);
+        CHECK(sender.is_idle());
+        CHECK(watch.expired());
+        if (sender.is_enabled()){
+            CHECK(sender.get_fallback_completions() > 0);
+        }
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+
+//Nothing is leaked: unsent bytes are dropped and in-flight buffers are waited for. The peer never reads, so the
+//pinned pages are never released and the sender resets the connection after ZEROCOPY_DRAIN_MS instead
+TEST(zerocopy_destructor_frees_every_buffer){
+    int fds[2];
+    CHECK(tcp_pair(fds));
+    small_buffers(fds);
+    std::shared_ptr<const std::string> body = std::make_shared<const std::string>(pattern(4 << 20, 0));
+    std::weak_ptr<const std::string> watch = body;
+    {
+        HDE::ZeroCopySender sender(fds[0], 65536);
+        CHECK(sender.send(body) == 1);
+        body.reset();
+        CHECK(!watch.expired());
+    }
+    CHECK(watch.expired());
+    close(fds[0]);
+    close(fds[1]);
+}
@@ -0,0 +1,436 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include "../Networking/Sockets/Connector.hpp"
+#include "../Networking/Events/EventLoop.hpp"
+#include "../Networking/Http/HttpResponse.hpp"
+#include "../Networking/Http/BodyFramer.hpp"
+#include "../Networking/Metrics/MetricsRegistry.hpp"
+
+//Open-loop HTTP load generator, requests are due at a constant rate whether or not earlier ones finished and
+//latency runs from when a request was due, so queueing behind a slow response is measured (coordinated
+//omission correction). Usage: LoadGenerator [-h host] [-p port] [-u path] [-r rate] [-d seconds] [-w warmup]
+//[-c connections] [-P pipeline] [-k] [-o file]
+
+struct Options{
+    std::string host;
+    int port;
+    std::string path;
+    double rate;
+    double duration;
+    double warmup;
+    int connections;
+    int pipeline;
+    bool keep_alive;
+    std::string output;
+    int drain_ms;
+};
+
+struct Connection{
+    int sock;
+    bool connecting;
+    bool closing;
+    std::string out;
+    size_t out_offset;
+    std::string in;
+    std::deque<int64_t> due;
+    HDE::HttpResponse response;
+    HDE::BodyFramer body;
+    bool in_body;
+    uint32_t events;
+};
+
+class LoadGenerator{
+    private:
+        Options options;
+        HDE::EventLoop loop;
+        HDE::Connector connector;
+        u_long interface;
+        std::string request;
+        std::vector<Connection> connections;
+        size_t next_connection;
+        std::deque<int64_t> backlog;
+        int64_t start_ns;
+        int64_t measure_ns;
+        int64_t end_ns;
+        int64_t interval_ns;
+        uint64_t scheduled;
+        uint64_t total;
+        uint64_t in_flight;
+        std::vector<uint64_t> counts;
+        uint64_t recorded;
+        uint64_t sum_ns;
+        uint64_t max_ns;
+        uint64_t completed;
+        uint64_t status_errors;
+        uint64_t connect_errors;
+        uint64_t io_errors;
+        uint64_t timeouts;
+        uint64_t connects;
+
+        //Keep-alive connections take up to pipeline requests, in close mode every request gets a fresh connection
+        bool has_capacity(Connection &connection){
+            if (!options.keep_alive){
+                return connection.sock < 0 && !connection.connecting;
+            }
+            return !connection.closing && connection.due.size() < (size_t)options.pipeline;
+        }
+
+        void dispatch(){
+            while (!backlog.empty()){
+                size_t found = connections.size();
+                for (size_t i = 0; i < connections.size(); i++){
+                    size_t index = (next_connection + i) % connections.size();
+                    if (has_capacity(connections[index])){
+                        found = index;
+                        break;
+                    }
+                }
+                if (found == connections.size()){
+                    return;
+                }
+                next_connection = (found + 1) % connections.size();
+                Connection &connection = connections[found];
+                connection.due.push_back(backlog.front());
+                connection.out += request;
+                backlog.pop_front();
+                in_flight++;
+                if (connection.sock < 0 && !connection.connecting){
+                    open_connection(found);
+                } else if (!connection.connecting){
+                    flush(found);
+                }
+            }
+        }
+
+        void open_connection(size_t index){
+            Connection &connection = connections[index];
+            connection.connecting = true;
+            connects++;
+            connector.connect(options.port, interface, [this, index](int sock, int error){
+                Connection &connection = connections[index];
+                connection.connecting = false;
+                if (sock < 0){
+                    (void)error;
+                    connect_errors += connection.due.size();
+                    drop(index, false);
+                    return;
+                }
+                connection.sock = sock;
+                connection.events = EPOLLIN;
+                loop.add(sock, EPOLLIN, [this, index](uint32_t events){ on_event(index, events); });
+                flush(index);
+            });
+        }
+
+        //Abandons the connection, requests still waiting on it fail
+        void drop(size_t index, bool failed){
+            Connection &connection = connections[index];
+            if (failed){
+                io_errors += connection.due.size();
+            }
+            in_flight -= connection.due.size();
+            if (connection.sock >= 0){
+                loop.remove(connection.sock);
+                close(connection.sock);
+            }
+            connection.sock = -1;
+            connection.closing = false;
+            connection.out.clear();
+            connection.out_offset = 0;
+            connection.in.clear();
+            connection.due.clear();
+            connection.in_body = false;
+        }
+
+        void flush(size_t index){
+            Connection &connection = connections[index];
+            while (connection.out_offset < connection.out.size()){
+                ssize_t n = send(connection.sock, connection.out.data() + connection.out_offset,
+                                 connection.out.size() - connection.out_offset, MSG_NOSIGNAL);
+                if (n < 0){
+                    if (errno == EAGAIN || errno == EWOULDBLOCK){
+                        break;
+                    }
+                    drop(index, true);
+                    return;
+                }
+                connection.out_offset += n;
+            }
+            if (connection.out_offset == connection.out.size()){
+                connection.out.clear();
+                connection.out_offset = 0;
+            }
+            uint32_t events = connection.out.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT;
+            if (events != connection.events){
+                connection.events = events;
+                loop.modify(connection.sock, events);
+            }
+        }
+
+        void on_event(size_t index, uint32_t events){
+            Connection &connection = connections[index];
+            if (events & EPOLLOUT){
+                flush(index);
+                if (connection.sock < 0){
+                    return;
+                }
+            }
+            bool eof = false;
+            char chunk[16384];
+            while (true){
+                ssize_t n = recv(connection.sock, chunk, sizeof(chunk), 0);
+                if (n > 0){
+                    connection.in.append(chunk, n);
+                    continue;
+                }
+                if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)){
+                    eof = true;
+                }
+                break;
+            }
+            if (!parse(index) || connection.sock < 0){
+                return;
+            }
+            if (eof){
+                if (connection.in_body && connection.body.get_mode() == HDE::BodyFramer::UNTIL_CLOSE){
+                    connection.body.finish_on_close();
+                    finish(index);
+                }
+                drop(index, !connection.due.empty());
+                dispatch();
+            }
+        }
+
+        //Consumes complete responses, false if the connection was dropped
+        bool parse(size_t index){
+            Connection &connection = connections[index];
+            while (!connection.due.empty()){
+                if (!connection.in_body){
+                    int head = connection.response.parse(connection.in.data(), connection.in.size());
+                    if (head == 0){
+                        return true;
+                    }
+                    if (head < 0){
+                        drop(index, true);
+                        return false;
+                    }
+                    connection.in.erase(0, head);
+                    int status = connection.response.get_status();
+                    if (status == 204 || status == 304 || status < 200){
+                        connection.body.reset(HDE::BodyFramer::NO_BODY, 0);
+                    } else if (connection.response.get_header("Transfer-Encoding").find("chunked") != std::string::npos){
+                        connection.body.reset(HDE::BodyFramer::CHUNKED, 0);
+                    } else if (connection.response.has_header("Content-Length")){
+                        connection.body.reset(HDE::BodyFramer::LENGTH, strtoull(connection.response.get_header("Content-Length").c_str(), NULL, 10));
+                    } else {
+                        connection.body.reset(HDE::BodyFramer::UNTIL_CLOSE, 0);
+                    }
+                    connection.in_body = true;
+                }
+                size_t used = connection.body.feed(connection.in.data(), connection.in.size());
+                connection.in.erase(0, used);
+                if (connection.body.is_error()){
+                    drop(index, true);
+                    return false;
+                }
+                if (!connection.body.is_done()){
+                    return true;
+                }
+                finish(index);
+            }
+            return true;
+        }
+
+        void finish(size_t index){
+            Connection &connection = connections[index];
+            int64_t now = HDE::EventLoop::now_ns();
+            int64_t due = connection.due.front();
+            connection.due.pop_front();
+            connection.in_body = false;
+            in_flight--;
+            completed++;
+            if (connection.response.get_status() >= 400){
+                status_errors++;
+            }
+            if (due >= measure_ns){
+                uint64_t latency = now - due;
+                counts[HDE::MetricsRegistry::latency_bucket(latency)]++;
+                recorded++;
+                sum_ns += latency;
+                max_ns = latency > max_ns ? latency : max_ns;
+            }
+            if (connection.response.get_header("Connection").find("close") != std::string::npos){
+                connection.closing = true;
+            }
+        }
+
+        //Runs every millisecond, queues the requests that fell due and hands them to free connections
+        void tick(){
+            int64_t now = HDE::EventLoop::now_ns();
+            while (scheduled < total && start_ns + (int64_t)scheduled * interval_ns <= now){
+                backlog.push_back(start_ns + (int64_t)scheduled * interval_ns);
+                scheduled++;
+            }
+            for (size_t i = 0; i < connections.size(); i++){
+                if (connections[i].closing && connections[i].due.empty()){
+                    drop(i, false);
+                }
+            }
+            dispatch();
+            if (scheduled == total && backlog.empty() && in_flight == 0){
+                loop.stop();
+                return;
+            }
+            if (now > end_ns + (int64_t)options.drain_ms * 1000000){
+                timeouts = backlog.size() + in_flight;
+                loop.stop();
+                return;
+            }
+            loop.run_after(1, [this](){ tick(); });
+        }
+
+    public:
+        LoadGenerator(Options options) : connector(&loop, 1000){
+            this->options = options;
+            struct in_addr address;
+            if (inet_pton(AF_INET, options.host.c_str(), &address) != 1){
+                std::cerr << "Invalid IPv4 address " << options.host << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            interface = ntohl(address.s_addr);
+            request = "GET " + options.path + " HTTP/1.1\r\nHost: " + options.host + "\r\nConnection: " +
+                      (options.keep_alive ? "keep-alive" : "close") + "\r\n\r\n";
+            connections.resize(options.connections);
+            for (size_t i = 0; i < connections.size(); i++){
+                connections[i].sock = -1;
+                connections[i].connecting = false;
+                connections[i].closing = false;
+                connections[i].out_offset = 0;
+                connections[i].in_body = false;
+                connections[i].events = 0;
+            }
+            next_connection = 0;
+            counts.assign(LATENCY_BUCKETS, 0);
+            interval_ns = (int64_t)(1e9 / options.rate);
+            total = (uint64_t)((options.warmup + options.duration) * options.rate);
+            scheduled = 0;
+            in_flight = 0;
+            recorded = 0;
+            sum_ns = 0;
+            max_ns = 0;
+            completed = 0;
+            status_errors = 0;
+            connect_errors = 0;
+            io_errors = 0;
+            timeouts = 0;
+            connects = 0;
+        }
+
+        void run(){
+            start_ns = HDE::EventLoop::now_ns();
+            measure_ns = start_ns + (int64_t)(options.warmup * 1e9);
+            end_ns = start_ns + (int64_t)total * interval_ns;
+            tick();
+            loop.run();
+            for (size_t i = 0; i < connections.size(); i++){
+                drop(i, false);
+            }
+        }
+
+        uint64_t percentile(double p){
+            uint64_t value = HDE::MetricsRegistry::percentile_of(counts, p);
+            return value < max_ns ? value : max_ns;
+        }
+
+        //HdrHistogram's percentile distribution layout, five rows per halving of the remaining tail
+        void write(std::ostream &out){
+            char line[256];
+            double mean = recorded > 0 ? (double)sum_ns / recorded : 0;
+            out << "# hdelibc LoadGenerator\n";
+            snprintf(line, sizeof(line), "# target=%s:%d%s mode=%s connections=%d pipeline=%d rate=%.1f duration_s=%.1f warmup_s=%.1f\n",
+                     options.host.c_str(), options.port, options.path.c_str(), options.keep_alive ? "keep-alive" : "close",
+                     options.connections, options.pipeline, options.rate, options.duration, options.warmup);
+            out << line;
+            snprintf(line, sizeof(line), "# requests=%llu recorded=%llu achieved_rate=%.1f connects=%llu status_errors=%llu connect_errors=%llu io_errors=%llu timeouts=%llu\n",
+                     (unsigned long long)completed, (unsigned long long)recorded, recorded / options.duration, (unsigned long long)connects,
+                     (unsigned long long)status_errors, (unsigned long long)connect_errors, (unsigned long long)io_errors, (unsigned long long)timeouts);
+            out << line;
+            snprintf(line, sizeof(line), "# mean_us=%.3f p50_us=%.3f p90_us=%.3f p99_us=%.3f p999_us=%.3f p9999_us=%.3f max_us=%.3f\n",
+                     mean / 1000, percentile(50) / 1000.0, percentile(90) / 1000.0, percentile(99) / 1000.0,
+                     percentile(99.9) / 1000.0, percentile(99.99) / 1000.0, max_ns / 1000.0);
+            out << line;
+            out << "       Value(us)   Percentile   TotalCount 1/(1-Percentile)\n\n";
+            double p = 0;
+            while (recorded > 0){
+                uint64_t rank = (uint64_t)(p / 100.0 * recorded + 0.5);
+                bool last = p >= 100 || rank >= recorded;
+                double shown = last ? 100 : p;
+                if (last){
+                    snprintf(line, sizeof(line), "%16.3f %12.10f %12llu\n", max_ns / 1000.0, 1.0, (unsigned long long)recorded);
+                } else {
+                    snprintf(line, sizeof(line), "%16.3f %12.10f %12llu %14.2f\n", percentile(shown) / 1000.0, shown / 100,
+                             (unsigned long long)(rank < 1 ? 1 : rank), 1 / (1 - shown / 100));
+                }
+                out << line;
+                if (last){
+                    break;
+                }
+                int halvings = (int)std::log2(100 / (100 - p)) + 1;
+                p += 100 / (5 * std::pow(2.0, halvings));
+            }
+            snprintf(line, sizeof(line), "#[Mean    = %12.3f, Max        = %12.3f]\n#[Total count    = %12llu]\n", mean / 1000, max_ns / 1000.0,
+                     (unsigned long long)recorded);
+            out << line;
+        }
+};
+
+static void usage(){
+    std::cerr << "Usage: LoadGenerator [-h host] [-p port] [-u path] [-r rate] [-d seconds] [-w warmup] [-c connections] [-P pipeline] [-k] [-o file]" << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv){
+    Options options = {"127.0.0.1", 3000, "/", 1000, 10, 1, 8, 1, false, "bench_output.txt", 2000};
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:u:r:d:w:c:P:ko:")) != -1){
+        switch (opt){
+            case 'h': options.host = optarg; break;
+            case 'p': options.port = atoi(optarg); break;
+            case 'u': options.path = optarg; break;
+            case 'r': options.rate = atof(optarg); break;
+            case 'd': options.duration = atof(optarg); break;
+            case 'w': options.warmup = atof(optarg); break;
+            case 'c': options.connections = atoi(optarg); break;
+            case 'P': options.pipeline = atoi(optarg); break;
+            case 'k': options.keep_alive = true; break;
+            case 'o': options.output = optarg; break;
+            default: usage();
+        }
+    }
+    if (options.rate <= 0 || options.duration <= 0 || options.warmup < 0 || options.connections < 1 || options.pipeline < 1){
+        usage();
+    }
+    signal(SIGPIPE, SIG_IGN);
+    LoadGenerator generator(options);
+    generator.run();
+    std::ofstream file(options.output.c_str());
+    if (!file){
+        std::cerr << "Failed to open " << options.output << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    generator.write(file);
+    generator.write(std::cout);
+    return 0;
+}
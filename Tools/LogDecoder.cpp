@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <unordered_map>
+#include <time.h>
+
+//Turns a BinaryLog file into text, usage: LogDecoder <file> [min-level]
+
+struct Site{
+    int level;
+    int line;
+    std::string file;
+    std::string format;
+    std::string signature;
+};
+
+struct Reader{
+    const std::string &data;
+    size_t offset;
+    bool get(void *out, size_t len){
+        if (data.size() - offset < len){
+            return false;
+        }
+        memcpy(out, data.data() + offset, len);
+        offset += len;
+        return true;
+    }
+    bool get_text(std::string &out, size_t len){
+        if (data.size() - offset < len){
+            return false;
+        }
+        out.assign(data, offset, len);
+        offset += len;
+        return true;
+    }
+};
+
+static std::string hex(const std::string &bytes){
+    std::string out;
+    char digits[4];
+    for (size_t i = 0; i < bytes.size(); i++){
+        snprintf(digits, sizeof(digits), i + 1 < bytes.size() ? "%02x " : "%02x", (unsigned char)bytes[i]);
+        out += digits;
+    }
+    return out;
+}
+
+static std::string printf_text(const std::string &spec, const char *value){
+    int size = snprintf(NULL, 0, spec.c_str(), value);
+    std::vector<char> text(size > 0 ? size + 1 : 1);
+    snprintf(text.data(), text.size(), spec.c_str(), value);
+    return std::string(text.data(), size > 0 ? size : 0);
+}
+
+//Replays the printf conversions against the captured arguments, length modifiers are replaced to match the stored width
+static std::string format_message(const Site &site, const char *args, const char *end){
+    std::string out;
+    const std::string &format = site.format;
+    size_t next = 0;
+    char text[512];
+    for (size_t i = 0; i < format.size(); i++){
+        if (format[i] != '%'){
+            out += format[i];
+            continue;
+        }
+        if (i + 1 < format.size() && format[i + 1] == '%'){
+            out += '%';
+            i++;
+            continue;
+        }
+        std::string spec = "%";
+        size_t j = i + 1;
+        while (j < format.size() && strchr("-+ #0123456789.*", format[j]) != NULL){
+            spec += format[j++];
+        }
+        while (j < format.size() && strchr("hlLqjzt", format[j]) != NULL){
+            j++;
+        }
+        char conversion = j < format.size() ? format[j] : 's';
+        i = j;
+        if (next >= site.signature.size()){
+            out += "<missing>";
+            continue;
+        }
+        char type = site.signature[next++];
+        if (type == 's' || type == 'x'){
+            uint32_t len = 0;
+            if (end - args < 4){
+                break;
+            }
+            memcpy(&len, args, 4);
+            std::string value(args + 4, len < (size_t)(end - args - 4) ? len : end - args - 4);
+            args += 4 + len;
+            out += printf_text(spec + "s", type == 'x' ? hex(value).c_str() : value.c_str());
+            continue;
+        }
+        if (end - args < 8){
+            break;
+        }
+        uint64_t bits = 0;
+        memcpy(&bits, args, 8);
+        args += 8;
+        double number = 0;
+        memcpy(&number, &bits, 8);
+        if (strchr("eEfgGaA", conversion) != NULL){
+            snprintf(text, sizeof(text), (spec + conversion).c_str(), type == 'd' ? number : type == 'i' ? (double)(int64_t)bits : (double)bits);
+        } else if (conversion == 'c'){
+            snprintf(text, sizeof(text), (spec + "c").c_str(), (int)bits);
+        } else if (conversion == 'p' || type == 'p'){
+            snprintf(text, sizeof(text), "%p", (void *)(uintptr_t)bits);
+        } else if (conversion == 's' && type == 'd'){
+            snprintf(text, sizeof(text), "%g", number);
+        } else if (conversion == 's'){
+            snprintf(text, sizeof(text), type == 'i' ? "%lld" : "%llu", (long long)bits);
+        } else {
+            long long value = type == 'd' ? (long long)number : (long long)bits;
+            snprintf(text, sizeof(text), (spec + "ll" + conversion).c_str(), value);
+        }
+        out += text;
+    }
+    return out;
+}
+
+int main(int argc, char *argv[]){
+    static const char *levels[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+    if (argc < 2){
+        std::cerr << "usage: " << argv[0] << " <file> [min-level]" << std::endl;
+        return 2;
+    }
+    int min_level = argc > 2 ? atoi(argv[2]) : 0;
+    std::ifstream in(argv[1], std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    Reader reader = {data, 0};
+    char magic[8];
+    double ns_per_tick = 1;
+    uint64_t base_tick = 0;
+    int64_t base_wall_ns = 0;
+    if (!reader.get(magic, 8) || memcmp(magic, "HDEBLOG1", 8) != 0 || !reader.get(&ns_per_tick, 8) ||
+        !reader.get(&base_tick, 8) || !reader.get(&base_wall_ns, 8)){
+        std::cerr << argv[1] << " is not a binary log" << std::endl;
+        return 1;
+    }
+    std::unordered_map<uint32_t, Site> sites;
+    char kind = 0;
+    while (reader.get(&kind, 1)){
+        if (kind == 'D'){
+            uint32_t id = 0;
+            uint32_t sizes[5];
+            Site site;
+            if (!reader.get(&id, 4) || !reader.get(sizes, sizeof(sizes)) || !reader.get_text(site.file, sizes[2]) ||
+                !reader.get_text(site.format, sizes[3]) || !reader.get_text(site.signature, sizes[4])){
+                break;
+            }
+            site.level = sizes[0];
+            site.line = sizes[1];
+            sites[id] = site;
+            continue;
+        }
+        uint32_t thread = 0;
+        uint32_t header[2];
+        uint64_t tick = 0;
+        if (kind != 'L' || !reader.get(&thread, 4) || !reader.get(header, 8) || !reader.get(&tick, 8) || header[1] < 16 ||
+            data.size() - reader.offset < header[1] - 16){
+            std::cerr << "truncated or corrupt record at offset " << reader.offset << std::endl;
+            return 1;
+        }
+        const char *args = data.data() + reader.offset;
+        reader.offset += header[1] - 16;
+        std::unordered_map<uint32_t, Site>::iterator it = sites.find(header[0]);
+        if (it == sites.end() || it->second.level < min_level){
+            continue;
+        }
+        int64_t wall_ns = base_wall_ns + (int64_t)((int64_t)(tick - base_tick) * ns_per_tick);
+        time_t seconds = wall_ns / 1000000000LL;
+        struct tm parts;
+        char stamp[32];
+        gmtime_r(&seconds, &parts);
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &parts);
+        const Site &site = it->second;
+        printf("%s.%06lldZ %-5s [%u] %s:%d %s\n", stamp, (long long)(wall_ns % 1000000000LL / 1000), levels[site.level & 3], thread,
+               site.file.c_str(), site.line, format_message(site, args, args + header[1] - 16).c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#!/bin/sh
+#Profile-guided build of the server: builds a plain Release+LTO tree, an instrumented tree whose server is
+#trained with LoadGenerator traffic, and a tree optimized with that profile, then runs the same load and the
+#microbenchmarks against the Release and PGO builds. Needs GCC and ports 3000 and 3001 free.
+#Usage: Tools/pgo.sh [rate] [seconds], builds under $PGO_BUILD_DIR (default build-pgo)
+set -e
+
+SRC=$(cd "$(dirname "$0")/.." && pwd)
+OUT=${PGO_BUILD_DIR:-$SRC/build-pgo}
+RATE=${1:-2000}
+DURATION=${2:-10}
+PROFILE=$OUT/profile
+JOBS=$(nproc 2>/dev/null || echo 2)
+
+configure() {
+    name=$1
+    shift
+    cmake -S "$SRC" -B "$OUT/$name" -DCMAKE_BUILD_TYPE=Release -DHDE_LTO=ON "$@" > "$OUT/$name.configure.log"
+}
+
+# Runs a server binary from its own directory so its logs stay out of the source tree
+start_server() {
+    mkdir -p "$OUT/run-$2"
+    (cd "$OUT/run-$2" && exec "$1" > server.log 2>&1) &
+    SERVER=$!
+    sleep 1
+}
+
+stop_server() {
+    kill -TERM "$SERVER"
+    wait "$SERVER" || true
+}
+
+load() {
+    "$OUT/release/LoadGenerator" -r "$1" -d "$2" -w 1 -c 16 -u "$3" -o "$4" -p "${5:-3000}" > /dev/null
+}
+
+mkdir -p "$OUT"
+rm -rf "$PROFILE"
+
+echo "== Release + LTO"
+configure release
+cmake --build "$OUT/release" -j "$JOBS" > "$OUT/release.build.log"
+
+echo "== Instrumented build"
+configure generate -DHDE_PGO=GENERATE -DHDE_PGO_DIR="$PROFILE"
+cmake --build "$OUT/generate" -j "$JOBS" --target server > "$OUT/generate.build.log"
+
+echo "== Training at $RATE req/s for ${DURATION}s"
+start_server "$OUT/generate/server" generate
+load "$RATE" "$DURATION" / "$OUT/train.txt"
+load 200 2 /metrics "$OUT/train-metrics.txt" 3001
+stop_server
+
+echo "== Profile-optimized build"
+configure use -DHDE_PGO=USE -DHDE_PGO_DIR="$PROFILE"
+cmake --build "$OUT/use" -j "$JOBS" > "$OUT/use.build.log"
+
+for build in release use; do
+    echo "== Server, $build build"
+    start_server "$OUT/$build/server" "$build"
+    load "$RATE" "$DURATION" / "$OUT/load-$build.txt"
+    stop_server
+    grep -e "achieved_rate" -e "p50_us" "$OUT/load-$build.txt"
+done
+
+echo "== Microbenchmarks, release build"
+"$OUT/release/MicroBenchmarks" --out "$OUT/micro-release.txt"
+echo "== Microbenchmarks, use build against release"
+"$OUT/use/MicroBenchmarks" --compare "$OUT/micro-release.txt" --out "$OUT/micro-use.txt"